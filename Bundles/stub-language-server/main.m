@@ -0,0 +1,713 @@
+//
+//  main.m
+//  stub-language-server
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// A language server for the unit tests. It answers every request right away
+// and understands a few extra methods to script the traffic:
+//
+//   stub/echo       replies with the params of the request
+//   stub/initialize replies with the params of the initialize request
+//   stub/flood      sends {count} "stub/notification" notifications, then replies
+//   stub/pause      a notification, stops reading input for {seconds}
+//   stub/statistics replies with the number of textDocument requests handled
+//                   and cancelled, the completion items resolved, the
+//                   semantic token deltas sent, the didChange notifications
+//                   and change events received, the responses received and
+//                   the result of the last one
+//   stub/showMessageRequest sends window/showMessageRequest with the params
+//                   of the request, then replies
+//   stub/text       replies with the text of the open document {uri}, as
+//                   reconstructed from didOpen and didChange
+//
+// completionItem/resolve replies with the item and its documentation.
+// textDocument/references replies with every occurrence in the open documents
+// of the word at the position, workspace/symbol with every word of the open
+// documents containing the query. Both send their results in chunks of 100,
+// as $/progress notifications if the request has a partialResultToken, and
+// report their work done progress if it has a workDoneToken.
+// textDocument/semanticTokens makes every word of the document a token whose
+// type is the length of the word modulo the number of token types. A
+// full/delta request with the last resultId is answered with one edit.
+// With "--delay <seconds>" textDocument and resolve requests take that long
+// to compute.
+// With "--initialize-delay <seconds>" the initialize request takes that long,
+// like the startup of a real server.
+// With "--diagnostics" every didOpen and didChange is answered with one
+// diagnostic whose message is the length of the document.
+// With "--response-size <bytes>" completion, hover and documentSymbol
+// requests are answered with results of about that many bytes, instead of null.
+// With "--notification-rate <count>" a "window/logMessage" notification is
+// sent that many times per second.
+// With "--without <capability>" the capability, like "completionProvider",
+// is left out of the initialize result. May be given more than once.
+// With "--progress" the server creates a work done progress after the
+// initialized notification, and reports its begin and end once the client
+// answered. The responses of the client are counted in stub/statistics.
+// Input is read on a separate thread, so $/cancelRequest stops the work on a
+// pending request, which is then answered with RequestCancelled.
+
+static NSTimeInterval LSPStubDelay = 0.0;
+static NSTimeInterval LSPStubInitializeDelay = 0.0;
+static BOOL LSPStubPublishesDiagnostics = NO;
+static NSUInteger LSPStubResponseSize = 0;
+static double LSPStubNotificationRate = 0.0;
+static NSCondition *LSPStubCondition = nil;
+static NSMutableArray *LSPStubMessages = nil;
+static NSMutableSet *LSPStubCancelledIDs = nil;
+static NSUInteger LSPStubHandledCount = 0;
+static NSUInteger LSPStubCancelledCount = 0;
+static NSUInteger LSPStubResolvedCount = 0;
+static NSUInteger LSPStubSemanticTokensDeltaCount = 0;
+static NSUInteger LSPStubSemanticTokensResultCount = 0;
+static NSUInteger LSPStubChangeNotificationCount = 0;
+static NSUInteger LSPStubContentChangeCount = 0;
+static BOOL LSPStubReportsProgress = NO;
+static NSMutableSet<NSString *> *LSPStubWithoutCapabilities = nil;
+static NSUInteger LSPStubResponseCount = 0;
+static id LSPStubLastResponseResult = nil;
+static NSMutableDictionary<NSString *, NSMutableString *> *LSPStubDocuments = nil;
+static NSMutableDictionary<NSString *, NSDictionary *> *LSPStubSemanticTokens = nil;
+static NSDictionary *LSPStubInitializeParams = nil;
+
+/** Reads one frame from input, returns nil at the end of input. */
+static NSData *LSPStubReadFrame(FILE *input) {
+    char line[1024];
+    long contentLength = -1;
+    while (fgets(line, sizeof(line), input) != NULL) {
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            if (contentLength < 0) {
+                continue;
+            }
+            NSMutableData *content = [NSMutableData dataWithLength:(NSUInteger)contentLength];
+            if (fread([content mutableBytes], 1, (size_t)contentLength, input) != (size_t)contentLength) {
+                return nil;
+            }
+            return content;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            contentLength = strtol(line + 15, NULL, 10);
+        }
+    }
+    return nil;
+}
+
+static void LSPStubWriteMessage(NSDictionary *message) {
+    NSData *content = [NSJSONSerialization dataWithJSONObject:message options:0 error:NULL];
+    // Notifications may be sent from a second thread, a frame is written at once.
+    flockfile(stdout);
+    fprintf(stdout, "Content-Length: %lu\r\n\r\n", (unsigned long)[content length]);
+    fwrite([content bytes], 1, [content length], stdout);
+    funlockfile(stdout);
+}
+
+static void LSPStubReply(id messageID, id result) {
+    LSPStubWriteMessage([NSDictionary dictionaryWithObjectsAndKeys:
+                         @"2.0", @"jsonrpc",
+                         messageID, @"id",
+                         result ?: [NSNull null], @"result",
+                         nil]);
+}
+
+static void LSPStubReplyError(id messageID, NSInteger code, NSString *message) {
+    NSDictionary *error = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithInteger:code], @"code",
+                           message, @"message",
+                           nil];
+    LSPStubWriteMessage([NSDictionary dictionaryWithObjectsAndKeys:
+                         @"2.0", @"jsonrpc",
+                         messageID, @"id",
+                         error, @"error",
+                         nil]);
+}
+
+static void LSPStubNotify(NSString *method, id params) {
+    LSPStubWriteMessage([NSDictionary dictionaryWithObjectsAndKeys:
+                         @"2.0", @"jsonrpc",
+                         method, @"method",
+                         params ?: [NSNull null], @"params",
+                         nil]);
+}
+
+static NSDictionary *LSPStubCapabilities(void) {
+    NSDictionary *completionProvider = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        [NSNumber numberWithBool:YES], @"resolveProvider",
+                                        nil];
+    NSDictionary *legend = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSArray arrayWithObjects:@"variable", @"function", @"keyword", @"number", nil], @"tokenTypes",
+                            [NSArray arrayWithObjects:@"declaration", nil], @"tokenModifiers",
+                            nil];
+    NSDictionary *semanticTokensProvider = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            legend, @"legend",
+                                            [NSNumber numberWithBool:YES], @"range",
+                                            [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES], @"delta", nil], @"full",
+                                            nil];
+    NSDictionary *workDoneProgress = [NSDictionary dictionaryWithObjectsAndKeys:
+                                      [NSNumber numberWithBool:YES], @"workDoneProgress",
+                                      nil];
+    NSMutableDictionary *capabilities = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                         [NSNumber numberWithInteger:2], @"textDocumentSync",
+                                         [NSNumber numberWithBool:YES], @"hoverProvider",
+                                         completionProvider, @"completionProvider",
+                                         [NSNumber numberWithBool:YES], @"documentSymbolProvider",
+                                         [NSNumber numberWithBool:YES], @"documentHighlightProvider",
+                                         semanticTokensProvider, @"semanticTokensProvider",
+                                         workDoneProgress, @"referencesProvider",
+                                         workDoneProgress, @"workspaceSymbolProvider",
+                                         nil];
+    [capabilities removeObjectsForKeys:[LSPStubWithoutCapabilities allObjects]];
+    return capabilities;
+}
+
+static BOOL LSPStubIsCancelled(id messageID) {
+    [LSPStubCondition lock];
+    BOOL cancelled = [LSPStubCancelledIDs containsObject:messageID];
+    [LSPStubCondition unlock];
+    return cancelled;
+}
+
+/** Simulates the work on a request, returns NO if it was cancelled meanwhile. */
+static BOOL LSPStubCompute(id messageID) {
+    NSDate *end = [NSDate dateWithTimeIntervalSinceNow:LSPStubDelay];
+    do {
+        if (LSPStubIsCancelled(messageID)) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval:MIN(0.005, MAX([end timeIntervalSinceNow], 0.0))];
+    } while ([end timeIntervalSinceNow] > 0.0);
+    return (LSPStubIsCancelled(messageID) == NO);
+}
+
+static void LSPStubPublishDiagnostics(NSString *uri, id version) {
+    NSDictionary *position = [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSNumber numberWithInteger:0], @"line",
+                              [NSNumber numberWithInteger:0], @"character",
+                              nil];
+    NSDictionary *diagnostic = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSDictionary dictionaryWithObjectsAndKeys:position, @"start", position, @"end", nil], @"range",
+                                [NSNumber numberWithInteger:3], @"severity",
+                                [NSString stringWithFormat:@"%lu", (unsigned long)[[LSPStubDocuments objectForKey:uri] length]], @"message",
+                                nil];
+    LSPStubNotify(@"textDocument/publishDiagnostics", [NSDictionary dictionaryWithObjectsAndKeys:
+                                                       uri, @"uri",
+                                                       [NSArray arrayWithObject:diagnostic], @"diagnostics",
+                                                       version, @"version",
+                                                       nil]);
+}
+
+/** A result of about LSPStubResponseSize bytes for the language feature requests the stub provides. */
+static id LSPStubResult(NSString *method, NSString *uri) {
+    if (LSPStubResponseSize == 0) {
+        return nil;
+    }
+    NSDictionary *position = [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSNumber numberWithInteger:0], @"line",
+                              [NSNumber numberWithInteger:0], @"character",
+                              nil];
+    NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:position, @"start", position, @"end", nil];
+    if ([method isEqualToString:@"textDocument/hover"]) {
+        NSString *value = [@"" stringByPaddingToLength:LSPStubResponseSize withString:@"hover " startingAtIndex:0];
+        NSDictionary *contents = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  @"plaintext", @"kind",
+                                  value, @"value",
+                                  nil];
+        return [NSDictionary dictionaryWithObjectsAndKeys:contents, @"contents", nil];
+    } else if ([method isEqualToString:@"textDocument/completion"]) {
+        // An item is about 64 bytes.
+        NSUInteger count = MAX(LSPStubResponseSize / 64, (NSUInteger)1);
+        NSMutableArray *items = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger index = 0; index < count; index++) {
+            [items addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSString stringWithFormat:@"completion%06lu", (unsigned long)index], @"label",
+                              [NSNumber numberWithInteger:3], @"kind",
+                              @"func stub()", @"detail",
+                              nil]];
+        }
+        return [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithBool:NO], @"isIncomplete",
+                items, @"items",
+                nil];
+    } else if ([method isEqualToString:@"textDocument/documentSymbol"]) {
+        // A symbol is about 192 bytes.
+        NSUInteger count = MAX(LSPStubResponseSize / 192, (NSUInteger)1);
+        NSMutableArray *symbols = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger index = 0; index < count; index++) {
+            NSDictionary *location = [NSDictionary dictionaryWithObjectsAndKeys:uri ?: @"", @"uri", range, @"range", nil];
+            [symbols addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSString stringWithFormat:@"symbol%06lu", (unsigned long)index], @"name",
+                                [NSNumber numberWithInteger:12], @"kind",
+                                location, @"location",
+                                nil]];
+        }
+        return symbols;
+    }
+    return nil;
+}
+
+/** The relative token integers of the words on the lines firstLine through lastLine. */
+static NSArray<NSNumber *> *LSPStubSemanticTokenData(NSString *text, NSUInteger firstLine, NSUInteger lastLine) {
+    NSUInteger length = [text length];
+    unichar *characters = malloc(MAX(length, (NSUInteger)1) * sizeof(unichar));
+    [text getCharacters:characters range:NSMakeRange(0, length)];
+    NSCharacterSet *wordCharacters = [NSCharacterSet alphanumericCharacterSet];
+    NSMutableArray<NSNumber *> *data = [NSMutableArray array];
+    NSUInteger line = 0;
+    NSUInteger lineStart = 0;
+    NSUInteger previousLine = 0;
+    NSUInteger previousCharacter = 0;
+    NSUInteger index = 0;
+    while (index < length) {
+        unichar c = characters[index];
+        if (c == '\r' || c == '\n' || c == 0x85 || c == 0x2028 || c == 0x2029) {
+            index++;
+            if (c == '\r' && index < length && characters[index] == '\n') {
+                index++;
+            }
+            line++;
+            lineStart = index;
+            continue;
+        }
+        if ([wordCharacters characterIsMember:c] == NO) {
+            index++;
+            continue;
+        }
+        NSUInteger start = index;
+        while (index < length && [wordCharacters characterIsMember:characters[index]]) {
+            index++;
+        }
+        if (line < firstLine || line > lastLine) {
+            continue;
+        }
+        NSUInteger character = start - lineStart;
+        [data addObject:[NSNumber numberWithUnsignedInteger:line - previousLine]];
+        [data addObject:[NSNumber numberWithUnsignedInteger:(line == previousLine) ? character - previousCharacter : character]];
+        [data addObject:[NSNumber numberWithUnsignedInteger:index - start]];
+        [data addObject:[NSNumber numberWithUnsignedInteger:(index - start) % 4]];
+        [data addObject:[NSNumber numberWithUnsignedInteger:0]];
+        previousLine = line;
+        previousCharacter = character;
+    }
+    free(characters);
+    return data;
+}
+
+static id LSPStubSemanticTokensResult(NSString *method, NSString *uri, NSDictionary *params) {
+    NSString *text = [LSPStubDocuments objectForKey:uri];
+    if ([method isEqualToString:@"textDocument/semanticTokens/range"]) {
+        NSDictionary *range = [params objectForKey:@"range"];
+        NSUInteger firstLine = [[[range objectForKey:@"start"] objectForKey:@"line"] unsignedIntegerValue];
+        NSUInteger lastLine = [[[range objectForKey:@"end"] objectForKey:@"line"] unsignedIntegerValue];
+        return [NSDictionary dictionaryWithObjectsAndKeys:LSPStubSemanticTokenData(text, firstLine, lastLine), @"data", nil];
+    }
+    NSArray<NSNumber *> *data = LSPStubSemanticTokenData(text, 0, NSUIntegerMax);
+    NSString *resultID = [NSString stringWithFormat:@"%lu", (unsigned long)++LSPStubSemanticTokensResultCount];
+    NSDictionary *previous = [LSPStubSemanticTokens objectForKey:uri];
+    [LSPStubSemanticTokens setObject:[NSDictionary dictionaryWithObjectsAndKeys:resultID, @"resultId", data, @"data", nil] forKey:uri];
+    if ([method isEqualToString:@"textDocument/semanticTokens/full/delta"] &&
+        [[params objectForKey:@"previousResultId"] isEqual:[previous objectForKey:@"resultId"]]) {
+        // One edit, from the first to the last integer that changed.
+        NSArray<NSNumber *> *previousData = [previous objectForKey:@"data"];
+        NSUInteger prefix = 0;
+        while (prefix < [previousData count] && prefix < [data count] && [[previousData objectAtIndex:prefix] isEqual:[data objectAtIndex:prefix]]) {
+            prefix++;
+        }
+        NSUInteger suffix = 0;
+        while (suffix < [previousData count] - prefix && suffix < [data count] - prefix &&
+               [[previousData objectAtIndex:[previousData count] - suffix - 1] isEqual:[data objectAtIndex:[data count] - suffix - 1]]) {
+            suffix++;
+        }
+        NSDictionary *edit = [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSNumber numberWithUnsignedInteger:prefix], @"start",
+                              [NSNumber numberWithUnsignedInteger:[previousData count] - prefix - suffix], @"deleteCount",
+                              [data subarrayWithRange:NSMakeRange(prefix, [data count] - prefix - suffix)], @"data",
+                              nil];
+        LSPStubSemanticTokensDeltaCount++;
+        return [NSDictionary dictionaryWithObjectsAndKeys:
+                resultID, @"resultId",
+                [NSArray arrayWithObject:edit], @"edits",
+                nil];
+    }
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            resultID, @"resultId",
+            data, @"data",
+            nil];
+}
+
+/** Sends window/logMessage notifications at LSPStubNotificationRate until the process exits. */
+static void LSPStubSendNotifications(void) {
+    NSUInteger count = 0;
+    NSDate *start = [NSDate date];
+    while (1) {
+        @autoreleasepool {
+            count++;
+            // Scheduled from the start, so the rate does not drift with the time it takes to write.
+            NSDate *next = [start dateByAddingTimeInterval:count / LSPStubNotificationRate];
+            [NSThread sleepForTimeInterval:MAX([next timeIntervalSinceNow], 0.0)];
+            LSPStubNotify(@"window/logMessage", [NSDictionary dictionaryWithObjectsAndKeys:
+                                                 [NSNumber numberWithInteger:4], @"type",
+                                                 [NSString stringWithFormat:@"notification %lu", (unsigned long)count], @"message",
+                                                 nil]);
+            fflush(stdout);
+        }
+    }
+}
+
+/** Character index of an LSP position, with its own line scan to cross-check the client. */
+static NSUInteger LSPStubCharacterIndex(NSString *text, NSDictionary *position) {
+    NSUInteger line = [[position objectForKey:@"line"] unsignedIntegerValue];
+    NSUInteger length = [text length];
+    NSUInteger index = 0;
+    while (line > 0 && index < length) {
+        unichar c = [text characterAtIndex:index++];
+        if (c == '\r' && index < length && [text characterAtIndex:index] == '\n') {
+            index++;
+        }
+        if (c == '\r' || c == '\n' || c == 0x85 || c == 0x2028 || c == 0x2029) {
+            line--;
+        }
+    }
+    return MIN(index + [[position objectForKey:@"character"] unsignedIntegerValue], length);
+}
+
+static void LSPStubApplyContentChanges(NSMutableString *text, NSArray *contentChanges) {
+    for (NSDictionary *change in contentChanges) {
+        NSDictionary *range = [change objectForKey:@"range"];
+        if (range) {
+            NSUInteger start = LSPStubCharacterIndex(text, [range objectForKey:@"start"]);
+            NSUInteger end = LSPStubCharacterIndex(text, [range objectForKey:@"end"]);
+            [text replaceCharactersInRange:NSMakeRange(start, end - start) withString:[change objectForKey:@"text"]];
+        } else {
+            [text setString:[change objectForKey:@"text"]];
+        }
+        LSPStubContentChangeCount++;
+    }
+}
+
+static void LSPStubNotifyProgress(id token, NSString *kind, NSString *title, NSUInteger percentage) {
+    NSMutableDictionary *value = [NSMutableDictionary dictionaryWithObjectsAndKeys:kind, @"kind", nil];
+    if (title) {
+        [value setObject:title forKey:@"title"];
+    }
+    if ([kind isEqualToString:@"end"] == NO) {
+        [value setObject:[NSNumber numberWithUnsignedInteger:percentage] forKey:@"percentage"];
+    }
+    LSPStubNotify(@"$/progress", [NSDictionary dictionaryWithObjectsAndKeys:token, @"token", value, @"value", nil]);
+}
+
+/**
+ * Calls block with every word of the open documents, in the order of their
+ * URIs, and its location.
+ */
+static void LSPStubEnumerateWords(void (^block)(NSString *uri, NSString *word, NSRange range, NSDictionary *location)) {
+    NSCharacterSet *wordCharacters = [NSCharacterSet alphanumericCharacterSet];
+    for (NSString *uri in [[LSPStubDocuments allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        NSString *text = [LSPStubDocuments objectForKey:uri];
+        NSUInteger length = [text length];
+        NSUInteger line = 0;
+        NSUInteger lineStart = 0;
+        NSUInteger index = 0;
+        while (index < length) {
+            unichar c = [text characterAtIndex:index];
+            if ([wordCharacters characterIsMember:c] == NO) {
+                index++;
+                if (c == '\n') {
+                    line++;
+                    lineStart = index;
+                }
+                continue;
+            }
+            NSUInteger start = index;
+            while (index < length && [wordCharacters characterIsMember:[text characterAtIndex:index]]) {
+                index++;
+            }
+            NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:line], @"line", [NSNumber numberWithUnsignedInteger:start - lineStart], @"character", nil], @"start",
+                                   [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:line], @"line", [NSNumber numberWithUnsignedInteger:index - lineStart], @"character", nil], @"end",
+                                   nil];
+            NSDictionary *location = [NSDictionary dictionaryWithObjectsAndKeys:uri, @"uri", range, @"range", nil];
+            block(uri, [text substringWithRange:NSMakeRange(start, index - start)], NSMakeRange(start, index - start), location);
+        }
+    }
+}
+
+static NSArray *LSPStubReferences(NSString *uri, NSDictionary *params) {
+    NSUInteger characterIndex = LSPStubCharacterIndex([LSPStubDocuments objectForKey:uri], [params objectForKey:@"position"]);
+    __block NSString *word = nil;
+    LSPStubEnumerateWords(^(NSString *wordURI, NSString *candidate, NSRange range, NSDictionary *location) {
+        if (word == nil && [wordURI isEqualToString:uri] && characterIndex >= range.location && characterIndex <= NSMaxRange(range)) {
+            word = candidate;
+        }
+    });
+    NSMutableArray *locations = [NSMutableArray array];
+    LSPStubEnumerateWords(^(NSString *wordURI, NSString *candidate, NSRange range, NSDictionary *location) {
+        if ([candidate isEqualToString:word]) {
+            [locations addObject:location];
+        }
+    });
+    return locations;
+}
+
+static NSArray *LSPStubWorkspaceSymbols(NSString *query) {
+    NSMutableArray *symbols = [NSMutableArray array];
+    LSPStubEnumerateWords(^(NSString *uri, NSString *word, NSRange range, NSDictionary *location) {
+        if ([query length] == 0 || [word rangeOfString:query].location != NSNotFound) {
+            [symbols addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                word, @"name",
+                                [NSNumber numberWithInteger:13], @"kind",
+                                location, @"location",
+                                nil]];
+        }
+    });
+    return symbols;
+}
+
+/**
+ * Computes the results in chunks of 100, each chunk takes the delay. They
+ * are streamed with the partialResultToken of the request, or sent at once
+ * in the reply.
+ */
+static void LSPStubReplyInChunks(id messageID, NSDictionary *params, NSArray *results) {
+    id partialResultToken = [params objectForKey:@"partialResultToken"];
+    id workDoneToken = [params objectForKey:@"workDoneToken"];
+    NSUInteger chunkSize = 100;
+    NSUInteger chunkCount = MAX(([results count] + chunkSize - 1) / chunkSize, (NSUInteger)1);
+    if (workDoneToken) {
+        LSPStubNotifyProgress(workDoneToken, @"begin", @"Searching", 0);
+    }
+    for (NSUInteger chunk = 0; chunk < chunkCount; chunk++) {
+        if (LSPStubCompute(messageID) == NO) {
+            LSPStubCancelledCount++;
+            if (workDoneToken) {
+                LSPStubNotifyProgress(workDoneToken, @"end", nil, 0);
+            }
+            LSPStubReplyError(messageID, -32800, @"Request cancelled");
+            return;
+        }
+        NSRange range = NSMakeRange(chunk * chunkSize, MIN(chunkSize, [results count] - MIN(chunk * chunkSize, [results count])));
+        if (partialResultToken && range.length > 0) {
+            LSPStubNotify(@"$/progress", [NSDictionary dictionaryWithObjectsAndKeys:
+                                          partialResultToken, @"token",
+                                          [results subarrayWithRange:range], @"value",
+                                          nil]);
+        }
+        if (workDoneToken && chunk + 1 < chunkCount) {
+            LSPStubNotifyProgress(workDoneToken, @"report", nil, (chunk + 1) * 100 / chunkCount);
+        }
+        fflush(stdout);
+    }
+    LSPStubHandledCount++;
+    if (workDoneToken) {
+        LSPStubNotifyProgress(workDoneToken, @"end", nil, 0);
+    }
+    LSPStubReply(messageID, partialResultToken ? [NSArray array] : results);
+}
+
+static void LSPStubHandleMessage(NSDictionary *message) {
+    NSString *method = [message objectForKey:@"method"];
+    id messageID = [message objectForKey:@"id"];
+    id params = [message objectForKey:@"params"];
+    if ([method isEqualToString:@"exit"]) {
+        exit(0);
+    }
+    if (method == nil) {
+        // A response of the client, they are not answered.
+        LSPStubResponseCount++;
+        LSPStubLastResponseResult = [message objectForKey:@"result"];
+        if ([messageID isEqual:@"stub-1"]) {
+            LSPStubNotifyProgress(@"stub-indexing", @"begin", @"Indexing", 0);
+            LSPStubNotifyProgress(@"stub-indexing", @"end", nil, 0);
+        }
+        return;
+    }
+    if (LSPStubReportsProgress && [method isEqualToString:@"initialized"]) {
+        NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                                 @"2.0", @"jsonrpc",
+                                 @"stub-1", @"id",
+                                 @"window/workDoneProgress/create", @"method",
+                                 [NSDictionary dictionaryWithObjectsAndKeys:@"stub-indexing", @"token", nil], @"params",
+                                 nil];
+        LSPStubWriteMessage(request);
+        return;
+    }
+    NSString *uri = [[params objectForKey:@"textDocument"] objectForKey:@"uri"];
+    if ([method isEqualToString:@"textDocument/didOpen"]) {
+        [LSPStubDocuments setObject:[[[params objectForKey:@"textDocument"] objectForKey:@"text"] mutableCopy] forKey:uri];
+    } else if ([method isEqualToString:@"textDocument/didChange"]) {
+        LSPStubChangeNotificationCount++;
+        LSPStubApplyContentChanges([LSPStubDocuments objectForKey:uri], [params objectForKey:@"contentChanges"]);
+    } else if ([method isEqualToString:@"textDocument/didClose"]) {
+        [LSPStubDocuments removeObjectForKey:uri];
+        [LSPStubSemanticTokens removeObjectForKey:uri];
+    }
+    if (LSPStubPublishesDiagnostics && ([method isEqualToString:@"textDocument/didOpen"] || [method isEqualToString:@"textDocument/didChange"])) {
+        LSPStubPublishDiagnostics(uri, [[params objectForKey:@"textDocument"] objectForKey:@"version"]);
+    }
+    if (messageID == nil) {
+        // Other notifications are ignored.
+        return;
+    }
+    if ([method isEqualToString:@"initialize"]) {
+        LSPStubInitializeParams = params;
+        [NSThread sleepForTimeInterval:LSPStubInitializeDelay];
+        LSPStubReply(messageID, [NSDictionary dictionaryWithObjectsAndKeys:LSPStubCapabilities(), @"capabilities", nil]);
+    } else if ([method isEqualToString:@"stub/echo"]) {
+        LSPStubReply(messageID, params);
+    } else if ([method isEqualToString:@"stub/initialize"]) {
+        LSPStubReply(messageID, LSPStubInitializeParams);
+    } else if ([method isEqualToString:@"textDocument/references"]) {
+        LSPStubReplyInChunks(messageID, params, LSPStubReferences(uri, params));
+    } else if ([method isEqualToString:@"workspace/symbol"]) {
+        LSPStubReplyInChunks(messageID, params, LSPStubWorkspaceSymbols([params objectForKey:@"query"]));
+    } else if ([method hasPrefix:@"textDocument/"]) {
+        if (LSPStubCompute(messageID)) {
+            LSPStubHandledCount++;
+            if ([method hasPrefix:@"textDocument/semanticTokens/"]) {
+                LSPStubReply(messageID, LSPStubSemanticTokensResult(method, uri, params));
+            } else {
+                LSPStubReply(messageID, LSPStubResult(method, uri));
+            }
+        } else {
+            LSPStubCancelledCount++;
+            LSPStubReplyError(messageID, -32800, @"Request cancelled");
+        }
+    } else if ([method isEqualToString:@"completionItem/resolve"]) {
+        if (LSPStubCompute(messageID)) {
+            LSPStubResolvedCount++;
+            NSMutableDictionary *item = [params mutableCopy];
+            [item setObject:[NSString stringWithFormat:@"documentation of %@", [params objectForKey:@"label"]] forKey:@"documentation"];
+            LSPStubReply(messageID, item);
+        } else {
+            LSPStubCancelledCount++;
+            LSPStubReplyError(messageID, -32800, @"Request cancelled");
+        }
+    } else if ([method isEqualToString:@"stub/statistics"]) {
+        LSPStubReply(messageID, [NSDictionary dictionaryWithObjectsAndKeys:
+                                 [NSNumber numberWithUnsignedInteger:LSPStubHandledCount], @"handled",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubCancelledCount], @"cancelled",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubResolvedCount], @"resolved",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubSemanticTokensDeltaCount], @"semanticTokensDeltas",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubChangeNotificationCount], @"changeNotifications",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubContentChangeCount], @"contentChanges",
+                                 [NSNumber numberWithUnsignedInteger:LSPStubResponseCount], @"responses",
+                                 LSPStubLastResponseResult ?: [NSNull null], @"lastResponseResult",
+                                 nil]);
+    } else if ([method isEqualToString:@"stub/text"]) {
+        LSPStubReply(messageID, [LSPStubDocuments objectForKey:[params objectForKey:@"uri"]]);
+    } else if ([method isEqualToString:@"stub/flood"]) {
+        NSUInteger count = [[params objectForKey:@"count"] unsignedIntegerValue];
+        for (NSUInteger index = 0; index < count; index++) {
+            @autoreleasepool {
+                LSPStubNotify(@"stub/notification", [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:index], @"index", nil]);
+            }
+        }
+        LSPStubReply(messageID, [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:count], @"count", nil]);
+    } else if ([method isEqualToString:@"stub/showMessageRequest"]) {
+        NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                                 @"2.0", @"jsonrpc",
+                                 @"stub-2", @"id",
+                                 @"window/showMessageRequest", @"method",
+                                 params, @"params",
+                                 nil];
+        LSPStubWriteMessage(request);
+        LSPStubReply(messageID, nil);
+    } else {
+        LSPStubReply(messageID, nil);
+    }
+}
+
+/** Reads the input, cancellations are recorded right away, everything else is queued. */
+static void LSPStubReadInput(void) {
+    NSData *frame = nil;
+    while ((frame = LSPStubReadFrame(stdin)) != nil) {
+        @autoreleasepool {
+            NSDictionary *message = [NSJSONSerialization JSONObjectWithData:frame options:0 error:NULL];
+            if ([message isKindOfClass:[NSDictionary class]] == NO) {
+                continue;
+            }
+            NSString *method = [message objectForKey:@"method"];
+            NSDictionary *params = [message objectForKey:@"params"];
+            if ([method isEqualToString:@"stub/pause"]) {
+                // Leaves the input unread, so the pipe fills up on the client side.
+                [NSThread sleepForTimeInterval:[[params objectForKey:@"seconds"] doubleValue]];
+                continue;
+            }
+            [LSPStubCondition lock];
+            if ([method isEqualToString:@"$/cancelRequest"]) {
+                id messageID = [params objectForKey:@"id"];
+                if (messageID) {
+                    [LSPStubCancelledIDs addObject:messageID];
+                }
+            } else {
+                [LSPStubMessages addObject:message];
+                [LSPStubCondition signal];
+            }
+            [LSPStubCondition unlock];
+        }
+    }
+    [LSPStubCondition lock];
+    [LSPStubMessages addObject:[NSNull null]];
+    [LSPStubCondition signal];
+    [LSPStubCondition unlock];
+}
+
+int main(int argc, const char * argv[]) {
+    @autoreleasepool {
+        for (int index = 1; index < argc; index++) {
+            if (strcmp(argv[index], "--delay") == 0 && index + 1 < argc) {
+                LSPStubDelay = strtod(argv[index + 1], NULL);
+            } else if (strcmp(argv[index], "--initialize-delay") == 0 && index + 1 < argc) {
+                LSPStubInitializeDelay = strtod(argv[index + 1], NULL);
+            } else if (strcmp(argv[index], "--diagnostics") == 0) {
+                LSPStubPublishesDiagnostics = YES;
+            } else if (strcmp(argv[index], "--response-size") == 0 && index + 1 < argc) {
+                LSPStubResponseSize = (NSUInteger)strtoul(argv[index + 1], NULL, 10);
+            } else if (strcmp(argv[index], "--notification-rate") == 0 && index + 1 < argc) {
+                LSPStubNotificationRate = strtod(argv[index + 1], NULL);
+            } else if (strcmp(argv[index], "--without") == 0 && index + 1 < argc) {
+                if (LSPStubWithoutCapabilities == nil) {
+                    LSPStubWithoutCapabilities = [NSMutableSet set];
+                }
+                [LSPStubWithoutCapabilities addObject:[NSString stringWithUTF8String:argv[index + 1]]];
+            } else if (strcmp(argv[index], "--progress") == 0) {
+                LSPStubReportsProgress = YES;
+            }
+        }
+        LSPStubCondition = [[NSCondition alloc] init];
+        LSPStubMessages = [NSMutableArray array];
+        LSPStubCancelledIDs = [NSMutableSet set];
+        LSPStubDocuments = [NSMutableDictionary dictionary];
+        LSPStubSemanticTokens = [NSMutableDictionary dictionary];
+        [NSThread detachNewThreadWithBlock:^{
+            @autoreleasepool {
+                LSPStubReadInput();
+            }
+        }];
+        if (LSPStubNotificationRate > 0.0) {
+            [NSThread detachNewThreadWithBlock:^{
+                LSPStubSendNotifications();
+            }];
+        }
+        while (1) {
+            @autoreleasepool {
+                [LSPStubCondition lock];
+                while ([LSPStubMessages count] == 0) {
+                    [LSPStubCondition wait];
+                }
+                id message = [LSPStubMessages firstObject];
+                [LSPStubMessages removeObjectAtIndex:0];
+                [LSPStubCondition unlock];
+                if (message == [NSNull null]) {
+                    break;
+                }
+                LSPStubHandleMessage(message);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
@@ -9,6 +9,11 @@
 #import <Foundation/Foundation.h>
 
 #import <LSPKit/LSPCommon.h>
+#import <LSPKit/LSPCompletionList.h>
+#import <LSPKit/LSPDiagnosticsStore.h>
+#import <LSPKit/LSPMetrics.h>
+#import <LSPKit/LSPSemanticTokens.h>
+#import <LSPKit/LSPTraceRecorder.h>
 
 @class LSPClient;
 
@@ -17,9 +22,31 @@
 @optional
 - (void)languageServer:(LSPClient *)client logMessage:(NSString *)message type:(LSPMessageType)type;
 - (void)languageServer:(LSPClient *)client showMessage:(NSString *)message type:(LSPMessageType)type;
+/**
+ * The server gets no action back: it is answered right after this returns,
+ * unless an observer implements the variant with a reply block.
+ */
 - (void)languageServer:(LSPClient *)client showMessageRequest:(NSString *)message actions:(NSArray<NSString *> *)actions;
+/**
+ * Called instead of the method above for the first observer that implements
+ * it. reply must be invoked once, on main thread, with the title of the
+ * chosen action or nil, to answer the server.
+ */
+- (void)languageServer:(LSPClient *)client showMessageRequest:(NSString *)message type:(LSPMessageType)type actions:(NSArray<NSString *> *)actions reply:(void (^)(NSString *action))reply;
 - (void)languageServer:(LSPClient *)client telemetryEvent:(id)event;
 - (void)languageServer:(LSPClient *)client document:(NSURL *)url diagnostics:(NSArray<LSPDiagnostic *> *)diagnostics;
+/**
+ * Called for every publishDiagnostics notification, before
+ * -languageServer:document:diagnostics:, with what changed since the
+ * previous one for the document.
+ */
+- (void)languageServer:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta;
+/**
+ * Called for the $/progress notifications of work done progress, the ones of
+ * the server and the ones of requests streaming their results. The progress
+ * of a request is also passed to the observers of its document.
+ */
+- (void)languageServer:(LSPClient *)client workDoneProgress:(LSPWorkDoneProgress *)progress;
 
 @end
 
@@ -69,6 +96,21 @@ typedef struct _LSPTextDocumentSyncOptions {
     
 } LSPTextDocumentSyncOptions;
 
+/**
+ * A pending request of a language feature method.
+ */
+@interface LSPRequest : NSObject
+@property (readonly) NSString *method;
+@property (readonly) NSURL *uri;
+@property (readonly, getter=isCancelled) BOOL cancelled;
+/**
+ * Sends $/cancelRequest to the server, unless the reply was already received.
+ * The completion handler of the request is not called after cancelling. Must
+ * be invoked on main thread.
+ */
+- (void)cancel;
+@end
+
 @interface LSPClient : NSObject
 
 /**
@@ -207,6 +249,21 @@ typedef struct _LSPTextDocumentSyncOptions {
  * The commands to be executed on the server
  */
 @property (readonly) NSArray<NSString *> *executeCommandCommands;
+/**
+ * The server provides semantic tokens for a whole document, and deltas
+ * between them, or for a range.
+ *
+ * Since 3.16.0
+ */
+@property (readonly, getter=hasSemanticTokensProvider) BOOL semanticTokensProvider;
+@property (readonly, getter=hasSemanticTokensDeltaProvider) BOOL semanticTokensDeltaProvider;
+@property (readonly, getter=hasSemanticTokensRangeProvider) BOOL semanticTokensRangeProvider;
+/**
+ * The legend of the server, the names of the token types and modifiers the
+ * runs of LSPSemanticTokens refer to.
+ */
+@property (readonly) NSArray<NSString *> *semanticTokenTypes;
+@property (readonly) NSArray<NSString *> *semanticTokenModifiers;
 /**
  * Workspace specific server capabilities
  */
@@ -220,12 +277,41 @@ typedef struct _LSPTextDocumentSyncOptions {
 - (instancetype)initWithPath:(NSString *)path arguments:(NSArray<NSString *> *)arguments currentDirectoryPath:(NSString *)currentDirectoryPath languageID:(NSString *)languageID;
 
 @property (readonly) NSString *languageID;
+/**
+ * The root of the workspace the server works on, sent as rootUri and the
+ * one workspace folder in the initialize request. Must be set before the
+ * client is initialized. Defaults to nil, no workspace.
+ */
+@property (copy) NSURL *rootURL;
 
 #pragma mark Observers
 
+/**
+ * Adds an observer of all notifications of all documents.
+ */
 - (void)addObserver:(id<LSPClientObserver>)observer;
+/**
+ * Adds an observer of the notifications of one document, or of all
+ * documents if uri is nil. Only notifications whose method is in methods
+ * are delivered to it, all if methods is nil. Notifications that are not
+ * about a document, like window/logMessage, only go to observers of all
+ * documents. A notification is looked up by method and uri, so it costs
+ * nothing for the observers of other documents.
+ *
+ * Adding an observer again for the same uri and method has no effect.
+ */
+- (void)addObserver:(id<LSPClientObserver>)observer forURI:(NSURL *)uri methods:(NSSet<NSString *> *)methods;
+/**
+ * Removes all registrations of observer.
+ */
 - (void)removeObserver:(id<LSPClientObserver>)observer;
 
+/**
+ * The diagnostics last published by the server, for all documents. They are
+ * kept when the server terminates, until the next server publishes again.
+ */
+@property (readonly) LSPDiagnosticsStore *diagnosticsStore;
+
 #pragma mark General
 
 - (void)initialWithCompletionHandler:(void (^)(NSError *error))completionHandler;
@@ -237,8 +323,74 @@ typedef struct _LSPTextDocumentSyncOptions {
 - (void)shutdownWithCompletionHandler:(void (^)(NSError *error))completionHandler;
 - (void)terminate;
 
+#pragma mark Suspension
+
+/**
+ * Shuts the server down and lets it exit, but keeps the open documents. The
+ * documents can still be changed, opened and closed while the client is
+ * suspended. The next call to -initialWithCompletionHandler: or a language
+ * feature method relaunches the server, initializes it and opens the
+ * documents again with their current text. Only an initialized client is
+ * suspended.
+ */
+- (void)suspend;
+@property (readonly, getter=isSuspended) BOOL suspended;
+/**
+ * The system uptime of the last edit, open or request. LSPServerPool
+ * suspends the least recently used server first.
+ */
+@property (readonly) NSTimeInterval lastActivityTime;
+
+#pragma mark Hot Standby
+
+/**
+ * Keeps a second server launched and initialized while the client is
+ * initialized. When the server terminates unexpectedly the spare one takes
+ * over right away: the client opens its documents on it with their current
+ * text and version, and the termination observers are not called. A new
+ * spare server is launched afterwards. Without a spare server ready, the
+ * server is relaunched and the documents are dropped as before. Costs one
+ * more server process, defaults to NO.
+ */
+@property (nonatomic) BOOL hotStandby;
+/**
+ * YES if the spare server is initialized and can take over.
+ */
+@property (readonly, getter=isStandbyReady) BOOL standbyReady;
+
+#pragma mark Metrics
+
+/**
+ * Measures request latencies by method, message counts, bytes written and
+ * read, and the durations of the pipeline stages. Costs a clock read and a
+ * lock per message and stage, defaults to NO. Turning it off discards the
+ * metrics.
+ */
+@property (nonatomic, getter=isMetricsEnabled) BOOL metricsEnabled;
+/**
+ * The metrics since they were enabled or reset, nil if they are not enabled.
+ * Cheap enough to be polled, it copies the histograms.
+ */
+- (LSPMetricsSnapshot *)metricsSnapshot;
+- (void)resetMetrics;
+
+#pragma mark Trace
+
+/**
+ * Records the messages between the client and its current server, across
+ * restarts. Messages of a standby server are recorded once it takes over.
+ * Defaults to nil.
+ */
+@property (nonatomic, strong) LSPTraceRecorder *traceRecorder;
+
 #pragma mark Text Synchronization
 
+// Documents can be opened, changed and closed right away, before the client
+// is initialized. The first call initializes the client, and the documents
+// still open are sent to the server with their text as it is then, right
+// after the "initialized" notification. So the server starts while the host
+// loads the document. Save notifications before that are not sent.
+
 /**
  * Sent to the server to signal newly opened text documents. The document’s
  * truth is now managed by the client and the server must not try to
@@ -248,17 +400,43 @@ typedef struct _LSPTextDocumentSyncOptions {
  */
 - (void)documentDidOpen:(NSURL *)url content:(NSString *)text;
 /**
- * Queues a notification, with coalescing turned on and a posting style
- * of NSPostWhenIdle.
- * When the user stops typing, the single notification in the queue (due to coalescing)
- * is posted when the run loop enters its wait state and the language server
- * "textDocument/didChange" notifcation is send.
+ * Like -documentDidOpen:content:, but instead of keeping its own copy of the
+ * text, the client reads the text from the text storage of the host, for
+ * example the NSTextStorage of a text view. The host must call
+ * -document:changeTextInRange:replacementString: before it changes the text
+ * storage, as from -textView:shouldChangeTextInRange:replacementString:, and
+ * apply the change right after.
+ */
+- (void)documentDidOpen:(NSURL *)url textStorage:(NSMutableAttributedString *)textStorage;
+/**
+ * Records a change of the document. The changes are collected and sent in
+ * one "textDocument/didChange" notification when no further change was made
+ * for documentChangeDebounceInterval, but at the latest
+ * documentChangeMaximumLatency after the first change that was not sent.
+ * Pending changes are always sent before a request or notification that
+ * depends on the document content.
  */
 - (void)document:(NSURL *)url changeTextInRange:(NSRange)affectedCharRange replacementString:(NSString *)replacementString;
 /**
- * You don’t need to send documentDidChange unless your run loop never enters its wait state.
+ * Sends the pending changes of the document right away. You don’t need to
+ * call it, unless the server must see the changes before the next request.
  */
 - (void)documentDidChange:(NSURL *)url;
+/**
+ * Seconds without a change after which pending changes are sent. Defaults to 0.1.
+ */
+@property NSTimeInterval documentChangeDebounceInterval;
+/**
+ * Seconds after the first pending change after which the changes are sent,
+ * even if the user keeps typing. Defaults to 0.5.
+ */
+@property NSTimeInterval documentChangeMaximumLatency;
+/**
+ * The number of changes recorded with -document:changeTextInRange:replacementString:
+ * and the number of "textDocument/didChange" notifications they were sent in.
+ */
+@property (readonly) NSUInteger documentEditCount;
+@property (readonly) NSUInteger documentChangeNotificationCount;
 /**
  * The document will save notification is sent from the client
  * to the server before the document is actually saved.
@@ -280,11 +458,114 @@ typedef struct _LSPTextDocumentSyncOptions {
 
 #pragma mark Language Features
 
-- (void)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error))completionHandler ;
-- (void)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler;
-- (void)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *, NSError *error))completionHandler;
+// Character indexes are converted to positions with the line index of the
+// open document, string must be the text kept in sync with
+// -document:changeTextInRange:replacementString:.
+//
+// The methods return the pending request. Requests made before the server is
+// initialized are kept, in order, and sent right after the documents were
+// opened. The ones for documents closed meanwhile, or methods the server
+// turns out not to provide, are cancelled. Completion, highlight and hover
+// requests replace each other:
+// starting one cancels the pending request of the same kind for the same
+// document, its result would be stale anyway. Replies with the error codes
+// LSPResponseRequestCancelled and LSPResponseContentModified are dropped,
+// the completion handler is not called for them.
+//
+// Symbol, folding range and hover results are cached for the document
+// version and position until the document changes, and an identical request
+// while one is in flight shares its reply instead of being sent again.
+//
+// A completion list that is not incomplete is kept for the word it was
+// requested in. While the user keeps typing that word, completion is
+// answered from it, filtered by the word, without a request to the server.
+
+- (LSPRequest *)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error))completionHandler ;
+/**
+ * Like -documentCompletion:inText:forCharacterAtIndex:completionHandler:,
+ * whose array is the same LSPCompletionList, typed for filtering and for
+ * resolving its items.
+ */
+- (LSPRequest *)documentCompletionList:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error))completionHandler;
+
+/**
+ * Resolves the documentation and details of an item of a completion list
+ * with completionItem/resolve. Resolved items are kept with the list, for it
+ * and the lists filtered from it, and a resolve of an item already in flight
+ * shares its reply. The handler is called with the item as is if the server
+ * has no completion resolve provider.
+ */
+- (LSPRequest *)resolveCompletionItemAtIndex:(NSUInteger)index ofCompletionList:(LSPCompletionList *)completionList completionHandler:(void (^)(LSPCompletionItem *item, NSError *error))completionHandler;
+/**
+ * Resolves the items in range ahead, typically the items visible in the
+ * completion popup, up to 32 of them. Call it whenever the visible range
+ * changes: prefetches of items no longer in range are cancelled. Resolving
+ * a prefetched item then is answered right away.
+ */
+- (void)prefetchResolvedCompletionItemsInRange:(NSRange)range ofCompletionList:(LSPCompletionList *)completionList;
+- (LSPRequest *)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler;
+- (LSPRequest *)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *, NSError *error))completionHandler;
+
+- (LSPRequest *)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler;
+- (LSPRequest *)documentFoldingRange:(NSURL *)url completionHandler:(void (^)(NSArray *foldingRanges, NSError *error))completionHandler;
+
+/**
+ * Pulls the semantic tokens of a document. The tokens of the last reply are
+ * kept for the document: if the server provides deltas, only the changes
+ * since then are requested and applied to those tokens in place, and the
+ * same object is passed to the handler again. tokens is nil if the server
+ * has none.
+ */
+- (LSPRequest *)documentSemanticTokens:(NSURL *)url completionHandler:(void (^)(LSPSemanticTokens *tokens, NSError *error))completionHandler;
+/**
+ * The semantic tokens of the visible part of a document, for a quick first
+ * highlighting of a large document. They are not kept.
+ */
+- (LSPRequest *)documentSemanticTokens:(NSURL *)url inCharacterRange:(NSRange)range completionHandler:(void (^)(LSPSemanticTokens *tokens, NSError *error))completionHandler;
 
-- (void)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler;
+/**
+ * Finds the references to the symbol at a character index, and the symbols
+ * of the workspace matching query. The server reports the progress of the
+ * request to the observers, and with a partialResultHandler it may send the
+ * results in chunks: each chunk is passed to the handler on main thread as
+ * it arrives, and the completion handler gets all of them. Cancelling the
+ * request stops both.
+ */
+- (LSPRequest *)documentReferences:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex includeDeclaration:(BOOL)includeDeclaration partialResultHandler:(void (^)(NSArray *locations))partialResultHandler completionHandler:(void (^)(NSArray *locations, NSError *error))completionHandler;
+- (LSPRequest *)workspaceSymbol:(NSString *)query partialResultHandler:(void (^)(NSArray *symbols))partialResultHandler completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler;
+
+/** Asks the server to cancel the work of a cancellable progress. */
+- (void)cancelWorkDoneProgress:(LSPWorkDoneProgress *)progress;
+
+/**
+ * Seconds a language feature request may take. A request the server did not
+ * answer by then is cancelled, and its completion handler is called with an
+ * LSPResponseRequestTimedOut error. 0 waits forever, defaults to 30. Requests
+ * streaming partial results wait for as long as the server sends them.
+ */
+@property NSTimeInterval requestTimeout;
+/**
+ * Completion, resolve, hover and highlight requests are written ahead of
+ * other requests still queued. Symbol, folding range and full semantic token
+ * requests are background requests: at most this many of them are in flight
+ * and the others wait, so the user does not wait behind them at a server
+ * that handles requests in order. A waiting request whose document changes
+ * is not sent: symbol and folding range requests are made again for the new
+ * version, semantic token requests are left to the next one. Defaults to 4.
+ */
+@property (nonatomic) NSUInteger maximumBackgroundRequestCount;
+
+/**
+ * Estimated bytes of cached results. Above it the least recently used results
+ * are evicted, 0 disables the cache. Defaults to 4 MB.
+ */
+@property NSUInteger responseCacheCostLimit;
+/**
+ * The number of symbol, folding range and hover requests answered from the
+ * cache, and the ones that were not.
+ */
+@property (readonly) NSUInteger responseCacheHitCount;
+@property (readonly) NSUInteger responseCacheMissCount;
 
 @end
 
@@ -9,280 +9,183 @@
 #import "LSPClient.h"
 
 #import "LSPCommon.h"
+#import "LSPCompletionList.h"
+#import "LSPDiagnosticsStore.h"
+#import "LSPMetricsRecorder.h"
+#import "LSPPipeline.h"
+#import "LSPResponseCache.h"
+#import "LSPRope.h"
 
 
 
-NSNotificationName const LSPDocumentDidChangeNotification = @"LSPDocumentDidChange";
-NSString * const LSPDocumentUserInfoKey = @"Document";
-
-typedef void (^ReplyBlock)(NSDictionary *, NSError *);
-
-@interface LSPPipeline : NSObject {
-    NSUInteger _messageID;
-    NSMutableData *_buffer;
-    CFHTTPMessageRef _message;
-    NSMutableDictionary <NSNumber *, ReplyBlock> *_replyBlocks;
+/** Whether string contains a line terminator as recognized by LSPLineIndex. */
+static BOOL LSPStringContainsLineTerminator(NSString *string) {
+    static NSCharacterSet *lineTerminators = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        unichar characters[] = { '\r', '\n', 0x85, 0x2028, 0x2029 };
+        lineTerminators = [NSCharacterSet characterSetWithCharactersInString:[NSString stringWithCharacters:characters length:5]];
+    });
+    return ([string rangeOfCharacterFromSet:lineTerminators].location != NSNotFound);
 }
-@property NSPipe *stdinPipe;
-@property NSPipe *stdoutPipe;
-@property NSPipe *stderrPipe;
-@property (copy) void (^readHandler)(NSData *);
-@property (copy) void (^dataHandler)(NSData *content, NSString *charset);
-@property (copy) void (^notificationMessageHandler)(NSDictionary *message);
-@property NSMutableString *log;
-@end
-
-@interface LSPPipeline (MessageTransport)
-- (void)didReceiveData:(NSData *)data;
-- (void)sendMessage:(NSData *)data;
-@end
 
-@interface LSPPipeline (ProtocolTransport)
-- (void)handlePipelineMessage:(NSData *)data;
+/**
+ * A change event not yet sent to the server. An edit touching the text of
+ * the previous change event is merged into it, so a run of typing or
+ * backspacing is sent as one change.
+ */
+@interface LSPContentChange : NSObject
+/**
+ * The replaced range in the text before the change, as character range and
+ * as positions.
+ */
+@property NSRange range;
+@property LSPPosition *start;
+@property LSPPosition *end;
+@property NSMutableString *text;
 @end
 
+@implementation LSPContentChange
 
-@implementation LSPPipeline
-
-- (instancetype)init
-{
+- (instancetype)initWithRange:(NSRange)range replacementString:(NSString *)string lineIndex:(LSPLineIndex *)lineIndex {
     self = [super init];
     if (self) {
-        _buffer = [NSMutableData data];
-        _replyBlocks = [NSMutableDictionary dictionary];
-        _stdinPipe = [NSPipe pipe];
-        _stdoutPipe = [NSPipe pipe];
-        _stderrPipe = [NSPipe pipe];
-        [[_stdoutPipe fileHandleForReading] setReadabilityHandler:^(NSFileHandle *fileHandle) {
-            NSData *data = [fileHandle availableData];
-            if ([data length] == 0) return;
-            if (self.readHandler == nil) return;
-            self.readHandler(data);
-        }];
-        [[_stderrPipe fileHandleForReading] setReadabilityHandler:^(NSFileHandle *fileHandle) {
-            NSData *data = [fileHandle availableData];
-            if ([data length] == 0) return;
-            NSLog(@"stderr: %@", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]);
-        }];
-        __weak __typeof(self) weakSelf = self;
-        [self setReadHandler:^(NSData *data) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            if ([data length] == 0) return;
-            [strongSelf didReceiveData:data];
-        }];
-        [self setDataHandler:^(NSData *content, NSString *charset) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            [strongSelf handlePipelineMessage:content];
-        }];
+        _range = range;
+        _start = [lineIndex positionForCharacterAtIndex:range.location];
+        _end = [lineIndex positionForCharacterAtIndex:NSMaxRange(range)];
+        _text = [string mutableCopy];
     }
     return self;
 }
 
-- (void)writeData:(NSData *)data {
-    [[_stdinPipe fileHandleForWriting] writeData:data];
-}
-
-- (void)close {
-    [[_stdinPipe fileHandleForReading] closeFile];
-    [[_stdinPipe fileHandleForWriting] closeFile];
-    [[_stdoutPipe fileHandleForReading] closeFile];
-    [[_stdoutPipe fileHandleForWriting] closeFile];
-    [[_stderrPipe fileHandleForReading] closeFile];
-    [[_stderrPipe fileHandleForWriting] closeFile];
-    [[_stdoutPipe fileHandleForReading] setReadabilityHandler:nil];
-    [[_stderrPipe fileHandleForReading] setReadabilityHandler:nil];
-}
-
-@end
-
-@implementation LSPPipeline (MessageTransport)
-
-NSString *ParsenContentType(NSString *str, NSDictionary **params) {
-    NSString *contentType = str;
-    NSArray *components = [str componentsSeparatedByString:@";"];
-    if ([components count] > 1) {
-        contentType = [components objectAtIndex:0];
-        if (*params) {
-            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
-            for (NSString *component in [components subarrayWithRange:NSMakeRange(1, [components count] - 1)]) {
-                NSArray *keyvalue = [component componentsSeparatedByString:@"="];
-                if ([keyvalue count] == 2) {
-                    NSString *key = [[keyvalue objectAtIndex:0] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
-                    NSString *value = [[keyvalue objectAtIndex:1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
-                    if (key && value) {
-                        [dict setObject:value forKey:key];
-                    }
-                }
-            }
-            *params = [dict copy];
-        }
-    }
-    return contentType;
-}
-
-- (void)didReceiveData:(NSData *)data {
-    [_buffer appendData:data];
-    NSData *remainingData = data;
-    do {
-        if (_message == NULL) {
-            _message = CFHTTPMessageCreateEmpty(NULL, NO);
-            NSData *header = [@"HTTP/1.1 200 OK\r\n" dataUsingEncoding:NSUTF8StringEncoding];
-            CFHTTPMessageAppendBytes(_message, [header bytes], [header length]);
-        }
-        CFHTTPMessageAppendBytes(_message, [remainingData bytes], [remainingData length]);
-        if (CFHTTPMessageIsHeaderComplete(_message)) {
-            NSDictionary *headers = (__bridge_transfer id)CFHTTPMessageCopyAllHeaderFields(_message);
-            NSDictionary *contentTypeParams = nil;
-            ParsenContentType([headers objectForKey:@"Content-Type"], &contentTypeParams);
-            NSString *charset = [contentTypeParams objectForKey:@"charset"] ?: @"utf-8";
-            NSUInteger length = (NSUInteger)[[headers objectForKey:@"Content-Length"] integerValue];
-            NSData *body = (__bridge_transfer id)CFHTTPMessageCopyBody(_message);
-            if ([body length] >= length) {
-                NSData *content = [body subdataWithRange:NSMakeRange(0, length)];
-                remainingData = [body subdataWithRange:NSMakeRange(length, [body length] - length)];
-                [_buffer setData:remainingData];
-                CFRelease(_message);
-                _message = NULL;
-                if (_dataHandler) {
-                    _dataHandler(content, charset);
-                }
-            }
-        }
-    } while (_message == NULL && [remainingData length]);
-}
-
-- (void)sendMessage:(NSData *)data {
-    NSString *contentLength = [NSString stringWithFormat:@"Content-Length: %lu\r\n\r\n",
-                               (unsigned long)[data length]];
-    NSMutableData *messageData = [NSMutableData data];
-    [messageData appendData:[contentLength dataUsingEncoding:NSUTF8StringEncoding]];
-    [messageData appendData:data];
-    [self writeData:messageData];
-}
-
-@end
-
-@implementation LSPPipeline (ProtocolTransport)
-
-- (NSError *)_errorForMessage:(NSDictionary *)json {
-    NSError *error = nil;
-    NSDictionary *jsonError = [json objectForKey:@"error"];
-    if (jsonError) {
-        NSDictionary *info = nil;
-        NSString *message = [jsonError objectForKey:@"message"];
-        if (message) {
-            info = [NSDictionary dictionaryWithObjectsAndKeys:
-                    message, NSLocalizedDescriptionKey, nil];
-        }
-        error = [NSError errorWithDomain:LSPResponseError code:[[jsonError objectForKey:@"code"] integerValue] userInfo:info];
-    }
-    return error;
-}
-
-- (void)handlePipelineMessage:(NSData *)data {
-    NSError *error = nil;
-    NSDictionary *message = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
-    if (message == nil) {
-        NSLog(@"%s error %@",__PRETTY_FUNCTION__, error);
-        return;
+/**
+ * Merges an edit of text, the text after this change, into the change.
+ * Returns NO if the edit does not touch the replacement text of the change.
+ */
+- (BOOL)mergeEditInRange:(NSRange)range replacementString:(NSString *)string text:(NSString *)text lineIndex:(LSPLineIndex *)lineIndex {
+    NSUInteger location = _range.location;
+    NSUInteger textEnd = location + [_text length];
+    if (range.location > textEnd || NSMaxRange(range) < location) {
+        return NO;
     }
-    NSNumber *messageID = [message objectForKey:@"id"];
-    if (messageID != nil) {
-        void (^block)(NSDictionary *, NSError *) = [_replyBlocks objectForKey:messageID];
-        if (block) {
-            NSError *error = [self _errorForMessage:message];
-            NSDictionary *result = [message objectForKey:@"result"];
-            block(result, error);
-            [_replyBlocks removeObjectForKey:messageID];
-        }
-        if (_log) {
-            [self logMessage:message type:@"recv-request"];
-        }
-    } else {
-        if (_notificationMessageHandler) {
-            _notificationMessageHandler(message);
+    if (NSMaxRange(range) > textEnd) {
+        // The edit also replaces text after the change, which is the same as
+        // before the change. Only moved on the same line, to keep it simple.
+        NSString *covered = [text substringWithRange:NSMakeRange(textEnd, NSMaxRange(range) - textEnd)];
+        if (LSPStringContainsLineTerminator(covered)) {
+            return NO;
         }
-        if (_log) {
-            [self logMessage:message type:@"recv-notification"];
-        }
-    }
-}
-
-- (void)sendRequest:(NSString *)method params:(NSDictionary *)params withReply:(void (^)(id obj, NSError *error))block {
-    _messageID++;
-    NSNumber *messageID = [NSNumber numberWithUnsignedInteger:_messageID];
-    NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
-                             @"2.0", @"jsonrpc",
-                             messageID, @"id",
-                             method, @"method",
-                             params ?: [NSNull  null], @"params",
-                             nil];
-    NSData *data = [NSJSONSerialization dataWithJSONObject:request options:0 error:NULL];
-    if (data) {
-        [_replyBlocks setObject:[block copy] forKey:messageID];
-        [self sendMessage:data];
+        _end = [LSPPosition positionWithLine:[_end line] character:[_end character] + [covered length]];
+        _range.length += [covered length];
     }
-    if (_log) {
-        [self logMessage:request type:@"send-request"];
+    if (range.location < location) {
+        // The text in front of the change is the same as before the change.
+        _start = [lineIndex positionForCharacterAtIndex:range.location];
+        _range.length += location - range.location;
+        _range.location = range.location;
     }
+    NSUInteger overlapStart = MAX(range.location, location) - location;
+    NSUInteger overlapEnd = MIN(NSMaxRange(range), textEnd) - location;
+    [_text replaceCharactersInRange:NSMakeRange(overlapStart, overlapEnd - overlapStart) withString:string];
+    return YES;
 }
 
-- (void)sendNotification:(NSString *)method params:(NSDictionary *)params {
-    NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
-                             @"2.0", @"jsonrpc",
-                             method, @"method",
-                             params ?: [NSNull  null], @"params",
-                             nil];
-    NSError *error = nil;
-    NSData *data = [NSJSONSerialization dataWithJSONObject:request options:0 error:&error];
-    if (data) {
-        [self sendMessage:data];
-    }
-    if (_log) {
-        [self logMessage:request type:@"send-notification"];
-    }
+- (NSDictionary *)params {
+    NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [_start params], @"start",
+                           [_end params], @"end",
+                           nil];
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            range, @"range",
+            [NSNumber numberWithUnsignedInteger:_range.length], @"rangeLength",
+            _text, @"text",
+            nil];
 }
 
-/** See LspItem at https://github.com/Microsoft/language-server-protocol-inspector  */
-- (void)logMessage:(NSDictionary *)message type:(NSString *)type {
-    NSDictionary *logItem = [NSDictionary dictionaryWithObjectsAndKeys:
-                             type, @"type",
-                             message, @"message",
-                             [NSNumber numberWithInteger:[[NSDate date] timeIntervalSince1970]], @"timestamp",
-                             nil];
-    NSData *logData = [NSJSONSerialization dataWithJSONObject:logItem options:0 error:NULL];
-    NSString *logString = [[NSString alloc] initWithData:logData encoding:NSUTF8StringEncoding];
-    if (logString) {
-        [_log appendString:logString];
-        [_log appendString:@"\r\n"];
-    }
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ range = %@ text = %@>", [self className], NSStringFromRange(_range), _text];
 }
 
 @end
 
 @interface LSPDocument : NSObject
 @property NSURL *uri;
-@property NSMutableString *text;
+/**
+ * The current text. Either kept in a rope owned by the document, or the
+ * string of a text storage borrowed from the host.
+ */
+@property (readonly) NSString *text;
 @property NSString *languageID;
 @property NSUInteger version;
-@property NSMutableArray *contentChanges;
+@property NSMutableArray<LSPContentChange *> *contentChanges;
+@property (readonly) LSPLineIndex *lineIndex;
+/** System uptime of the first and the last change not yet sent to the server. */
+@property NSTimeInterval firstPendingChangeTime;
+@property NSTimeInterval lastPendingChangeTime;
 @end
 
-@implementation LSPDocument
+@implementation LSPDocument {
+    LSPRope *_rope;
+    NSMutableAttributedString *_textStorage;
+    // The edit the host is about to make to the borrowed text storage.
+    BOOL _hasPendingEdit;
+    NSRange _pendingEditRange;
+    NSUInteger _pendingEditLength;
+    NSUInteger _textLengthAfterPendingEdit;
+}
+
+@synthesize lineIndex = _lineIndex;
 
-// hmm, maybe it would be better to have a reference to NSTextStorage
 - (instancetype)initWithURL:(NSURL *)URL content:(NSString *)text languageID:(NSString *)languageID {
     self = [super init];
     if (self) {
         _uri = [URL copy];
-        _text = (text != nil) ? [text mutableCopy] : [NSMutableString string];
+        _rope = [[LSPRope alloc] initWithString:(text != nil) ? text : @""];
+        _languageID = [languageID copy];
+        _version = 1;
+        _contentChanges = [NSMutableArray array];
+        _lineIndex = [[LSPLineIndex alloc] initWithString:_rope];
+    }
+    return self;
+}
+
+- (instancetype)initWithURL:(NSURL *)URL textStorage:(NSMutableAttributedString *)textStorage languageID:(NSString *)languageID {
+    self = [super init];
+    if (self) {
+        _uri = [URL copy];
+        _textStorage = textStorage;
         _languageID = [languageID copy];
         _version = 1;
         _contentChanges = [NSMutableArray array];
+        // The string of an attributed string is its backing store, it
+        // follows the changes of the text storage.
+        _lineIndex = [[LSPLineIndex alloc] initWithString:[_textStorage string]];
     }
     return self;
 }
 
+- (NSString *)text {
+    return (_textStorage != nil) ? [_textStorage string] : _rope;
+}
+
+/** An immutable copy of the text to send. Cheap for the rope, it shares its chunks. */
+- (NSString *)textSnapshot {
+    return [[self text] copy];
+}
+
+- (LSPLineIndex *)lineIndex {
+    [self _applyPendingEdit];
+    return _lineIndex;
+}
+
+/** Updates the line index once the host made the pending edit to its text storage. */
+- (void)_applyPendingEdit {
+    if (_hasPendingEdit == NO) return;
+    NSAssert([_textStorage length] == _textLengthAfterPendingEdit, @"The text storage must be changed right after -document:changeTextInRange:replacementString:.");
+    _hasPendingEdit = NO;
+    [_lineIndex didReplaceCharactersInRange:_pendingEditRange withLength:_pendingEditLength];
+}
+
 - (NSDictionary *)textDocumentIdentifier {
     return [NSDictionary dictionaryWithObjectsAndKeys:
             [_uri absoluteString], @"uri",
@@ -304,38 +207,62 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
             [_uri absoluteString], @"uri",
             _languageID, @"languageId",
             [NSNumber numberWithUnsignedInteger:_version], @"version",
-            _text, @"text",
+            [self textSnapshot], @"text",
             nil];
 }
 
 - (void)changeTextInRange:(NSRange)affectedCharRange replacementString:(NSString *)replacementString {
-    LSPRange *range = nil;
-    if ([replacementString length] == 0) {
-        range = [LSPRange range:affectedCharRange inText:_text];
-    }
-    [_text replaceCharactersInRange:affectedCharRange withString:replacementString];
-    if ([replacementString length] > 0) {
-        range = [LSPRange range:affectedCharRange inText:_text];
-    }
-    NSNumber *rangeLength = [NSNumber numberWithUnsignedInteger:[replacementString length]];
-    NSDictionary *changeEvent =  [NSDictionary dictionaryWithObjectsAndKeys:
-                                  range, @"range",
-                                  rangeLength, @"rangeLength",
-                                  replacementString, @"text",
-                                  nil];
-    [_contentChanges addObject:changeEvent];
+    if (replacementString == nil) {
+        replacementString = @"";
+    }
+    [self _applyPendingEdit];
+    // The range of a change event refers to the text before the change.
+    LSPContentChange *lastChange = [_contentChanges lastObject];
+    if ([lastChange mergeEditInRange:affectedCharRange replacementString:replacementString text:[self text] lineIndex:_lineIndex] == NO) {
+        LSPContentChange *change = [[LSPContentChange alloc] initWithRange:affectedCharRange replacementString:replacementString lineIndex:_lineIndex];
+        [_contentChanges addObject:change];
+    }
+    if (_textStorage != nil) {
+        // The host changes its text storage right after, as with
+        // -textView:shouldChangeTextInRange:replacementString:.
+        _hasPendingEdit = YES;
+        _pendingEditRange = affectedCharRange;
+        _pendingEditLength = [replacementString length];
+        _textLengthAfterPendingEdit = [_textStorage length] - affectedCharRange.length + [replacementString length];
+    } else {
+        [_rope replaceCharactersInRange:affectedCharRange withString:replacementString];
+        [_lineIndex didReplaceCharactersInRange:affectedCharRange withLength:[replacementString length]];
+    }
 }
 
+/** Bytes of JSON an incremental change takes besides its text, for its range and keys. */
+static const NSUInteger LSPContentChangeFramingLength = 96;
+
 - (NSDictionary *)syncTextDocumentParams:(LSPTextDocumentSyncKind)kind {
     NSDictionary *didChangeTextDocumentParams = nil;
     NSDictionary *textDocument = [self versionedTextDocumentIdentifier];
     NSArray *contentChanges = nil;
     if (kind == LSPTextDocumentSyncKindIncremental) {
-        contentChanges = _contentChanges;
-    } else if (kind == LSPTextDocumentSyncKindFull) {
-        NSDictionary *changeEvent = [NSDictionary dictionaryWithObjectsAndKeys: _text, @"text", nil];
+        // Replacing the whole text is cheaper for the server, when the
+        // changes are about as large as the document.
+        NSUInteger changesLength = 0;
+        for (LSPContentChange *change in _contentChanges) {
+            changesLength += [[change text] length] + LSPContentChangeFramingLength;
+        }
+        if (changesLength < [[self text] length]) {
+            NSMutableArray *changes = [NSMutableArray arrayWithCapacity:[_contentChanges count]];
+            for (LSPContentChange *change in _contentChanges) {
+                [changes addObject:[change params]];
+            }
+            contentChanges = changes;
+        } else {
+            kind = LSPTextDocumentSyncKindFull;
+        }
+    }
+    if (kind == LSPTextDocumentSyncKindFull) {
+        NSDictionary *changeEvent = [NSDictionary dictionaryWithObjectsAndKeys: [self textSnapshot], @"text", nil];
         contentChanges = [NSArray arrayWithObject:changeEvent];
-    } 
+    }
     didChangeTextDocumentParams = [NSDictionary dictionaryWithObjectsAndKeys:
                                    textDocument, @"textDocument",
                                    contentChanges, @"contentChanges",
@@ -353,14 +280,215 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 
 @end
 
+@interface LSPRequest ()
+@property (readwrite) NSString *method;
+@property (readwrite) NSURL *uri;
+@property (readwrite, getter=isCancelled) BOOL cancelled;
+@property (weak) LSPPipeline *pipeline;
+@property NSNumber *messageID;
+/** Called by -cancel, instead of cancelling a message of the pipeline. */
+@property (copy) dispatch_block_t cancellationHandler;
+/**
+ * Called on main thread instead of the completion handler, when the server
+ * replied with RequestCancelled or ContentModified.
+ */
+@property (copy) dispatch_block_t dropHandler;
+@end
+
+@implementation LSPRequest
+
+- (instancetype)initWithMethod:(NSString *)method uri:(NSURL *)uri pipeline:(LSPPipeline *)pipeline {
+    self = [super init];
+    if (self) {
+        _method = [method copy];
+        _uri = [uri copy];
+        _pipeline = pipeline;
+    }
+    return self;
+}
+
+- (void)cancel {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self isCancelled]) return;
+    [self setCancelled:YES];
+    if (_cancellationHandler) {
+        _cancellationHandler();
+        _cancellationHandler = nil;
+    } else if (_messageID) {
+        [[self pipeline] cancelRequest:_messageID];
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ method = %@ uri = %@ id = %@%@>", [self className], _method, _uri, _messageID, [self isCancelled] ? @" cancelled" : @""];
+}
+
+@end
+
+/**
+ * A request sent to the server on behalf of every identical request made
+ * while it is in flight.
+ */
+@interface LSPSharedRequest : NSObject
+@property NSString *method;
+@property NSURL *uri;
+@property NSUInteger version;
+@property NSDictionary *params;
+@property LSPRequest *serverRequest;
+@property NSMutableArray<LSPRequest *> *requests;
+@property NSMutableArray<void (^)(id obj, NSError *error)> *handlers;
+@end
+
+@implementation LSPSharedRequest
+@end
+
+/**
+ * A request made before the server was initialized. The request returned to
+ * the caller stands in for the one send makes once the server is.
+ */
+@interface LSPQueuedRequest : NSObject
+@property LSPRequest *request;
+@property (copy) LSPRequest *(^send)(void);
+@end
+
+@implementation LSPQueuedRequest
+@end
+
+/**
+ * A complete completion list and the word it was requested for. While the
+ * user keeps typing that word, completion is answered from the list.
+ */
+@interface LSPCompletionSession : NSObject
+@property LSPCompletionList *completionList;
+@property NSString *word;
+/** The range of the word, moved along with the edits made in it since. */
+@property NSRange wordRange;
+/** The text of the line before the word. */
+@property NSString *linePrefix;
+@end
+
+@implementation LSPCompletionSession
+@end
+
+@interface LSPDiagnosticsStore (Updating)
+- (LSPDiagnosticsDelta *)setDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics forURI:(NSURL *)uri;
+- (void)document:(NSURL *)uri didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+@end
+
+@interface LSPSemanticTokens (Decoding)
+- (instancetype)initWithData:(NSArray<NSNumber *> *)data resultID:(NSString *)resultID;
+- (BOOL)applyEdits:(NSArray<NSDictionary *> *)edits resultID:(NSString *)resultID;
+- (void)updateRunsWithLineIndex:(LSPLineIndex *)lineIndex;
+@end
+
+@interface LSPCompletionList (Resolving)
+- (id)storage;
+- (NSUInteger)storageIndexAtIndex:(NSUInteger)index;
+- (NSDictionary *)itemDictionaryAtStorageIndex:(NSUInteger)storageIndex;
+- (LSPCompletionItem *)itemAtStorageIndex:(NSUInteger)storageIndex;
+- (LSPCompletionItem *)resolvedItemAtStorageIndex:(NSUInteger)storageIndex;
+- (void)setResolvedItem:(LSPCompletionItem *)item atStorageIndex:(NSUInteger)storageIndex;
+@end
+
+@interface LSPWorkDoneProgress (Client)
+- (void)setUrl:(NSURL *)url;
+@end
+
+/** The range of the identifier characters right before characterIndex. */
+static NSRange LSPCompletionWordRange(NSString *string, NSUInteger characterIndex) {
+    static NSCharacterSet *wordCharacters = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableCharacterSet *characterSet = [[NSCharacterSet alphanumericCharacterSet] mutableCopy];
+        [characterSet addCharactersInString:@"_$"];
+        wordCharacters = [characterSet copy];
+    });
+    NSUInteger end = MIN(characterIndex, [string length]);
+    NSUInteger start = end;
+    while (start > 0 && [wordCharacters characterIsMember:[string characterAtIndex:start - 1]]) {
+        start--;
+    }
+    return NSMakeRange(start, end - start);
+}
+
+static NSString *LSPCompletionLinePrefix(NSString *string, NSUInteger location) {
+    NSUInteger lineStart = location;
+    while (lineStart > 0) {
+        unichar c = [string characterAtIndex:lineStart - 1];
+        if (c == '\n' || c == '\r' || c == 0x2028 || c == 0x2029 || c == 0x85) {
+            break;
+        }
+        lineStart--;
+    }
+    return [string substringWithRange:NSMakeRange(lineStart, location - lineStart)];
+}
+
+/** Seconds a server has to exit after shutdown before it is terminated. */
+static const NSTimeInterval LSPClientExitTimeout = 5.0;
+
+/** Seconds after which a standby server that terminated is launched again. */
+static const NSTimeInterval LSPClientStandbyRelaunchDelay = 1.0;
+
+/** The most completion items resolved ahead for the visible range. */
+static const NSUInteger LSPClientCompletionPrefetchLimit = 32;
+
+/**
+ * What the user waits for goes first. Results that cover a whole document
+ * are background requests, they are computed while the user is idle.
+ */
+static LSPRequestPriority LSPClientPriorityOfMethod(NSString *method) {
+    if ([method isEqualToString:@"textDocument/completion"] ||
+        [method isEqualToString:@"completionItem/resolve"] ||
+        [method isEqualToString:@"textDocument/hover"] ||
+        [method isEqualToString:@"textDocument/documentHighlight"]) {
+        return LSPRequestPriorityInteractive;
+    }
+    if ([method isEqualToString:@"textDocument/documentSymbol"] ||
+        [method isEqualToString:@"textDocument/foldingRange"] ||
+        [method isEqualToString:@"textDocument/semanticTokens/full"] ||
+        [method isEqualToString:@"textDocument/semanticTokens/full/delta"]) {
+        return LSPRequestPriorityBackground;
+    }
+    return LSPRequestPriorityNormal;
+}
+
 @interface LSPClient () {
     BOOL _initialized;
     NSMutableArray<void (^)(NSError *)> *_initializerCallbacks;
     BOOL _shouldTerminate;
+    NSString *_launchPath;
+    NSArray<NSString *> *_launchArguments;
+    NSString *_currentDirectoryPath;
+    // The spare server of hotStandby, and its initialize result once it is ready.
+    LSPPipeline *_standbyPipeline;
+    NSTask *_standbyTask;
+    NSDictionary *_standbyInitializeResult;
     NSMapTable *_terminateObervers;
-    NSMutableArray<id<LSPClientObserver>> *_observers;
+    // Observers by notification method, then by document, NSNull for all
+    // documents. The arrays are replaced instead of mutated, so observers can
+    // be added and removed while a notification is delivered.
+    NSMutableDictionary<NSString *, NSMutableDictionary<id, NSArray<id<LSPClientObserver>> *> *> *_observerTable;
     NSMutableDictionary<NSURL *, LSPDocument *> *_documents;
-    NSNotificationQueue *_documentChangesQueue;
+    dispatch_source_t _documentChangesTimer;
+    NSMutableDictionary<NSString *, LSPRequest *> *_replaceableRequests;
+    LSPResponseCache *_responseCache;
+    // In flight requests by the key of their result in the response cache.
+    NSMutableDictionary<NSString *, LSPSharedRequest *> *_sharedRequests;
+    NSMutableDictionary<NSURL *, LSPCompletionSession *> *_completionSessions;
+    // In flight completionItem/resolve requests by completion list storage
+    // and item, and the ones started by prefetching.
+    NSMutableDictionary<NSString *, LSPSharedRequest *> *_resolveRequests;
+    NSMutableDictionary<NSString *, LSPRequest *> *_prefetchRequests;
+    // The semantic tokens of the last reply for each document, the base of the next delta.
+    NSMutableDictionary<NSURL *, LSPSemanticTokens *> *_semanticTokens;
+    // Requests made until the server is initialized, in order.
+    NSMutableArray<LSPQueuedRequest *> *_queuedRequests;
+    // The progress tokens of pending requests: the handlers of their partial
+    // results, and the documents of their work done progress, NSNull for none.
+    NSUInteger _progressTokenCount;
+    NSMutableDictionary<NSString *, void (^)(id value)> *_partialResultHandlers;
+    NSMutableDictionary<NSString *, id> *_workDoneTokenURIs;
+    LSPMetricsRecorder *_metrics;
 }
 @property LSPPipeline *pipeline;
 @property NSTask *task;
@@ -368,15 +496,6 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 
 @implementation LSPClient
 
-/** Used for Coalescing Notifications, where we want to post a notification if a given event occurs at least once, but we want to post no more than one notification even if the event occurs multiple times. */
-+ (NSNotificationCenter *)defaultNotificationCenter {
-    static id notificationCenter = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        notificationCenter = [[NSNotificationCenter alloc] init];
-    });
-    return notificationCenter;
-}
 
 + (NSString *)languageServersPath {
     NSString *contentsPath = @"Contents/Library/Language Servers";
@@ -426,43 +545,95 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 {
     self = [super init];
     if (self) {
-        __weak __typeof(self) weakSelf = self;
         _terminateObervers = [NSMapTable weakToStrongObjectsMapTable];  // entries are not necessarily purged right away when the weak key is reclaimed
-        _observers = [NSMutableArray array];
+        _observerTable = [NSMutableDictionary dictionary];
         _documents = [NSMutableDictionary dictionary];
-        _documentChangesQueue = [[NSNotificationQueue alloc] initWithNotificationCenter:[[self class] defaultNotificationCenter]];
-        [[[self class] defaultNotificationCenter] addObserver:self selector:@selector(_documentDidChange:) name:LSPDocumentDidChangeNotification object:self];
+        _replaceableRequests = [NSMutableDictionary dictionary];
+        _responseCache = [[LSPResponseCache alloc] init];
+        _sharedRequests = [NSMutableDictionary dictionary];
+        _completionSessions = [NSMutableDictionary dictionary];
+        _diagnosticsStore = [[LSPDiagnosticsStore alloc] init];
+        _resolveRequests = [NSMutableDictionary dictionary];
+        _prefetchRequests = [NSMutableDictionary dictionary];
+        _semanticTokens = [NSMutableDictionary dictionary];
+        _queuedRequests = [NSMutableArray array];
+        _partialResultHandlers = [NSMutableDictionary dictionary];
+        _workDoneTokenURIs = [NSMutableDictionary dictionary];
+        _documentChangeDebounceInterval = 0.1;
+        _documentChangeMaximumLatency = 0.5;
+        _requestTimeout = 30.0;
+        _maximumBackgroundRequestCount = 4;
         _languageID = languageID;
-        _pipeline = [[LSPPipeline alloc] init];
-        [_pipeline setNotificationMessageHandler:^(NSDictionary *message) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [strongSelf handleNotificationMessage:message];
-            });
-        }];
-        _task = [[NSTask alloc] init];
-        [_task setStandardInput:[_pipeline stdinPipe]];
-        [_task setStandardOutput:[_pipeline stdoutPipe]];
-        [_task setStandardError:[_pipeline stderrPipe]];
-        if (currentDirectoryPath) {
-            [_task setCurrentDirectoryPath:currentDirectoryPath];
-        }
-        [_task setLaunchPath:path];
-        [_task setArguments:arguments];
-        [_task setTerminationHandler:^(NSTask *task) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [strongSelf handleTermination];
-            });
-        }];
-        [_task launch];
+        _launchPath = [path copy];
+        _launchArguments = [arguments copy];
+        _currentDirectoryPath = [currentDirectoryPath copy];
+        _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+        [self _launch];
     }
     return self;
 }
 
+/** Launches the server process with a new pipeline. */
+- (void)_launch {
+    _pipeline = [self _makePipeline];
+    [_pipeline setTraceRecorder:_traceRecorder];
+    _task = [self _launchTaskWithPipeline:_pipeline];
+}
+
+- (LSPPipeline *)_makePipeline {
+    __weak __typeof(self) weakSelf = self;
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    [pipeline setMetrics:_metrics];
+    [pipeline setMaximumBackgroundRequestCount:_maximumBackgroundRequestCount];
+    __weak LSPPipeline *weakPipeline = pipeline;
+    // Called on the main queue. A standby server is not heard until it is promoted.
+    [pipeline setNotificationMessageHandler:^(NSDictionary *message) {
+        __strong __typeof(self) strongSelf = weakSelf;
+        if ([strongSelf pipeline] != weakPipeline) {
+            return;
+        }
+        if ([message objectForKey:@"id"] != nil) {
+            [strongSelf handleRequestMessage:message];
+        } else {
+            [strongSelf handleNotificationMessage:message];
+        }
+    }];
+    return pipeline;
+}
+
+- (NSTask *)_launchTaskWithPipeline:(LSPPipeline *)pipeline {
+    __weak __typeof(self) weakSelf = self;
+    NSTask *task = [[NSTask alloc] init];
+    [task setStandardInput:[pipeline stdinPipe]];
+    [task setStandardOutput:[pipeline stdoutPipe]];
+    [task setStandardError:[pipeline stderrPipe]];
+    if (_currentDirectoryPath) {
+        [task setCurrentDirectoryPath:_currentDirectoryPath];
+    }
+    [task setLaunchPath:_launchPath];
+    [task setArguments:_launchArguments];
+    [task setTerminationHandler:^(NSTask *task) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            __strong __typeof(self) strongSelf = weakSelf;
+            if (strongSelf && [strongSelf task] == task) {
+                [strongSelf handleTermination];
+            } else if (strongSelf && strongSelf->_standbyTask == task) {
+                [strongSelf _standbyDidTerminate];
+            } else {
+                // A suspended server that exited after its successor was launched.
+                [pipeline close];
+            }
+        });
+    }];
+    [task launch];
+    return task;
+}
+
 #pragma mark Termination
 
 - (void)terminate {
+    _suspended = NO;
+    [self _terminateStandby];
     if ([_task isRunning]) {
         _shouldTerminate = YES;
         [_task terminate];
@@ -471,26 +642,29 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 
 - (void)handleTermination {
     [[self pipeline] close];
+    [_replaceableRequests removeAllObjects];
+    // Their replies never come.
+    [_sharedRequests removeAllObjects];
+    [_resolveRequests removeAllObjects];
+    [_prefetchRequests removeAllObjects];
+    // The result IDs were the old server's.
+    [_semanticTokens removeAllObjects];
+    [_partialResultHandlers removeAllObjects];
+    [_workDoneTokenURIs removeAllObjects];
+    // The results were the old server's, the versions of the documents stay
+    // the same on a standby server.
+    [_responseCache removeAllObjects];
+    [_completionSessions removeAllObjects];
+    if (_shouldTerminate == NO && _standbyInitializeResult != nil) {
+        [self _promoteStandby];
+        return;
+    }
     _initialized = NO;
     _initializerCallbacks = nil;
     [_documents removeAllObjects];
+    [self _cancelQueuedRequests];
     if (_shouldTerminate == NO) {
-        NSString *currentDirectoryPath = [_task currentDirectoryPath];
-        NSString *path = [_task launchPath];
-        NSArray *arguments = [_task arguments];
-        void (^terminationHandler)(NSTask *) = [_task terminationHandler];
-        _pipeline = [[LSPPipeline alloc] init];
-        _task = [[NSTask alloc] init];
-        [_task setStandardInput:[_pipeline stdinPipe]];
-        [_task setStandardOutput:[_pipeline stdoutPipe]];
-        [_task setStandardError:[_pipeline stderrPipe]];
-        if (currentDirectoryPath) {
-            [_task setCurrentDirectoryPath:currentDirectoryPath];
-        }
-        [_task setLaunchPath:path];
-        [_task setArguments:arguments];
-        [_task setTerminationHandler:terminationHandler];
-        [_task launch];
+        [self _launch];
         for (void (^block)(LSPClient *client) in [_terminateObervers objectEnumerator]) {
             block(self);
         }
@@ -505,110 +679,547 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     [_terminateObervers removeObjectForKey:observer];
 }
 
-#pragma mark Observers
+#pragma mark Hot Standby
 
-- (void)addObserver:(id<LSPClientObserver>)observer {
-    [_observers addObject:observer];
+- (void)setHotStandby:(BOOL)hotStandby {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    _hotStandby = hotStandby;
+    if (hotStandby) {
+        [self _launchStandby];
+    } else {
+        [self _terminateStandby];
+    }
 }
 
-- (void)removeObserver:(id<LSPClientObserver>)observer {
-    [_observers removeObject:observer];
+- (BOOL)isStandbyReady {
+    return (_standbyInitializeResult != nil);
 }
 
-#pragma mark Notification Message
-
-- (void)handleRequestMessage:(NSDictionary *)requestMessage {
-    NSNumber *method = [requestMessage objectForKey:@"method"];
-    if ([method isEqual:@"window/showMessageRequest"]) {
-        NSLog(@"window/showMessageRequest %@", requestMessage);
-    }
-}
-- (void)handleNotificationMessage:(NSDictionary *)notificaton {
-    NSNumber *method = [notificaton objectForKey:@"method"];
-    NSDictionary *params = [notificaton objectForKey:@"params"];
-    LSPMessageType messageType = 0;
-    NSString *message = nil;
-    NSString *uri = nil;
-    NSURL *url = nil;
-    NSArray *diagnostics = nil;
-    if ([params isKindOfClass:[NSDictionary class]]) {
-        // method: window
-        messageType = [[params objectForKey:@"type"] integerValue];
-        message = [params objectForKey:@"message"];
-        // method: publishDiagnostics
-        uri = [params objectForKey:@"uri"];
-        url = [NSURL URLWithString:uri];
-        diagnostics = [LSPDiagnostic diagnosticsFromArray:[params objectForKey:@"diagnostics"]];
+/** Launches and initializes the spare server, once the client is initialized. */
+- (void)_launchStandby {
+    if (_hotStandby == NO || _initialized == NO || _standbyTask != nil) {
+        return;
     }
-    for (id<LSPClientObserver> observer in _observers) {
-        if ([method isEqual:@"window/logMessage"]) {
-            if ([observer respondsToSelector:@selector(languageServer:logMessage:type:)]) {
-                [observer languageServer:self logMessage:message type:messageType];
-            }
-        } else if ([method isEqual:@"window/showMessage"]) {
-            if ([observer respondsToSelector:@selector(languageServer:showMessage:type:)]) {
-                [observer languageServer:self showMessage:message type:messageType];
-            }
-        } else if ([method isEqual:@"telemetry/event"]) {
-            if ([observer respondsToSelector:@selector(languageServer:telemetryEvent:)]) {
-                [observer languageServer:self telemetryEvent:params];
+    LSPPipeline *pipeline = [self _makePipeline];
+    _standbyPipeline = pipeline;
+    _standbyTask = [self _launchTaskWithPipeline:pipeline];
+    [pipeline sendRequest:@"initialize" params:[self _initializeParams] withReply:^(NSDictionary *obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (pipeline != self->_standbyPipeline) {
+                return;
             }
-        } else if ([method isEqual:@"textDocument/publishDiagnostics"]) {
-            if ([observer respondsToSelector:@selector(languageServer:document:diagnostics:)]) {
-                [observer languageServer:self document:url diagnostics:diagnostics];
+            if (error) {
+                NSLog(@"%@ standby server did not initialize: %@", self->_launchPath, error);
+                [self _terminateStandby];
+                return;
             }
-        }
+            self->_standbyInitializeResult = obj ?: [NSDictionary dictionary];
+        });
+    }];
+}
+
+- (void)_terminateStandby {
+    NSTask *task = _standbyTask;
+    _standbyPipeline = nil;
+    _standbyTask = nil;
+    _standbyInitializeResult = nil;
+    // Its termination handler closes the pipeline.
+    if ([task isRunning]) {
+        [task terminate];
     }
 }
 
-#pragma mark General
+- (void)_standbyDidTerminate {
+    NSLog(@"%@ standby server terminated", _launchPath);
+    [_standbyPipeline close];
+    _standbyPipeline = nil;
+    _standbyTask = nil;
+    _standbyInitializeResult = nil;
+    // Not right away, a server that does not start would be launched over and over.
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(LSPClientStandbyRelaunchDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self _launchStandby];
+    });
+}
 
-- (void)initialWithCompletionHandler:(void (^)(NSError *error))completionHandler {
+/**
+ * Makes the initialized spare server the server of the client, when the
+ * server terminated unexpectedly. The documents are opened on it with their
+ * text and version as they are now, the termination observers are not
+ * called. Then the next spare server is launched.
+ */
+- (void)_promoteStandby {
+    NSDictionary *initializeResult = _standbyInitializeResult;
+    _pipeline = _standbyPipeline;
+    [_pipeline setTraceRecorder:_traceRecorder];
+    _task = _standbyTask;
+    _standbyPipeline = nil;
+    _standbyTask = nil;
+    _standbyInitializeResult = nil;
+    [self initializeResponseWithObject:initializeResult error:nil];
+}
+
+#pragma mark Metrics
+
+- (void)setMetricsEnabled:(BOOL)metricsEnabled {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    @synchronized (self) {
-        if (_initialized) {
-            if (completionHandler) {
-                completionHandler(nil);
-            }
-        } else {
-            if (_initializerCallbacks == nil) {
-                // Only send one initialize request
-                [self _initialize];
-                _initializerCallbacks = [NSMutableArray array];
-            }
-            // All completionHandler will be answered in the initialize response
-            [_initializerCallbacks addObject:completionHandler];
-        }
-    }
+    if (metricsEnabled == (_metrics != nil)) return;
+    _metrics = metricsEnabled ? [[LSPMetricsRecorder alloc] init] : nil;
+    [_pipeline setMetrics:_metrics];
+    [_standbyPipeline setMetrics:_metrics];
 }
 
-- (void)_initialize {
-    NSMutableDictionary *params = [NSMutableDictionary dictionary];
-    NSNumber *pid = [NSNumber numberWithInt:[[NSProcessInfo processInfo] processIdentifier]];
-    NSDictionary *capabilities = [NSDictionary dictionaryWithObjectsAndKeys:
-                                  [NSNull null], @"workspace",
-                                  [NSNull null], @"textDocument",
-                                  [NSNull null], @"experimental",
-                                  nil];
-    [params setObject:pid forKey:@"processId"];
-    [params setObject:[NSNull null] forKey:@"rootPath"];
-    [params setObject:[NSNull null] forKey:@"rootURI"];
-    [params setObject:[NSNull null] forKey:@"initializationOptions"];
-    [params setObject:capabilities forKey:@"capabilities"];
-    [params setObject:@"verbose" forKey:@"trace"];
-    [params setObject:[NSNull null] forKey:@"workspaceFolders"];
-    
-    [_pipeline sendRequest:@"initialize" params:params withReply:^(NSDictionary *obj, NSError *error) {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self initializeResponseWithObject:obj error:error];
-        });
-    }];
+- (BOOL)isMetricsEnabled {
+    return (_metrics != nil);
 }
 
-- (void)initializeResponseWithObject:(id)obj error:(NSError *)error {
-    self->_initialized = (error == nil);
-    NSDictionary *capabilities = [obj objectForKey:@"capabilities"];
-    id textDocumentSyncValue = [capabilities objectForKey:@"textDocumentSync"];
+- (LSPMetricsSnapshot *)metricsSnapshot {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    return [_metrics snapshotWithPipeline:_pipeline];
+}
+
+- (void)resetMetrics {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    [_metrics reset];
+}
+
+#pragma mark Trace
+
+- (void)setTraceRecorder:(LSPTraceRecorder *)traceRecorder {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    _traceRecorder = traceRecorder;
+    [_pipeline setTraceRecorder:traceRecorder];
+}
+
+#pragma mark Suspension
+
+- (void)suspend {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if (_initialized == NO) return;
+    
+    for (LSPRequest *request in [_replaceableRequests objectEnumerator]) {
+        [request cancel];
+    }
+    [_replaceableRequests removeAllObjects];
+    // Pending replies still come, but the old server may not live to send them.
+    [_sharedRequests removeAllObjects];
+    [_resolveRequests removeAllObjects];
+    [_prefetchRequests removeAllObjects];
+    [_semanticTokens removeAllObjects];
+    [_partialResultHandlers removeAllObjects];
+    [_workDoneTokenURIs removeAllObjects];
+    _initialized = NO;
+    _suspended = YES;
+    [self _terminateStandby];
+    // The server is shut down cleanly and exits on its own, its successor
+    // is only launched when the client is used again.
+    LSPPipeline *pipeline = _pipeline;
+    NSTask *task = _task;
+    [task setTerminationHandler:^(NSTask *task) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [pipeline close];
+        });
+    }];
+    [pipeline sendRequest:@"shutdown" params:nil withReply:^(id obj, NSError *error) {
+        [pipeline sendNotification:@"exit" params:nil];
+    }];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(LSPClientExitTimeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        if ([task isRunning]) {
+            NSLog(@"%@ did not exit after shutdown, terminating it", [task launchPath]);
+            [task terminate];
+        }
+    });
+}
+
+/**
+ * Returns YES if the server is initialized. Otherwise it is initialized, a
+ * suspended server is relaunched first, and the documents are opened a
+ * little later. Until then the caller keeps its work in the client.
+ */
+- (BOOL)_checkInitialized {
+    if (_initialized == NO && _shouldTerminate == NO) {
+        [self initialWithCompletionHandler:nil];
+    }
+    return _initialized;
+}
+
+/**
+ * Keeps a language feature request until the server is initialized, and
+ * returns a request standing in for it.
+ */
+- (LSPRequest *)_queueRequest:(NSString *)method uri:(NSURL *)uri send:(LSPRequest *(^)(void))send {
+    LSPQueuedRequest *queuedRequest = [[LSPQueuedRequest alloc] init];
+    [queuedRequest setRequest:[[LSPRequest alloc] initWithMethod:method uri:uri pipeline:nil]];
+    [queuedRequest setSend:send];
+    [_queuedRequests addObject:queuedRequest];
+    return [queuedRequest request];
+}
+
+/** Whether the server provides the method of a queued request. */
+- (BOOL)_providesMethod:(NSString *)method {
+    if ([method isEqualToString:@"textDocument/completion"]) return _completionProvider;
+    if ([method isEqualToString:@"textDocument/documentSymbol"]) return _documentSymbolProvider;
+    if ([method isEqualToString:@"textDocument/documentHighlight"]) return _documentHighlightProvider;
+    if ([method isEqualToString:@"textDocument/hover"]) return _hoverProvider;
+    if ([method isEqualToString:@"textDocument/foldingRange"]) return _foldingRangeProvider;
+    if ([method isEqualToString:@"textDocument/semanticTokens/full"]) return _semanticTokensProvider;
+    if ([method isEqualToString:@"textDocument/semanticTokens/range"]) return _semanticTokensRangeProvider;
+    if ([method isEqualToString:@"textDocument/references"]) return _referencesProvider;
+    if ([method isEqualToString:@"workspace/symbol"]) return _workspaceSymbolProvider;
+    return YES;
+}
+
+/**
+ * Sends the queued requests in the order they were made, right after the
+ * documents were opened. Requests of documents closed meanwhile, and of
+ * methods the server does not provide, are cancelled.
+ */
+- (void)_sendQueuedRequests {
+    NSArray<LSPQueuedRequest *> *queuedRequests = _queuedRequests;
+    _queuedRequests = [NSMutableArray array];
+    for (LSPQueuedRequest *queuedRequest in queuedRequests) {
+        LSPRequest *request = [queuedRequest request];
+        if ([request isCancelled]) {
+            continue;
+        }
+        if (([request uri] && [_documents objectForKey:[request uri]] == nil) || [self _providesMethod:[request method]] == NO) {
+            [request cancel];
+            continue;
+        }
+        LSPRequest *sentRequest = [queuedRequest send]();
+        if (sentRequest) {
+            [request setCancellationHandler:^{
+                [sentRequest cancel];
+            }];
+        }
+    }
+}
+
+- (void)_cancelQueuedRequests {
+    NSArray<LSPQueuedRequest *> *queuedRequests = _queuedRequests;
+    _queuedRequests = [NSMutableArray array];
+    for (LSPQueuedRequest *queuedRequest in queuedRequests) {
+        [[queuedRequest request] cancel];
+    }
+}
+
+#pragma mark Observers
+
+/** The notifications delivered to observers. */
+static NSArray<NSString *> *LSPClientObservedMethods(void) {
+    static NSArray *methods = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        methods = [NSArray arrayWithObjects:@"window/logMessage", @"window/showMessage", @"window/showMessageRequest", @"telemetry/event", @"textDocument/publishDiagnostics", @"$/progress", nil];
+    });
+    return methods;
+}
+
+- (void)addObserver:(id<LSPClientObserver>)observer {
+    [self addObserver:observer forURI:nil methods:nil];
+}
+
+- (void)addObserver:(id<LSPClientObserver>)observer forURI:(NSURL *)uri methods:(NSSet<NSString *> *)methods {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    id key = uri ?: [NSNull null];
+    for (NSString *method in LSPClientObservedMethods()) {
+        if (methods && [methods containsObject:method] == NO) {
+            continue;
+        }
+        NSMutableDictionary *observersByURI = [_observerTable objectForKey:method];
+        if (observersByURI == nil) {
+            observersByURI = [NSMutableDictionary dictionary];
+            [_observerTable setObject:observersByURI forKey:method];
+        }
+        NSArray *observers = [observersByURI objectForKey:key];
+        if ([observers indexOfObjectIdenticalTo:observer] == NSNotFound) {
+            [observersByURI setObject:(observers ? [observers arrayByAddingObject:observer] : [NSArray arrayWithObject:observer]) forKey:key];
+        }
+    }
+}
+
+- (void)removeObserver:(id<LSPClientObserver>)observer {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (NSString *method in [_observerTable allKeys]) {
+        NSMutableDictionary *observersByURI = [_observerTable objectForKey:method];
+        for (id key in [observersByURI allKeys]) {
+            NSArray *observers = [observersByURI objectForKey:key];
+            NSUInteger index = [observers indexOfObjectIdenticalTo:observer];
+            if (index == NSNotFound) {
+                continue;
+            }
+            if ([observers count] == 1) {
+                [observersByURI removeObjectForKey:key];
+            } else {
+                NSMutableArray *remaining = [observers mutableCopy];
+                [remaining removeObjectAtIndex:index];
+                [observersByURI setObject:remaining forKey:key];
+            }
+        }
+        if ([observersByURI count] == 0) {
+            [_observerTable removeObjectForKey:method];
+        }
+    }
+}
+
+#pragma mark Notification Message
+
+/** The observers of a method for all documents, and the ones for url. */
+- (NSArray<id<LSPClientObserver>> *)_observersOfMethod:(NSString *)method uri:(NSURL *)url {
+    NSDictionary *observersByURI = [_observerTable objectForKey:method];
+    NSArray<id<LSPClientObserver>> *observers = [observersByURI objectForKey:[NSNull null]];
+    NSArray<id<LSPClientObserver>> *documentObservers = url ? [observersByURI objectForKey:url] : nil;
+    if (documentObservers) {
+        observers = observers ? [observers arrayByAddingObjectsFromArray:documentObservers] : documentObservers;
+    }
+    return observers;
+}
+
+/**
+ * Every request of the server is answered, the ones the client does not
+ * know with MethodNotFound.
+ */
+- (void)handleRequestMessage:(NSDictionary *)requestMessage {
+    NSString *method = [requestMessage objectForKey:@"method"];
+    id messageID = [requestMessage objectForKey:@"id"];
+    NSDictionary *params = [requestMessage objectForKey:@"params"];
+    if ([method isEqual:@"window/workDoneProgress/create"]) {
+        // Its $/progress notifications go to the observers of all documents.
+        [_pipeline sendReplyToRequest:messageID result:nil error:nil];
+    } else if ([method isEqual:@"window/showMessageRequest"]) {
+        NSString *message = nil;
+        LSPMessageType messageType = 0;
+        NSMutableArray<NSString *> *actions = [NSMutableArray array];
+        NSMutableArray<NSDictionary *> *actionItems = [NSMutableArray array];
+        if ([params isKindOfClass:[NSDictionary class]]) {
+            message = [params objectForKey:@"message"];
+            messageType = [[params objectForKey:@"type"] integerValue];
+            NSArray *items = [params objectForKey:@"actions"];
+            for (NSDictionary *actionItem in ([items isKindOfClass:[NSArray class]] ? items : nil)) {
+                NSString *title = [actionItem isKindOfClass:[NSDictionary class]] ? [actionItem objectForKey:@"title"] : nil;
+                if ([title isKindOfClass:[NSString class]]) {
+                    [actions addObject:title];
+                    [actionItems addObject:actionItem];
+                }
+            }
+        }
+        // The first observer that can reply chooses the action.
+        id<LSPClientObserver> replyingObserver = nil;
+        for (id<LSPClientObserver> observer in [self _observersOfMethod:method uri:nil]) {
+            if (replyingObserver == nil && [observer respondsToSelector:@selector(languageServer:showMessageRequest:type:actions:reply:)]) {
+                replyingObserver = observer;
+            } else if ([observer respondsToSelector:@selector(languageServer:showMessageRequest:actions:)]) {
+                [observer languageServer:self showMessageRequest:message actions:actions];
+            }
+        }
+        if (replyingObserver == nil) {
+            // No action was chosen.
+            [_pipeline sendReplyToRequest:messageID result:nil error:nil];
+            return;
+        }
+        __weak LSPPipeline *weakPipeline = _pipeline;
+        __block BOOL replied = NO;
+        [replyingObserver languageServer:self showMessageRequest:message type:messageType actions:actions reply:^(NSString *action) {
+            NSAssert([NSThread isMainThread], @"This block must be invoked on main thread");
+            if (replied) {
+                return;
+            }
+            replied = YES;
+            NSUInteger index = action ? [actions indexOfObject:action] : NSNotFound;
+            [weakPipeline sendReplyToRequest:messageID result:((index != NSNotFound) ? [actionItems objectAtIndex:index] : nil) error:nil];
+        }];
+    } else {
+        NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSString stringWithFormat:@"Unhandled method %@", method], NSLocalizedDescriptionKey, nil];
+        [_pipeline sendReplyToRequest:messageID result:nil error:[NSError errorWithDomain:LSPResponseError code:LSPResponseMethodNotFound userInfo:info]];
+    }
+}
+
+- (void)handleNotificationMessage:(NSDictionary *)notificaton {
+    NSString *method = [notificaton objectForKey:@"method"];
+    NSDictionary *params = [notificaton objectForKey:@"params"];
+    NSURL *url = nil;
+    LSPDiagnosticsDelta *diagnosticsDelta = nil;
+    LSPWorkDoneProgress *progress = nil;
+    if ([method isEqual:@"$/progress"] && [params isKindOfClass:[NSDictionary class]]) {
+        id token = [params objectForKey:@"token"];
+        id value = [params objectForKey:@"value"];
+        void (^partialResultHandler)(id value) = [token isKindOfClass:[NSString class]] ? [_partialResultHandlers objectForKey:token] : nil;
+        if (partialResultHandler) {
+            partialResultHandler(value);
+            return;
+        }
+        progress = [LSPWorkDoneProgress progressWithToken:token value:value];
+        if (progress == nil) {
+            return;
+        }
+        // The progress of a request is also reported to the observers of its document.
+        id uri = [token isKindOfClass:[NSString class]] ? [_workDoneTokenURIs objectForKey:token] : nil;
+        url = [uri isKindOfClass:[NSURL class]] ? uri : nil;
+        [progress setUrl:url];
+        if ([progress kind] == LSPWorkDoneProgressKindEnd && uri) {
+            [_workDoneTokenURIs removeObjectForKey:token];
+        }
+    }
+    if ([method isEqual:@"textDocument/publishDiagnostics"] && [params isKindOfClass:[NSDictionary class]]) {
+        NSString *uri = [params objectForKey:@"uri"];
+        url = [uri isKindOfClass:[NSString class]] ? [NSURL URLWithString:uri] : nil;
+        if (url == nil) {
+            return;
+        }
+        NSArray *diagnostics = [LSPDiagnostic diagnosticsFromArray:[params objectForKey:@"diagnostics"]];
+        LSPDocument *document = [_documents objectForKey:url];
+        if (document) {
+            [LSPDiagnostic resolveCharacterRangesOfDiagnostics:diagnostics lineIndex:[document lineIndex]];
+        }
+        diagnosticsDelta = [_diagnosticsStore setDiagnostics:diagnostics forURI:url];
+    }
+    // Only the observers of the method, and of the document if it has one.
+    NSArray<id<LSPClientObserver>> *observers = [self _observersOfMethod:method uri:url];
+    if ([observers count] == 0) {
+        return;
+    }
+    LSPMessageType messageType = 0;
+    NSString *message = nil;
+    if ([params isKindOfClass:[NSDictionary class]]) {
+        // method: window
+        messageType = [[params objectForKey:@"type"] integerValue];
+        message = [params objectForKey:@"message"];
+    }
+    for (id<LSPClientObserver> observer in observers) {
+        if ([method isEqual:@"window/logMessage"]) {
+            if ([observer respondsToSelector:@selector(languageServer:logMessage:type:)]) {
+                [observer languageServer:self logMessage:message type:messageType];
+            }
+        } else if ([method isEqual:@"window/showMessage"]) {
+            if ([observer respondsToSelector:@selector(languageServer:showMessage:type:)]) {
+                [observer languageServer:self showMessage:message type:messageType];
+            }
+        } else if ([method isEqual:@"telemetry/event"]) {
+            if ([observer respondsToSelector:@selector(languageServer:telemetryEvent:)]) {
+                [observer languageServer:self telemetryEvent:params];
+            }
+        } else if ([method isEqual:@"textDocument/publishDiagnostics"]) {
+            if ([observer respondsToSelector:@selector(languageServer:didChangeDiagnostics:)]) {
+                [observer languageServer:self didChangeDiagnostics:diagnosticsDelta];
+            }
+            if ([observer respondsToSelector:@selector(languageServer:document:diagnostics:)]) {
+                [observer languageServer:self document:url diagnostics:[diagnosticsDelta diagnostics]];
+            }
+        } else if ([method isEqual:@"$/progress"]) {
+            if ([observer respondsToSelector:@selector(languageServer:workDoneProgress:)]) {
+                [observer languageServer:self workDoneProgress:progress];
+            }
+        }
+    }
+}
+
+#pragma mark General
+
+- (void)initialWithCompletionHandler:(void (^)(NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    if (_suspended) {
+        _suspended = NO;
+        [self _launch];
+    }
+    @synchronized (self) {
+        if (_initialized) {
+            if (completionHandler) {
+                completionHandler(nil);
+            }
+        } else {
+            if (_initializerCallbacks == nil) {
+                // Only send one initialize request
+                [self _initialize];
+                _initializerCallbacks = [NSMutableArray array];
+            }
+            // All completionHandler will be answered in the initialize response
+            if (completionHandler) {
+                [_initializerCallbacks addObject:completionHandler];
+            }
+        }
+    }
+}
+
+- (void)_initialize {
+    LSPPipeline *pipeline = _pipeline;
+    [pipeline sendRequest:@"initialize" params:[self _initializeParams] withReply:^(NSDictionary *obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            // The reply of a server that was suspended meanwhile is stale.
+            if (pipeline == self->_pipeline) {
+                [self initializeResponseWithObject:obj error:error];
+            }
+        });
+    }];
+}
+
+- (NSDictionary *)_initializeParams {
+    NSMutableDictionary *params = [NSMutableDictionary dictionary];
+    NSNumber *pid = [NSNumber numberWithInt:[[NSProcessInfo processInfo] processIdentifier]];
+    NSDictionary *semanticTokensRequests = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            [NSNumber numberWithBool:YES], @"range",
+                                            [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:YES], @"delta", nil], @"full",
+                                            nil];
+    NSArray *tokenTypes = [NSArray arrayWithObjects:
+                           @"namespace", @"type", @"class", @"enum", @"interface", @"struct", @"typeParameter",
+                           @"parameter", @"variable", @"property", @"enumMember", @"event", @"function", @"method",
+                           @"macro", @"keyword", @"modifier", @"comment", @"string", @"number", @"regexp", @"operator",
+                           nil];
+    NSArray *tokenModifiers = [NSArray arrayWithObjects:
+                               @"declaration", @"definition", @"readonly", @"static", @"deprecated", @"abstract",
+                               @"async", @"modification", @"documentation", @"defaultLibrary",
+                               nil];
+    NSDictionary *semanticTokens = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    semanticTokensRequests, @"requests",
+                                    tokenTypes, @"tokenTypes",
+                                    tokenModifiers, @"tokenModifiers",
+                                    [NSArray arrayWithObject:@"relative"], @"formats",
+                                    nil];
+    NSDictionary *textDocument = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  semanticTokens, @"semanticTokens",
+                                  nil];
+    NSDictionary *window = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSNumber numberWithBool:YES], @"workDoneProgress",
+                            nil];
+    NSDictionary *capabilities = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  [NSNull null], @"workspace",
+                                  textDocument, @"textDocument",
+                                  window, @"window",
+                                  [NSNull null], @"experimental",
+                                  nil];
+    NSArray *workspaceFolders = nil;
+    if (_rootURL) {
+        NSDictionary *workspaceFolder = [NSDictionary dictionaryWithObjectsAndKeys:
+                                         [_rootURL absoluteString], @"uri",
+                                         [_rootURL lastPathComponent], @"name",
+                                         nil];
+        workspaceFolders = [NSArray arrayWithObject:workspaceFolder];
+    }
+    [params setObject:pid forKey:@"processId"];
+    [params setObject:[_rootURL path] ?: [NSNull null] forKey:@"rootPath"];
+    [params setObject:[_rootURL absoluteString] ?: [NSNull null] forKey:@"rootUri"];
+    [params setObject:[NSNull null] forKey:@"initializationOptions"];
+    [params setObject:capabilities forKey:@"capabilities"];
+    [params setObject:@"verbose" forKey:@"trace"];
+    [params setObject:workspaceFolders ?: [NSNull null] forKey:@"workspaceFolders"];
+    return params;
+}
+
+/**
+ * A provider is either a boolean, or options like workDoneProgress that
+ * imply it is provided.
+ */
+static BOOL LSPClientProviderEnabled(id provider) {
+    if ([provider isKindOfClass:[NSDictionary class]]) {
+        return YES;
+    }
+    return [provider isKindOfClass:[NSNumber class]] && [provider boolValue];
+}
+
+- (void)initializeResponseWithObject:(id)obj error:(NSError *)error {
+    self->_initialized = (error == nil);
+    NSDictionary *capabilities = [obj objectForKey:@"capabilities"];
+    id textDocumentSyncValue = [capabilities objectForKey:@"textDocumentSync"];
     if ([textDocumentSyncValue isKindOfClass:[NSDictionary class]]) {
         NSDictionary *syncOptions = textDocumentSyncValue;
         self->_textDocumentSync.openClose = [[syncOptions objectForKey:@"openClose"] boolValue];
@@ -632,7 +1243,7 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
                 break;
         }
     }
-    self->_hoverProvider = [[capabilities objectForKey:@"hoverProvider"] boolValue];
+    self->_hoverProvider = LSPClientProviderEnabled([capabilities objectForKey:@"hoverProvider"]);
     id completionProvider = [capabilities objectForKey:@"completionProvider"];
     if ([completionProvider isKindOfClass:[NSDictionary class]]) {
         NSDictionary *completionDict = completionProvider;
@@ -645,13 +1256,13 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
         self->_signatureHelpProvider = YES;
         _signatureHelpProviderTriggerCharacters = [signatureHelpProvider objectForKey:@"triggerCharacters"];
     }
-    self->_definitionProvider = [[capabilities objectForKey:@"definitionProvider"] boolValue];
+    self->_definitionProvider = LSPClientProviderEnabled([capabilities objectForKey:@"definitionProvider"]);
     //self->_typeDefinitionProvider; unsure about TextDocumentRegistrationOptions
     //self->_implementationProvider; unsure about TextDocumentRegistrationOptions
-    self->_referencesProvider = [[capabilities objectForKey:@"referencesProvider"] boolValue];
-    self->_documentHighlightProvider = [[capabilities objectForKey:@"documentHighlightProvider"] boolValue];
-    self->_documentSymbolProvider = [[capabilities objectForKey:@"documentSymbolProvider"] boolValue];
-    self->_workspaceSymbolProvider = [[capabilities objectForKey:@"workspaceSymbolProvider"] boolValue];
+    self->_referencesProvider = LSPClientProviderEnabled([capabilities objectForKey:@"referencesProvider"]);
+    self->_documentHighlightProvider = LSPClientProviderEnabled([capabilities objectForKey:@"documentHighlightProvider"]);
+    self->_documentSymbolProvider = LSPClientProviderEnabled([capabilities objectForKey:@"documentSymbolProvider"]);
+    self->_workspaceSymbolProvider = LSPClientProviderEnabled([capabilities objectForKey:@"workspaceSymbolProvider"]);
     //self->_codeActionProvider; to many CodeActionOptions right now
     NSDictionary *codeLensProvider = [capabilities objectForKey:@"codeLensProvider"];
     if ([codeLensProvider isKindOfClass:[NSDictionary class]]) {
@@ -685,17 +1296,52 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
         self->_colorProvider = YES;
         _colorProviderDynamicRegistration = [[colorProvider objectForKey:@"dynamicRegistration"] boolValue];
     }
-    self->_foldingRangeProvider = [[capabilities objectForKey:@"foldingRangeProvider"] boolValue];
+    self->_foldingRangeProvider = LSPClientProviderEnabled([capabilities objectForKey:@"foldingRangeProvider"]);
     NSDictionary *executeCommandProvider = [capabilities objectForKey:@"executeCommandProvider"];
     if ([executeCommandProvider isKindOfClass:[NSDictionary class]]) {
         self->_executeCommandProvider = YES;
         self->_executeCommandCommands = [executeCommandProvider objectForKey:@"commands"];
     }
+    NSDictionary *semanticTokensProvider = [capabilities objectForKey:@"semanticTokensProvider"];
+    if ([semanticTokensProvider isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *legend = [semanticTokensProvider objectForKey:@"legend"];
+        id range = [semanticTokensProvider objectForKey:@"range"];
+        id full = [semanticTokensProvider objectForKey:@"full"];
+        self->_semanticTokensProvider = [full isKindOfClass:[NSDictionary class]] || [full boolValue];
+        self->_semanticTokensDeltaProvider = [full isKindOfClass:[NSDictionary class]] && [[full objectForKey:@"delta"] boolValue];
+        self->_semanticTokensRangeProvider = [range isKindOfClass:[NSDictionary class]] || [range boolValue];
+        if ([legend isKindOfClass:[NSDictionary class]]) {
+            self->_semanticTokenTypes = [legend objectForKey:@"tokenTypes"];
+            self->_semanticTokenModifiers = [legend objectForKey:@"tokenModifiers"];
+        }
+    }
     
+    // Documents opened before the server was initialized, kept while it was
+    // suspended, or when the standby server took over, are opened with
+    // their text as it is now.
+    if (self->_initialized) {
+        _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+        [_pipeline sendNotification:@"initialized" params:[NSDictionary dictionary]];
+        for (LSPDocument *document in [_documents objectEnumerator]) {
+            [document clearContentChanges];
+            [document setFirstPendingChangeTime:0.0];
+            [document setLastPendingChangeTime:0.0];
+            if (_textDocumentSync.openClose) {
+                NSDictionary *documentParams = [document textDocumentItem];
+                [_pipeline sendNotification:@"textDocument/didOpen" params:[NSDictionary dictionaryWithObjectsAndKeys:documentParams, @"textDocument", nil]];
+            }
+        }
+    }
+    if (self->_initialized) {
+        [self _sendQueuedRequests];
+    } else {
+        [self _cancelQueuedRequests];
+    }
     for (void (^completionHandler)(NSError *) in _initializerCallbacks) {
         completionHandler(error);
     }
     _initializerCallbacks = nil;
+    [self _launchStandby];
 }
 
 - (void)shutdownWithCompletionHandler:(void (^)(NSError *error))completionHandler  {
@@ -725,12 +1371,29 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 
 - (void)documentDidOpen:(NSURL *)url content:(NSString *)text {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
-    NSAssert(([_documents objectForKey:url] == nil), @"An open notification must not be sent more than once without a corresponding close notification send before. This means open and close notification must be balanced and the max open count for a particular textDocument is one.");
+    if (_shouldTerminate) return;
+    
+    [self _documentDidOpen:[[LSPDocument alloc] initWithURL:url content:text languageID:_languageID]];
+}
+
+- (void)documentDidOpen:(NSURL *)url textStorage:(NSMutableAttributedString *)textStorage {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if (_shouldTerminate) return;
     
-    LSPDocument *document = [[LSPDocument alloc] initWithURL:url content:text languageID:_languageID];
-    [_documents setObject:document forKey:url];
-    if (_textDocumentSync.openClose == NO) {
+    [self _documentDidOpen:[[LSPDocument alloc] initWithURL:url textStorage:textStorage languageID:_languageID]];
+}
+
+- (void)_documentDidOpen:(LSPDocument *)document {
+    NSAssert(([_documents objectForKey:[document uri]] == nil), @"An open notification must not be sent more than once without a corresponding close notification send before. This means open and close notification must be balanced and the max open count for a particular textDocument is one.");
+    
+    [_documents setObject:document forKey:[document uri]];
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    // The server is told about the document once it is initialized. A
+    // suspended server is only relaunched by a request.
+    if (_initialized == NO && _suspended == NO) {
+        [self initialWithCompletionHandler:nil];
+    }
+    if (_initialized == NO || _textDocumentSync.openClose == NO) {
         return;
     }
     NSDictionary *documentParams = [document textDocumentItem];
@@ -739,25 +1402,26 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
 
 - (void)document:(NSURL *)url changeTextInRange:(NSRange)affectedCharRange replacementString:(nullable NSString *)replacementString {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
     LSPDocument *document = [_documents objectForKey:url];
+    if (document == nil && _initialized == NO) return;
     NSAssert((document != nil), @"An open notification must be send before.");
     
     [document changeTextInRange:affectedCharRange replacementString:replacementString];
+    [_diagnosticsStore document:url didReplaceCharactersInRange:affectedCharRange withLength:[replacementString length]];
+    [self _completionSessionOfDocument:url didReplaceCharactersInRange:affectedCharRange withLength:[replacementString length]];
+    _documentEditCount++;
     
-    NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:document, LSPDocumentUserInfoKey, nil];
-    NSNotification *changeNotification = [NSNotification notificationWithName:LSPDocumentDidChangeNotification object:self userInfo:userInfo];
     // It would be very expensive (and not very useful) to update the document after
     // each character the user types, especially if the user types quickly.
-    // We queue a notification, with coalescing turned on and a posting style
-    // of NSPostWhenIdle after each character typed.
-    // When the user stops typing, the single notification in the queue (due to coalescing)
-    // is posted when the run loop enters its wait state and the language server
-    // "textDocument/didChange" notifcation is send.
-    [_documentChangesQueue enqueueNotification:changeNotification
-                                  postingStyle:NSPostWhenIdle
-                                  coalesceMask:NSNotificationCoalescingOnName
-                                      forModes:nil];
+    // The changes are sent once the user paused typing for the debounce interval,
+    // but no later than the maximum latency after the first unsent change.
+    NSTimeInterval now = [self _documentChangeTime];
+    if ([document firstPendingChangeTime] == 0.0) {
+        [document setFirstPendingChangeTime:now];
+    }
+    [document setLastPendingChangeTime:now];
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    [self _scheduleDocumentChangesTimer];
 }
 
 - (void)documentDidChange:(NSURL *)url {
@@ -766,19 +1430,77 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
     
-    NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:document, LSPDocumentUserInfoKey, nil];
-    NSNotification *changeNotification = [NSNotification notificationWithName:LSPDocumentDidChangeNotification object:self userInfo:userInfo];
-    [_documentChangesQueue enqueueNotification:changeNotification
-                                  postingStyle:NSPostNow
-                                  coalesceMask:NSNotificationCoalescingOnName
-                                      forModes:nil];
+    [self _documentDidChange:document];
+}
+
+/** The clock of the pending changes, replaced by the tests. */
+- (NSTimeInterval)_documentChangeTime {
+    return [[NSProcessInfo processInfo] systemUptime];
+}
+
+/** The time at which the pending changes of a document are due. */
+- (NSTimeInterval)_documentChangesDeadline:(LSPDocument *)document {
+    return MIN([document lastPendingChangeTime] + _documentChangeDebounceInterval,
+               [document firstPendingChangeTime] + _documentChangeMaximumLatency);
 }
 
-- (void)_documentDidChange:(NSNotification *)notification {
+/**
+ * Sets the timer to the earliest deadline of the documents with pending changes.
+ * The timer runs on the main queue, which is also serviced while the run loop
+ * is tracking events, so scrolling does not hold the changes back.
+ */
+- (void)_scheduleDocumentChangesTimer {
+    NSTimeInterval deadline = DBL_MAX;
+    // Changes to the documents of a suspended server are not sent, they are
+    // opened again with their current text.
+    for (LSPDocument *document in [_documents objectEnumerator]) {
+        if ([document firstPendingChangeTime] != 0.0 && _initialized) {
+            deadline = MIN(deadline, [self _documentChangesDeadline:document]);
+        }
+    }
+    if (_documentChangesTimer == nil) {
+        if (deadline == DBL_MAX) {
+            return;
+        }
+        __weak __typeof(self) weakSelf = self;
+        _documentChangesTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(_documentChangesTimer, ^{
+            [weakSelf _documentChangesTimerDidFire];
+        });
+        dispatch_source_set_timer(_documentChangesTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_documentChangesTimer);
+    }
+    dispatch_time_t start = DISPATCH_TIME_FOREVER;
+    if (deadline != DBL_MAX) {
+        NSTimeInterval delay = MAX(deadline - [self _documentChangeTime], 0.0);
+        start = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC));
+    }
+    dispatch_source_set_timer(_documentChangesTimer, start, DISPATCH_TIME_FOREVER, NSEC_PER_MSEC);
+}
+
+- (void)_documentChangesTimerDidFire {
+    NSTimeInterval now = [self _documentChangeTime];
+    for (LSPDocument *document in [[_documents allValues] copy]) {
+        if ([document firstPendingChangeTime] != 0.0 && [self _documentChangesDeadline:document] <= now) {
+            [self _documentDidChange:document];
+        }
+    }
+    [self _scheduleDocumentChangesTimer];
+}
+
+/**
+ * Sends the pending changes of a document. Also called before every request
+ * that depends on the document content, so the server sees the changes first.
+ */
+- (void)_documentDidChange:(LSPDocument *)document {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
     if (_initialized == NO) return;
+    if ([document firstPendingChangeTime] == 0.0) return;
     
-    LSPDocument *document = [[notification userInfo] objectForKey:LSPDocumentUserInfoKey];
+    [document setFirstPendingChangeTime:0.0];
+    [document setLastPendingChangeTime:0.0];
+    [self _removeResponsesForURI:[document uri]];
+    // Without sync the version does not change with the text.
     if (_textDocumentSync.change == LSPTextDocumentSyncKindNone) {
         [document clearContentChanges];
         return;
@@ -786,6 +1508,7 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     NSDictionary *documentParams = [document syncTextDocumentParams:_textDocumentSync.change];
     [_pipeline sendNotification:@"textDocument/didChange" params:documentParams];
     [document clearContentChanges];
+    _documentChangeNotificationCount++;
 }
 
 - (void)documentWillSave:(NSURL *)url {
@@ -793,6 +1516,7 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     if (_initialized == NO) return;
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
     
     NSDictionary *documentParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
     [_pipeline sendNotification:@"textDocument/willSave" params:documentParams];
@@ -803,36 +1527,343 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     if (_initialized == NO) return;
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
     
     NSMutableDictionary *documentParams = [NSMutableDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];;
     if (_textDocumentSync.saveOptionIncludeText) {
-        [documentParams setObject:[document text] forKey:@"text"];
+        [documentParams setObject:[document textSnapshot] forKey:@"text"];
     }
     [_pipeline sendNotification:@"textDocument/didSave" params:documentParams];
 }
 
 - (void)documentDidClose:(NSURL *)url {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
     LSPDocument *document = [_documents objectForKey:url];
+    if (document == nil && _initialized == NO) return;
     NSAssert((document != nil), @"An open notification must be send before.");
     
-    NSDictionary *documentParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
-    [_pipeline sendNotification:@"textDocument/didClose" params:documentParams];
+    // Pending changes are dropped, the truth is on disk again.
+    if (_initialized) {
+        NSDictionary *documentParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
+        [_pipeline sendNotification:@"textDocument/didClose" params:documentParams];
+    }
     [_documents removeObjectForKey:url];
+    [self _removeResponsesForURI:url];
+    [_completionSessions removeObjectForKey:url];
+    [_semanticTokens removeObjectForKey:url];
+    for (NSString *key in [_replaceableRequests allKeys]) {
+        LSPRequest *request = [_replaceableRequests objectForKey:key];
+        if ([[request uri] isEqual:url]) {
+            [request cancel];
+            [_replaceableRequests removeObjectForKey:key];
+        }
+    }
 }
 
 #pragma mark Language Features
 
-- (void)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error))completionHandler {
+/**
+ * Sends a request of a language feature method. The reply block is called on
+ * the decode queue, unless the request was cancelled or the server replied
+ * with RequestCancelled or ContentModified, then the request is dropped.
+ * With replacesPendingRequest the pending request of the same method for the
+ * same document is cancelled.
+ */
+- (LSPRequest *)_sendRequest:(NSString *)method document:(LSPDocument *)document params:(NSDictionary *)params replacesPendingRequest:(BOOL)replacesPendingRequest withReply:(void (^)(LSPRequest *request, id obj, NSError *error))block {
+    LSPRequest *request = [[LSPRequest alloc] initWithMethod:method uri:[document uri] pipeline:_pipeline];
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    if (replacesPendingRequest) {
+        [self _replacePendingRequest:request];
+    }
+    // A request streaming its results takes as long as there are results.
+    NSTimeInterval timeout = ([params objectForKey:@"partialResultToken"] != nil) ? 0.0 : _requestTimeout;
+    id workDoneToken = [params objectForKey:@"workDoneToken"];
+    id partialResultToken = [params objectForKey:@"partialResultToken"];
+    __weak __typeof(self) weakSelf = self;
+    NSNumber *messageID = [_pipeline sendRequest:method params:params priority:LSPClientPriorityOfMethod(method) timeout:timeout withReply:^(id obj, NSError *error) {
+        if ([[error domain] isEqualToString:LSPResponseError] &&
+            ([error code] == LSPResponseRequestCancelled || [error code] == LSPResponseContentModified)) {
+            // The block is not called, the progress tokens end here.
+            dispatch_async(dispatch_get_main_queue(), ^{
+                __strong __typeof(self) strongSelf = weakSelf;
+                if (workDoneToken) {
+                    [strongSelf _removeProgressTokens:[NSArray arrayWithObjects:workDoneToken, partialResultToken, nil]];
+                }
+                [strongSelf _dropRequest:request];
+            });
+            return;
+        }
+        if ([request isCancelled]) {
+            return;
+        }
+        block(request, obj, error);
+    }];
+    [request setMessageID:messageID];
+    return request;
+}
+
+/**
+ * Cancels the pending request of the same method for the same document.
+ */
+- (void)_replacePendingRequest:(LSPRequest *)request {
+    NSString *key = [NSString stringWithFormat:@"%@ %@", [request method], [[request uri] absoluteString]];
+    [[_replaceableRequests objectForKey:key] cancel];
+    [_replaceableRequests setObject:request forKey:key];
+}
+
+/**
+ * Calls the completion handler of a request on main thread, unless the
+ * request was cancelled in the meantime.
+ */
+- (void)_finishRequest:(LSPRequest *)request withHandler:(dispatch_block_t)handler {
+    __weak __typeof(self) weakSelf = self;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        if (strongSelf) {
+            [strongSelf _completeRequest:request withHandler:handler];
+        } else if ([request isCancelled] == NO) {
+            handler();
+        }
+    });
+}
+
+- (void)_completeRequest:(LSPRequest *)request withHandler:(dispatch_block_t)handler {
+    NSString *key = [NSString stringWithFormat:@"%@ %@", [request method], [[request uri] absoluteString]];
+    if ([_replaceableRequests objectForKey:key] == request) {
+        [_replaceableRequests removeObjectForKey:key];
+    }
+    if ([request isCancelled] == NO) {
+        handler();
+    }
+}
+
+/**
+ * Calls the drop handler of a request whose reply was dropped, unless the
+ * request was cancelled in the meantime.
+ */
+- (void)_dropRequest:(LSPRequest *)request {
+    [self _completeRequest:request withHandler:^{
+        dispatch_block_t dropHandler = [request dropHandler];
+        [request setDropHandler:nil];
+        if (dropHandler) {
+            dropHandler();
+        }
+    }];
+}
+
+/**
+ * Sends a request whose result only depends on the document version and the
+ * position, unless the result is in the response cache or an identical
+ * request is in flight. The handler is called on main thread with the result
+ * as received. Each call returns its own request, the request to the server
+ * is cancelled when all requests sharing it are.
+ */
+- (LSPRequest *)_sendCachedRequest:(NSString *)method document:(LSPDocument *)document position:(LSPPosition *)position params:(NSDictionary *)params replacesPendingRequest:(BOOL)replacesPendingRequest completionHandler:(void (^)(id obj, NSError *error))handler {
+    NSURL *uri = [document uri];
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%@ %@ %lu", method, [uri absoluteString], (unsigned long)[document version]];
+    if (position) {
+        [key appendFormat:@" %lu:%lu", (unsigned long)[position line], (unsigned long)[position character]];
+    }
+    LSPRequest *request = [[LSPRequest alloc] initWithMethod:method uri:uri pipeline:_pipeline];
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    id cachedObject = [_responseCache objectForKey:key];
+    if (cachedObject) {
+        id obj = (cachedObject == [NSNull null]) ? nil : cachedObject;
+        if (replacesPendingRequest) {
+            [self _replacePendingRequest:request];
+        }
+        [self _finishRequest:request withHandler:^{
+            handler(obj, nil);
+        }];
+        return request;
+    }
+    
+    LSPSharedRequest *sharedRequest = [_sharedRequests objectForKey:key];
+    if (sharedRequest == nil) {
+        sharedRequest = [[LSPSharedRequest alloc] init];
+        [sharedRequest setMethod:method];
+        [sharedRequest setUri:uri];
+        [sharedRequest setVersion:[document version]];
+        [sharedRequest setParams:params];
+        [sharedRequest setRequests:[NSMutableArray array]];
+        [sharedRequest setHandlers:[NSMutableArray array]];
+        [_sharedRequests setObject:sharedRequest forKey:key];
+        
+        __weak __typeof(self) weakSelf = self;
+        LSPRequest *serverRequest = [[LSPRequest alloc] initWithMethod:method uri:uri pipeline:_pipeline];
+        NSNumber *messageID = [_pipeline sendRequest:method params:params priority:LSPClientPriorityOfMethod(method) timeout:_requestTimeout withReply:^(id obj, NSError *error) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf _finishSharedRequest:sharedRequest forKey:key object:obj error:error];
+            });
+        }];
+        [serverRequest setMessageID:messageID];
+        [sharedRequest setServerRequest:serverRequest];
+    }
+    [[sharedRequest requests] addObject:request];
+    [[sharedRequest handlers] addObject:[handler copy]];
+    __weak __typeof(self) weakSelf = self;
+    __weak LSPSharedRequest *weakSharedRequest = sharedRequest;
+    [request setCancellationHandler:^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        LSPSharedRequest *sharedRequest = weakSharedRequest;
+        for (LSPRequest *request in [sharedRequest requests]) {
+            if ([request isCancelled] == NO) {
+                return;
+            }
+        }
+        [[sharedRequest serverRequest] cancel];
+        if (strongSelf && [strongSelf->_sharedRequests objectForKey:key] == sharedRequest) {
+            [strongSelf->_sharedRequests removeObjectForKey:key];
+        }
+    }];
+    // Only now, a replaced identical request must not cancel the shared one.
+    if (replacesPendingRequest) {
+        [self _replacePendingRequest:request];
+    }
+    return request;
+}
+
+- (void)_finishSharedRequest:(LSPSharedRequest *)sharedRequest forKey:(NSString *)key object:(id)obj error:(NSError *)error {
+    BOOL dropped = ([[error domain] isEqualToString:LSPResponseError] &&
+                    ([error code] == LSPResponseRequestCancelled || [error code] == LSPResponseContentModified));
+    // A request removed meanwhile was for a document that changed or closed.
+    if ([_sharedRequests objectForKey:key] == sharedRequest) {
+        [_sharedRequests removeObjectForKey:key];
+        if (error == nil) {
+            [_responseCache setObject:obj forKey:key uri:[sharedRequest uri]];
+        }
+    }
+    if (dropped) {
+        if ([self _resendSharedRequest:sharedRequest error:error] == NO) {
+            for (LSPRequest *request in [sharedRequest requests]) {
+                [self _dropRequest:request];
+            }
+        }
+        return;
+    }
+    NSArray *requests = [sharedRequest requests];
+    NSArray *handlers = [sharedRequest handlers];
+    for (NSUInteger index = 0; index < [requests count]; index++) {
+        void (^handler)(id obj, NSError *error) = [handlers objectAtIndex:index];
+        [self _completeRequest:[requests objectAtIndex:index] withHandler:^{
+            handler(obj, error);
+        }];
+    }
+}
+
+/**
+ * A held background request is answered with LSPResponseContentModified,
+ * without being sent, once its document changed. Symbol and folding range
+ * requests are not replaced by the next one, so they are made again for the
+ * current version of the document, unless it was closed. Returns NO if the
+ * requests are not made again.
+ */
+- (BOOL)_resendSharedRequest:(LSPSharedRequest *)sharedRequest error:(NSError *)error {
+    LSPDocument *document = [_documents objectForKey:[sharedRequest uri]];
+    if ([error code] != LSPResponseContentModified || LSPClientPriorityOfMethod([sharedRequest method]) != LSPRequestPriorityBackground ||
+        document == nil || [document version] == [sharedRequest version]) {
+        return NO;
+    }
+    [self _documentDidChange:document];
+    __weak __typeof(self) weakSelf = self;
+    NSArray *requests = [sharedRequest requests];
+    NSArray *handlers = [sharedRequest handlers];
+    for (NSUInteger index = 0; index < [requests count]; index++) {
+        LSPRequest *request = [requests objectAtIndex:index];
+        if ([request isCancelled]) {
+            continue;
+        }
+        void (^handler)(id obj, NSError *error) = [handlers objectAtIndex:index];
+        LSPRequest *resentRequest = [self _sendCachedRequest:[sharedRequest method] document:document position:nil params:[sharedRequest params] replacesPendingRequest:NO completionHandler:^(id obj, NSError *error) {
+            [weakSelf _completeRequest:request withHandler:^{
+                handler(obj, error);
+            }];
+        }];
+        [request setCancellationHandler:^{
+            [resentRequest cancel];
+        }];
+    }
+    return YES;
+}
+
+- (void)_removeResponsesForURI:(NSURL *)uri {
+    [_responseCache removeObjectsForURI:uri];
+    for (NSString *key in [_sharedRequests allKeys]) {
+        if ([[[_sharedRequests objectForKey:key] uri] isEqual:uri]) {
+            [_sharedRequests removeObjectForKey:key];
+        }
+    }
+}
+
+- (NSUInteger)responseCacheCostLimit {
+    return [_responseCache costLimit];
+}
+
+- (void)setMaximumBackgroundRequestCount:(NSUInteger)maximumBackgroundRequestCount {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
+    _maximumBackgroundRequestCount = maximumBackgroundRequestCount;
+    [_pipeline setMaximumBackgroundRequestCount:maximumBackgroundRequestCount];
+    [_standbyPipeline setMaximumBackgroundRequestCount:maximumBackgroundRequestCount];
+}
+
+- (void)setResponseCacheCostLimit:(NSUInteger)responseCacheCostLimit {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    [_responseCache setCostLimit:responseCacheCostLimit];
+}
+
+- (NSUInteger)responseCacheHitCount {
+    return [_responseCache hitCount];
+}
+
+- (NSUInteger)responseCacheMissCount {
+    return [_responseCache missCount];
+}
+
+- (LSPRequest *)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error))completionHandler {
+    return [self documentCompletionList:url inText:string forCharacterAtIndex:characterIndex completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+        if (completionHandler) {
+            completionHandler(completionList, isIncomplete, error);
+        }
+    }];
+}
+
+- (LSPRequest *)documentCompletionList:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/completion" uri:url send:^LSPRequest *{
+            return [weakSelf documentCompletionList:url inText:string forCharacterAtIndex:characterIndex completionHandler:completionHandler];
+        }];
+    }
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
     
-    LSPPosition *position = [LSPPosition positionForCharacterAtIndex:characterIndex inText:string];
+    // Typing on in the word of a complete list only narrows it down, the
+    // list is filtered here instead of asking the server again.
+    NSRange wordRange = LSPCompletionWordRange(string, characterIndex);
+    NSString *linePrefix = LSPCompletionLinePrefix(string, wordRange.location);
+    NSString *word = [string substringWithRange:wordRange];
+    LSPCompletionSession *session = [_completionSessions objectForKey:url];
+    if (session && [session wordRange].location == wordRange.location && [word hasPrefix:[session word]] &&
+        [[session linePrefix] isEqualToString:linePrefix]) {
+        LSPCompletionList *completionList = [[session completionList] completionListFilteredByWord:word];
+        LSPRequest *request = [[LSPRequest alloc] initWithMethod:@"textDocument/completion" uri:url pipeline:_pipeline];
+        [self _replacePendingRequest:request];
+        [self _finishRequest:request withHandler:^{
+            if (completionHandler) {
+                completionHandler(completionList, NO, nil);
+            }
+        }];
+        return request;
+    }
+    [_completionSessions removeObjectForKey:url];
+    [self _documentDidChange:document];
+    
+    LSPPosition *position = [[document lineIndex] positionForCharacterAtIndex:characterIndex];
     NSDictionary *completionParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", [position params], @"position", nil];
-    [_pipeline sendRequest:@"textDocument/completion" params:completionParams withReply:^(id obj, NSError *error) {
+    return [self _sendRequest:@"textDocument/completion" document:document params:completionParams replacesPendingRequest:YES withReply:^(LSPRequest *request, id obj, NSError *error) {
+        // The columns of the list are extracted here on the decode queue,
+        // the items are only decoded when they are accessed.
         BOOL isIncomplete = NO;
         NSArray *items = nil;
         if ([obj isKindOfClass:[NSDictionary class]]) {
@@ -842,42 +1873,206 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
         } else if ([obj isKindOfClass:[NSArray class]]) {
             items = obj;
         }
-        NSMutableArray *completionList = [NSMutableArray arrayWithCapacity:[items count]];
-        for (NSDictionary *item in items) {
-            LSPCompletionItem *completionItem = [[LSPCompletionItem alloc] initWithDictionary:item];
-            if (completionItem) {
-                [completionList addObject:completionItem];
+        LSPCompletionList *completionList = [[LSPCompletionList alloc] initWithItems:([items isKindOfClass:[NSArray class]] ? items : nil) incomplete:isIncomplete];
+        [self _finishRequest:request withHandler:^{
+            if (isIncomplete == NO && error == nil && [self->_documents objectForKey:url] != nil) {
+                LSPCompletionSession *session = [[LSPCompletionSession alloc] init];
+                [session setCompletionList:completionList];
+                [session setWord:word];
+                [session setWordRange:wordRange];
+                [session setLinePrefix:linePrefix];
+                [self->_completionSessions setObject:session forKey:url];
             }
-        }
-        if (completionHandler) {
+            if (completionHandler) {
+                completionHandler(completionList, isIncomplete, error);
+            }
+        }];
+    }];
+}
+
+/**
+ * Typing in the word of a completion session moves its end, any other edit
+ * may change the completions and ends the session.
+ */
+- (void)_completionSessionOfDocument:(NSURL *)url didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length {
+    LSPCompletionSession *session = [_completionSessions objectForKey:url];
+    if (session == nil) {
+        return;
+    }
+    NSRange wordRange = [session wordRange];
+    if (range.location < wordRange.location || NSMaxRange(range) > NSMaxRange(wordRange)) {
+        [_completionSessions removeObjectForKey:url];
+        return;
+    }
+    [session setWordRange:NSMakeRange(wordRange.location, wordRange.length - range.length + length)];
+}
+
+- (LSPRequest *)resolveCompletionItemAtIndex:(NSUInteger)index ofCompletionList:(LSPCompletionList *)completionList completionHandler:(void (^)(LSPCompletionItem *item, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    NSUInteger storageIndex = [completionList storageIndexAtIndex:index];
+    LSPRequest *request = [[LSPRequest alloc] initWithMethod:@"completionItem/resolve" uri:nil pipeline:_pipeline];
+    LSPCompletionItem *resolvedItem = [completionList resolvedItemAtStorageIndex:storageIndex];
+    if (resolvedItem == nil && _completionResolveProvider == NO) {
+        resolvedItem = [completionList itemAtStorageIndex:storageIndex];
+    }
+    if (resolvedItem) {
+        [self _finishRequest:request withHandler:^{
+            if (completionHandler) {
+                completionHandler(resolvedItem, nil);
+            }
+        }];
+        return request;
+    }
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"completionItem/resolve" uri:nil send:^LSPRequest *{
+            return [weakSelf resolveCompletionItemAtIndex:index ofCompletionList:completionList completionHandler:completionHandler];
+        }];
+    }
+    _lastActivityTime = [[NSProcessInfo processInfo] systemUptime];
+    
+    // The item is resolved once for the list and the lists filtered from it.
+    NSString *key = [NSString stringWithFormat:@"%p %lu", [completionList storage], (unsigned long)storageIndex];
+    LSPSharedRequest *sharedRequest = [_resolveRequests objectForKey:key];
+    if (sharedRequest == nil) {
+        sharedRequest = [[LSPSharedRequest alloc] init];
+        [sharedRequest setRequests:[NSMutableArray array]];
+        [sharedRequest setHandlers:[NSMutableArray array]];
+        [_resolveRequests setObject:sharedRequest forKey:key];
+        
+        __weak __typeof(self) weakSelf = self;
+        NSDictionary *params = [completionList itemDictionaryAtStorageIndex:storageIndex];
+        LSPRequest *serverRequest = [[LSPRequest alloc] initWithMethod:@"completionItem/resolve" uri:nil pipeline:_pipeline];
+        NSNumber *messageID = [_pipeline sendRequest:@"completionItem/resolve" params:params priority:LSPClientPriorityOfMethod(@"completionItem/resolve") timeout:_requestTimeout withReply:^(id obj, NSError *error) {
+            LSPCompletionItem *item = ([obj isKindOfClass:[NSDictionary class]]) ? [[LSPCompletionItem alloc] initWithDictionary:obj] : nil;
             dispatch_async(dispatch_get_main_queue(), ^{
-                completionHandler([completionList copy], isIncomplete, error);
+                [weakSelf _finishResolveRequest:sharedRequest forKey:key completionList:completionList storageIndex:storageIndex item:item error:error];
             });
+        }];
+        [serverRequest setMessageID:messageID];
+        [sharedRequest setServerRequest:serverRequest];
+    }
+    [[sharedRequest requests] addObject:request];
+    [[sharedRequest handlers] addObject:[^(id obj, NSError *error) {
+        if (completionHandler) {
+            completionHandler(obj, error);
+        }
+    } copy]];
+    __weak __typeof(self) weakSelf = self;
+    __weak LSPSharedRequest *weakSharedRequest = sharedRequest;
+    [request setCancellationHandler:^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        LSPSharedRequest *sharedRequest = weakSharedRequest;
+        for (LSPRequest *request in [sharedRequest requests]) {
+            if ([request isCancelled] == NO) {
+                return;
+            }
+        }
+        [[sharedRequest serverRequest] cancel];
+        if (strongSelf && [strongSelf->_resolveRequests objectForKey:key] == sharedRequest) {
+            [strongSelf->_resolveRequests removeObjectForKey:key];
         }
     }];
+    return request;
+}
+
+- (void)_finishResolveRequest:(LSPSharedRequest *)sharedRequest forKey:(NSString *)key completionList:(LSPCompletionList *)completionList storageIndex:(NSUInteger)storageIndex item:(LSPCompletionItem *)item error:(NSError *)error {
+    if ([_resolveRequests objectForKey:key] == sharedRequest) {
+        [_resolveRequests removeObjectForKey:key];
+    }
+    if ([[error domain] isEqualToString:LSPResponseError] &&
+        ([error code] == LSPResponseRequestCancelled || [error code] == LSPResponseContentModified)) {
+        for (LSPRequest *request in [sharedRequest requests]) {
+            [self _dropRequest:request];
+        }
+        return;
+    }
+    if (item) {
+        [completionList setResolvedItem:item atStorageIndex:storageIndex];
+    } else if (error == nil) {
+        // A server may answer null, the item is as complete as it gets.
+        item = [completionList itemAtStorageIndex:storageIndex];
+    }
+    NSArray *requests = [sharedRequest requests];
+    NSArray *handlers = [sharedRequest handlers];
+    for (NSUInteger index = 0; index < [requests count]; index++) {
+        void (^handler)(id obj, NSError *error) = [handlers objectAtIndex:index];
+        if ([[requests objectAtIndex:index] isCancelled] == NO) {
+            handler(item, error);
+        }
+    }
 }
+
+- (void)prefetchResolvedCompletionItemsInRange:(NSRange)range ofCompletionList:(LSPCompletionList *)completionList {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if (_completionResolveProvider == NO) return;
+    range.location = MIN(range.location, [completionList count]);
+    range.length = MIN(MIN(range.length, [completionList count] - range.location), LSPClientCompletionPrefetchLimit);
     
-- (void)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler  {
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:range.length];
+    NSMutableDictionary<NSString *, NSNumber *> *visibleItems = [NSMutableDictionary dictionaryWithCapacity:range.length];
+    for (NSUInteger index = range.location; index < NSMaxRange(range); index++) {
+        NSUInteger storageIndex = [completionList storageIndexAtIndex:index];
+        if ([completionList resolvedItemAtStorageIndex:storageIndex] == nil) {
+            NSString *key = [NSString stringWithFormat:@"%p %lu", [completionList storage], (unsigned long)storageIndex];
+            [keys addObject:key];
+            [visibleItems setObject:[NSNumber numberWithUnsignedInteger:index] forKey:key];
+        }
+    }
+    // Items scrolled out of view, or of a previous list, are not needed anymore.
+    for (NSString *key in [_prefetchRequests allKeys]) {
+        if ([visibleItems objectForKey:key] == nil) {
+            [[_prefetchRequests objectForKey:key] cancel];
+            [_prefetchRequests removeObjectForKey:key];
+        }
+    }
+    // Sent back to back from the top, the first replies come in while the
+    // others are still computed.
+    __weak __typeof(self) weakSelf = self;
+    for (NSString *key in keys) {
+        if ([_prefetchRequests objectForKey:key] != nil) {
+            continue;
+        }
+        __block LSPRequest *request = nil;
+        request = [self resolveCompletionItemAtIndex:[[visibleItems objectForKey:key] unsignedIntegerValue] ofCompletionList:completionList completionHandler:^(LSPCompletionItem *item, NSError *error) {
+            __strong __typeof(self) strongSelf = weakSelf;
+            if (strongSelf && [strongSelf->_prefetchRequests objectForKey:key] == request) {
+                [strongSelf->_prefetchRequests removeObjectForKey:key];
+            }
+            request = nil;
+        }];
+        if (request == nil) {
+            break;
+        }
+        [_prefetchRequests setObject:request forKey:key];
+    }
+}
+
+- (LSPRequest *)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler  {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/documentSymbol" uri:url send:^LSPRequest *{
+            return [weakSelf documentSymbol:url completionHandler:completionHandler];
+        }];
+    }
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
     
     NSDictionary *symbolParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
-    [_pipeline sendRequest:@"textDocument/documentSymbol" params:symbolParams withReply:^(NSDictionary *obj, NSError *error) {
+    return [self _sendCachedRequest:@"textDocument/documentSymbol" document:document position:nil params:symbolParams replacesPendingRequest:NO completionHandler:^(id obj, NSError *error) {
         if (completionHandler) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                completionHandler((id)obj, error);
-            });
+            completionHandler(obj, error);
         }
     }];
 }
 
-+ (NSArray<LSPDocumentHighlight *> *)documentHighlightFromArray:(NSArray *)array inText:(NSString *)string {
++ (NSArray<LSPDocumentHighlight *> *)documentHighlightFromArray:(NSArray *)array lineIndex:(LSPLineIndex *)lineIndex {
     NSMutableArray *result = [NSMutableArray arrayWithCapacity:[array count]];
     for (NSDictionary *dict in array) {
         if ([dict isKindOfClass:[NSDictionary class]]) {
-            LSPDocumentHighlight *highlight = [[self class] documentHighlightFromDictionary:dict inText:string];
+            LSPDocumentHighlight *highlight = [[self class] documentHighlightFromDictionary:dict lineIndex:lineIndex];
             if (highlight) {
                 [result addObject:highlight];
             }
@@ -886,9 +2081,9 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     return [result copy];
 }
 
-+ (LSPDocumentHighlight *)documentHighlightFromDictionary:(NSDictionary *)dict inText:(NSString *)string {
++ (LSPDocumentHighlight *)documentHighlightFromDictionary:(NSDictionary *)dict lineIndex:(LSPLineIndex *)lineIndex {
     LSPRange *lspRange = [LSPRange rangeFromDictionary:[dict objectForKey:@"range"]];
-    NSRange range = [lspRange convertToRangeInText:string];
+    NSRange range = [lineIndex characterRangeForRange:lspRange];
     LSPDocumentHighlightKind kind = LSPDocumentHighlightKindText;
     if ([dict objectForKey:@"kind"]) {
         kind = [[dict objectForKey:@"kind"] integerValue];
@@ -896,50 +2091,257 @@ NSString *ParsenContentType(NSString *str, NSDictionary **params) {
     return [[LSPDocumentHighlight alloc] initWithRange:range kind:kind];
 }
 
-- (void)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *, NSError *error))completionHandler  {
+- (LSPRequest *)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *, NSError *error))completionHandler  {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/documentHighlight" uri:url send:^LSPRequest *{
+            return [weakSelf documentHighlight:url inText:string forCharacterAtIndex:characterIndex completionHandler:completionHandler];
+        }];
+    }
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
     
-    LSPPosition *position = [LSPPosition positionForCharacterAtIndex:characterIndex inText:string];
+    LSPPosition *position = [[document lineIndex] positionForCharacterAtIndex:characterIndex];
     NSMutableDictionary *params = [NSMutableDictionary dictionary];
     [params setObject:[document textDocumentIdentifier] forKey:@"textDocument"];
     [params setObject:[position params] forKey:@"position"];
-    [_pipeline sendRequest:@"textDocument/documentHighlight" params:params withReply:^(id obj, NSError *error) {
-        NSArray *documentHighlights = nil;
-        if ([obj isKindOfClass:[NSArray class]]) {
-            documentHighlights = [[self class] documentHighlightFromArray:obj inText:string];
-        }
+    return [self _sendRequest:@"textDocument/documentHighlight" document:document params:params replacesPendingRequest:YES withReply:^(LSPRequest *request, id obj, NSError *error) {
         if (completionHandler) {
-            dispatch_async(dispatch_get_main_queue(), ^{
+            // The line index belongs to the main thread.
+            [self _finishRequest:request withHandler:^{
+                NSArray *documentHighlights = nil;
+                if ([obj isKindOfClass:[NSArray class]]) {
+                    documentHighlights = [[self class] documentHighlightFromArray:obj lineIndex:[document lineIndex]];
+                }
                 completionHandler(documentHighlights, error);
-            });
+            }];
         }
     }];
 }
 
-- (void)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler  {
+- (LSPRequest *)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler  {
     NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
-    if (_initialized == NO) return;
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/hover" uri:url send:^LSPRequest *{
+            return [weakSelf documentHoverWithContentsOfURL:url inText:string forCharacterAtIndex:characterIndex completionHandler:completionHandler];
+        }];
+    }
     LSPDocument *document = [_documents objectForKey:url];
     NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
     
-    LSPPosition *position = [LSPPosition positionForCharacterAtIndex:characterIndex inText:string];
+    LSPPosition *position = [[document lineIndex] positionForCharacterAtIndex:characterIndex];
     NSMutableDictionary *params = [NSMutableDictionary dictionary];
     [params setObject:[document textDocumentIdentifier] forKey:@"textDocument"];
     [params setObject:[position params] forKey:@"position"];
-    [_pipeline sendRequest:@"textDocument/hover" params:params withReply:^(id obj, NSError *error) {
+    return [self _sendCachedRequest:@"textDocument/hover" document:document position:position params:params replacesPendingRequest:YES completionHandler:^(id obj, NSError *error) {
         NSDictionary *result = nil;
         if ([obj isKindOfClass:[NSDictionary class]]) {
             result = obj;
         }
         if (completionHandler) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                completionHandler(result, error);
-            });
+            completionHandler(result, error);
+        }
+    }];
+}
+
+- (LSPRequest *)documentFoldingRange:(NSURL *)url completionHandler:(void (^)(NSArray *foldingRanges, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/foldingRange" uri:url send:^LSPRequest *{
+            return [weakSelf documentFoldingRange:url completionHandler:completionHandler];
+        }];
+    }
+    LSPDocument *document = [_documents objectForKey:url];
+    NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
+    
+    NSDictionary *foldingRangeParams = [NSDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
+    return [self _sendCachedRequest:@"textDocument/foldingRange" document:document position:nil params:foldingRangeParams replacesPendingRequest:NO completionHandler:^(id obj, NSError *error) {
+        NSArray *foldingRanges = nil;
+        if ([obj isKindOfClass:[NSArray class]]) {
+            foldingRanges = obj;
         }
+        if (completionHandler) {
+            completionHandler(foldingRanges, error);
+        }
+    }];
+}
+
+- (LSPRequest *)documentSemanticTokens:(NSURL *)url completionHandler:(void (^)(LSPSemanticTokens *tokens, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/semanticTokens/full" uri:url send:^LSPRequest *{
+            return [weakSelf documentSemanticTokens:url completionHandler:completionHandler];
+        }];
+    }
+    LSPDocument *document = [_documents objectForKey:url];
+    NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
+    
+    LSPSemanticTokens *previousTokens = [_semanticTokens objectForKey:url];
+    NSString *method = @"textDocument/semanticTokens/full";
+    NSMutableDictionary *semanticTokensParams = [NSMutableDictionary dictionaryWithObjectsAndKeys:[document textDocumentIdentifier], @"textDocument", nil];
+    if (_semanticTokensDeltaProvider && [previousTokens resultID] != nil) {
+        method = @"textDocument/semanticTokens/full/delta";
+        [semanticTokensParams setObject:[previousTokens resultID] forKey:@"previousResultId"];
+    }
+    return [self _sendRequest:method document:document params:semanticTokensParams replacesPendingRequest:YES withReply:^(LSPRequest *request, id obj, NSError *error) {
+        // The integers of a full reply are copied here on the decode queue,
+        // a delta is applied on main thread to the tokens it refers to.
+        NSDictionary *result = [obj isKindOfClass:[NSDictionary class]] ? obj : nil;
+        NSString *resultID = [result objectForKey:@"resultId"];
+        NSArray *data = [result objectForKey:@"data"];
+        NSArray *edits = [result objectForKey:@"edits"];
+        LSPSemanticTokens *tokens = [data isKindOfClass:[NSArray class]] ? [[LSPSemanticTokens alloc] initWithData:data resultID:resultID] : nil;
+        [self _finishRequest:request withHandler:^{
+            LSPSemanticTokens *semanticTokens = tokens;
+            if (semanticTokens == nil && [edits isKindOfClass:[NSArray class]] &&
+                [self->_semanticTokens objectForKey:url] == previousTokens && [previousTokens applyEdits:edits resultID:resultID]) {
+                semanticTokens = previousTokens;
+            }
+            LSPDocument *document = [self->_documents objectForKey:url];
+            if (semanticTokens && document) {
+                [semanticTokens updateRunsWithLineIndex:[document lineIndex]];
+                [self->_semanticTokens setObject:semanticTokens forKey:url];
+            } else {
+                // The next request asks for all tokens again.
+                [self->_semanticTokens removeObjectForKey:url];
+            }
+            if (completionHandler) {
+                completionHandler(semanticTokens, error);
+            }
+        }];
     }];
 }
 
+- (LSPRequest *)documentSemanticTokens:(NSURL *)url inCharacterRange:(NSRange)range completionHandler:(void (^)(LSPSemanticTokens *tokens, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/semanticTokens/range" uri:url send:^LSPRequest *{
+            return [weakSelf documentSemanticTokens:url inCharacterRange:range completionHandler:completionHandler];
+        }];
+    }
+    LSPDocument *document = [_documents objectForKey:url];
+    NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
+    
+    NSDictionary *semanticTokensParams = [NSDictionary dictionaryWithObjectsAndKeys:
+                                          [document textDocumentIdentifier], @"textDocument",
+                                          [[[document lineIndex] rangeForCharacterRange:range] params], @"range",
+                                          nil];
+    return [self _sendRequest:@"textDocument/semanticTokens/range" document:document params:semanticTokensParams replacesPendingRequest:YES withReply:^(LSPRequest *request, id obj, NSError *error) {
+        NSArray *data = [obj isKindOfClass:[NSDictionary class]] ? [obj objectForKey:@"data"] : nil;
+        LSPSemanticTokens *tokens = [data isKindOfClass:[NSArray class]] ? [[LSPSemanticTokens alloc] initWithData:data resultID:nil] : nil;
+        [self _finishRequest:request withHandler:^{
+            LSPDocument *document = [self->_documents objectForKey:url];
+            if (document) {
+                [tokens updateRunsWithLineIndex:[document lineIndex]];
+            }
+            if (completionHandler) {
+                completionHandler(document ? tokens : nil, error);
+            }
+        }];
+    }];
+}
+
+- (LSPRequest *)documentReferences:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex includeDeclaration:(BOOL)includeDeclaration partialResultHandler:(void (^)(NSArray *locations))partialResultHandler completionHandler:(void (^)(NSArray *locations, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"textDocument/references" uri:url send:^LSPRequest *{
+            return [weakSelf documentReferences:url inText:string forCharacterAtIndex:characterIndex includeDeclaration:includeDeclaration partialResultHandler:partialResultHandler completionHandler:completionHandler];
+        }];
+    }
+    LSPDocument *document = [_documents objectForKey:url];
+    NSAssert((document != nil), @"An open notification must be send before.");
+    [self _documentDidChange:document];
+    
+    LSPPosition *position = [[document lineIndex] positionForCharacterAtIndex:characterIndex];
+    NSDictionary *context = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:includeDeclaration], @"includeDeclaration", nil];
+    NSMutableDictionary *params = [NSMutableDictionary dictionary];
+    [params setObject:[document textDocumentIdentifier] forKey:@"textDocument"];
+    [params setObject:[position params] forKey:@"position"];
+    [params setObject:context forKey:@"context"];
+    return [self _sendStreamingRequest:@"textDocument/references" document:document params:params partialResultHandler:partialResultHandler completionHandler:completionHandler];
+}
+
+- (LSPRequest *)workspaceSymbol:(NSString *)query partialResultHandler:(void (^)(NSArray *symbols))partialResultHandler completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([self _checkInitialized] == NO) {
+        __weak __typeof(self) weakSelf = self;
+        return [self _queueRequest:@"workspace/symbol" uri:nil send:^LSPRequest *{
+            return [weakSelf workspaceSymbol:query partialResultHandler:partialResultHandler completionHandler:completionHandler];
+        }];
+    }
+    NSMutableDictionary *params = [NSMutableDictionary dictionaryWithObjectsAndKeys:query ?: @"", @"query", nil];
+    return [self _sendStreamingRequest:@"workspace/symbol" document:nil params:params partialResultHandler:partialResultHandler completionHandler:completionHandler];
+}
+
+/**
+ * Sends a request whose result is an array, with a work done token, and
+ * with a partial result token if there is a partial result handler. The
+ * chunks of the result are passed to the partial result handler on main
+ * thread as they arrive. The completion handler gets the whole result.
+ */
+- (LSPRequest *)_sendStreamingRequest:(NSString *)method document:(LSPDocument *)document params:(NSMutableDictionary *)params partialResultHandler:(void (^)(NSArray *results))partialResultHandler completionHandler:(void (^)(NSArray *results, NSError *error))completionHandler {
+    NSString *workDoneToken = [NSString stringWithFormat:@"LSPKit-%lu", (unsigned long)++_progressTokenCount];
+    [params setObject:workDoneToken forKey:@"workDoneToken"];
+    NSString *partialResultToken = nil;
+    if (partialResultHandler) {
+        partialResultToken = [NSString stringWithFormat:@"LSPKit-%lu", (unsigned long)++_progressTokenCount];
+        [params setObject:partialResultToken forKey:@"partialResultToken"];
+    }
+    [_workDoneTokenURIs setObject:[document uri] ?: [NSNull null] forKey:workDoneToken];
+    // Used on main thread only, by the partial results and the completion.
+    NSMutableArray *results = [NSMutableArray array];
+    LSPRequest *request = [self _sendRequest:method document:document params:params replacesPendingRequest:YES withReply:^(LSPRequest *request, id obj, NSError *error) {
+        [self _finishRequest:request withHandler:^{
+            [self _removeProgressTokens:[NSArray arrayWithObjects:workDoneToken, partialResultToken, nil]];
+            if ([obj isKindOfClass:[NSArray class]]) {
+                [results addObjectsFromArray:obj];
+            }
+            if (completionHandler) {
+                completionHandler((error == nil) ? [results copy] : nil, error);
+            }
+        }];
+    }];
+    __weak __typeof(self) weakSelf = self;
+    __weak LSPRequest *weakRequest = request;
+    [request setCancellationHandler:^{
+        LSPRequest *request = weakRequest;
+        [[request pipeline] cancelRequest:[request messageID]];
+        [weakSelf _removeProgressTokens:[NSArray arrayWithObjects:workDoneToken, partialResultToken, nil]];
+    }];
+    if (partialResultToken) {
+        [_partialResultHandlers setObject:^(id value) {
+            if ([value isKindOfClass:[NSArray class]] == NO || [weakRequest isCancelled]) {
+                return;
+            }
+            [results addObjectsFromArray:value];
+            partialResultHandler(value);
+        } forKey:partialResultToken];
+    }
+    return request;
+}
+
+- (void)_removeProgressTokens:(NSArray<NSString *> *)tokens {
+    [_partialResultHandlers removeObjectsForKeys:tokens];
+    [_workDoneTokenURIs removeObjectsForKeys:tokens];
+}
+
+- (void)cancelWorkDoneProgress:(LSPWorkDoneProgress *)progress {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if ([progress isCancellable] == NO || [progress token] == nil) {
+        return;
+    }
+    [_pipeline sendNotification:@"window/workDoneProgress/cancel" params:[NSDictionary dictionaryWithObjectsAndKeys:[progress token], @"token", nil]];
+}
+
 @end
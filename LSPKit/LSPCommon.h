@@ -22,7 +22,10 @@ typedef NS_ENUM(NSUInteger, LSPErrorCode) {
     LSPResponseUnknownErrorCode = -32001,
     // Defined by the protocol.
     LSPResponseRequestCancelled = -32800,
-    LSPResponseContentModified = -32801
+    LSPResponseContentModified = -32801,
+    // Not sent by servers, the error of a request that was not answered
+    // within its timeout.
+    LSPResponseRequestTimedOut = -1001
 };
 
 typedef NS_ENUM(NSUInteger, LSPMessageType) {
@@ -82,10 +85,24 @@ typedef NS_ENUM(NSUInteger, LSPDocumentHighlightKind) {
  */
 @property (readonly) NSUInteger character;
 
+/**
+ * The end of a string ending with a line terminator is at the end of its last
+ * line, unlike with -[LSPLineIndex positionForCharacterAtIndex:].
+ *
+ * The methods converting in a string keep an LSPLineIndex of the last
+ * immutable string, converting in the same string again is a binary search.
+ */
 + (instancetype)positionForCharacterAtIndex:(NSUInteger)location inText:(NSString *)string;
 + (instancetype)positionFromDictionary:(NSDictionary *)dict;
 + (instancetype)positionWithLine:(NSUInteger)line character:(NSUInteger)character;
 
+/**
+ * A character beyond the end of the line defaults back to the end of the
+ * line, a line beyond the end of the string to the end of the string. Before
+ * LSPLineIndex, the character ran on into the following lines. The end of
+ * the last line of a string ending with a line terminator is the end of the
+ * string, as returned by +positionForCharacterAtIndex:inText:.
+ */
 - (NSUInteger)convertToPositionInText:(NSString *)string;
 
 - (NSDictionary *)params;
@@ -109,9 +126,73 @@ typedef NS_ENUM(NSUInteger, LSPDocumentHighlightKind) {
  */
 @property (readonly) LSPPosition *end;
 
+/**
+ * The positions are the ones of +[LSPPosition positionForCharacterAtIndex:inText:].
+ */
 + (instancetype)range:(NSRange)range inText:(NSString *)string;
 + (instancetype)rangeFromDictionary:(NSDictionary *)dict;
+/**
+ * The positions are converted as with -[LSPPosition convertToPositionInText:].
+ */
 - (NSRange)convertToRangeInText:(NSString *)string;
+/**
+ * Converts all ranges with a single pass over string, instead of one pass
+ * per range. characterRanges must have room for [ranges count] elements.
+ */
++ (void)getCharacterRanges:(NSRange *)characterRanges forRanges:(NSArray<LSPRange *> *)ranges inText:(NSString *)string;
+
+- (NSDictionary *)params;
+
+@end
+
+/**
+ * The sorted line start offsets of a string. Converting between character
+ * indexes and positions is a binary search instead of a walk over the text.
+ *
+ * Line terminators are the same as for -[NSString lineRangeForRange:]. When
+ * the indexed string is mutable, every edit must be reported with
+ * -didReplaceCharactersInRange:withLength: after it was applied. The offsets
+ * behind an edit are shifted lazily, so typing at the same place does not
+ * touch the rest of the index.
+ */
+@interface LSPLineIndex : NSObject
+/**
+ * The indexed string. Not copied.
+ */
+@property (readonly) NSString *string;
+/**
+ * The number of lines. A string ending with a line terminator has an empty
+ * last line.
+ */
+@property (readonly) NSUInteger numberOfLines;
+
+- (instancetype)initWithString:(NSString *)string;
+
+/**
+ * Updates the index after the characters in range (of the string before the
+ * edit) have been replaced with length characters.
+ */
+- (void)didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+
+- (NSUInteger)lineForCharacterAtIndex:(NSUInteger)location;
+/**
+ * The character index at which line starts, or NSNotFound if the string has
+ * less lines.
+ */
+- (NSUInteger)characterIndexForLine:(NSUInteger)line;
+
+/**
+ * Returns nil if location is beyond the end of the string.
+ */
+- (LSPPosition *)positionForCharacterAtIndex:(NSUInteger)location;
+/**
+ * A character beyond the end of the line defaults back to the end of the line,
+ * a line beyond the end of the string to the end of the string.
+ */
+- (NSUInteger)characterIndexForPosition:(LSPPosition *)position;
+- (LSPRange *)rangeForCharacterRange:(NSRange)range;
+- (NSRange)characterRangeForRange:(LSPRange *)range;
+- (void)getCharacterRanges:(NSRange *)characterRanges forRanges:(NSArray<LSPRange *> *)ranges;
 
 @end
 
@@ -167,10 +248,22 @@ typedef NS_ENUM(NSUInteger, LSPDiagnosticSeverity) {
  * a scope collide all definitions can be marked via this property.
  */
 @property (readonly) id relatedInformation;
+/**
+ * The range converted to a character range of the document text. LSPClient
+ * resolves the ranges of diagnostics for open documents before the observers
+ * are notified. {NSNotFound, 0} if the range was not resolved.
+ */
+@property (readonly) NSRange characterRange;
 
 + (NSArray<LSPDiagnostic *> *)diagnosticsFromArray:(NSArray *)array;
 + (instancetype)diagnosticFromDictionary:(NSDictionary *)dict;
 
+/**
+ * Resolves the characterRange of all diagnostics with a single pass over string.
+ */
++ (void)resolveCharacterRangesOfDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics inText:(NSString *)string;
++ (void)resolveCharacterRangesOfDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics lineIndex:(LSPLineIndex *)lineIndex;
+
 @end
 
 /**
@@ -319,3 +412,45 @@ typedef NS_ENUM(NSUInteger, LSPCompletionItemKind) {
 - (instancetype)initWithDictionary:(NSDictionary *)dict;
 
 @end
+
+typedef NS_ENUM(NSUInteger, LSPWorkDoneProgressKind) {
+    LSPWorkDoneProgressKindBegin = 1,
+    LSPWorkDoneProgressKindReport = 2,
+    LSPWorkDoneProgressKindEnd = 3,
+};
+
+/**
+ * A $/progress notification of work done by the server, for a request of
+ * the client or for work the server started on its own, like indexing.
+ */
+@interface LSPWorkDoneProgress : NSObject
+/**
+ * Identifies the work across its begin, report and end notifications.
+ */
+@property (readonly) id token;
+@property (readonly) LSPWorkDoneProgressKind kind;
+/**
+ * Only sent with the begin notification.
+ */
+@property (readonly) NSString *title;
+@property (readonly) NSString *message;
+/**
+ * From 0 to 100, NSNotFound if the server does not know.
+ */
+@property (readonly) NSUInteger percentage;
+/**
+ * YES if the work can be cancelled with -[LSPClient cancelWorkDoneProgress:].
+ */
+@property (readonly, getter=isCancellable) BOOL cancellable;
+/**
+ * The document of the request reporting the progress, nil for the work of
+ * the server itself and for requests without a document.
+ */
+@property (readonly) NSURL *url;
+
+/**
+ * Returns nil if value is not a work done progress.
+ */
++ (instancetype)progressWithToken:(id)token value:(NSDictionary *)value;
+
+@end
@@ -8,8 +8,66 @@
 
 #import "LSPCommon.h"
 
+#import <os/lock.h>
+
 NSErrorDomain const LSPResponseError = @"LSPResponseError";
 
+/**
+ * The line index of the string last converted with one of the methods taking
+ * a string, so converting several positions of the same text builds the index
+ * once. Only immutable strings are cached, a mutable one may have changed.
+ *
+ * The cache is weak. The index, and the string it holds, live until the
+ * autorelease pool of the conversion is drained, not until the next one.
+ */
+static LSPLineIndex *LSPLineIndexForString(NSString *string) {
+    static os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+    static __weak LSPLineIndex *cachedLineIndex = nil;
+    NSString *immutableString = [string copy];
+    os_unfair_lock_lock(&lock);
+    LSPLineIndex *lineIndex = cachedLineIndex;
+    os_unfair_lock_unlock(&lock);
+    if (lineIndex != nil && [lineIndex string] == immutableString) {
+        return lineIndex;
+    }
+    lineIndex = [[LSPLineIndex alloc] initWithString:immutableString];
+    if (immutableString == string) {
+        __autoreleasing LSPLineIndex *autoreleasedLineIndex = lineIndex;
+        (void)autoreleasedLineIndex;
+        os_unfair_lock_lock(&lock);
+        cachedLineIndex = lineIndex;
+        os_unfair_lock_unlock(&lock);
+    }
+    return lineIndex;
+}
+
+/**
+ * Like -[LSPLineIndex positionForCharacterAtIndex:], except that the end of a
+ * string ending with a line terminator is at the end of the last line, not at
+ * the start of the empty line after it, as it always was for these methods.
+ */
+static LSPPosition *LSPLegacyPositionForCharacterAtIndex(LSPLineIndex *lineIndex, NSUInteger location) {
+    NSUInteger numberOfLines = [lineIndex numberOfLines];
+    NSUInteger length = [[lineIndex string] length];
+    if (location == length && numberOfLines > 1 && [lineIndex characterIndexForLine:numberOfLines - 1] == length) {
+        NSUInteger line = numberOfLines - 2;
+        return [LSPPosition positionWithLine:line character:location - [lineIndex characterIndexForLine:line]];
+    }
+    return [lineIndex positionForCharacterAtIndex:location];
+}
+
+/** The inverse of LSPLegacyPositionForCharacterAtIndex(). */
+static NSUInteger LSPLegacyCharacterIndexForPosition(LSPLineIndex *lineIndex, LSPPosition *position) {
+    NSUInteger numberOfLines = [lineIndex numberOfLines];
+    NSUInteger length = [[lineIndex string] length];
+    if (numberOfLines > 1 && [position line] == numberOfLines - 2 && [lineIndex characterIndexForLine:numberOfLines - 1] == length) {
+        if ([lineIndex characterIndexForLine:[position line]] + [position character] >= length) {
+            return length;
+        }
+    }
+    return [lineIndex characterIndexForPosition:position];
+}
+
 @implementation LSPPosition
 
 + (instancetype)positionFromDictionary:(NSDictionary *)dict {
@@ -22,24 +80,7 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 }
 
 + (instancetype)positionForCharacterAtIndex:(NSUInteger)loc inText:(NSString *)string {
-    LSPPosition *position = nil;
-    NSUInteger lineNumber, index, stringLength = [string length];
-    BOOL locationIsEndOfString = (loc == stringLength);
-    if (locationIsEndOfString) {
-        position = [LSPPosition positionWithLine:0 character:0];
-    }
-    for (index = 0, lineNumber = 0; index < stringLength; lineNumber++) {
-        NSRange range = [string lineRangeForRange:NSMakeRange(index, 0)];
-        BOOL locationInRange = NSLocationInRange(loc, range);
-        BOOL isEndOfString = (stringLength == NSMaxRange(range));
-        if (locationInRange || (isEndOfString && locationIsEndOfString)) {
-            NSUInteger character = loc - index;
-            position = [LSPPosition positionWithLine:lineNumber character:character];
-            break;
-        }
-        index = NSMaxRange(range);
-    }
-    return position;
+    return LSPLegacyPositionForCharacterAtIndex(LSPLineIndexForString(string), loc);
 }
 
 + (instancetype)positionWithLine:(NSUInteger)line character:(NSUInteger)character {
@@ -60,15 +101,7 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 }
 
 - (NSUInteger)convertToPositionInText:(NSString *)string {
-    NSUInteger numberOfLines, index, stringLength = [string length];
-    for (index = 0, numberOfLines = 0; index <= stringLength; numberOfLines++) {
-        if (_line == numberOfLines) {
-            return index + _character;
-        }
-        NSRange lineRange = [string lineRangeForRange:NSMakeRange(index, 0)];
-        index = NSMaxRange(lineRange);
-    }
-    return NSNotFound;
+    return LSPLegacyCharacterIndexForPosition(LSPLineIndexForString(string), self);
 }
 
 - (NSDictionary *)params {
@@ -90,8 +123,9 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 }
 
 + (instancetype)range:(NSRange)range inText:(NSString *)string {
-    LSPPosition *start = [LSPPosition positionForCharacterAtIndex:range.location inText:string];
-    LSPPosition *end = [LSPPosition positionForCharacterAtIndex:NSMaxRange(range) inText:string];
+    LSPLineIndex *lineIndex = LSPLineIndexForString(string);
+    LSPPosition *start = LSPLegacyPositionForCharacterAtIndex(lineIndex, range.location);
+    LSPPosition *end = LSPLegacyPositionForCharacterAtIndex(lineIndex, NSMaxRange(range));
     return [[LSPRange alloc] initWithStart:start end:end];
 }
 
@@ -110,11 +144,19 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 }
 
 - (NSRange)convertToRangeInText:(NSString *)string {
-    NSUInteger startCharacterIndex = [_start convertToPositionInText:string];
-    NSUInteger endCharacterIndex = [_end convertToPositionInText:string];
+    LSPLineIndex *lineIndex = LSPLineIndexForString(string);
+    NSUInteger startCharacterIndex = LSPLegacyCharacterIndexForPosition(lineIndex, _start);
+    NSUInteger endCharacterIndex = LSPLegacyCharacterIndexForPosition(lineIndex, _end);
+    if (startCharacterIndex == NSNotFound || endCharacterIndex < startCharacterIndex) {
+        return NSMakeRange(NSNotFound, 0);
+    }
     return NSMakeRange(startCharacterIndex, endCharacterIndex - startCharacterIndex);
 }
 
++ (void)getCharacterRanges:(NSRange *)characterRanges forRanges:(NSArray<LSPRange *> *)ranges inText:(NSString *)string {
+    [LSPLineIndexForString(string) getCharacterRanges:characterRanges forRanges:ranges];
+}
+
 - (NSDictionary *)params {
     return [NSDictionary dictionaryWithObjectsAndKeys:
             [_start params], @"start",
@@ -125,6 +167,210 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 @end
 
 
+/**
+ * Line start offsets. The offsets from deltaIndex on are stored without the
+ * pending delta of the edits before them.
+ */
+typedef struct {
+    NSUInteger *offsets;
+    NSUInteger count;
+    NSUInteger capacity;
+    NSUInteger deltaIndex;
+    NSInteger delta;
+} LSPLineStarts;
+
+static inline NSUInteger LSPLineStartAtIndex(const LSPLineStarts *lines, NSUInteger index) {
+    NSUInteger offset = lines->offsets[index];
+    return (index < lines->deltaIndex) ? offset : offset + lines->delta;
+}
+
+static void LSPLineStartsReserve(LSPLineStarts *lines, NSUInteger count) {
+    if (count <= lines->capacity) return;
+    NSUInteger capacity = MAX(lines->capacity * 2, MAX(count, 64));
+    lines->offsets = reallocf(lines->offsets, capacity * sizeof(NSUInteger));
+    lines->capacity = capacity;
+}
+
+/** Moves the start of the pending delta to index, applying or removing it on the lines in between. */
+static void LSPLineStartsMoveDelta(LSPLineStarts *lines, NSUInteger index) {
+    if (lines->delta != 0) {
+        NSUInteger from = MIN(index, lines->deltaIndex);
+        NSUInteger to = MIN(MAX(index, lines->deltaIndex), lines->count);
+        NSInteger delta = (index > lines->deltaIndex) ? lines->delta : -lines->delta;
+        for (NSUInteger i = from; i < to; i++) {
+            lines->offsets[i] += delta;
+        }
+    }
+    lines->deltaIndex = index;
+}
+
+/** Index of the first line starting at or after location. */
+static NSUInteger LSPLineStartsLowerBound(const LSPLineStarts *lines, NSUInteger location) {
+    NSUInteger low = 0, high = lines->count;
+    while (low < high) {
+        NSUInteger mid = low + (high - low) / 2;
+        if (LSPLineStartAtIndex(lines, mid) < location) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * Appends the start of every line following a line terminator in
+ * [from, to) of string, as long as the start is within [minStart, maxStart].
+ */
+static void LSPLineStartsScan(LSPLineStarts *lines, CFStringRef string, NSUInteger from, NSUInteger to, NSUInteger minStart, NSUInteger maxStart) {
+    NSUInteger length = CFStringGetLength(string);
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer(string, &buffer, CFRangeMake(0, length));
+    for (NSUInteger i = from; i < to; i++) {
+        UniChar c = CFStringGetCharacterFromInlineBuffer(&buffer, i);
+        if (c == '\r') {
+            if (i + 1 < length && CFStringGetCharacterFromInlineBuffer(&buffer, i + 1) == '\n') {
+                i++;
+            }
+        } else if (c != '\n' && c != 0x85 && c != 0x2028 && c != 0x2029) {
+            continue;
+        }
+        NSUInteger start = i + 1;
+        if (start >= minStart && start <= maxStart) {
+            LSPLineStartsReserve(lines, lines->count + 1);
+            lines->offsets[lines->count++] = start;
+        }
+    }
+}
+
+@implementation LSPLineIndex {
+    LSPLineStarts _lines;
+}
+
+- (instancetype)initWithString:(NSString *)string {
+    self = [super init];
+    if (self) {
+        _string = (string != nil) ? string : @"";
+        LSPLineStartsReserve(&_lines, 1);
+        _lines.offsets[_lines.count++] = 0;
+        NSUInteger length = [_string length];
+        LSPLineStartsScan(&_lines, (__bridge CFStringRef)_string, 0, length, 1, length);
+        _lines.deltaIndex = _lines.count;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_lines.offsets);
+}
+
+- (NSUInteger)numberOfLines {
+    return _lines.count;
+}
+
+- (void)didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length {
+    // Whether a line starts at an index only depends on the characters before
+    // and at that index. So only line starts from the edit up to one character
+    // behind it can change, the ones after it are just shifted.
+    NSUInteger location = MAX(range.location, 1);
+    NSUInteger first = LSPLineStartsLowerBound(&_lines, location);
+    NSUInteger last = LSPLineStartsLowerBound(&_lines, NSMaxRange(range) + 2);
+    LSPLineStartsMoveDelta(&_lines, last);
+    
+    LSPLineStarts scanned = { 0 };
+    NSUInteger editEnd = range.location + length;
+    NSUInteger scanStart = (range.location > 0) ? range.location - 1 : 0;
+    LSPLineStartsScan(&scanned, (__bridge CFStringRef)_string, scanStart, MIN(editEnd + 1, [_string length]), location, editEnd + 1);
+    NSUInteger count = _lines.count;
+    NSUInteger inserted = scanned.count;
+    NSUInteger removed = last - first;
+    LSPLineStartsReserve(&_lines, count - removed + inserted);
+    memmove(_lines.offsets + first + inserted, _lines.offsets + last, (count - last) * sizeof(NSUInteger));
+    if (inserted > 0) {
+        memcpy(_lines.offsets + first, scanned.offsets, inserted * sizeof(NSUInteger));
+    }
+    free(scanned.offsets);
+    _lines.count = count - removed + inserted;
+    _lines.deltaIndex = first + inserted;
+    _lines.delta += (NSInteger)length - (NSInteger)range.length;
+    if (_lines.deltaIndex >= _lines.count) {
+        _lines.delta = 0;
+    }
+}
+
+- (NSUInteger)lineForCharacterAtIndex:(NSUInteger)location {
+    // The last line starting at or before location.
+    NSUInteger index = LSPLineStartsLowerBound(&_lines, location);
+    if (index == _lines.count || LSPLineStartAtIndex(&_lines, index) > location) {
+        index--;
+    }
+    return index;
+}
+
+- (NSUInteger)characterIndexForLine:(NSUInteger)line {
+    if (line >= _lines.count) return NSNotFound;
+    return LSPLineStartAtIndex(&_lines, line);
+}
+
+/** The end of line without its line terminator. */
+- (NSUInteger)_contentsEndOfLine:(NSUInteger)line {
+    if (line + 1 >= _lines.count) {
+        return [_string length];
+    }
+    NSUInteger lineStart = LSPLineStartAtIndex(&_lines, line);
+    NSUInteger end = LSPLineStartAtIndex(&_lines, line + 1) - 1;
+    if (end > lineStart && [_string characterAtIndex:end] == '\n' && [_string characterAtIndex:end - 1] == '\r') {
+        end--;
+    }
+    return end;
+}
+
+- (LSPPosition *)positionForCharacterAtIndex:(NSUInteger)location {
+    if (location > [_string length]) return nil;
+    NSUInteger line = [self lineForCharacterAtIndex:location];
+    return [LSPPosition positionWithLine:line character:location - LSPLineStartAtIndex(&_lines, line)];
+}
+
+- (NSUInteger)characterIndexForPosition:(LSPPosition *)position {
+    if (position == nil) return NSNotFound;
+    NSUInteger line = [position line];
+    if (line >= _lines.count) {
+        return [_string length];
+    }
+    NSUInteger lineStart = LSPLineStartAtIndex(&_lines, line);
+    NSUInteger lineEnd = [self _contentsEndOfLine:line];
+    return lineStart + MIN([position character], lineEnd - lineStart);
+}
+
+- (LSPRange *)rangeForCharacterRange:(NSRange)range {
+    LSPPosition *start = [self positionForCharacterAtIndex:range.location];
+    LSPPosition *end = [self positionForCharacterAtIndex:NSMaxRange(range)];
+    return [[LSPRange alloc] initWithStart:start end:end];
+}
+
+- (NSRange)characterRangeForRange:(LSPRange *)range {
+    NSUInteger startCharacterIndex = [self characterIndexForPosition:[range start]];
+    NSUInteger endCharacterIndex = [self characterIndexForPosition:[range end]];
+    if (startCharacterIndex == NSNotFound || endCharacterIndex < startCharacterIndex) {
+        return NSMakeRange(NSNotFound, 0);
+    }
+    return NSMakeRange(startCharacterIndex, endCharacterIndex - startCharacterIndex);
+}
+
+- (void)getCharacterRanges:(NSRange *)characterRanges forRanges:(NSArray<LSPRange *> *)ranges {
+    NSUInteger index = 0;
+    for (LSPRange *range in ranges) {
+        characterRanges[index++] = [self characterRangeForRange:range];
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ numberOfLines = %lu>", [self className], (unsigned long)_lines.count];
+}
+
+@end
+
+
 @interface LSPDiagnostic ()
 @property (readwrite) LSPRange *range;
 @property (readwrite) LSPDiagnosticSeverity severity;
@@ -132,6 +378,7 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 @property (readwrite) NSString *source;
 @property (readwrite) NSString *message;
 @property (readwrite) id relatedInformation;
+@property (readwrite) NSRange characterRange;
 @end
 
 @implementation LSPDiagnostic
@@ -151,6 +398,7 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 + (instancetype)diagnosticFromDictionary:(NSDictionary *)dict {
     if ([dict isKindOfClass:[NSDictionary class]] == NO) return nil;
     LSPDiagnostic *diagnostic = [[LSPDiagnostic alloc] init];
+    diagnostic.characterRange = NSMakeRange(NSNotFound, 0);
     diagnostic.range = [LSPRange rangeFromDictionary:[dict objectForKey:@"range"]];
     diagnostic.severity = [[dict objectForKey:@"severity"] integerValue];
     diagnostic.code = [dict objectForKey:@"code"];
@@ -159,6 +407,17 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
     return diagnostic;
 }
 
++ (void)resolveCharacterRangesOfDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics inText:(NSString *)string {
+    if ([diagnostics count] == 0) return;
+    [self resolveCharacterRangesOfDiagnostics:diagnostics lineIndex:LSPLineIndexForString(string)];
+}
+
++ (void)resolveCharacterRangesOfDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics lineIndex:(LSPLineIndex *)lineIndex {
+    for (LSPDiagnostic *diagnostic in diagnostics) {
+        diagnostic.characterRange = [lineIndex characterRangeForRange:diagnostic.range];
+    }
+}
+
 - (NSString *)description {
     return [NSString stringWithFormat:@"<%@ message = %@ range = %@>", [self className], _message, _range];
 }
@@ -223,3 +482,47 @@ NSErrorDomain const LSPResponseError = @"LSPResponseError";
 
 @end
 
+
+
+@interface LSPWorkDoneProgress ()
+@property (readwrite) id token;
+@property (readwrite) LSPWorkDoneProgressKind kind;
+@property (readwrite) NSString *title;
+@property (readwrite) NSString *message;
+@property (readwrite) NSUInteger percentage;
+@property (readwrite, getter=isCancellable) BOOL cancellable;
+/** Used by LSPClient. */
+@property (readwrite) NSURL *url;
+@end
+
+@implementation LSPWorkDoneProgress
+
++ (instancetype)progressWithToken:(id)token value:(NSDictionary *)value {
+    if ([value isKindOfClass:[NSDictionary class]] == NO) return nil;
+    NSString *kind = [value objectForKey:@"kind"];
+    LSPWorkDoneProgress *progress = [[LSPWorkDoneProgress alloc] init];
+    if ([kind isEqual:@"begin"]) {
+        progress.kind = LSPWorkDoneProgressKindBegin;
+    } else if ([kind isEqual:@"report"]) {
+        progress.kind = LSPWorkDoneProgressKindReport;
+    } else if ([kind isEqual:@"end"]) {
+        progress.kind = LSPWorkDoneProgressKindEnd;
+    } else {
+        return nil;
+    }
+    NSString *title = [value objectForKey:@"title"];
+    NSString *message = [value objectForKey:@"message"];
+    NSNumber *percentage = [value objectForKey:@"percentage"];
+    progress.token = token;
+    progress.title = [title isKindOfClass:[NSString class]] ? title : nil;
+    progress.message = [message isKindOfClass:[NSString class]] ? message : nil;
+    progress.percentage = [percentage isKindOfClass:[NSNumber class]] ? MIN([percentage unsignedIntegerValue], (NSUInteger)100) : NSNotFound;
+    progress.cancellable = [[value objectForKey:@"cancellable"] boolValue];
+    return progress;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ token = %@ kind = %lu percentage = %lu message = %@ url = %@>", [self className], _token, (unsigned long)_kind, (unsigned long)_percentage, _message, _url];
+}
+
+@end
@@ -0,0 +1,51 @@
+//
+//  LSPCompletionList.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <LSPKit/LSPCommon.h>
+
+/**
+ * The items of a completion reply. An array of LSPCompletionItem, but an
+ * item is only decoded when it is accessed. The labels, kinds and filter
+ * texts are extracted into compact arrays when the list is created, and the
+ * sort texts are turned into the rank of each item. So a list of thousands of
+ * items can be shown and filtered without creating an object per item.
+ *
+ * Immutable and safe to use from any thread.
+ */
+@interface LSPCompletionList : NSArray<LSPCompletionItem *>
+
+/**
+ * items are the CompletionItem dictionaries of the reply, entries that are
+ * not dictionaries are skipped.
+ */
+- (instancetype)initWithItems:(NSArray<NSDictionary *> *)items incomplete:(BOOL)incomplete;
+
+/**
+ * This list is not complete. Further typing should result in recomputing
+ * this list.
+ */
+@property (readonly, getter=isIncomplete) BOOL incomplete;
+
+/**
+ * The label and kind of an item, without decoding it.
+ */
+- (NSString *)labelAtIndex:(NSUInteger)index;
+- (LSPCompletionItemKind)kindAtIndex:(NSUInteger)index;
+@property (readonly) NSArray<NSString *> *labels;
+
+/**
+ * The items whose filter text starts with word or contains its characters
+ * in order, ignoring ASCII case. Items starting with word come first, then
+ * the ones whose first character matches, each ordered by sort text. An
+ * empty word keeps all items, ordered by sort text. The list shares the
+ * storage of the receiver.
+ */
+- (LSPCompletionList *)completionListFilteredByWord:(NSString *)word;
+
+@end
@@ -0,0 +1,438 @@
+//
+//  LSPCompletionList.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPCompletionList.h"
+
+#import <os/lock.h>
+
+/**
+ * The columns of a completion reply, shared by a list and the lists filtered
+ * from it. The filter texts are kept in one buffer of UTF-16 code units with
+ * ASCII folded to lower case, item i at filterOffsets[i] up to
+ * filterOffsets[i + 1].
+ */
+@interface LSPCompletionListStorage : NSObject {
+@public
+    NSArray<NSDictionary *> *_items;
+    NSArray<NSString *> *_labels;
+    NSArray<NSString *> *_sortTexts;
+    uint8_t *_kinds;
+    unichar *_filterCharacters;
+    NSUInteger *_filterOffsets;
+    uint32_t *_sortRanks;
+    NSPointerArray *_decodedItems;
+    NSMutableDictionary<NSNumber *, LSPCompletionItem *> *_resolvedItems;
+    os_unfair_lock _lock;
+}
+- (instancetype)initWithItems:(NSArray<NSDictionary *> *)items;
+- (instancetype)initWithStorage:(LSPCompletionListStorage *)storage insertingItemsAtIndexes:(const uint32_t *)indexes count:(NSUInteger)count ofStorage:(LSPCompletionListStorage *)insertedStorage atIndex:(NSUInteger)position;
+@end
+
+static inline unichar LSPFoldCharacter(unichar c) {
+    return (c >= 'A' && c <= 'Z') ? (unichar)(c + ('a' - 'A')) : c;
+}
+
+@implementation LSPCompletionListStorage
+
+- (instancetype)initWithItems:(NSArray<NSDictionary *> *)items {
+    self = [super init];
+    if (self) {
+        NSMutableArray *dictionaries = [NSMutableArray arrayWithCapacity:[items count]];
+        for (NSDictionary *item in items) {
+            if ([item isKindOfClass:[NSDictionary class]]) {
+                [dictionaries addObject:item];
+            }
+        }
+        _items = dictionaries;
+        NSUInteger count = [dictionaries count];
+        NSMutableArray *labels = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *sortTexts = [NSMutableArray arrayWithCapacity:count];
+        _kinds = calloc(MAX(count, 1), sizeof(uint8_t));
+        _filterOffsets = calloc(count + 1, sizeof(NSUInteger));
+        NSUInteger filterCapacity = 16 * MAX(count, 1);
+        _filterCharacters = malloc(filterCapacity * sizeof(unichar));
+        for (NSUInteger index = 0; index < count; index++) {
+            NSDictionary *item = [dictionaries objectAtIndex:index];
+            NSString *label = [item objectForKey:@"label"];
+            if ([label isKindOfClass:[NSString class]] == NO) {
+                label = @"";
+            }
+            [labels addObject:label];
+            _kinds[index] = (uint8_t)MIN([[item objectForKey:@"kind"] unsignedIntegerValue], (NSUInteger)UINT8_MAX);
+            NSString *sortText = [item objectForKey:@"sortText"];
+            [sortTexts addObject:[sortText isKindOfClass:[NSString class]] ? sortText : label];
+
+            NSString *filterText = [item objectForKey:@"filterText"];
+            if ([filterText isKindOfClass:[NSString class]] == NO) {
+                filterText = label;
+            }
+            NSUInteger length = [filterText length];
+            NSUInteger offset = _filterOffsets[index];
+            if (offset + length > filterCapacity) {
+                filterCapacity = MAX(filterCapacity * 2, offset + length);
+                _filterCharacters = realloc(_filterCharacters, filterCapacity * sizeof(unichar));
+            }
+            [filterText getCharacters:_filterCharacters + offset range:NSMakeRange(0, length)];
+            for (NSUInteger i = offset; i < offset + length; i++) {
+                _filterCharacters[i] = LSPFoldCharacter(_filterCharacters[i]);
+            }
+            _filterOffsets[index + 1] = offset + length;
+        }
+        _labels = labels;
+        _sortTexts = sortTexts;
+
+        // The sort texts are only needed to order the items, their rank is enough.
+        NSUInteger *order = malloc(MAX(count, 1) * sizeof(NSUInteger));
+        for (NSUInteger index = 0; index < count; index++) {
+            order[index] = index;
+        }
+        qsort_b(order, count, sizeof(NSUInteger), ^int(const void *a, const void *b) {
+            NSUInteger indexA = *(const NSUInteger *)a;
+            NSUInteger indexB = *(const NSUInteger *)b;
+            NSComparisonResult result = [[sortTexts objectAtIndex:indexA] compare:[sortTexts objectAtIndex:indexB]];
+            if (result == NSOrderedSame) {
+                return (indexA < indexB) ? -1 : (indexA > indexB);
+            }
+            return (result == NSOrderedAscending) ? -1 : 1;
+        });
+        _sortRanks = malloc(MAX(count, 1) * sizeof(uint32_t));
+        for (NSUInteger rank = 0; rank < count; rank++) {
+            _sortRanks[order[rank]] = (uint32_t)rank;
+        }
+        free(order);
+
+        _decodedItems = [NSPointerArray strongObjectsPointerArray];
+        [_decodedItems setCount:count];
+        _resolvedItems = [NSMutableDictionary dictionary];
+        _lock = OS_UNFAIR_LOCK_INIT;
+    }
+    return self;
+}
+
+/**
+ * The items of storage with the items at indexes of insertedStorage, in the
+ * order of indexes, inserted at position. The columns are copied, the item
+ * dictionaries are not read again. The sort ranks of both are merged, only
+ * the inserted items are sorted.
+ */
+- (instancetype)initWithStorage:(LSPCompletionListStorage *)storage insertingItemsAtIndexes:(const uint32_t *)indexes count:(NSUInteger)count ofStorage:(LSPCompletionListStorage *)insertedStorage atIndex:(NSUInteger)position {
+    self = [super init];
+    if (self) {
+        NSUInteger storageCount = [storage->_items count];
+        NSUInteger total = storageCount + count;
+        NSMutableArray *items = [NSMutableArray arrayWithCapacity:total];
+        NSMutableArray *labels = [NSMutableArray arrayWithCapacity:total];
+        NSMutableArray *sortTexts = [NSMutableArray arrayWithCapacity:total];
+        [items addObjectsFromArray:[storage->_items subarrayWithRange:NSMakeRange(0, position)]];
+        [labels addObjectsFromArray:[storage->_labels subarrayWithRange:NSMakeRange(0, position)]];
+        [sortTexts addObjectsFromArray:[storage->_sortTexts subarrayWithRange:NSMakeRange(0, position)]];
+        for (NSUInteger index = 0; index < count; index++) {
+            [items addObject:[insertedStorage->_items objectAtIndex:indexes[index]]];
+            [labels addObject:[insertedStorage->_labels objectAtIndex:indexes[index]]];
+            [sortTexts addObject:[insertedStorage->_sortTexts objectAtIndex:indexes[index]]];
+        }
+        NSRange tail = NSMakeRange(position, storageCount - position);
+        [items addObjectsFromArray:[storage->_items subarrayWithRange:tail]];
+        [labels addObjectsFromArray:[storage->_labels subarrayWithRange:tail]];
+        [sortTexts addObjectsFromArray:[storage->_sortTexts subarrayWithRange:tail]];
+        _items = items;
+        _labels = labels;
+        _sortTexts = sortTexts;
+
+        _kinds = calloc(MAX(total, 1), sizeof(uint8_t));
+        memcpy(_kinds, storage->_kinds, position * sizeof(uint8_t));
+        for (NSUInteger index = 0; index < count; index++) {
+            _kinds[position + index] = insertedStorage->_kinds[indexes[index]];
+        }
+        memcpy(_kinds + position + count, storage->_kinds + position, tail.length * sizeof(uint8_t));
+
+        NSUInteger insertedLength = 0;
+        for (NSUInteger index = 0; index < count; index++) {
+            insertedLength += insertedStorage->_filterOffsets[indexes[index] + 1] - insertedStorage->_filterOffsets[indexes[index]];
+        }
+        NSUInteger headLength = storage->_filterOffsets[position];
+        NSUInteger tailLength = storage->_filterOffsets[storageCount] - headLength;
+        _filterCharacters = malloc(MAX(headLength + insertedLength + tailLength, 1) * sizeof(unichar));
+        _filterOffsets = calloc(total + 1, sizeof(NSUInteger));
+        memcpy(_filterCharacters, storage->_filterCharacters, headLength * sizeof(unichar));
+        memcpy(_filterOffsets, storage->_filterOffsets, (position + 1) * sizeof(NSUInteger));
+        for (NSUInteger index = 0; index < count; index++) {
+            NSUInteger start = insertedStorage->_filterOffsets[indexes[index]];
+            NSUInteger length = insertedStorage->_filterOffsets[indexes[index] + 1] - start;
+            NSUInteger offset = _filterOffsets[position + index];
+            memcpy(_filterCharacters + offset, insertedStorage->_filterCharacters + start, length * sizeof(unichar));
+            _filterOffsets[position + index + 1] = offset + length;
+        }
+        memcpy(_filterCharacters + headLength + insertedLength, storage->_filterCharacters + headLength, tailLength * sizeof(unichar));
+        for (NSUInteger index = position + 1; index <= storageCount; index++) {
+            _filterOffsets[index + count] = storage->_filterOffsets[index] + insertedLength;
+        }
+
+        // The items of storage are in order of their ranks already, ties by
+        // index. The inserted ones are sorted on their own, then both merged.
+        NSUInteger *order = malloc(MAX(storageCount, 1) * sizeof(NSUInteger));
+        for (NSUInteger index = 0; index < storageCount; index++) {
+            order[storage->_sortRanks[index]] = (index < position) ? index : index + count;
+        }
+        NSUInteger *insertedOrder = malloc(MAX(count, 1) * sizeof(NSUInteger));
+        for (NSUInteger index = 0; index < count; index++) {
+            insertedOrder[index] = position + index;
+        }
+        NSComparisonResult (^compare)(NSUInteger, NSUInteger) = ^NSComparisonResult(NSUInteger indexA, NSUInteger indexB) {
+            NSComparisonResult result = [[sortTexts objectAtIndex:indexA] compare:[sortTexts objectAtIndex:indexB]];
+            if (result == NSOrderedSame) {
+                return (indexA < indexB) ? NSOrderedAscending : (indexA > indexB) ? NSOrderedDescending : NSOrderedSame;
+            }
+            return result;
+        };
+        qsort_b(insertedOrder, count, sizeof(NSUInteger), ^int(const void *a, const void *b) {
+            return (int)compare(*(const NSUInteger *)a, *(const NSUInteger *)b);
+        });
+        _sortRanks = malloc(MAX(total, 1) * sizeof(uint32_t));
+        NSUInteger next = 0, insertedNext = 0;
+        for (NSUInteger rank = 0; rank < total; rank++) {
+            BOOL takesInserted = (next == storageCount) || (insertedNext < count && compare(insertedOrder[insertedNext], order[next]) == NSOrderedAscending);
+            _sortRanks[takesInserted ? insertedOrder[insertedNext++] : order[next++]] = (uint32_t)rank;
+        }
+        free(order);
+        free(insertedOrder);
+
+        _decodedItems = [NSPointerArray strongObjectsPointerArray];
+        [_decodedItems setCount:total];
+        _resolvedItems = [NSMutableDictionary dictionary];
+        _lock = OS_UNFAIR_LOCK_INIT;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_kinds);
+    free(_filterCharacters);
+    free(_filterOffsets);
+    free(_sortRanks);
+}
+
+- (LSPCompletionItem *)itemAtIndex:(NSUInteger)index {
+    os_unfair_lock_lock(&_lock);
+    LSPCompletionItem *item = (__bridge LSPCompletionItem *)[_decodedItems pointerAtIndex:index];
+    if (item == nil) {
+        item = [[LSPCompletionItem alloc] initWithDictionary:[_items objectAtIndex:index]];
+        [_decodedItems replacePointerAtIndex:index withPointer:(__bridge void *)item];
+    }
+    os_unfair_lock_unlock(&_lock);
+    return item;
+}
+
+/**
+ * 0 if the filter text of the item starts with word, 1 if it contains the
+ * characters of word in order and starts with the first one, 2 if it only
+ * contains them, NSNotFound otherwise.
+ */
+- (NSUInteger)matchOfItemAtIndex:(NSUInteger)index word:(const unichar *)word length:(NSUInteger)wordLength {
+    const unichar *text = _filterCharacters + _filterOffsets[index];
+    NSUInteger length = _filterOffsets[index + 1] - _filterOffsets[index];
+    if (wordLength == 0) {
+        return 0;
+    }
+    if (length < wordLength) {
+        return NSNotFound;
+    }
+    if (memcmp(text, word, wordLength * sizeof(unichar)) == 0) {
+        return 0;
+    }
+    NSUInteger matched = 0;
+    for (NSUInteger i = 0; i < length && matched < wordLength; i++) {
+        if (text[i] == word[matched]) {
+            matched++;
+        }
+    }
+    if (matched < wordLength) {
+        return NSNotFound;
+    }
+    return (text[0] == word[0]) ? 1 : 2;
+}
+
+@end
+
+
+@interface LSPCompletionList () {
+    LSPCompletionListStorage *_storage;
+    // Indexes into the storage, NULL for all items in the order of the reply.
+    uint32_t *_indexes;
+    NSUInteger _count;
+}
+/**
+ * Used by LSPClient to resolve items. A storage index identifies an item in
+ * the list and all lists filtered from it, the storage itself identifies
+ * the completion session.
+ */
+- (id)storage;
+- (NSUInteger)storageIndexAtIndex:(NSUInteger)index;
+- (NSDictionary *)itemDictionaryAtStorageIndex:(NSUInteger)storageIndex;
+- (LSPCompletionItem *)itemAtStorageIndex:(NSUInteger)storageIndex;
+- (LSPCompletionItem *)resolvedItemAtStorageIndex:(NSUInteger)storageIndex;
+- (void)setResolvedItem:(LSPCompletionItem *)item atStorageIndex:(NSUInteger)storageIndex;
+/**
+ * Used by LSPCompositeClient to merge the replies of several servers. The
+ * receiver must not be filtered.
+ */
+- (LSPCompletionList *)completionListByInsertingItemsOfList:(LSPCompletionList *)completionList atIndex:(NSUInteger)index incomplete:(BOOL)incomplete;
+@end
+
+@implementation LSPCompletionList
+
+- (instancetype)initWithItems:(NSArray<NSDictionary *> *)items incomplete:(BOOL)incomplete {
+    self = [super init];
+    if (self) {
+        _storage = [[LSPCompletionListStorage alloc] initWithItems:items];
+        _count = [_storage->_items count];
+        _incomplete = incomplete;
+    }
+    return self;
+}
+
+- (instancetype)_initWithStorage:(LSPCompletionListStorage *)storage indexes:(uint32_t *)indexes count:(NSUInteger)count incomplete:(BOOL)incomplete {
+    self = [super init];
+    if (self) {
+        _storage = storage;
+        _indexes = indexes;
+        _count = count;
+        _incomplete = incomplete;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_indexes);
+}
+
+- (NSUInteger)_storageIndex:(NSUInteger)index {
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)_count];
+    }
+    return _indexes ? _indexes[index] : index;
+}
+
+#pragma mark NSArray
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (LSPCompletionItem *)objectAtIndex:(NSUInteger)index {
+    return [_storage itemAtIndex:[self _storageIndex:index]];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    // Immutable, a copy would decode every item.
+    return self;
+}
+
+#pragma mark Columns
+
+- (NSString *)labelAtIndex:(NSUInteger)index {
+    return [_storage->_labels objectAtIndex:[self _storageIndex:index]];
+}
+
+- (LSPCompletionItemKind)kindAtIndex:(NSUInteger)index {
+    return (LSPCompletionItemKind)_storage->_kinds[[self _storageIndex:index]];
+}
+
+- (NSArray<NSString *> *)labels {
+    if (_indexes == NULL) {
+        return _storage->_labels;
+    }
+    NSMutableArray *labels = [NSMutableArray arrayWithCapacity:_count];
+    for (NSUInteger index = 0; index < _count; index++) {
+        [labels addObject:[_storage->_labels objectAtIndex:_indexes[index]]];
+    }
+    return labels;
+}
+
+#pragma mark Resolving
+
+- (id)storage {
+    return _storage;
+}
+
+- (NSUInteger)storageIndexAtIndex:(NSUInteger)index {
+    return [self _storageIndex:index];
+}
+
+- (NSDictionary *)itemDictionaryAtStorageIndex:(NSUInteger)storageIndex {
+    return [_storage->_items objectAtIndex:storageIndex];
+}
+
+- (LSPCompletionItem *)itemAtStorageIndex:(NSUInteger)storageIndex {
+    return [_storage itemAtIndex:storageIndex];
+}
+
+- (LSPCompletionItem *)resolvedItemAtStorageIndex:(NSUInteger)storageIndex {
+    os_unfair_lock_lock(&_storage->_lock);
+    LSPCompletionItem *item = [_storage->_resolvedItems objectForKey:[NSNumber numberWithUnsignedInteger:storageIndex]];
+    os_unfair_lock_unlock(&_storage->_lock);
+    return item;
+}
+
+- (void)setResolvedItem:(LSPCompletionItem *)item atStorageIndex:(NSUInteger)storageIndex {
+    os_unfair_lock_lock(&_storage->_lock);
+    [_storage->_resolvedItems setObject:item forKey:[NSNumber numberWithUnsignedInteger:storageIndex]];
+    os_unfair_lock_unlock(&_storage->_lock);
+}
+
+#pragma mark Merging
+
+- (LSPCompletionList *)completionListByInsertingItemsOfList:(LSPCompletionList *)completionList atIndex:(NSUInteger)index incomplete:(BOOL)incomplete {
+    NSAssert(_indexes == NULL, @"A filtered list can not be merged into");
+    NSUInteger count = [completionList count];
+    uint32_t *indexes = malloc(MAX(count, 1) * sizeof(uint32_t));
+    for (NSUInteger itemIndex = 0; itemIndex < count; itemIndex++) {
+        indexes[itemIndex] = (uint32_t)[completionList _storageIndex:itemIndex];
+    }
+    LSPCompletionListStorage *storage = [[LSPCompletionListStorage alloc] initWithStorage:_storage insertingItemsAtIndexes:indexes count:count ofStorage:completionList->_storage atIndex:index];
+    free(indexes);
+    return [[LSPCompletionList alloc] _initWithStorage:storage indexes:NULL count:[storage->_items count] incomplete:incomplete];
+}
+
+#pragma mark Filtering
+
+- (LSPCompletionList *)completionListFilteredByWord:(NSString *)word {
+    NSUInteger wordLength = [word length];
+    unichar *characters = malloc(MAX(wordLength, 1) * sizeof(unichar));
+    [word getCharacters:characters range:NSMakeRange(0, wordLength)];
+    for (NSUInteger i = 0; i < wordLength; i++) {
+        characters[i] = LSPFoldCharacter(characters[i]);
+    }
+    // The match and the sort rank of an item make its key, the storage
+    // index is kept in the low bits.
+    uint64_t *keys = malloc(MAX(_count, 1) * sizeof(uint64_t));
+    NSUInteger count = 0;
+    NSUInteger storageCount = [_storage->_items count];
+    for (NSUInteger index = 0; index < _count; index++) {
+        NSUInteger storageIndex = _indexes ? _indexes[index] : index;
+        NSUInteger match = [_storage matchOfItemAtIndex:storageIndex word:characters length:wordLength];
+        if (match != NSNotFound) {
+            uint64_t order = (uint64_t)match * storageCount + _storage->_sortRanks[storageIndex];
+            keys[count++] = (order << 32) | storageIndex;
+        }
+    }
+    free(characters);
+    qsort_b(keys, count, sizeof(uint64_t), ^int(const void *a, const void *b) {
+        uint64_t keyA = *(const uint64_t *)a;
+        uint64_t keyB = *(const uint64_t *)b;
+        return (keyA < keyB) ? -1 : (keyA > keyB);
+    });
+    uint32_t *indexes = malloc(MAX(count, 1) * sizeof(uint32_t));
+    for (NSUInteger index = 0; index < count; index++) {
+        indexes[index] = (uint32_t)(keys[index] & UINT32_MAX);
+    }
+    free(keys);
+    return [[LSPCompletionList alloc] _initWithStorage:_storage indexes:indexes count:count incomplete:_incomplete];
+}
+
+@end
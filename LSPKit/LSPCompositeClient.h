@@ -0,0 +1,113 @@
+//
+//  LSPCompositeClient.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <LSPKit/LSPClient.h>
+
+/**
+ * Several language servers working on the same documents, for example a
+ * language server and a separate linter.
+ *
+ * The text of a document is kept once: the backing clients read it from one
+ * text storage, and every open, change, save and close goes to all of them.
+ * Each client still sends the changes to its server, with versions of its
+ * own. A server that terminates gets the open documents again, with their
+ * current text.
+ *
+ * A language feature request goes in parallel to the clients whose server
+ * provides its method. The results are merged in the order of the clients,
+ * as the servers answer. Like LSPClient, documents can be opened and
+ * requests made before the clients are initialized.
+ *
+ * Must be used on the main thread.
+ */
+@interface LSPCompositeClient : NSObject
+
+/**
+ * The first client comes first in merged results, and its hover wins.
+ */
+- (instancetype)initWithClients:(NSArray<LSPClient *> *)clients;
+@property (readonly) NSArray<LSPClient *> *clients;
+
+#pragma mark General
+
+/**
+ * Initializes all clients. The completion handler is called once all of
+ * them are, with the error of the first client that failed, if any.
+ */
+- (void)initialWithCompletionHandler:(void (^)(NSError *error))completionHandler;
+- (void)terminate;
+
+/**
+ * The clients whose server provides method, like "textDocument/completion".
+ * Empty until the clients are initialized.
+ */
+- (NSArray<LSPClient *> *)clientsProvidingMethod:(NSString *)method;
+
+#pragma mark Diagnostics
+
+/**
+ * Adds an observer of the diagnostics of one document, or of all documents
+ * if uri is nil. Whenever one of the servers publishes, the observer gets
+ * -languageServer:didChangeDiagnostics: with the diagnostics of all servers
+ * for the document, and the ones the publishing server added and removed,
+ * then -languageServer:document:diagnostics: with the diagnostics of all
+ * servers. client is the backing client that published. Other notifications
+ * are observed on the backing clients.
+ */
+- (void)addObserver:(id<LSPClientObserver>)observer forURI:(NSURL *)uri;
+- (void)removeObserver:(id<LSPClientObserver>)observer;
+
+/**
+ * The diagnostics last published by all servers for a document, in the
+ * order of the clients.
+ */
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri;
+
+#pragma mark Text Synchronization
+
+- (void)documentDidOpen:(NSURL *)url content:(NSString *)text;
+/**
+ * The clients read the text from the text storage of the host. As with
+ * -[LSPClient documentDidOpen:textStorage:], the host must call
+ * -document:changeTextInRange:replacementString: before it changes it.
+ */
+- (void)documentDidOpen:(NSURL *)url textStorage:(NSMutableAttributedString *)textStorage;
+- (void)document:(NSURL *)url changeTextInRange:(NSRange)affectedCharRange replacementString:(NSString *)replacementString;
+- (void)documentDidChange:(NSURL *)url;
+- (void)documentWillSave:(NSURL *)url;
+- (void)documentDidSave:(NSURL *)url;
+- (void)documentDidClose:(NSURL *)url;
+
+#pragma mark Language Features
+
+// A request replaces the pending request of the same kind for the same
+// document, as with LSPClient. A server whose reply the client drops, for
+// RequestCancelled or ContentModified, counts as one without a result. The
+// completion handler gets an error only if all servers failed.
+
+/**
+ * Merges the completion lists of the servers. After each server but the last
+ * answered, partialResultHandler gets the items of the servers that answered
+ * so far. isIncomplete is YES if one of the lists is.
+ */
+- (LSPRequest *)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex partialResultHandler:(void (^)(LSPCompletionList *completionList))partialResultHandler completionHandler:(void (^)(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error))completionHandler;
+/**
+ * Resolves an item of a merged completion list, or of a list filtered from
+ * it, with the client whose server sent the item.
+ */
+- (LSPRequest *)resolveCompletionItemAtIndex:(NSUInteger)index ofCompletionList:(LSPCompletionList *)completionList completionHandler:(void (^)(LSPCompletionItem *item, NSError *error))completionHandler;
+/**
+ * The hover of the first client with one. It is passed on as soon as the
+ * clients before had none, without waiting for the ones after.
+ */
+- (LSPRequest *)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler;
+- (LSPRequest *)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *highlights, NSError *error))completionHandler;
+- (LSPRequest *)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler;
+
+@end
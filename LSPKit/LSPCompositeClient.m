@@ -0,0 +1,674 @@
+//
+//  LSPCompositeClient.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPCompositeClient.h"
+
+@class LSPPipeline;
+
+@interface LSPClient (Composite)
+- (BOOL)_providesMethod:(NSString *)method;
+@end
+
+@interface LSPRequest (Composite)
+- (instancetype)initWithMethod:(NSString *)method uri:(NSURL *)uri pipeline:(LSPPipeline *)pipeline;
+- (void)setCancellationHandler:(dispatch_block_t)cancellationHandler;
+- (void)setDropHandler:(dispatch_block_t)dropHandler;
+@end
+
+@interface LSPCompletionList (Composite)
+- (id)storage;
+- (NSUInteger)storageIndexAtIndex:(NSUInteger)index;
+- (LSPCompletionList *)completionListByInsertingItemsOfList:(LSPCompletionList *)completionList atIndex:(NSUInteger)index incomplete:(BOOL)incomplete;
+@end
+
+@interface LSPDiagnosticsDelta (Composite)
+- (void)setUri:(NSURL *)uri;
+- (void)setDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics;
+- (void)setAddedDiagnostics:(NSArray<LSPDiagnostic *> *)addedDiagnostics;
+- (void)setRemovedDiagnostics:(NSArray<LSPDiagnostic *> *)removedDiagnostics;
+- (void)setUnchangedDiagnostics:(NSArray<LSPDiagnostic *> *)unchangedDiagnostics;
+@end
+
+/**
+ * The items of a backing completion list in a merged one, from offset on.
+ * No completion list for a single list passed on as is, the map table of
+ * the sources would keep its storage alive.
+ */
+@interface LSPCompositeCompletionSource : NSObject
+@property LSPClient *client;
+@property NSUInteger clientIndex;
+@property LSPCompletionList *completionList;
+@property NSUInteger offset;
+@end
+
+@implementation LSPCompositeCompletionSource
+@end
+
+/**
+ * Observes the diagnostics of the backing clients. The clients keep their
+ * observers, the composite client is only referenced weakly.
+ */
+@interface LSPCompositeClientObserver : NSObject <LSPClientObserver>
+@property (weak) LSPCompositeClient *compositeClient;
+@end
+
+@interface LSPCompositeClient ()
+- (void)_client:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta;
+@end
+
+@implementation LSPCompositeClientObserver
+
+- (void)languageServer:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta {
+    [_compositeClient _client:client didChangeDiagnostics:delta];
+}
+
+@end
+
+@interface LSPCompositeClient () {
+    LSPCompositeClientObserver *_clientObserver;
+    // The text storage of every open document, shared by the clients. The
+    // composite client changes the ones it created itself.
+    NSMutableDictionary<NSURL *, NSMutableAttributedString *> *_textStorages;
+    NSMutableSet<NSURL *> *_ownedTextStorageURLs;
+    // Observers of merged diagnostics, by uri, NSNull for all documents.
+    NSMutableDictionary<id, NSArray<id<LSPClientObserver>> *> *_observers;
+    BOOL _initialized;
+    NSMutableArray *_initializerCallbacks;
+    // Requests made until the clients are initialized, in order.
+    NSMutableArray<dispatch_block_t> *_queuedRequests;
+    // The pending requests that the next one of the same kind replaces.
+    NSMutableDictionary<NSString *, LSPRequest *> *_replaceableRequests;
+    // The requests of the clients that did not answer yet, by index of the
+    // client, for every request still waiting for one.
+    NSMapTable<LSPRequest *, NSMutableDictionary<NSNumber *, LSPRequest *> *> *_pendingClientRequests;
+    // The sources of merged completion lists, by their storage.
+    NSMapTable *_completionSources;
+}
+@end
+
+@implementation LSPCompositeClient
+
+- (instancetype)initWithClients:(NSArray<LSPClient *> *)clients {
+    self = [super init];
+    if (self) {
+        _clients = [clients copy];
+        _textStorages = [NSMutableDictionary dictionary];
+        _ownedTextStorageURLs = [NSMutableSet set];
+        _observers = [NSMutableDictionary dictionary];
+        _queuedRequests = [NSMutableArray array];
+        _replaceableRequests = [NSMutableDictionary dictionary];
+        _pendingClientRequests = [NSMapTable strongToStrongObjectsMapTable];
+        _completionSources = [NSMapTable weakToStrongObjectsMapTable];
+        _clientObserver = [[LSPCompositeClientObserver alloc] init];
+        [_clientObserver setCompositeClient:self];
+        __weak __typeof(self) weakSelf = self;
+        for (LSPClient *client in _clients) {
+            [client addObserver:_clientObserver forURI:nil methods:[NSSet setWithObject:@"textDocument/publishDiagnostics"]];
+            [client addTerminationObserver:_clientObserver block:^(LSPClient *terminatedClient) {
+                [weakSelf _clientDidTerminate:terminatedClient];
+            }];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (LSPClient *client in _clients) {
+        [client removeObserver:_clientObserver];
+        [client removeTerminationObserver:_clientObserver];
+    }
+}
+
+#pragma mark General
+
+- (void)initialWithCompletionHandler:(void (^)(NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if (_initialized) {
+        if (completionHandler) {
+            completionHandler(nil);
+        }
+        return;
+    }
+    if (_initializerCallbacks) {
+        if (completionHandler) {
+            [_initializerCallbacks addObject:[completionHandler copy]];
+        }
+        return;
+    }
+    _initializerCallbacks = [NSMutableArray array];
+    if (completionHandler) {
+        [_initializerCallbacks addObject:[completionHandler copy]];
+    }
+    NSUInteger count = [_clients count];
+    NSMutableArray *errors = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        [errors addObject:[NSNull null]];
+    }
+    __block NSUInteger pendingCount = count;
+    __weak __typeof(self) weakSelf = self;
+    void (^initialized)(NSUInteger index, NSError *error) = ^(NSUInteger index, NSError *error) {
+        if (error) {
+            [errors replaceObjectAtIndex:index withObject:error];
+        }
+        if (--pendingCount > 0) {
+            return;
+        }
+        NSError *firstError = nil;
+        for (id clientError in errors) {
+            if (clientError != [NSNull null]) {
+                firstError = clientError;
+                break;
+            }
+        }
+        [weakSelf _didInitializeWithError:firstError];
+    };
+    if (count == 0) {
+        [self _didInitializeWithError:nil];
+        return;
+    }
+    [_clients enumerateObjectsUsingBlock:^(LSPClient *client, NSUInteger index, BOOL *stop) {
+        [client initialWithCompletionHandler:^(NSError *error) {
+            initialized(index, error);
+        }];
+    }];
+}
+
+/**
+ * A client that failed provides no language features, the requests go to
+ * the others.
+ */
+- (void)_didInitializeWithError:(NSError *)error {
+    _initialized = YES;
+    NSArray *callbacks = _initializerCallbacks;
+    _initializerCallbacks = nil;
+    for (void (^callback)(NSError *error) in callbacks) {
+        callback(error);
+    }
+    NSArray<dispatch_block_t> *queuedRequests = _queuedRequests;
+    _queuedRequests = [NSMutableArray array];
+    for (dispatch_block_t send in queuedRequests) {
+        send();
+    }
+}
+
+- (void)terminate {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in _clients) {
+        [client removeObserver:_clientObserver];
+        [client removeTerminationObserver:_clientObserver];
+        [client terminate];
+    }
+}
+
+- (NSArray<LSPClient *> *)clientsProvidingMethod:(NSString *)method {
+    if (_initialized == NO) {
+        return [NSArray array];
+    }
+    NSMutableArray<LSPClient *> *clients = [NSMutableArray arrayWithCapacity:[_clients count]];
+    for (LSPClient *client in _clients) {
+        if ([client _providesMethod:method]) {
+            [clients addObject:client];
+        }
+    }
+    return clients;
+}
+
+/** The server was relaunched without the documents, they are opened again. */
+- (void)_clientDidTerminate:(LSPClient *)client {
+    for (NSURL *url in _textStorages) {
+        [client documentDidOpen:url textStorage:[_textStorages objectForKey:url]];
+    }
+}
+
+#pragma mark Diagnostics
+
+- (void)addObserver:(id<LSPClientObserver>)observer forURI:(NSURL *)uri {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    id key = uri ?: [NSNull null];
+    NSArray *observers = [_observers objectForKey:key];
+    if ([observers indexOfObjectIdenticalTo:observer] == NSNotFound) {
+        [_observers setObject:(observers ? [observers arrayByAddingObject:observer] : [NSArray arrayWithObject:observer]) forKey:key];
+    }
+}
+
+- (void)removeObserver:(id<LSPClientObserver>)observer {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (id key in [_observers allKeys]) {
+        NSMutableArray *observers = [[_observers objectForKey:key] mutableCopy];
+        [observers removeObjectIdenticalTo:observer];
+        if ([observers count]) {
+            [_observers setObject:observers forKey:key];
+        } else {
+            [_observers removeObjectForKey:key];
+        }
+    }
+}
+
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri {
+    NSMutableArray<LSPDiagnostic *> *diagnostics = [NSMutableArray array];
+    for (LSPClient *client in _clients) {
+        [diagnostics addObjectsFromArray:[[client diagnosticsStore] diagnosticsForURI:uri]];
+    }
+    return diagnostics;
+}
+
+/**
+ * The diagnostics are the objects of the stores of the clients, which move
+ * their ranges along with the edits. Only the merged list is new.
+ */
+- (void)_client:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta {
+    NSURL *uri = [delta uri];
+    NSArray<id<LSPClientObserver>> *observers = [_observers objectForKey:[NSNull null]];
+    NSArray<id<LSPClientObserver>> *documentObservers = uri ? [_observers objectForKey:uri] : nil;
+    if (documentObservers) {
+        observers = observers ? [observers arrayByAddingObjectsFromArray:documentObservers] : documentObservers;
+    }
+    if ([observers count] == 0) {
+        return;
+    }
+    NSArray<LSPDiagnostic *> *diagnostics = [self diagnosticsForURI:uri];
+    NSHashTable *addedObjects = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+    for (LSPDiagnostic *diagnostic in [delta addedDiagnostics]) {
+        [addedObjects addObject:diagnostic];
+    }
+    NSMutableArray<LSPDiagnostic *> *unchanged = [NSMutableArray arrayWithCapacity:[diagnostics count]];
+    for (LSPDiagnostic *diagnostic in diagnostics) {
+        if ([addedObjects containsObject:diagnostic] == NO) {
+            [unchanged addObject:diagnostic];
+        }
+    }
+    LSPDiagnosticsDelta *mergedDelta = [[LSPDiagnosticsDelta alloc] init];
+    [mergedDelta setUri:uri];
+    [mergedDelta setDiagnostics:diagnostics];
+    [mergedDelta setAddedDiagnostics:[delta addedDiagnostics]];
+    [mergedDelta setRemovedDiagnostics:[delta removedDiagnostics]];
+    [mergedDelta setUnchangedDiagnostics:unchanged];
+    for (id<LSPClientObserver> observer in observers) {
+        if ([observer respondsToSelector:@selector(languageServer:didChangeDiagnostics:)]) {
+            [observer languageServer:client didChangeDiagnostics:mergedDelta];
+        }
+        if ([observer respondsToSelector:@selector(languageServer:document:diagnostics:)]) {
+            [observer languageServer:client document:uri diagnostics:diagnostics];
+        }
+    }
+}
+
+#pragma mark Text Synchronization
+
+- (void)documentDidOpen:(NSURL *)url content:(NSString *)text {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    [_ownedTextStorageURLs addObject:url];
+    [self _documentDidOpen:url textStorage:[[NSMutableAttributedString alloc] initWithString:text ?: @""]];
+}
+
+- (void)documentDidOpen:(NSURL *)url textStorage:(NSMutableAttributedString *)textStorage {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    [_ownedTextStorageURLs removeObject:url];
+    [self _documentDidOpen:url textStorage:textStorage];
+}
+
+- (void)_documentDidOpen:(NSURL *)url textStorage:(NSMutableAttributedString *)textStorage {
+    [_textStorages setObject:textStorage forKey:url];
+    for (LSPClient *client in _clients) {
+        [client documentDidOpen:url textStorage:textStorage];
+    }
+}
+
+- (void)document:(NSURL *)url changeTextInRange:(NSRange)affectedCharRange replacementString:(NSString *)replacementString {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    // Every client records the change before the text storage is changed.
+    for (LSPClient *client in _clients) {
+        [client document:url changeTextInRange:affectedCharRange replacementString:replacementString];
+    }
+    if ([_ownedTextStorageURLs containsObject:url]) {
+        [[_textStorages objectForKey:url] replaceCharactersInRange:affectedCharRange withString:replacementString ?: @""];
+    }
+}
+
+- (void)documentDidChange:(NSURL *)url {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in _clients) {
+        [client documentDidChange:url];
+    }
+}
+
+- (void)documentWillSave:(NSURL *)url {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in _clients) {
+        [client documentWillSave:url];
+    }
+}
+
+- (void)documentDidSave:(NSURL *)url {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in _clients) {
+        [client documentDidSave:url];
+    }
+}
+
+- (void)documentDidClose:(NSURL *)url {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in _clients) {
+        [client documentDidClose:url];
+    }
+    [_textStorages removeObjectForKey:url];
+    [_ownedTextStorageURLs removeObject:url];
+}
+
+#pragma mark Language Features
+
+/**
+ * Sends a request to every client whose server provides method, with send,
+ * once the clients are initialized. The results are kept in the order of the
+ * clients, NSNull for no result, and passed to answered after each reply
+ * with the indexes of the clients that did not answer yet. A reply dropped
+ * by a client, for RequestCancelled or ContentModified, is no result. error
+ * is the error of the first client if all of them failed. A request for a
+ * document closed meanwhile is cancelled. The requests of the clients that
+ * did not answer yet are cancelled by -_completeRequest:.
+ */
+- (LSPRequest *)_sendRequest:(NSString *)method uri:(NSURL *)url replacesPendingRequest:(BOOL)replacesPendingRequest send:(LSPRequest *(^)(LSPClient *client, void (^reply)(id result, NSError *error)))send answered:(void (^)(NSArray *results, NSIndexSet *pendingIndexes, NSError *error))answered {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    LSPRequest *request = [[LSPRequest alloc] initWithMethod:method uri:url pipeline:nil];
+    NSMutableDictionary<NSNumber *, LSPRequest *> *clientRequests = [NSMutableDictionary dictionary];
+    __weak __typeof(self) weakSelf = self;
+    [request setCancellationHandler:^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        if (strongSelf) {
+            [strongSelf->_pendingClientRequests removeObjectForKey:request];
+        }
+        for (LSPRequest *clientRequest in [clientRequests allValues]) {
+            [clientRequest cancel];
+        }
+    }];
+    if (replacesPendingRequest) {
+        NSString *key = [NSString stringWithFormat:@"%@ %@", method, [url absoluteString]];
+        [[_replaceableRequests objectForKey:key] cancel];
+        [_replaceableRequests setObject:request forKey:key];
+    }
+    dispatch_block_t sendToClients = ^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        if (strongSelf == nil || [request isCancelled]) {
+            return;
+        }
+        if (url && [strongSelf->_textStorages objectForKey:url] == nil) {
+            [request cancel];
+            return;
+        }
+        NSArray<LSPClient *> *clients = [strongSelf clientsProvidingMethod:method];
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:[clients count]];
+        for (NSUInteger index = 0; index < [clients count]; index++) {
+            [results addObject:[NSNull null]];
+        }
+        NSMutableIndexSet *pendingIndexes = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, [clients count])];
+        __block NSError *firstError = nil;
+        __block NSUInteger firstErrorIndex = NSNotFound;
+        __block NSUInteger failedCount = 0;
+        if ([clients count] == 0) {
+            answered(results, pendingIndexes, nil);
+            return;
+        }
+        [strongSelf->_pendingClientRequests setObject:clientRequests forKey:request];
+        [clients enumerateObjectsUsingBlock:^(LSPClient *client, NSUInteger index, BOOL *stop) {
+            // Completed by an answer from a cache, the other clients are not asked.
+            if ([strongSelf->_pendingClientRequests objectForKey:request] == nil) {
+                *stop = YES;
+                return;
+            }
+            void (^reply)(id result, NSError *error) = ^(id result, NSError *error) {
+                if ([request isCancelled]) {
+                    return;
+                }
+                if (error) {
+                    failedCount++;
+                    // The first in the order of the clients, not of the replies.
+                    if (index < firstErrorIndex) {
+                        firstError = error;
+                        firstErrorIndex = index;
+                    }
+                } else if (result) {
+                    [results replaceObjectAtIndex:index withObject:result];
+                }
+                [pendingIndexes removeIndex:index];
+                [clientRequests removeObjectForKey:[NSNumber numberWithUnsignedInteger:index]];
+                __strong __typeof(self) replySelf = weakSelf;
+                if (replySelf && [pendingIndexes count] == 0) {
+                    [replySelf->_pendingClientRequests removeObjectForKey:request];
+                }
+                answered(results, pendingIndexes, (failedCount == [clients count]) ? firstError : nil);
+            };
+            LSPRequest *clientRequest = send(client, reply);
+            // Not kept when it was answered right away, from a cache.
+            if (clientRequest && [pendingIndexes containsIndex:index]) {
+                [clientRequest setDropHandler:^{
+                    reply(nil, nil);
+                }];
+                [clientRequests setObject:clientRequest forKey:[NSNumber numberWithUnsignedInteger:index]];
+            }
+        }];
+    };
+    if (_initialized) {
+        sendToClients();
+    } else {
+        [_queuedRequests addObject:[sendToClients copy]];
+        [self initialWithCompletionHandler:nil];
+    }
+    return request;
+}
+
+/**
+ * Called once request has its result. The requests of the clients that did
+ * not answer yet are cancelled, a hover needs only the first answer.
+ */
+- (void)_completeRequest:(LSPRequest *)request {
+    NSMutableDictionary<NSNumber *, LSPRequest *> *clientRequests = [_pendingClientRequests objectForKey:request];
+    [_pendingClientRequests removeObjectForKey:request];
+    for (LSPRequest *clientRequest in [clientRequests allValues]) {
+        [clientRequest cancel];
+    }
+    NSString *key = [NSString stringWithFormat:@"%@ %@", [request method], [[request uri] absoluteString]];
+    if ([_replaceableRequests objectForKey:key] == request) {
+        [_replaceableRequests removeObjectForKey:key];
+    }
+}
+
+/**
+ * Merges the list of the client at clientIndex into the merged list of the
+ * clients that answered before, in the order of the clients. Only the new
+ * items are copied, the merged list is not built again from every reply. A
+ * single list is passed on as is. sources are those of mergedList and are
+ * replaced by the ones of the result, which are kept for resolving its items.
+ */
+- (LSPCompletionList *)_mergeCompletionList:(LSPCompletionList *)completionList ofClient:(LSPClient *)client atIndex:(NSUInteger)clientIndex intoList:(LSPCompletionList *)mergedList sources:(NSMutableArray<LSPCompositeCompletionSource *> *)sources {
+    NSMutableArray<LSPCompositeCompletionSource *> *mergedSources = [NSMutableArray arrayWithCapacity:[sources count] + 1];
+    LSPCompositeCompletionSource *newSource = [[LSPCompositeCompletionSource alloc] init];
+    [newSource setClient:client];
+    [newSource setClientIndex:clientIndex];
+    if (mergedList == nil) {
+        [mergedSources addObject:newSource];
+        mergedList = completionList;
+    } else {
+        LSPCompositeCompletionSource *firstSource = [sources firstObject];
+        if ([firstSource completionList] == nil) {
+            // The single list passed on so far may be filtered, it is copied first.
+            LSPCompletionList *emptyList = [[LSPCompletionList alloc] initWithItems:[NSArray array] incomplete:NO];
+            LSPCompositeCompletionSource *source = [[LSPCompositeCompletionSource alloc] init];
+            [source setClient:[firstSource client]];
+            [source setClientIndex:[firstSource clientIndex]];
+            [source setCompletionList:mergedList];
+            [sources setArray:[NSArray arrayWithObject:source]];
+            mergedList = [emptyList completionListByInsertingItemsOfList:mergedList atIndex:0 incomplete:[mergedList isIncomplete]];
+        }
+        // The items of the clients after it move behind the new ones.
+        [newSource setCompletionList:completionList];
+        [newSource setOffset:[mergedList count]];
+        for (LSPCompositeCompletionSource *source in sources) {
+            if ([source clientIndex] < clientIndex) {
+                [mergedSources addObject:source];
+                continue;
+            }
+            if ([mergedSources containsObject:newSource] == NO) {
+                [newSource setOffset:[source offset]];
+                [mergedSources addObject:newSource];
+            }
+            // The sources of the lists merged before are not changed.
+            LSPCompositeCompletionSource *movedSource = [[LSPCompositeCompletionSource alloc] init];
+            [movedSource setClient:[source client]];
+            [movedSource setClientIndex:[source clientIndex]];
+            [movedSource setCompletionList:[source completionList]];
+            [movedSource setOffset:[source offset] + [completionList count]];
+            [mergedSources addObject:movedSource];
+        }
+        if ([mergedSources containsObject:newSource] == NO) {
+            [mergedSources addObject:newSource];
+        }
+        mergedList = [mergedList completionListByInsertingItemsOfList:completionList atIndex:[newSource offset] incomplete:[mergedList isIncomplete] || [completionList isIncomplete]];
+    }
+    [sources setArray:mergedSources];
+    if ([mergedList storage]) {
+        [_completionSources setObject:mergedSources forKey:[mergedList storage]];
+    }
+    return mergedList;
+}
+
+- (LSPRequest *)documentCompletion:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex partialResultHandler:(void (^)(LSPCompletionList *completionList))partialResultHandler completionHandler:(void (^)(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error))completionHandler {
+    NSMutableArray<LSPClient *> *sentClients = [NSMutableArray array];
+    // The list merged from the replies so far, and the clients in it.
+    __block LSPCompletionList *mergedList = nil;
+    NSMutableArray<LSPCompositeCompletionSource *> *sources = [NSMutableArray array];
+    NSMutableIndexSet *mergedIndexes = [NSMutableIndexSet indexSet];
+    __weak __typeof(self) weakSelf = self;
+    __block LSPRequest *request = nil;
+    request = [self _sendRequest:@"textDocument/completion" uri:url replacesPendingRequest:YES send:^LSPRequest *(LSPClient *client, void (^reply)(id result, NSError *error)) {
+        [sentClients addObject:client];
+        return [client documentCompletionList:url inText:string forCharacterAtIndex:characterIndex completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+            reply(completionList, error);
+        }];
+    } answered:^(NSArray *results, NSIndexSet *pendingIndexes, NSError *error) {
+        __strong __typeof(self) strongSelf = weakSelf;
+        BOOL merged = NO;
+        for (NSUInteger index = 0; index < [results count]; index++) {
+            id result = [results objectAtIndex:index];
+            if ([result isKindOfClass:[LSPCompletionList class]] && [mergedIndexes containsIndex:index] == NO) {
+                [mergedIndexes addIndex:index];
+                mergedList = [strongSelf _mergeCompletionList:result ofClient:[sentClients objectAtIndex:index] atIndex:index intoList:mergedList sources:sources];
+                merged = YES;
+            }
+        }
+        if ([pendingIndexes count] > 0) {
+            if (partialResultHandler && merged) {
+                partialResultHandler(mergedList);
+            }
+            return;
+        }
+        [strongSelf _completeRequest:request];
+        LSPCompletionList *completionList = mergedList;
+        mergedList = nil;
+        if (completionHandler) {
+            completionHandler(completionList, [completionList isIncomplete], error);
+        }
+    }];
+    return request;
+}
+
+- (LSPRequest *)resolveCompletionItemAtIndex:(NSUInteger)index ofCompletionList:(LSPCompletionList *)completionList completionHandler:(void (^)(LSPCompletionItem *item, NSError *error))completionHandler {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    NSUInteger storageIndex = [completionList storageIndexAtIndex:index];
+    for (LSPCompositeCompletionSource *source in [[_completionSources objectForKey:[completionList storage]] reverseObjectEnumerator]) {
+        if (storageIndex >= [source offset]) {
+            LSPCompletionList *sourceList = [source completionList];
+            NSUInteger sourceIndex = storageIndex - [source offset];
+            // A single list is passed on as is, the index may be of a list filtered from it.
+            if (sourceList == nil) {
+                return [[source client] resolveCompletionItemAtIndex:index ofCompletionList:completionList completionHandler:completionHandler];
+            }
+            return [[source client] resolveCompletionItemAtIndex:sourceIndex ofCompletionList:sourceList completionHandler:completionHandler];
+        }
+    }
+    // Not a list of the composite client, the item is passed on as is.
+    if (completionHandler) {
+        completionHandler([completionList objectAtIndex:index], nil);
+    }
+    return nil;
+}
+
+- (LSPRequest *)documentHoverWithContentsOfURL:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSDictionary *dict, NSError *error))completionHandler {
+    __weak __typeof(self) weakSelf = self;
+    __block LSPRequest *request = nil;
+    __block BOOL completed = NO;
+    request = [self _sendRequest:@"textDocument/hover" uri:url replacesPendingRequest:YES send:^LSPRequest *(LSPClient *client, void (^reply)(id result, NSError *error)) {
+        return [client documentHoverWithContentsOfURL:url inText:string forCharacterAtIndex:characterIndex completionHandler:^(NSDictionary *dict, NSError *error) {
+            reply(dict, error);
+        }];
+    } answered:^(NSArray *results, NSIndexSet *pendingIndexes, NSError *error) {
+        if (completed) {
+            return;
+        }
+        // The first hover, once the clients before it had none.
+        NSDictionary *hover = nil;
+        for (NSUInteger index = 0; index < [results count] && [pendingIndexes containsIndex:index] == NO; index++) {
+            if ([[results objectAtIndex:index] isKindOfClass:[NSDictionary class]]) {
+                hover = [results objectAtIndex:index];
+                break;
+            }
+        }
+        if (hover == nil && [pendingIndexes count] > 0) {
+            return;
+        }
+        completed = YES;
+        [weakSelf _completeRequest:request];
+        if (completionHandler) {
+            completionHandler(hover, error);
+        }
+    }];
+    return request;
+}
+
+/** Concatenates the array results of the servers, in the order of the clients. */
+static NSArray *LSPCompositeConcatenatedResults(NSArray *results) {
+    NSMutableArray *concatenated = [NSMutableArray array];
+    for (id result in results) {
+        if ([result isKindOfClass:[NSArray class]]) {
+            [concatenated addObjectsFromArray:result];
+        }
+    }
+    return concatenated;
+}
+
+- (LSPRequest *)documentHighlight:(NSURL *)url inText:(NSString *)string forCharacterAtIndex:(NSUInteger)characterIndex completionHandler:(void (^)(NSArray<LSPDocumentHighlight *> *highlights, NSError *error))completionHandler {
+    __weak __typeof(self) weakSelf = self;
+    __block LSPRequest *request = nil;
+    request = [self _sendRequest:@"textDocument/documentHighlight" uri:url replacesPendingRequest:YES send:^LSPRequest *(LSPClient *client, void (^reply)(id result, NSError *error)) {
+        return [client documentHighlight:url inText:string forCharacterAtIndex:characterIndex completionHandler:^(NSArray<LSPDocumentHighlight *> *highlights, NSError *error) {
+            reply(highlights, error);
+        }];
+    } answered:^(NSArray *results, NSIndexSet *pendingIndexes, NSError *error) {
+        if ([pendingIndexes count] > 0) {
+            return;
+        }
+        [weakSelf _completeRequest:request];
+        if (completionHandler) {
+            completionHandler((error == nil) ? LSPCompositeConcatenatedResults(results) : nil, error);
+        }
+    }];
+    return request;
+}
+
+- (LSPRequest *)documentSymbol:(NSURL *)url completionHandler:(void (^)(NSArray *symbols, NSError *error))completionHandler {
+    return [self _sendRequest:@"textDocument/documentSymbol" uri:url replacesPendingRequest:NO send:^LSPRequest *(LSPClient *client, void (^reply)(id result, NSError *error)) {
+        return [client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+            reply(symbols, error);
+        }];
+    } answered:^(NSArray *results, NSIndexSet *pendingIndexes, NSError *error) {
+        if ([pendingIndexes count] == 0 && completionHandler) {
+            completionHandler((error == nil) ? LSPCompositeConcatenatedResults(results) : nil, error);
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,58 @@
+//
+//  LSPDiagnosticsStore.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <LSPKit/LSPCommon.h>
+
+/**
+ * The change of the diagnostics of a document by a publishDiagnostics
+ * notification. A diagnostic published again with the same range, severity,
+ * code, source and message is unchanged, and stays the same object. So a
+ * host can keep what it shows for a diagnostic and only update the added
+ * and removed ones.
+ */
+@interface LSPDiagnosticsDelta : NSObject
+@property (readonly) NSURL *uri;
+/** All diagnostics of the document, in the order of the server. */
+@property (readonly) NSArray<LSPDiagnostic *> *diagnostics;
+@property (readonly) NSArray<LSPDiagnostic *> *addedDiagnostics;
+@property (readonly) NSArray<LSPDiagnostic *> *removedDiagnostics;
+@property (readonly) NSArray<LSPDiagnostic *> *unchangedDiagnostics;
+@end
+
+/**
+ * The diagnostics last published for each document of a client.
+ *
+ * The character ranges of the diagnostics of an open document are moved
+ * along with the edits made to it until the server publishes again, so they
+ * still point at the same text. Only the characterRange is moved, range
+ * stays as published. A diagnostic published again keeps its object, which
+ * takes the range of the new publish. Must be used on the main thread.
+ */
+@interface LSPDiagnosticsStore : NSObject
+
+/** The documents with diagnostics. */
+@property (readonly) NSArray<NSURL *> *URIs;
+
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri;
+/**
+ * The diagnostics of a document whose character range intersects or touches
+ * range, ordered by location. Diagnostics without a character range, of
+ * documents that are not open, are not included.
+ */
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri inCharacterRange:(NSRange)range;
+
+/** The number of diagnostics of all documents with severity. */
+- (NSUInteger)countOfDiagnosticsWithSeverity:(LSPDiagnosticSeverity)severity;
+/**
+ * Enumerates the diagnostics of all documents with severity, document by
+ * document in the order of the server.
+ */
+- (void)enumerateDiagnosticsWithSeverity:(LSPDiagnosticSeverity)severity usingBlock:(void (^)(NSURL *uri, LSPDiagnostic *diagnostic, BOOL *stop))block;
+
+@end
@@ -0,0 +1,231 @@
+//
+//  LSPDiagnosticsStore.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPDiagnosticsStore.h"
+
+@interface LSPDiagnostic (Store)
+- (void)setRange:(LSPRange *)range;
+- (void)setCharacterRange:(NSRange)characterRange;
+@end
+
+@interface LSPDiagnosticsDelta ()
+@property (readwrite) NSURL *uri;
+@property (readwrite) NSArray<LSPDiagnostic *> *diagnostics;
+@property (readwrite) NSArray<LSPDiagnostic *> *addedDiagnostics;
+@property (readwrite) NSArray<LSPDiagnostic *> *removedDiagnostics;
+@property (readwrite) NSArray<LSPDiagnostic *> *unchangedDiagnostics;
+@end
+
+@implementation LSPDiagnosticsDelta
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ uri = %@ added = %lu removed = %lu unchanged = %lu>", [self className], _uri, (unsigned long)[_addedDiagnostics count], (unsigned long)[_removedDiagnostics count], (unsigned long)[_unchangedDiagnostics count]];
+}
+
+@end
+
+/** Severities out of range are counted as unknown. */
+static inline NSUInteger LSPSeverityIndex(LSPDiagnosticSeverity severity) {
+    return (severity <= LSPDiagnosticSeverityHint) ? severity : LSPDiagnosticSeverityUnknown;
+}
+
+/**
+ * What identifies a diagnostic across publishes. The character range if it
+ * was resolved, it follows the edits, the published range otherwise.
+ */
+static NSString *LSPDiagnosticKey(LSPDiagnostic *diagnostic) {
+    NSRange characterRange = [diagnostic characterRange];
+    NSString *range = nil;
+    if (characterRange.location != NSNotFound) {
+        range = NSStringFromRange(characterRange);
+    } else {
+        LSPRange *lspRange = [diagnostic range];
+        range = [NSString stringWithFormat:@"%lu:%lu-%lu:%lu",
+                 (unsigned long)[[lspRange start] line], (unsigned long)[[lspRange start] character],
+                 (unsigned long)[[lspRange end] line], (unsigned long)[[lspRange end] character]];
+    }
+    return [NSString stringWithFormat:@"%@ %lu %@ %@ %@", range, (unsigned long)[diagnostic severity], [diagnostic code], [diagnostic source], [diagnostic message]];
+}
+
+@interface LSPDiagnosticsStore () {
+    NSMutableDictionary<NSURL *, NSArray<LSPDiagnostic *> *> *_diagnostics;
+    // The diagnostics with a character range, by location. Moving them
+    // through an edit keeps the order.
+    NSMutableDictionary<NSURL *, NSArray<LSPDiagnostic *> *> *_sortedDiagnostics;
+    NSUInteger _severityCounts[LSPDiagnosticSeverityHint + 1];
+}
+/** Used by LSPClient. */
+- (LSPDiagnosticsDelta *)setDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics forURI:(NSURL *)uri;
+- (void)document:(NSURL *)uri didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+@end
+
+@implementation LSPDiagnosticsStore
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _diagnostics = [NSMutableDictionary dictionary];
+        _sortedDiagnostics = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+#pragma mark Updating
+
+- (LSPDiagnosticsDelta *)setDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics forURI:(NSURL *)uri {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    NSArray<LSPDiagnostic *> *previousDiagnostics = [_diagnostics objectForKey:uri];
+    NSMutableDictionary<NSString *, NSMutableArray<LSPDiagnostic *> *> *previousByKey = [NSMutableDictionary dictionaryWithCapacity:[previousDiagnostics count]];
+    for (LSPDiagnostic *diagnostic in previousDiagnostics) {
+        NSString *key = LSPDiagnosticKey(diagnostic);
+        NSMutableArray *sameKey = [previousByKey objectForKey:key];
+        if (sameKey == nil) {
+            sameKey = [NSMutableArray arrayWithCapacity:1];
+            [previousByKey setObject:sameKey forKey:key];
+        }
+        [sameKey addObject:diagnostic];
+    }
+
+    // The previous object of an unchanged diagnostic is kept, each one only
+    // matches once. It takes the range as published now, which differs from
+    // the previous one if the text before it changed.
+    NSMutableArray *current = [NSMutableArray arrayWithCapacity:[diagnostics count]];
+    NSMutableArray *added = [NSMutableArray array];
+    NSMutableArray *unchanged = [NSMutableArray arrayWithCapacity:[diagnostics count]];
+    for (LSPDiagnostic *diagnostic in diagnostics) {
+        NSMutableArray *sameKey = [previousByKey objectForKey:LSPDiagnosticKey(diagnostic)];
+        if ([sameKey count]) {
+            LSPDiagnostic *previous = [sameKey objectAtIndex:0];
+            [sameKey removeObjectAtIndex:0];
+            [previous setRange:[diagnostic range]];
+            [previous setCharacterRange:[diagnostic characterRange]];
+            [current addObject:previous];
+            [unchanged addObject:previous];
+        } else {
+            [current addObject:diagnostic];
+            [added addObject:diagnostic];
+        }
+    }
+    NSMutableArray *removed = [NSMutableArray array];
+    NSHashTable *unchangedObjects = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+    for (LSPDiagnostic *diagnostic in unchanged) {
+        [unchangedObjects addObject:diagnostic];
+    }
+    for (LSPDiagnostic *diagnostic in previousDiagnostics) {
+        if ([unchangedObjects containsObject:diagnostic] == NO) {
+            [removed addObject:diagnostic];
+        }
+    }
+
+    for (LSPDiagnostic *diagnostic in removed) {
+        _severityCounts[LSPSeverityIndex([diagnostic severity])]--;
+    }
+    for (LSPDiagnostic *diagnostic in added) {
+        _severityCounts[LSPSeverityIndex([diagnostic severity])]++;
+    }
+    if ([current count]) {
+        [_diagnostics setObject:[current copy] forKey:uri];
+        NSMutableArray *sorted = [NSMutableArray arrayWithCapacity:[current count]];
+        for (LSPDiagnostic *diagnostic in current) {
+            if ([diagnostic characterRange].location != NSNotFound) {
+                [sorted addObject:diagnostic];
+            }
+        }
+        [sorted sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(LSPDiagnostic *diagnostic1, LSPDiagnostic *diagnostic2) {
+            NSUInteger location1 = [diagnostic1 characterRange].location;
+            NSUInteger location2 = [diagnostic2 characterRange].location;
+            return (location1 < location2) ? NSOrderedAscending : (location1 > location2) ? NSOrderedDescending : NSOrderedSame;
+        }];
+        [_sortedDiagnostics setObject:sorted forKey:uri];
+    } else {
+        [_diagnostics removeObjectForKey:uri];
+        [_sortedDiagnostics removeObjectForKey:uri];
+    }
+
+    LSPDiagnosticsDelta *delta = [[LSPDiagnosticsDelta alloc] init];
+    [delta setUri:uri];
+    [delta setDiagnostics:[current copy]];
+    [delta setAddedDiagnostics:added];
+    [delta setRemovedDiagnostics:removed];
+    [delta setUnchangedDiagnostics:unchanged];
+    return delta;
+}
+
+- (void)document:(NSURL *)uri didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    NSUInteger editEnd = NSMaxRange(range);
+    for (LSPDiagnostic *diagnostic in [_sortedDiagnostics objectForKey:uri]) {
+        NSRange characterRange = [diagnostic characterRange];
+        NSUInteger start = characterRange.location;
+        NSUInteger end = NSMaxRange(characterRange);
+        if (end <= range.location && (characterRange.length > 0 || start < range.location)) {
+            // Before the edit, an insertion at the end does not extend it.
+            continue;
+        }
+        // A boundary in the replaced text moves to its start or its end.
+        start = (start < range.location) ? start : (start >= editEnd) ? start - range.length + length : range.location;
+        end = (end < range.location) ? end : (end >= editEnd) ? end - range.length + length : range.location + length;
+        [diagnostic setCharacterRange:NSMakeRange(start, MAX(end, start) - start)];
+    }
+}
+
+#pragma mark Queries
+
+- (NSArray<NSURL *> *)URIs {
+    return [_diagnostics allKeys];
+}
+
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri {
+    return [_diagnostics objectForKey:uri] ?: [NSArray array];
+}
+
+- (NSArray<LSPDiagnostic *> *)diagnosticsForURI:(NSURL *)uri inCharacterRange:(NSRange)range {
+    NSArray<LSPDiagnostic *> *sorted = [_sortedDiagnostics objectForKey:uri];
+    // The diagnostics starting after range are skipped with a binary search.
+    NSUInteger low = 0;
+    NSUInteger high = [sorted count];
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        if ([[sorted objectAtIndex:middle] characterRange].location <= NSMaxRange(range)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    NSMutableArray *result = [NSMutableArray array];
+    for (NSUInteger index = 0; index < low; index++) {
+        LSPDiagnostic *diagnostic = [sorted objectAtIndex:index];
+        if (NSMaxRange([diagnostic characterRange]) >= range.location) {
+            [result addObject:diagnostic];
+        }
+    }
+    return result;
+}
+
+- (NSUInteger)countOfDiagnosticsWithSeverity:(LSPDiagnosticSeverity)severity {
+    return _severityCounts[LSPSeverityIndex(severity)];
+}
+
+- (void)enumerateDiagnosticsWithSeverity:(LSPDiagnosticSeverity)severity usingBlock:(void (^)(NSURL *uri, LSPDiagnostic *diagnostic, BOOL *stop))block {
+    if (_severityCounts[LSPSeverityIndex(severity)] == 0) {
+        return;
+    }
+    BOOL stop = NO;
+    for (NSURL *uri in _diagnostics) {
+        for (LSPDiagnostic *diagnostic in [_diagnostics objectForKey:uri]) {
+            if (LSPSeverityIndex([diagnostic severity]) == LSPSeverityIndex(severity)) {
+                block(uri, diagnostic, &stop);
+                if (stop) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+@end
@@ -16,5 +16,13 @@ FOUNDATION_EXPORT const unsigned char LSPClientVersionString[];
 
 #import <LSPKit/LSPClient.h>
 #import <LSPKit/LSPCommon.h>
+#import <LSPKit/LSPCompletionList.h>
+#import <LSPKit/LSPCompositeClient.h>
+#import <LSPKit/LSPDiagnosticsStore.h>
+#import <LSPKit/LSPMetrics.h>
+#import <LSPKit/LSPSemanticTokens.h>
+#import <LSPKit/LSPTraceRecorder.h>
+#import <LSPKit/LSPRope.h>
+#import <LSPKit/LSPServerPool.h>
 
 
@@ -0,0 +1,58 @@
+//
+//  LSPMessageEncoder.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Strings of at least this many UTF-16 code units are streamed by
+ * LSPMessageEncoder instead of being serialized with the message.
+ */
+extern const NSUInteger LSPMessageEncoderMinimumStreamedStringLength;
+
+/**
+ * Encodes a JSON message with long strings, like the text of a document in
+ * didOpen, piece by piece.
+ *
+ * The message is serialized with NSJSONSerialization, but with a short
+ * placeholder in place of every long string. The long strings are escaped
+ * into the caller's buffer as the message is read. So a document is never
+ * held as escaped JSON in memory at once, and it is escaped on the thread
+ * reading the encoder, not the one sending the message.
+ *
+ * The strings must not be mutated while the encoder is in use, pass copies.
+ *
+ * Not part of the public API of the framework, the header is only visible
+ * to LSPKit and the unit tests.
+ */
+@interface LSPMessageEncoder : NSObject
+
+/**
+ * Returns nil if the message has no string of at least minimumLength code
+ * units, or can not be serialized. Such a message is better serialized at once.
+ */
+- (instancetype)initWithJSONObject:(id)object minimumStreamedStringLength:(NSUInteger)minimumLength;
+
+/**
+ * Length of the message in UTF-16 code units for the long strings, and bytes
+ * for the rest. A lower bound of the content length that is known right away.
+ */
+@property (readonly) NSUInteger estimatedContentLength;
+
+/**
+ * Length of the UTF-8 encoded message in bytes. Escapes the long strings once
+ * to count the bytes, the first time it is called.
+ */
+@property (readonly) NSUInteger contentLength;
+
+/**
+ * Encodes the next bytes of the message into buffer, which must hold at least
+ * 16 bytes. Returns the number of bytes encoded, 0 at the end of the message.
+ */
+- (NSUInteger)getBytes:(uint8_t *)buffer maxLength:(NSUInteger)maxLength;
+
+@end
@@ -0,0 +1,240 @@
+//
+//  LSPMessageEncoder.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPMessageEncoder.h"
+
+const NSUInteger LSPMessageEncoderMinimumStreamedStringLength = 256 * 1024;
+
+/** The longest encoding of a code point, \u001f or a 4 byte UTF-8 sequence. */
+static const NSUInteger LSPMaximumEscapedCharacterLength = 6;
+
+/**
+ * Returns object with every string of at least minimumLength code units
+ * replaced by prefix and its index in strings. Containers are copied only
+ * if something in them is replaced.
+ */
+static id LSPJSONObjectByReplacingLongStrings(id object, NSUInteger minimumLength, NSString *prefix, NSMutableArray *strings) {
+    if ([object isKindOfClass:[NSString class]]) {
+        if ([object length] < minimumLength) {
+            return object;
+        }
+        [strings addObject:[object copy]];
+        return [prefix stringByAppendingFormat:@"%lu", (unsigned long)([strings count] - 1)];
+    }
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *dictionary = nil;
+        for (id key in object) {
+            id value = [object objectForKey:key];
+            id replacement = LSPJSONObjectByReplacingLongStrings(value, minimumLength, prefix, strings);
+            if (replacement != value) {
+                if (dictionary == nil) {
+                    dictionary = [object mutableCopy];
+                }
+                [dictionary setObject:replacement forKey:key];
+            }
+        }
+        return dictionary ?: object;
+    }
+    if ([object isKindOfClass:[NSArray class]]) {
+        NSMutableArray *array = nil;
+        NSUInteger count = [object count];
+        for (NSUInteger index = 0; index < count; index++) {
+            id value = [object objectAtIndex:index];
+            id replacement = LSPJSONObjectByReplacingLongStrings(value, minimumLength, prefix, strings);
+            if (replacement != value) {
+                if (array == nil) {
+                    array = [object mutableCopy];
+                }
+                [array replaceObjectAtIndex:index withObject:replacement];
+            }
+        }
+        return array ?: object;
+    }
+    return object;
+}
+
+/**
+ * Escapes the characters of a string from *index on as the UTF-8 contents of
+ * a JSON string, until the string ends or the next character does not fit
+ * into maxLength bytes. Only counts the bytes if bytes is NULL. Unpaired
+ * surrogates are replaced with U+FFFD, they have no UTF-8 encoding.
+ */
+static NSUInteger LSPEscapeJSONString(CFStringInlineBuffer *buffer, NSUInteger length, NSUInteger *index, uint8_t *bytes, NSUInteger maxLength) {
+    static const char hexDigits[] = "0123456789abcdef";
+    NSUInteger byteCount = 0;
+    NSUInteger location = *index;
+    while (location < length) {
+        uint32_t character = CFStringGetCharacterFromInlineBuffer(buffer, (CFIndex)location);
+        NSUInteger unitCount = 1;
+        uint8_t encoded[LSPMaximumEscapedCharacterLength];
+        NSUInteger encodedLength = 0;
+        if (character < 0x80) {
+            if (character == '"' || character == '\\') {
+                encoded[0] = '\\';
+                encoded[1] = (uint8_t)character;
+                encodedLength = 2;
+            } else if (character >= 0x20) {
+                encoded[0] = (uint8_t)character;
+                encodedLength = 1;
+            } else if (character == '\n' || character == '\r' || character == '\t') {
+                encoded[0] = '\\';
+                encoded[1] = (character == '\n') ? 'n' : (character == '\r') ? 'r' : 't';
+                encodedLength = 2;
+            } else {
+                encoded[0] = '\\';
+                encoded[1] = 'u';
+                encoded[2] = '0';
+                encoded[3] = '0';
+                encoded[4] = (uint8_t)hexDigits[character >> 4];
+                encoded[5] = (uint8_t)hexDigits[character & 0xF];
+                encodedLength = 6;
+            }
+        } else if (character < 0x800) {
+            encoded[0] = (uint8_t)(0xC0 | (character >> 6));
+            encoded[1] = (uint8_t)(0x80 | (character & 0x3F));
+            encodedLength = 2;
+        } else {
+            if (CFStringIsSurrogateHighCharacter((UniChar)character)) {
+                UniChar low = (location + 1 < length) ? CFStringGetCharacterFromInlineBuffer(buffer, (CFIndex)location + 1) : 0;
+                if (CFStringIsSurrogateLowCharacter(low)) {
+                    character = (uint32_t)CFStringGetLongCharacterForSurrogatePair((UniChar)character, low);
+                    unitCount = 2;
+                } else {
+                    character = 0xFFFD;
+                }
+            } else if (CFStringIsSurrogateLowCharacter((UniChar)character)) {
+                character = 0xFFFD;
+            }
+            if (character < 0x10000) {
+                encoded[0] = (uint8_t)(0xE0 | (character >> 12));
+                encoded[1] = (uint8_t)(0x80 | ((character >> 6) & 0x3F));
+                encoded[2] = (uint8_t)(0x80 | (character & 0x3F));
+                encodedLength = 3;
+            } else {
+                encoded[0] = (uint8_t)(0xF0 | (character >> 18));
+                encoded[1] = (uint8_t)(0x80 | ((character >> 12) & 0x3F));
+                encoded[2] = (uint8_t)(0x80 | ((character >> 6) & 0x3F));
+                encoded[3] = (uint8_t)(0x80 | (character & 0x3F));
+                encodedLength = 4;
+            }
+        }
+        if (byteCount + encodedLength > maxLength) {
+            break;
+        }
+        if (bytes) {
+            memcpy(bytes + byteCount, encoded, encodedLength);
+        }
+        byteCount += encodedLength;
+        location += unitCount;
+    }
+    *index = location;
+    return byteCount;
+}
+
+@interface LSPMessageEncoder () {
+    // NSData parts of the serialized message, and the long strings between them.
+    NSMutableArray *_segments;
+    NSUInteger _contentLength;
+    NSUInteger _segmentIndex;
+    NSUInteger _segmentOffset;
+    CFStringInlineBuffer _inlineBuffer;
+}
+@end
+
+
+@implementation LSPMessageEncoder
+
+- (instancetype)initWithJSONObject:(id)object minimumStreamedStringLength:(NSUInteger)minimumLength {
+    self = [super init];
+    if (self) {
+        // The placeholders are unique, no string of the message can contain them.
+        NSString *prefix = [NSString stringWithFormat:@"LSPKit-streamed-string-%@-", [[NSUUID UUID] UUIDString]];
+        NSMutableArray *strings = [NSMutableArray array];
+        id placeholderObject = LSPJSONObjectByReplacingLongStrings(object, MAX(minimumLength, 1), prefix, strings);
+        if ([strings count] == 0) {
+            return nil;
+        }
+        NSData *data = [NSJSONSerialization dataWithJSONObject:placeholderObject options:0 error:NULL];
+        if (data == nil) {
+            return nil;
+        }
+        NSData *prefixData = [prefix dataUsingEncoding:NSUTF8StringEncoding];
+        const uint8_t *bytes = [data bytes];
+        NSUInteger length = [data length];
+        NSUInteger start = 0;
+        _segments = [NSMutableArray arrayWithCapacity:[strings count] * 2 + 1];
+        while (start < length) {
+            const uint8_t *match = memmem(bytes + start, length - start, [prefixData bytes], [prefixData length]);
+            if (match == NULL) {
+                break;
+            }
+            NSUInteger matchOffset = (NSUInteger)(match - bytes);
+            NSUInteger end = matchOffset + [prefixData length];
+            NSUInteger stringIndex = 0;
+            while (end < length && bytes[end] >= '0' && bytes[end] <= '9') {
+                stringIndex = stringIndex * 10 + (NSUInteger)(bytes[end++] - '0');
+            }
+            if (stringIndex >= [strings count]) {
+                return nil;
+            }
+            // The quotes around the placeholder stay in the data segments.
+            [_segments addObject:[data subdataWithRange:NSMakeRange(start, matchOffset - start)]];
+            [_segments addObject:[strings objectAtIndex:stringIndex]];
+            start = end;
+        }
+        [_segments addObject:[data subdataWithRange:NSMakeRange(start, length - start)]];
+        for (id segment in _segments) {
+            _estimatedContentLength += [segment length];
+        }
+    }
+    return self;
+}
+
+- (NSUInteger)contentLength {
+    if (_contentLength == 0) {
+        for (id segment in _segments) {
+            if ([segment isKindOfClass:[NSData class]]) {
+                _contentLength += [segment length];
+                continue;
+            }
+            CFStringInlineBuffer buffer;
+            NSUInteger length = [segment length];
+            NSUInteger index = 0;
+            CFStringInitInlineBuffer((__bridge CFStringRef)segment, &buffer, CFRangeMake(0, (CFIndex)length));
+            _contentLength += LSPEscapeJSONString(&buffer, length, &index, NULL, NSUIntegerMax);
+        }
+    }
+    return _contentLength;
+}
+
+- (NSUInteger)getBytes:(uint8_t *)buffer maxLength:(NSUInteger)maxLength {
+    NSParameterAssert(maxLength >= 16);
+    NSUInteger byteCount = 0;
+    while (_segmentIndex < [_segments count] && maxLength - byteCount >= LSPMaximumEscapedCharacterLength) {
+        id segment = [_segments objectAtIndex:_segmentIndex];
+        NSUInteger length = [segment length];
+        if ([segment isKindOfClass:[NSData class]]) {
+            NSUInteger count = MIN(length - _segmentOffset, maxLength - byteCount);
+            memcpy(buffer + byteCount, (const uint8_t *)[segment bytes] + _segmentOffset, count);
+            byteCount += count;
+            _segmentOffset += count;
+        } else {
+            if (_segmentOffset == 0) {
+                CFStringInitInlineBuffer((__bridge CFStringRef)segment, &_inlineBuffer, CFRangeMake(0, (CFIndex)length));
+            }
+            byteCount += LSPEscapeJSONString(&_inlineBuffer, length, &_segmentOffset, buffer + byteCount, maxLength - byteCount);
+        }
+        if (_segmentOffset == length) {
+            _segmentIndex++;
+            _segmentOffset = 0;
+        }
+    }
+    return byteCount;
+}
+
+@end
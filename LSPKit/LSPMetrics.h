@@ -0,0 +1,103 @@
+//
+//  LSPMetrics.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * The stages a message goes through in the pipeline, the keys of
+ * stageDurations. Encode serializes a message, write hands it to the pipe of
+ * the server, read cuts the bytes read from the server into frames and queues
+ * them, including any wait while too many messages are in flight, decode
+ * parses a frame, and dispatch runs the handler of a notification or request
+ * of the server on the notification queue, the main thread by default.
+ */
+FOUNDATION_EXPORT NSString * const LSPMetricsStageEncode;
+FOUNDATION_EXPORT NSString * const LSPMetricsStageWrite;
+FOUNDATION_EXPORT NSString * const LSPMetricsStageRead;
+FOUNDATION_EXPORT NSString * const LSPMetricsStageDecode;
+FOUNDATION_EXPORT NSString * const LSPMetricsStageDispatch;
+
+/**
+ * Durations counted in buckets of exponentially growing upper bounds, from
+ * 10 microseconds to 5 seconds, and one for everything longer.
+ */
+@interface LSPLatencyHistogram : NSObject <NSCopying>
+
+/**
+ * The upper bounds of the buckets in seconds, the last one is infinity.
+ */
++ (NSArray<NSNumber *> *)bucketUpperBounds;
+
+@property (readonly) NSArray<NSNumber *> *bucketCounts;
+@property (readonly) NSUInteger count;
+@property (readonly) NSTimeInterval totalDuration;
+@property (readonly) NSTimeInterval maximumDuration;
+
+/**
+ * The upper bound of the bucket below which the percentile (0 to 100) of the
+ * durations fall, 0 if there are none.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile;
+
+@end
+
+/**
+ * The metrics of a client since they were enabled or reset. Counts and
+ * durations are summed over all server processes of the client.
+ */
+@interface LSPMetricsSnapshot : NSObject
+
+/**
+ * Seconds from sending a request until its reply was decoded, by method.
+ * Requests cancelled before the reply are not included.
+ */
+@property (readonly) NSDictionary<NSString *, LSPLatencyHistogram *> *requestLatencies;
+/**
+ * Seconds spent per message in each stage, by LSPMetricsStage key.
+ */
+@property (readonly) NSDictionary<NSString *, LSPLatencyHistogram *> *stageDurations;
+
+@property (readonly) NSUInteger sentRequestCount;
+@property (readonly) NSUInteger sentNotificationCount;
+@property (readonly) NSUInteger cancelledRequestCount;
+@property (readonly) NSUInteger receivedResponseCount;
+/**
+ * Responses with an error, including the RequestCancelled replies of
+ * cancelled requests.
+ */
+@property (readonly) NSUInteger errorResponseCount;
+@property (readonly) NSUInteger receivedNotificationCount;
+/**
+ * Requests of the server to the client.
+ */
+@property (readonly) NSUInteger receivedRequestCount;
+
+/**
+ * Bytes written to stdin of the server and read from its stdout, and the
+ * writev(2) calls and reads it took.
+ */
+@property (readonly) NSUInteger bytesWritten;
+@property (readonly) NSUInteger bytesRead;
+@property (readonly) NSUInteger writeCount;
+@property (readonly) NSUInteger readCount;
+
+/**
+ * The queues of the current server process at the time of the snapshot:
+ * bytes not yet written, the most bytes queued so far, and messages
+ * received but not yet handled.
+ */
+@property (readonly) NSUInteger queuedByteCount;
+@property (readonly) NSUInteger queuedByteHighWaterMark;
+@property (readonly) NSUInteger inFlightMessageCount;
+
+/**
+ * Seconds since the metrics were enabled or reset, to turn counts into rates.
+ */
+@property (readonly) NSTimeInterval duration;
+
+@end
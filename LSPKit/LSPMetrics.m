@@ -0,0 +1,290 @@
+//
+//  LSPMetrics.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPMetrics.h"
+
+#import <os/lock.h>
+#import <time.h>
+
+#import "LSPMetricsRecorder.h"
+#import "LSPPipeline.h"
+
+NSString * const LSPMetricsStageEncode = @"encode";
+NSString * const LSPMetricsStageWrite = @"write";
+NSString * const LSPMetricsStageRead = @"read";
+NSString * const LSPMetricsStageDecode = @"decode";
+NSString * const LSPMetricsStageDispatch = @"dispatch";
+
+/** Upper bounds of the buckets in nanoseconds, the last bucket has none. */
+static const uint64_t LSPLatencyBucketUpperBounds[] = {
+    10000, 20000, 50000, 100000, 200000, 500000,
+    1000000, 2000000, 5000000, 10000000, 20000000, 50000000,
+    100000000, 200000000, 500000000, 1000000000, 2000000000, 5000000000
+};
+#define LSPLatencyBucketCount (sizeof(LSPLatencyBucketUpperBounds) / sizeof(LSPLatencyBucketUpperBounds[0]) + 1)
+
+static os_log_t LSPMetricsLog(void) {
+    static os_log_t log = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        log = os_log_create("com.letteropener.LSPKit", "Pipeline");
+    });
+    return log;
+}
+
+uint64_t LSPMetricsTime(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+LSPMetricsInterval LSPMetricsIntervalBegin(LSPMetricsRecorder *recorder, LSPMetricsStageIndex stage) {
+    LSPMetricsInterval interval = { 0, OS_SIGNPOST_ID_NULL };
+    os_log_t log = LSPMetricsLog();
+    if (os_signpost_enabled(log)) {
+        // Signpost names must be string literals.
+        interval.signpostID = os_signpost_id_generate(log);
+        switch (stage) {
+            case LSPMetricsStageIndexEncode: os_signpost_interval_begin(log, interval.signpostID, "Encode"); break;
+            case LSPMetricsStageIndexWrite: os_signpost_interval_begin(log, interval.signpostID, "Write"); break;
+            case LSPMetricsStageIndexRead: os_signpost_interval_begin(log, interval.signpostID, "Read"); break;
+            case LSPMetricsStageIndexDecode: os_signpost_interval_begin(log, interval.signpostID, "Decode"); break;
+            case LSPMetricsStageIndexDispatch: os_signpost_interval_begin(log, interval.signpostID, "Dispatch"); break;
+            default: break;
+        }
+    }
+    if (recorder) {
+        interval.start = LSPMetricsTime();
+    }
+    return interval;
+}
+
+void LSPMetricsIntervalEnd(LSPMetricsRecorder *recorder, LSPMetricsStageIndex stage, LSPMetricsInterval interval) {
+    if (recorder && interval.start) {
+        [recorder recordDuration:LSPMetricsTime() - interval.start ofStage:stage];
+    }
+    if (interval.signpostID != OS_SIGNPOST_ID_NULL) {
+        os_log_t log = LSPMetricsLog();
+        switch (stage) {
+            case LSPMetricsStageIndexEncode: os_signpost_interval_end(log, interval.signpostID, "Encode"); break;
+            case LSPMetricsStageIndexWrite: os_signpost_interval_end(log, interval.signpostID, "Write"); break;
+            case LSPMetricsStageIndexRead: os_signpost_interval_end(log, interval.signpostID, "Read"); break;
+            case LSPMetricsStageIndexDecode: os_signpost_interval_end(log, interval.signpostID, "Decode"); break;
+            case LSPMetricsStageIndexDispatch: os_signpost_interval_end(log, interval.signpostID, "Dispatch"); break;
+            default: break;
+        }
+    }
+}
+
+@interface LSPLatencyHistogram () {
+    NSUInteger _buckets[LSPLatencyBucketCount];
+    NSUInteger _count;
+    uint64_t _total;
+    uint64_t _maximum;
+}
+- (void)recordDuration:(uint64_t)nanoseconds;
+@end
+
+@implementation LSPLatencyHistogram
+
++ (NSArray<NSNumber *> *)bucketUpperBounds {
+    static NSArray *bucketUpperBounds = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray *bounds = [NSMutableArray arrayWithCapacity:LSPLatencyBucketCount];
+        for (NSUInteger index = 0; index + 1 < LSPLatencyBucketCount; index++) {
+            [bounds addObject:[NSNumber numberWithDouble:(double)LSPLatencyBucketUpperBounds[index] / NSEC_PER_SEC]];
+        }
+        [bounds addObject:[NSNumber numberWithDouble:INFINITY]];
+        bucketUpperBounds = [bounds copy];
+    });
+    return bucketUpperBounds;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    LSPLatencyHistogram *copy = [[[self class] allocWithZone:zone] init];
+    memcpy(copy->_buckets, _buckets, sizeof(_buckets));
+    copy->_count = _count;
+    copy->_total = _total;
+    copy->_maximum = _maximum;
+    return copy;
+}
+
+- (void)recordDuration:(uint64_t)nanoseconds {
+    NSUInteger index = 0;
+    while (index + 1 < LSPLatencyBucketCount && nanoseconds > LSPLatencyBucketUpperBounds[index]) {
+        index++;
+    }
+    _buckets[index]++;
+    _count++;
+    _total += nanoseconds;
+    _maximum = MAX(_maximum, nanoseconds);
+}
+
+- (NSArray<NSNumber *> *)bucketCounts {
+    NSMutableArray *bucketCounts = [NSMutableArray arrayWithCapacity:LSPLatencyBucketCount];
+    for (NSUInteger index = 0; index < LSPLatencyBucketCount; index++) {
+        [bucketCounts addObject:[NSNumber numberWithUnsignedInteger:_buckets[index]]];
+    }
+    return bucketCounts;
+}
+
+- (NSTimeInterval)totalDuration {
+    return (NSTimeInterval)_total / NSEC_PER_SEC;
+}
+
+- (NSTimeInterval)maximumDuration {
+    return (NSTimeInterval)_maximum / NSEC_PER_SEC;
+}
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile {
+    if (_count == 0) {
+        return 0.0;
+    }
+    double rank = MAX(MIN(percentile, 100.0), 0.0) / 100.0 * (double)_count;
+    NSUInteger seen = 0;
+    for (NSUInteger index = 0; index + 1 < LSPLatencyBucketCount; index++) {
+        seen += _buckets[index];
+        if ((double)seen >= rank && seen > 0) {
+            // Never more than the longest duration, the bucket may be much wider.
+            return (NSTimeInterval)MIN(LSPLatencyBucketUpperBounds[index], _maximum) / NSEC_PER_SEC;
+        }
+    }
+    return [self maximumDuration];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ count = %lu p50 = %.3f ms p99 = %.3f ms max = %.3f ms>", [self className], (unsigned long)_count,
+            [self durationAtPercentile:50.0] * 1000.0, [self durationAtPercentile:99.0] * 1000.0, [self maximumDuration] * 1000.0];
+}
+
+@end
+
+@interface LSPMetricsSnapshot ()
+@property (readwrite) NSDictionary<NSString *, LSPLatencyHistogram *> *requestLatencies;
+@property (readwrite) NSDictionary<NSString *, LSPLatencyHistogram *> *stageDurations;
+@property (readwrite) NSUInteger sentRequestCount;
+@property (readwrite) NSUInteger sentNotificationCount;
+@property (readwrite) NSUInteger cancelledRequestCount;
+@property (readwrite) NSUInteger receivedResponseCount;
+@property (readwrite) NSUInteger errorResponseCount;
+@property (readwrite) NSUInteger receivedNotificationCount;
+@property (readwrite) NSUInteger receivedRequestCount;
+@property (readwrite) NSUInteger bytesWritten;
+@property (readwrite) NSUInteger bytesRead;
+@property (readwrite) NSUInteger writeCount;
+@property (readwrite) NSUInteger readCount;
+@property (readwrite) NSUInteger queuedByteCount;
+@property (readwrite) NSUInteger queuedByteHighWaterMark;
+@property (readwrite) NSUInteger inFlightMessageCount;
+@property (readwrite) NSTimeInterval duration;
+@end
+
+@implementation LSPMetricsSnapshot
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ requests = %lu notifications = %lu cancelled = %lu errors = %lu written = %lu read = %lu latencies = %@ stages = %@>", [self className],
+            (unsigned long)_sentRequestCount, (unsigned long)_sentNotificationCount, (unsigned long)_cancelledRequestCount, (unsigned long)_errorResponseCount,
+            (unsigned long)_bytesWritten, (unsigned long)_bytesRead, _requestLatencies, _stageDurations];
+}
+
+@end
+
+@interface LSPMetricsRecorder () {
+    // Guards everything below.
+    os_unfair_lock _lock;
+    NSUInteger _counters[LSPMetricsCounterCount];
+    LSPLatencyHistogram *_stageHistograms[LSPMetricsStageIndexCount];
+    NSMutableDictionary<NSString *, LSPLatencyHistogram *> *_requestHistograms;
+    uint64_t _startTime;
+}
+@end
+
+@implementation LSPMetricsRecorder
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _lock = OS_UNFAIR_LOCK_INIT;
+        _requestHistograms = [NSMutableDictionary dictionary];
+        for (NSUInteger stage = 0; stage < LSPMetricsStageIndexCount; stage++) {
+            _stageHistograms[stage] = [[LSPLatencyHistogram alloc] init];
+        }
+        _startTime = LSPMetricsTime();
+    }
+    return self;
+}
+
+- (void)incrementCounter:(LSPMetricsCounter)counter by:(NSUInteger)value {
+    os_unfair_lock_lock(&_lock);
+    _counters[counter] += value;
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)recordDuration:(uint64_t)nanoseconds ofStage:(LSPMetricsStageIndex)stage {
+    os_unfair_lock_lock(&_lock);
+    [_stageHistograms[stage] recordDuration:nanoseconds];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)recordLatency:(uint64_t)nanoseconds ofRequest:(NSString *)method {
+    os_unfair_lock_lock(&_lock);
+    LSPLatencyHistogram *histogram = [_requestHistograms objectForKey:method];
+    if (histogram == nil) {
+        histogram = [[LSPLatencyHistogram alloc] init];
+        [_requestHistograms setObject:histogram forKey:method];
+    }
+    [histogram recordDuration:nanoseconds];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)reset {
+    os_unfair_lock_lock(&_lock);
+    memset(_counters, 0, sizeof(_counters));
+    for (NSUInteger stage = 0; stage < LSPMetricsStageIndexCount; stage++) {
+        _stageHistograms[stage] = [[LSPLatencyHistogram alloc] init];
+    }
+    [_requestHistograms removeAllObjects];
+    _startTime = LSPMetricsTime();
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (LSPMetricsSnapshot *)snapshotWithPipeline:(LSPPipeline *)pipeline {
+    LSPMetricsSnapshot *snapshot = [[LSPMetricsSnapshot alloc] init];
+    NSString *stageKeys[LSPMetricsStageIndexCount] = {
+        LSPMetricsStageEncode, LSPMetricsStageWrite, LSPMetricsStageRead, LSPMetricsStageDecode, LSPMetricsStageDispatch
+    };
+    NSMutableDictionary *stageDurations = [NSMutableDictionary dictionaryWithCapacity:LSPMetricsStageIndexCount];
+    NSMutableDictionary *requestLatencies = [NSMutableDictionary dictionary];
+    os_unfair_lock_lock(&_lock);
+    for (NSUInteger stage = 0; stage < LSPMetricsStageIndexCount; stage++) {
+        [stageDurations setObject:[_stageHistograms[stage] copy] forKey:stageKeys[stage]];
+    }
+    for (NSString *method in _requestHistograms) {
+        [requestLatencies setObject:[[_requestHistograms objectForKey:method] copy] forKey:method];
+    }
+    [snapshot setSentRequestCount:_counters[LSPMetricsCounterSentRequests]];
+    [snapshot setSentNotificationCount:_counters[LSPMetricsCounterSentNotifications]];
+    [snapshot setCancelledRequestCount:_counters[LSPMetricsCounterCancelledRequests]];
+    [snapshot setReceivedResponseCount:_counters[LSPMetricsCounterReceivedResponses]];
+    [snapshot setErrorResponseCount:_counters[LSPMetricsCounterErrorResponses]];
+    [snapshot setReceivedNotificationCount:_counters[LSPMetricsCounterReceivedNotifications]];
+    [snapshot setReceivedRequestCount:_counters[LSPMetricsCounterReceivedRequests]];
+    [snapshot setBytesWritten:_counters[LSPMetricsCounterBytesWritten]];
+    [snapshot setBytesRead:_counters[LSPMetricsCounterBytesRead]];
+    [snapshot setWriteCount:_counters[LSPMetricsCounterWrites]];
+    [snapshot setReadCount:_counters[LSPMetricsCounterReads]];
+    [snapshot setDuration:(NSTimeInterval)(LSPMetricsTime() - _startTime) / NSEC_PER_SEC];
+    os_unfair_lock_unlock(&_lock);
+    [snapshot setStageDurations:stageDurations];
+    [snapshot setRequestLatencies:requestLatencies];
+    [snapshot setQueuedByteCount:[pipeline queuedByteCount]];
+    [snapshot setQueuedByteHighWaterMark:[pipeline queuedByteHighWaterMark]];
+    [snapshot setInFlightMessageCount:[pipeline inFlightMessageCount]];
+    return snapshot;
+}
+
+@end
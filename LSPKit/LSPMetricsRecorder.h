@@ -0,0 +1,72 @@
+//
+//  LSPMetricsRecorder.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <os/signpost.h>
+
+#import "LSPMetrics.h"
+
+@class LSPPipeline;
+
+typedef NS_ENUM(NSUInteger, LSPMetricsStageIndex) {
+    LSPMetricsStageIndexEncode,
+    LSPMetricsStageIndexWrite,
+    LSPMetricsStageIndexRead,
+    LSPMetricsStageIndexDecode,
+    LSPMetricsStageIndexDispatch,
+    LSPMetricsStageIndexCount
+};
+
+typedef NS_ENUM(NSUInteger, LSPMetricsCounter) {
+    LSPMetricsCounterSentRequests,
+    LSPMetricsCounterSentNotifications,
+    LSPMetricsCounterCancelledRequests,
+    LSPMetricsCounterReceivedResponses,
+    LSPMetricsCounterErrorResponses,
+    LSPMetricsCounterReceivedNotifications,
+    LSPMetricsCounterReceivedRequests,
+    LSPMetricsCounterBytesWritten,
+    LSPMetricsCounterBytesRead,
+    LSPMetricsCounterWrites,
+    LSPMetricsCounterReads,
+    LSPMetricsCounterCount
+};
+
+/**
+ * Collects the metrics of LSPClient and its pipelines, from any thread.
+ *
+ * A pipeline without a recorder does not measure anything. The stages are
+ * also marked with os_signpost intervals in the "com.letteropener.LSPKit"
+ * subsystem, whenever Instruments records them, with or without a recorder.
+ *
+ * Not part of the public API of the framework, the header is only visible
+ * to LSPKit and the unit tests.
+ */
+@interface LSPMetricsRecorder : NSObject
+
+- (void)incrementCounter:(LSPMetricsCounter)counter by:(NSUInteger)value;
+- (void)recordDuration:(uint64_t)nanoseconds ofStage:(LSPMetricsStageIndex)stage;
+- (void)recordLatency:(uint64_t)nanoseconds ofRequest:(NSString *)method;
+- (void)reset;
+/**
+ * The queue sizes are taken from pipeline, the current one of the client.
+ */
+- (LSPMetricsSnapshot *)snapshotWithPipeline:(LSPPipeline *)pipeline;
+
+@end
+
+/** The start of a stage interval, all zero if nothing is measured. */
+typedef struct {
+    uint64_t start;
+    os_signpost_id_t signpostID;
+} LSPMetricsInterval;
+
+/** Nanoseconds of a monotonic clock. */
+extern uint64_t LSPMetricsTime(void);
+extern LSPMetricsInterval LSPMetricsIntervalBegin(LSPMetricsRecorder *recorder, LSPMetricsStageIndex stage);
+extern void LSPMetricsIntervalEnd(LSPMetricsRecorder *recorder, LSPMetricsStageIndex stage, LSPMetricsInterval interval);
@@ -0,0 +1,178 @@
+//
+//  LSPPipeline.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class LSPMessageEncoder;
+@class LSPMetricsRecorder;
+@class LSPTraceRecorder;
+
+/**
+ * The order in which requests are sent. Requests of a higher priority are
+ * written ahead of the ones still queued for stdin, and background requests
+ * wait while maximumBackgroundRequestCount of them are in flight.
+ */
+typedef NS_ENUM(NSInteger, LSPRequestPriority) {
+    /** Results nobody waits for right now, like the symbols of a document. */
+    LSPRequestPriorityBackground = -1,
+    LSPRequestPriorityNormal = 0,
+    /** Results the user is waiting for, like completion or hover. */
+    LSPRequestPriorityInteractive = 1,
+};
+
+/**
+ * The JSON-RPC transport between LSPClient and a language server process.
+ *
+ * The readability handler of stdout only cuts the bytes into frames. The
+ * frames are decoded on a serial decode queue, which also calls the reply
+ * blocks. Notifications and requests of the server are handed to the
+ * notification message handler on the notification queue.
+ *
+ * Not part of the public API of the framework, the header is only visible
+ * to LSPKit and the unit tests.
+ */
+@interface LSPPipeline : NSObject
+@property NSPipe *stdinPipe;
+@property NSPipe *stdoutPipe;
+@property NSPipe *stderrPipe;
+@property (copy) void (^readHandler)(NSData *);
+/**
+ * Called for every complete frame with the content part of the frame. The
+ * content is a slice of the data read from the pipe whenever the frame was
+ * received in one read, otherwise it is assembled into a single buffer sized
+ * by the Content-Length header. In both cases the content is not copied again.
+ */
+@property (copy) void (^dataHandler)(NSData *content, NSString *charset);
+/**
+ * Called with every notification and request of the server, in the order
+ * they were received. The messages received while the notification queue is
+ * busy are handled in one block on it.
+ */
+@property (copy) void (^notificationMessageHandler)(NSDictionary *message);
+/**
+ * The queue on which the notification message handler is called. Defaults
+ * to the main queue.
+ */
+@property (strong) dispatch_queue_t notificationQueue;
+/**
+ * The maximum number of messages received but not yet handled, including the
+ * ones waiting on the notification queue. When it is reached, stdout is not
+ * read until messages have been handled. So a server flooding notifications
+ * is held back by the pipe instead of growing memory. Defaults to 1024.
+ */
+@property NSUInteger maximumInFlightMessageCount;
+@property (readonly) NSUInteger inFlightMessageCount;
+
+/**
+ * Bytes queued for stdin but not yet written, and the largest number of
+ * queued bytes so far.
+ */
+@property (readonly) NSUInteger queuedByteCount;
+@property (readonly) NSUInteger queuedByteHighWaterMark;
+/**
+ * Frames written to stdin, and the number of writev(2) calls it took. Frames
+ * queued while a write is pending are gathered into one call.
+ */
+@property (readonly) NSUInteger writtenMessageCount;
+@property (readonly) NSUInteger writeCount;
+
+/**
+ * The maximum number of background requests sent to the server and not
+ * answered yet. Further background requests are held back until one of
+ * them is answered, cancelled or timed out, so a server that handles
+ * requests in order does not keep interactive requests waiting behind a
+ * long line of them. Defaults to 4.
+ */
+@property NSUInteger maximumBackgroundRequestCount;
+/**
+ * Requests whose reply block has not been called yet, including the held
+ * background requests.
+ */
+@property (readonly) NSUInteger pendingRequestCount;
+@property (readonly) NSUInteger heldRequestCount;
+
+/**
+ * Records counters, request latencies and the durations of the pipeline
+ * stages, if set. Without a recorder nothing is measured.
+ */
+@property (strong) LSPMetricsRecorder *metrics;
+/**
+ * Records every frame sent and received, if set.
+ */
+@property (strong) LSPTraceRecorder *traceRecorder;
+
+/**
+ * Queues data for stdin and returns right away. The data is written on the
+ * write queue, whenever the server reads.
+ */
+- (void)writeData:(NSData *)data;
+/**
+ * Closes the pipes. The reply blocks of pending requests are released
+ * without being called.
+ */
+- (void)close;
+
+@end
+
+@interface LSPPipeline (MessageTransport)
+- (void)didReceiveData:(NSData *)data;
+- (void)sendMessage:(NSData *)data;
+/**
+ * Queues a message whose content is encoded on the write queue, in chunks
+ * written to stdin as they are encoded.
+ */
+- (void)sendMessageWithEncoder:(LSPMessageEncoder *)encoder;
+@end
+
+@interface LSPPipeline (ProtocolTransport)
+/**
+ * Can be called from any thread. The reply block is called on the decode queue.
+ * Returns the id of the request.
+ */
+- (NSNumber *)sendRequest:(NSString *)method params:(NSDictionary *)params withReply:(void (^)(id obj, NSError *error))block;
+/**
+ * Sends a request with a priority. A held background request is sent after
+ * the notifications sent meanwhile. If one of them was a didChange or
+ * didClose of the document in its params, the request is not sent anymore,
+ * its reply block is called with an LSPResponseContentModified error.
+ *
+ * With a timeout greater than 0, a request that is not answered in time is
+ * cancelled and its reply block is called with an LSPResponseRequestTimedOut
+ * error instead.
+ */
+- (NSNumber *)sendRequest:(NSString *)method params:(NSDictionary *)params priority:(LSPRequestPriority)priority timeout:(NSTimeInterval)timeout withReply:(void (^)(id obj, NSError *error))block;
+/**
+ * Forgets the reply block of a request and sends $/cancelRequest, unless the
+ * reply was already received. The reply block is not called anymore. A held
+ * background request is dropped without being sent.
+ */
+- (void)cancelRequest:(NSNumber *)messageID;
+/**
+ * Answers a request of the server, with an error if error is not nil. The
+ * code and description of the error are sent.
+ */
+- (void)sendReplyToRequest:(id)messageID result:(id)result error:(NSError *)error;
+/**
+ * Strings in params of at least LSPMessageEncoderMinimumStreamedStringLength
+ * code units, like the text of a large document, are not serialized on the
+ * calling thread but escaped on the write queue while the message is written.
+ */
+- (void)sendNotification:(NSString *)method params:(NSDictionary *)params;
+@end
+
+@interface LSPPipeline (Replay)
+/**
+ * Feeds the messages a trace received from its server into didReceiveData:,
+ * as if this pipeline read them from stdout. Sent and truncated messages are
+ * skipped. With preservingTiming, waits between the messages as long as
+ * they were apart when recorded. Blocks while too many messages are in
+ * flight, so it must not be called on the notification queue. Returns the
+ * number of messages replayed.
+ */
+- (NSUInteger)replayReceivedMessagesOfTrace:(LSPTraceRecorder *)trace preservingTiming:(BOOL)preservingTiming;
+@end
@@ -0,0 +1,1186 @@
+//
+//  LSPPipeline.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPPipeline.h"
+
+#import <fcntl.h>
+#import <os/lock.h>
+#import <sys/uio.h>
+
+#import "LSPCommon.h"
+#import "LSPMessageEncoder.h"
+#import "LSPMetricsRecorder.h"
+#import "LSPTraceRecorder.h"
+
+typedef void (^ReplyBlock)(NSDictionary *, NSError *);
+
+/**
+ * A background request waiting for one in flight to finish. It is stale once
+ * its document changed or closed, and is then not sent anymore.
+ */
+@interface LSPHeldRequest : NSObject
+@property NSNumber *messageID;
+@property NSData *data;
+@property NSString *uri;
+@property (getter=isStale) BOOL stale;
+@end
+
+@implementation LSPHeldRequest
+@end
+
+@interface LSPTraceRecorder (Recording)
+- (void)recordMessage:(NSData *)content length:(NSUInteger)length direction:(LSPTraceDirection)direction;
+@end
+
+/**
+ * A frame is a header part, terminated by "\r\n\r\n", followed by
+ * Content-Length bytes of content.
+ */
+typedef NS_ENUM(NSUInteger, LSPFrameDecoderState) {
+    LSPFrameDecoderStateHeader = 0,
+    LSPFrameDecoderStateContent = 1,
+    // The content of a frame that could not be buffered is read past.
+    LSPFrameDecoderStateSkipContent = 2,
+};
+
+static const char LSPFrameHeaderTerminator[] = "\r\n\r\n";
+static const NSUInteger LSPFrameHeaderTerminatorLength = 4;
+/**
+ * Headers are a few short fields. Bytes past this length without a
+ * terminator are not a header, they are dropped up to the next terminator.
+ */
+static const NSUInteger LSPMaximumFrameHeaderLength = 4 * 1024;
+
+/**
+ * A frame queued for stdin. The header is formatted in place, the content
+ * is retained and written as is.
+ *
+ * The content of a frame with an encoder is encoded on the write queue, one
+ * chunk at a time. Then content holds the current chunk, which starts at
+ * chunkStart of the content, and the header is formatted once the encoder
+ * knows the content length.
+ */
+typedef struct {
+    char header[48];
+    NSUInteger headerLength;
+    CFDataRef content;
+    NSUInteger contentLength;
+    CFTypeRef encoder;
+    NSUInteger chunkStart;
+    // Bytes of header and content already written.
+    NSUInteger offset;
+    // Requests of a higher priority are written before a request that was
+    // not started yet. Other frames keep their place.
+    BOOL request;
+    LSPRequestPriority priority;
+} LSPOutboundFrame;
+
+/** At most this many frames are gathered into one writev(2). */
+static const NSUInteger LSPMaximumGatheredFrameCount = 64;
+
+/** Content of a frame with an encoder is encoded in chunks of this size. */
+static const NSUInteger LSPEncodedChunkLength = 64 * 1024;
+
+static void LSPOutboundFrameRelease(LSPOutboundFrame *frame) {
+    if (frame->content) {
+        CFRelease(frame->content);
+    }
+    if (frame->encoder) {
+        CFRelease(frame->encoder);
+    }
+}
+
+/** Returns YES if the next bytes of a frame with an encoder are not encoded yet. */
+static BOOL LSPOutboundFrameNeedsChunk(LSPOutboundFrame *frame) {
+    if (frame->encoder == NULL) {
+        return NO;
+    }
+    if (frame->headerLength == 0) {
+        return YES;
+    }
+    NSUInteger contentOffset = (frame->offset > frame->headerLength) ? frame->offset - frame->headerLength : 0;
+    NSUInteger chunkEnd = frame->chunkStart + (frame->content ? (NSUInteger)CFDataGetLength(frame->content) : 0);
+    return (contentOffset == chunkEnd && contentOffset < frame->contentLength);
+}
+
+/** The uri of params.textDocument, or nil. */
+static NSString *LSPTextDocumentURIOfParams(NSDictionary *params) {
+    if ([params isKindOfClass:[NSDictionary class]] == NO) {
+        return nil;
+    }
+    NSDictionary *textDocument = [params objectForKey:@"textDocument"];
+    if ([textDocument isKindOfClass:[NSDictionary class]] == NO) {
+        return nil;
+    }
+    NSString *uri = [textDocument objectForKey:@"uri"];
+    return [uri isKindOfClass:[NSString class]] ? uri : nil;
+}
+
+@interface LSPPipeline () {
+    NSUInteger _messageID;
+    LSPFrameDecoderState _state;
+    NSMutableData *_header;
+    NSUInteger _headerTerminatorMatch;
+    BOOL _headerOverflow;
+    NSUInteger _contentLength;
+    NSString *_contentCharset;
+    uint8_t *_content;
+    NSUInteger _contentOffset;
+    NSMutableDictionary <NSNumber *, ReplyBlock> *_replyBlocks;
+    // Background requests sent and not finished, and the ones waiting for
+    // them, in the order they were sent. Guarded by _replyBlocks.
+    NSMutableSet<NSNumber *> *_backgroundRequestIDs;
+    NSMutableArray<LSPHeldRequest *> *_heldRequests;
+    dispatch_queue_t _decodeQueue;
+    NSCondition *_inFlightCondition;
+    NSUInteger _inFlightMessageCount;
+    BOOL _closed;
+    // Notifications waiting for the notification queue, guarded by
+    // _notificationLock. One block is scheduled for all of them.
+    os_unfair_lock _notificationLock;
+    NSMutableArray<NSDictionary *> *_pendingNotifications;
+    // Outbound frames, guarded by _outboundLock.
+    os_unfair_lock _outboundLock;
+    LSPOutboundFrame *_outboundFrames;
+    NSUInteger _outboundFrameStart;
+    NSUInteger _outboundFrameCount;
+    NSUInteger _outboundFrameCapacity;
+    NSUInteger _queuedByteCount;
+    NSUInteger _queuedByteHighWaterMark;
+    NSUInteger _writtenMessageCount;
+    NSUInteger _writeCount;
+    BOOL _flushScheduled;
+    BOOL _waitingForWritable;
+    BOOL _outboundClosed;
+    dispatch_queue_t _writeQueue;
+    dispatch_source_t _writeSource;
+    int _writeFileDescriptor;
+}
+@end
+
+@interface LSPPipeline (Decoding)
+/**
+ * Decodes a message on the decode queue and hands it to its reply block or
+ * the notification message handler. Releases the in-flight slot the message
+ * took when it was received.
+ */
+- (void)handlePipelineMessage:(NSData *)data;
+@end
+
+
+@implementation LSPPipeline
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _state = LSPFrameDecoderStateHeader;
+        _header = [NSMutableData dataWithCapacity:64];
+        _replyBlocks = [NSMutableDictionary dictionary];
+        _backgroundRequestIDs = [NSMutableSet set];
+        _heldRequests = [NSMutableArray array];
+        _maximumBackgroundRequestCount = 4;
+        _decodeQueue = dispatch_queue_create("com.letteropener.LSPKit.LSPPipeline.decode", DISPATCH_QUEUE_SERIAL);
+        _notificationQueue = dispatch_get_main_queue();
+        _maximumInFlightMessageCount = 1024;
+        _inFlightCondition = [[NSCondition alloc] init];
+        _outboundLock = OS_UNFAIR_LOCK_INIT;
+        _notificationLock = OS_UNFAIR_LOCK_INIT;
+        _pendingNotifications = [NSMutableArray array];
+        _writeQueue = dispatch_queue_create("com.letteropener.LSPKit.LSPPipeline.write", DISPATCH_QUEUE_SERIAL);
+        _stdinPipe = [NSPipe pipe];
+        _stdoutPipe = [NSPipe pipe];
+        _stderrPipe = [NSPipe pipe];
+        // Writes must never block the sending thread, and a server that went
+        // away must not kill us with SIGPIPE.
+        _writeFileDescriptor = [[_stdinPipe fileHandleForWriting] fileDescriptor];
+        fcntl(_writeFileDescriptor, F_SETFL, fcntl(_writeFileDescriptor, F_GETFL) | O_NONBLOCK);
+        fcntl(_writeFileDescriptor, F_SETNOSIGPIPE, 1);
+        [[_stdoutPipe fileHandleForReading] setReadabilityHandler:^(NSFileHandle *fileHandle) {
+            NSData *data = [fileHandle availableData];
+            if ([data length] == 0) return;
+            if (self.readHandler == nil) return;
+            self.readHandler(data);
+        }];
+        [[_stderrPipe fileHandleForReading] setReadabilityHandler:^(NSFileHandle *fileHandle) {
+            NSData *data = [fileHandle availableData];
+            if ([data length] == 0) return;
+            NSLog(@"stderr: %@", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]);
+        }];
+        __weak __typeof(self) weakSelf = self;
+        [self setReadHandler:^(NSData *data) {
+            __strong __typeof(self) strongSelf = weakSelf;
+            if ([data length] == 0) return;
+            [strongSelf didReceiveData:data];
+        }];
+        [self setDataHandler:^(NSData *content, NSString *charset) {
+            __strong __typeof(self) strongSelf = weakSelf;
+            [strongSelf enqueueMessage:content];
+        }];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_content);
+    [self _removeOutboundFrames];
+    free(_outboundFrames);
+}
+
+- (void)writeData:(NSData *)data {
+    LSPOutboundFrame frame = { 0 };
+    [self _enqueueFrame:&frame content:data];
+}
+
+#pragma mark Outbound Queue
+
+/** Must be called with _outboundLock held. */
+- (void)_removeOutboundFrames {
+    for (NSUInteger index = _outboundFrameStart; index < _outboundFrameStart + _outboundFrameCount; index++) {
+        LSPOutboundFrameRelease(&_outboundFrames[index]);
+    }
+    _outboundFrameStart = 0;
+    _outboundFrameCount = 0;
+    _queuedByteCount = 0;
+}
+
+- (void)_enqueueFrame:(LSPOutboundFrame *)frame content:(NSData *)content {
+    NSData *contentCopy = [content copy];
+    frame->contentLength = [contentCopy length];
+    if (frame->headerLength + frame->contentLength == 0) {
+        return;
+    }
+    frame->content = (frame->contentLength > 0) ? CFBridgingRetain(contentCopy) : NULL;
+    [self _enqueueFrame:frame];
+}
+
+- (void)_enqueueFrame:(LSPOutboundFrame *)frame {
+    BOOL scheduleFlush = NO;
+    os_unfair_lock_lock(&_outboundLock);
+    if (_outboundClosed) {
+        os_unfair_lock_unlock(&_outboundLock);
+        LSPOutboundFrameRelease(frame);
+        return;
+    }
+    if (_outboundFrameStart + _outboundFrameCount == _outboundFrameCapacity) {
+        if (_outboundFrameStart > 0) {
+            memmove(_outboundFrames, _outboundFrames + _outboundFrameStart, _outboundFrameCount * sizeof(LSPOutboundFrame));
+            _outboundFrameStart = 0;
+        }
+        if (_outboundFrameCount == _outboundFrameCapacity) {
+            _outboundFrameCapacity = MAX(_outboundFrameCapacity * 2, 16);
+            _outboundFrames = reallocf(_outboundFrames, _outboundFrameCapacity * sizeof(LSPOutboundFrame));
+        }
+    }
+    // A request goes ahead of the requests of a lower priority that are
+    // still waiting, but never ahead of a notification.
+    NSUInteger index = _outboundFrameCount;
+    while (frame->request && index > 0) {
+        LSPOutboundFrame *previous = &_outboundFrames[_outboundFrameStart + index - 1];
+        if (previous->request == NO || previous->offset > 0 || previous->priority >= frame->priority) {
+            break;
+        }
+        index--;
+    }
+    if (index < _outboundFrameCount) {
+        memmove(_outboundFrames + _outboundFrameStart + index + 1, _outboundFrames + _outboundFrameStart + index, (_outboundFrameCount - index) * sizeof(LSPOutboundFrame));
+    }
+    _outboundFrames[_outboundFrameStart + index] = *frame;
+    _outboundFrameCount++;
+    _queuedByteCount += frame->headerLength + frame->contentLength;
+    _queuedByteHighWaterMark = MAX(_queuedByteHighWaterMark, _queuedByteCount);
+    // Frames queued while a flush is pending go out with it, in one writev(2).
+    if (_flushScheduled == NO && _waitingForWritable == NO) {
+        _flushScheduled = YES;
+        scheduleFlush = YES;
+    }
+    os_unfair_lock_unlock(&_outboundLock);
+    if (scheduleFlush) {
+        dispatch_async(_writeQueue, ^{
+            [self _flush];
+        });
+    }
+}
+
+/** Writes queued frames on the write queue until they are written or stdin is full. */
+- (void)_flush {
+    os_unfair_lock_lock(&_outboundLock);
+    _flushScheduled = NO;
+    while (_outboundFrameCount > 0 && _outboundClosed == NO) {
+        if (LSPOutboundFrameNeedsChunk(&_outboundFrames[_outboundFrameStart])) {
+            if ([self _encodeChunkOfFirstFrame] == NO) {
+                break;
+            }
+        }
+        struct iovec vectors[LSPMaximumGatheredFrameCount * 2];
+        int vectorCount = 0;
+        NSUInteger frameCount = MIN(_outboundFrameCount, LSPMaximumGatheredFrameCount);
+        for (NSUInteger index = 0; index < frameCount; index++) {
+            LSPOutboundFrame *frame = &_outboundFrames[_outboundFrameStart + index];
+            if (index > 0 && LSPOutboundFrameNeedsChunk(frame)) {
+                break;
+            }
+            if (frame->offset < frame->headerLength) {
+                vectors[vectorCount].iov_base = frame->header + frame->offset;
+                vectors[vectorCount].iov_len = frame->headerLength - frame->offset;
+                vectorCount++;
+            }
+            NSUInteger contentOffset = (frame->offset > frame->headerLength) ? frame->offset - frame->headerLength : 0;
+            NSUInteger contentEnd = frame->chunkStart + (frame->content ? (NSUInteger)CFDataGetLength(frame->content) : 0);
+            if (contentOffset < contentEnd) {
+                vectors[vectorCount].iov_base = (uint8_t *)CFDataGetBytePtr(frame->content) + contentOffset - frame->chunkStart;
+                vectors[vectorCount].iov_len = contentEnd - contentOffset;
+                vectorCount++;
+            }
+            if (contentEnd < frame->contentLength) {
+                // The rest of the content is not encoded yet, later frames wait.
+                break;
+            }
+        }
+        LSPMetricsRecorder *metrics = [self metrics];
+        LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexWrite);
+        ssize_t written = writev(_writeFileDescriptor, vectors, vectorCount);
+        LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexWrite, interval);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                // The server does not read, continue when there is room in the pipe.
+                [self _waitForWritable];
+                break;
+            }
+            NSLog(@"%s write error %s, dropping %lu queued bytes", __PRETTY_FUNCTION__, strerror(errno), (unsigned long)_queuedByteCount);
+            [self _removeOutboundFrames];
+            break;
+        }
+        _writeCount++;
+        _queuedByteCount -= (NSUInteger)written;
+        if (metrics) {
+            [metrics incrementCounter:LSPMetricsCounterWrites by:1];
+            [metrics incrementCounter:LSPMetricsCounterBytesWritten by:(NSUInteger)written];
+        }
+        NSUInteger remaining = (NSUInteger)written;
+        while (remaining > 0) {
+            LSPOutboundFrame *frame = &_outboundFrames[_outboundFrameStart];
+            NSUInteger frameRemaining = frame->headerLength + frame->contentLength - frame->offset;
+            if (remaining < frameRemaining) {
+                frame->offset += remaining;
+                break;
+            }
+            remaining -= frameRemaining;
+            LSPOutboundFrameRelease(frame);
+            _outboundFrameStart++;
+            _outboundFrameCount--;
+            _writtenMessageCount++;
+        }
+        if (_outboundFrameCount == 0) {
+            _outboundFrameStart = 0;
+        }
+    }
+    os_unfair_lock_unlock(&_outboundLock);
+}
+
+/**
+ * Must be called on the write queue with _outboundLock held. Encodes the next
+ * chunk of the first frame, and formats its header before the first chunk.
+ * The lock is released while encoding, so senders do not wait for it. Returns
+ * NO if the queue was closed meanwhile.
+ */
+- (BOOL)_encodeChunkOfFirstFrame {
+    LSPOutboundFrame *frame = &_outboundFrames[_outboundFrameStart];
+    // Keeps the encoder alive when the queue is closed while encoding.
+    LSPMessageEncoder *encoder = (__bridge LSPMessageEncoder *)frame->encoder;
+    os_unfair_lock_unlock(&_outboundLock);
+    LSPMetricsRecorder *metrics = [self metrics];
+    LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexEncode);
+    NSUInteger contentLength = [encoder contentLength];
+    NSMutableData *chunk = [NSMutableData dataWithLength:LSPEncodedChunkLength];
+    [chunk setLength:[encoder getBytes:[chunk mutableBytes] maxLength:[chunk length]]];
+    LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexEncode, interval);
+    os_unfair_lock_lock(&_outboundLock);
+    if (_outboundClosed) {
+        return NO;
+    }
+    // Frames queued meanwhile may have moved the queue, not its first frame.
+    frame = &_outboundFrames[_outboundFrameStart];
+    if (frame->headerLength == 0) {
+        frame->headerLength = (NSUInteger)snprintf(frame->header, sizeof(frame->header), "Content-Length: %lu\r\n\r\n", (unsigned long)contentLength);
+        _queuedByteCount = _queuedByteCount - frame->contentLength + frame->headerLength + contentLength;
+        _queuedByteHighWaterMark = MAX(_queuedByteHighWaterMark, _queuedByteCount);
+        frame->contentLength = contentLength;
+    } else {
+        frame->chunkStart += (NSUInteger)CFDataGetLength(frame->content);
+    }
+    if (frame->content) {
+        CFRelease(frame->content);
+    }
+    frame->content = CFBridgingRetain(chunk);
+    return YES;
+}
+
+/** Must be called on the write queue with _outboundLock held. */
+- (void)_waitForWritable {
+    _waitingForWritable = YES;
+    if (_writeSource == nil) {
+        _writeSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_WRITE, (uintptr_t)_writeFileDescriptor, 0, _writeQueue);
+        __weak __typeof(self) weakSelf = self;
+        dispatch_source_set_event_handler(_writeSource, ^{
+            __strong __typeof(self) strongSelf = weakSelf;
+            [strongSelf _writeSourceDidFire];
+        });
+    }
+    dispatch_resume(_writeSource);
+}
+
+- (void)_writeSourceDidFire {
+    os_unfair_lock_lock(&_outboundLock);
+    if (_waitingForWritable) {
+        _waitingForWritable = NO;
+        dispatch_suspend(_writeSource);
+    }
+    os_unfair_lock_unlock(&_outboundLock);
+    [self _flush];
+}
+
+- (NSUInteger)queuedByteCount {
+    os_unfair_lock_lock(&_outboundLock);
+    NSUInteger count = _queuedByteCount;
+    os_unfair_lock_unlock(&_outboundLock);
+    return count;
+}
+
+- (NSUInteger)queuedByteHighWaterMark {
+    os_unfair_lock_lock(&_outboundLock);
+    NSUInteger count = _queuedByteHighWaterMark;
+    os_unfair_lock_unlock(&_outboundLock);
+    return count;
+}
+
+- (NSUInteger)writtenMessageCount {
+    os_unfair_lock_lock(&_outboundLock);
+    NSUInteger count = _writtenMessageCount;
+    os_unfair_lock_unlock(&_outboundLock);
+    return count;
+}
+
+- (NSUInteger)writeCount {
+    os_unfair_lock_lock(&_outboundLock);
+    NSUInteger count = _writeCount;
+    os_unfair_lock_unlock(&_outboundLock);
+    return count;
+}
+
+#pragma mark Inbound Queue
+
+- (NSUInteger)inFlightMessageCount {
+    [_inFlightCondition lock];
+    NSUInteger count = _inFlightMessageCount;
+    [_inFlightCondition unlock];
+    return count;
+}
+
+/** Called by the reader for every frame, waits while too many messages are in flight. */
+- (void)enqueueMessage:(NSData *)data {
+    [_inFlightCondition lock];
+    while (_inFlightMessageCount >= MAX(_maximumInFlightMessageCount, 1) && _closed == NO) {
+        [_inFlightCondition wait];
+    }
+    _inFlightMessageCount++;
+    [_inFlightCondition unlock];
+    dispatch_async(_decodeQueue, ^{
+        [self handlePipelineMessage:data];
+    });
+}
+
+- (void)didHandleMessage {
+    [_inFlightCondition lock];
+    _inFlightMessageCount--;
+    [_inFlightCondition signal];
+    [_inFlightCondition unlock];
+}
+
+- (void)close {
+    [_inFlightCondition lock];
+    _closed = YES;
+    [_inFlightCondition broadcast];
+    [_inFlightCondition unlock];
+    // The replies never come, the reply blocks are released without being called.
+    @synchronized (_replyBlocks) {
+        [_replyBlocks removeAllObjects];
+        [_backgroundRequestIDs removeAllObjects];
+        [_heldRequests removeAllObjects];
+    }
+    os_unfair_lock_lock(&_outboundLock);
+    _outboundClosed = YES;
+    [self _removeOutboundFrames];
+    if (_writeSource) {
+        // The source runs only while waiting for writable, it is suspended
+        // otherwise and must be resumed before it is released.
+        if (_waitingForWritable) {
+            _waitingForWritable = NO;
+        } else {
+            dispatch_resume(_writeSource);
+        }
+        dispatch_source_cancel(_writeSource);
+        _writeSource = nil;
+    }
+    os_unfair_lock_unlock(&_outboundLock);
+    [[_stdinPipe fileHandleForReading] closeFile];
+    [[_stdinPipe fileHandleForWriting] closeFile];
+    [[_stdoutPipe fileHandleForReading] closeFile];
+    [[_stdoutPipe fileHandleForWriting] closeFile];
+    [[_stderrPipe fileHandleForReading] closeFile];
+    [[_stderrPipe fileHandleForWriting] closeFile];
+    [[_stdoutPipe fileHandleForReading] setReadabilityHandler:nil];
+    [[_stderrPipe fileHandleForReading] setReadabilityHandler:nil];
+}
+
+@end
+
+@implementation LSPPipeline (MessageTransport)
+
+NSString *ParsenContentType(NSString *str, NSDictionary **params) {
+    NSString *contentType = str;
+    NSArray *components = [str componentsSeparatedByString:@";"];
+    if ([components count] > 1) {
+        contentType = [components objectAtIndex:0];
+        if (params) {
+            NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+            for (NSString *component in [components subarrayWithRange:NSMakeRange(1, [components count] - 1)]) {
+                NSArray *keyvalue = [component componentsSeparatedByString:@"="];
+                if ([keyvalue count] == 2) {
+                    NSString *key = [[keyvalue objectAtIndex:0] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+                    NSString *value = [[keyvalue objectAtIndex:1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+                    if (key && value) {
+                        [dict setObject:value forKey:key];
+                    }
+                }
+            }
+            *params = [dict copy];
+        }
+    }
+    return contentType;
+}
+
+/** Compares a header field name, case-insensitive as in HTTP. */
+static BOOL LSPHeaderFieldNameEqual(const char *bytes, NSUInteger length, const char *name) {
+    return (strlen(name) == length && strncasecmp(bytes, name, length) == 0);
+}
+
+/** Trims spaces and horizontal tabs from both ends of a header field value. */
+static void LSPHeaderFieldTrim(const char **bytes, NSUInteger *length) {
+    while (*length > 0 && (**bytes == ' ' || **bytes == '\t')) {
+        (*bytes)++;
+        (*length)--;
+    }
+    while (*length > 0 && ((*bytes)[*length - 1] == ' ' || (*bytes)[*length - 1] == '\t')) {
+        (*length)--;
+    }
+}
+
+/**
+ * Parses the header part of a frame, without the terminating empty line.
+ * Returns NO if there is no valid Content-Length field.
+ */
+static BOOL LSPParseFrameHeader(const char *bytes, NSUInteger length, NSUInteger *contentLength, NSString **charset) {
+    BOOL hasContentLength = NO;
+    NSUInteger lineStart = 0;
+    while (lineStart < length) {
+        const char *line = bytes + lineStart;
+        const char *lineEnd = memchr(line, '\n', length - lineStart);
+        NSUInteger lineLength = (lineEnd != NULL) ? (NSUInteger)(lineEnd - line) : length - lineStart;
+        lineStart += lineLength + 1;
+        if (lineLength > 0 && line[lineLength - 1] == '\r') {
+            lineLength--;
+        }
+        const char *separator = memchr(line, ':', lineLength);
+        if (separator == NULL) {
+            continue;
+        }
+        const char *name = line;
+        NSUInteger nameLength = (NSUInteger)(separator - line);
+        const char *value = separator + 1;
+        NSUInteger valueLength = lineLength - nameLength - 1;
+        LSPHeaderFieldTrim(&name, &nameLength);
+        LSPHeaderFieldTrim(&value, &valueLength);
+        if (LSPHeaderFieldNameEqual(name, nameLength, "Content-Length")) {
+            NSUInteger number = 0;
+            NSUInteger index = 0;
+            for (index = 0; index < valueLength && value[index] >= '0' && value[index] <= '9'; index++) {
+                if (number > (NSUIntegerMax - 9) / 10) {
+                    return NO;
+                }
+                number = number * 10 + (NSUInteger)(value[index] - '0');
+            }
+            if (index == 0 || index != valueLength) {
+                return NO;
+            }
+            *contentLength = number;
+            hasContentLength = YES;
+        } else if (LSPHeaderFieldNameEqual(name, nameLength, "Content-Type")) {
+            NSString *contentType = [[NSString alloc] initWithBytes:value length:valueLength encoding:NSASCIIStringEncoding];
+            NSDictionary *contentTypeParams = nil;
+            ParsenContentType(contentType, &contentTypeParams);
+            NSString *contentTypeCharset = [contentTypeParams objectForKey:@"charset"];
+            if (contentTypeCharset) {
+                *charset = contentTypeCharset;
+            }
+        }
+    }
+    return hasContentLength;
+}
+
+/** Wraps the bytes of data, without copying them, so slices can be handed out. */
+static dispatch_data_t LSPDispatchDataWithData(NSData *data) {
+    return dispatch_data_create([data bytes], [data length], NULL, ^{
+        (void)data;
+    });
+}
+
+- (void)didReceiveData:(NSData *)data {
+    LSPMetricsRecorder *metrics = [self metrics];
+    if (metrics) {
+        [metrics incrementCounter:LSPMetricsCounterReads by:1];
+        [metrics incrementCounter:LSPMetricsCounterBytesRead by:[data length]];
+    }
+    // Includes queueing the frames, so the time stdout is held back by too
+    // many messages in flight shows up here.
+    LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexRead);
+    [self _decodeFramesOfData:data];
+    LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexRead, interval);
+}
+
+- (void)_decodeFramesOfData:(NSData *)data {
+    const uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger offset = 0;
+    dispatch_data_t chunk = nil;
+    while (offset < length) {
+        if (_state == LSPFrameDecoderStateHeader) {
+            // Each byte is looked at once, the terminator may be split
+            // across reads.
+            NSUInteger index = offset;
+            while (index < length && _headerTerminatorMatch < LSPFrameHeaderTerminatorLength) {
+                uint8_t byte = bytes[index++];
+                if (byte == (uint8_t)LSPFrameHeaderTerminator[_headerTerminatorMatch]) {
+                    _headerTerminatorMatch++;
+                } else {
+                    _headerTerminatorMatch = (byte == '\r') ? 1 : 0;
+                }
+            }
+            if (_headerOverflow == NO && [_header length] + index - offset > LSPMaximumFrameHeaderLength) {
+                NSLog(@"%s invalid header, longer than %lu bytes, skipping to the next header", __PRETTY_FUNCTION__, (unsigned long)LSPMaximumFrameHeaderLength);
+                _headerOverflow = YES;
+                [_header setLength:0];
+            }
+            if (_headerOverflow == NO) {
+                [_header appendBytes:bytes + offset length:index - offset];
+            }
+            offset = index;
+            if (_headerTerminatorMatch < LSPFrameHeaderTerminatorLength) {
+                break;
+            }
+            if (_headerOverflow) {
+                _headerOverflow = NO;
+                _headerTerminatorMatch = 0;
+                continue;
+            }
+            NSUInteger headerLength = [_header length] - LSPFrameHeaderTerminatorLength;
+            _headerTerminatorMatch = 0;
+            _contentLength = 0;
+            _contentCharset = @"utf-8";
+            NSString *charset = nil;
+            BOOL valid = LSPParseFrameHeader([_header bytes], headerLength, &_contentLength, &charset);
+            [_header setLength:0];
+            if (valid == NO) {
+                NSLog(@"%s invalid header, frame without Content-Length", __PRETTY_FUNCTION__);
+                continue;
+            }
+            if (charset) {
+                _contentCharset = charset;
+            }
+            _state = LSPFrameDecoderStateContent;
+            if (_contentLength == 0) {
+                [self didDecodeContent:dispatch_data_empty];
+            }
+        } else if (_state == LSPFrameDecoderStateSkipContent) {
+            // The content bytes are not parsed as a header, the next frame
+            // starts after them.
+            NSUInteger count = MIN(length - offset, _contentLength - _contentOffset);
+            _contentOffset += count;
+            offset += count;
+            if (_contentOffset == _contentLength) {
+                _contentOffset = 0;
+                _state = LSPFrameDecoderStateHeader;
+            }
+        } else {
+            NSUInteger available = length - offset;
+            if (_content == NULL && available >= _contentLength) {
+                // The whole content is in this read, hand out a slice of it.
+                if (chunk == nil) {
+                    chunk = LSPDispatchDataWithData(data);
+                }
+                dispatch_data_t content = dispatch_data_create_subrange(chunk, offset, _contentLength);
+                offset += _contentLength;
+                [self didDecodeContent:content];
+                continue;
+            }
+            if (_content == NULL) {
+                // The content spans reads, assemble it into a buffer allocated
+                // once for the announced length instead of growing a buffer.
+                _content = malloc(_contentLength);
+                _contentOffset = 0;
+                if (_content == NULL) {
+                    NSLog(@"%s could not allocate %lu bytes for content, skipping it", __PRETTY_FUNCTION__, (unsigned long)_contentLength);
+                    _state = LSPFrameDecoderStateSkipContent;
+                    continue;
+                }
+            }
+            NSUInteger count = MIN(available, _contentLength - _contentOffset);
+            memcpy(_content + _contentOffset, bytes + offset, count);
+            _contentOffset += count;
+            offset += count;
+            if (_contentOffset == _contentLength) {
+                dispatch_data_t content = dispatch_data_create(_content, _contentLength, NULL, DISPATCH_DATA_DESTRUCTOR_FREE);
+                _content = NULL;
+                _contentOffset = 0;
+                [self didDecodeContent:content];
+            }
+        }
+    }
+}
+
+- (void)didDecodeContent:(dispatch_data_t)content {
+    _state = LSPFrameDecoderStateHeader;
+    // dispatch_data_t is toll-free bridged to NSData.
+    NSData *data = (NSData *)content;
+    [[self traceRecorder] recordMessage:data length:[data length] direction:LSPTraceDirectionReceive];
+    if (_dataHandler) {
+        _dataHandler(data, _contentCharset);
+    }
+}
+
+- (void)sendMessage:(NSData *)data {
+    [self _sendMessage:data request:NO priority:LSPRequestPriorityNormal];
+}
+
+- (void)_sendMessage:(NSData *)data request:(BOOL)request priority:(LSPRequestPriority)priority {
+    [[self traceRecorder] recordMessage:data length:[data length] direction:LSPTraceDirectionSend];
+    LSPOutboundFrame frame = { 0 };
+    frame.headerLength = (NSUInteger)snprintf(frame.header, sizeof(frame.header), "Content-Length: %lu\r\n\r\n", (unsigned long)[data length]);
+    frame.request = request;
+    frame.priority = priority;
+    [self _enqueueFrame:&frame content:data];
+}
+
+- (void)sendMessageWithEncoder:(LSPMessageEncoder *)encoder {
+    // Until the header is formatted, the content length is an estimate.
+    LSPOutboundFrame frame = { 0 };
+    frame.contentLength = [encoder estimatedContentLength];
+    frame.encoder = CFBridgingRetain(encoder);
+    [self _enqueueFrame:&frame];
+}
+
+@end
+
+@implementation LSPPipeline (ProtocolTransport)
+
+- (NSError *)_errorForMessage:(NSDictionary *)json {
+    NSError *error = nil;
+    NSDictionary *jsonError = [json objectForKey:@"error"];
+    if (jsonError) {
+        NSDictionary *info = nil;
+        NSString *message = [jsonError objectForKey:@"message"];
+        if (message) {
+            info = [NSDictionary dictionaryWithObjectsAndKeys:
+                    message, NSLocalizedDescriptionKey, nil];
+        }
+        error = [NSError errorWithDomain:LSPResponseError code:[[jsonError objectForKey:@"code"] integerValue] userInfo:info];
+    }
+    return error;
+}
+
+- (void)handlePipelineMessage:(NSData *)data {
+    NSError *error = nil;
+    LSPMetricsRecorder *metrics = [self metrics];
+    LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexDecode);
+    NSDictionary *message = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+    LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexDecode, interval);
+    if ([message isKindOfClass:[NSDictionary class]] == NO) {
+        NSLog(@"%s error %@",__PRETTY_FUNCTION__, error);
+        [self didHandleMessage];
+        return;
+    }
+    NSNumber *messageID = [message objectForKey:@"id"];
+    if (messageID != nil && [message objectForKey:@"method"] == nil) {
+        ReplyBlock block = nil;
+        LSPHeldRequest *nextRequest = nil;
+        NSMutableArray<ReplyBlock> *staleReplyBlocks = [NSMutableArray array];
+        @synchronized (_replyBlocks) {
+            block = [_replyBlocks objectForKey:messageID];
+            [_replyBlocks removeObjectForKey:messageID];
+            nextRequest = [self _finishBackgroundRequest:messageID staleReplyBlocks:staleReplyBlocks];
+        }
+        [self _sendHeldRequest:nextRequest staleReplyBlocks:staleReplyBlocks];
+        if (metrics) {
+            [metrics incrementCounter:LSPMetricsCounterReceivedResponses by:1];
+            if ([message objectForKey:@"error"]) {
+                [metrics incrementCounter:LSPMetricsCounterErrorResponses by:1];
+            }
+        }
+        if (block) {
+            NSError *error = [self _errorForMessage:message];
+            NSDictionary *result = [message objectForKey:@"result"];
+            block(result, error);
+        }
+        [self didHandleMessage];
+    } else {
+        if (metrics) {
+            [metrics incrementCounter:(messageID != nil) ? LSPMetricsCounterReceivedRequests : LSPMetricsCounterReceivedNotifications by:1];
+        }
+        if (_notificationMessageHandler) {
+            os_unfair_lock_lock(&_notificationLock);
+            [_pendingNotifications addObject:message];
+            BOOL scheduled = ([_pendingNotifications count] > 1);
+            os_unfair_lock_unlock(&_notificationLock);
+            if (scheduled == NO) {
+                dispatch_async(_notificationQueue ?: dispatch_get_main_queue(), ^{
+                    [self _deliverNotifications];
+                });
+            }
+        } else {
+            [self didHandleMessage];
+        }
+    }
+}
+
+/**
+ * Calls the notification message handler with all notifications received
+ * since the last call. A burst takes one hop to the notification queue.
+ */
+- (void)_deliverNotifications {
+    os_unfair_lock_lock(&_notificationLock);
+    NSArray<NSDictionary *> *notifications = _pendingNotifications;
+    _pendingNotifications = [NSMutableArray array];
+    os_unfair_lock_unlock(&_notificationLock);
+    void (^handler)(NSDictionary *) = _notificationMessageHandler;
+    LSPMetricsRecorder *metrics = [self metrics];
+    for (NSDictionary *message in notifications) {
+        @autoreleasepool {
+            LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexDispatch);
+            if (handler) {
+                handler(message);
+            }
+            LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexDispatch, interval);
+            [self didHandleMessage];
+        }
+    }
+}
+
+- (NSNumber *)sendRequest:(NSString *)method params:(NSDictionary *)params withReply:(void (^)(id obj, NSError *error))block {
+    return [self sendRequest:method params:params priority:LSPRequestPriorityNormal timeout:0.0 withReply:block];
+}
+
+- (NSNumber *)sendRequest:(NSString *)method params:(NSDictionary *)params priority:(LSPRequestPriority)priority timeout:(NSTimeInterval)timeout withReply:(void (^)(id obj, NSError *error))block {
+    NSNumber *messageID = nil;
+    @synchronized (_replyBlocks) {
+        _messageID++;
+        messageID = [NSNumber numberWithUnsignedInteger:_messageID];
+    }
+    NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                             @"2.0", @"jsonrpc",
+                             messageID, @"id",
+                             method, @"method",
+                             params ?: [NSNull  null], @"params",
+                             nil];
+    LSPMetricsRecorder *metrics = [self metrics];
+    LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexEncode);
+    NSData *data = [NSJSONSerialization dataWithJSONObject:request options:0 error:NULL];
+    LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexEncode, interval);
+    if (metrics) {
+        [metrics incrementCounter:LSPMetricsCounterSentRequests by:1];
+        // The latency is taken when the reply is decoded, before the reply block runs.
+        void (^replyBlock)(id obj, NSError *error) = block;
+        uint64_t start = LSPMetricsTime();
+        block = ^(id obj, NSError *error) {
+            [metrics recordLatency:LSPMetricsTime() - start ofRequest:method];
+            if (replyBlock) {
+                replyBlock(obj, error);
+            }
+        };
+    }
+    if (data == nil) {
+        return messageID;
+    }
+    // Every request has a reply block, it tells whether the request is
+    // still pending.
+    ReplyBlock replyBlock = block;
+    if (replyBlock == nil) {
+        replyBlock = ^(NSDictionary *obj, NSError *error) {};
+    }
+    BOOL held = NO;
+    @synchronized (_replyBlocks) {
+        [_replyBlocks setObject:[replyBlock copy] forKey:messageID];
+        if (priority == LSPRequestPriorityBackground) {
+            if ([_backgroundRequestIDs count] >= MAX(_maximumBackgroundRequestCount, 1)) {
+                LSPHeldRequest *heldRequest = [[LSPHeldRequest alloc] init];
+                [heldRequest setMessageID:messageID];
+                [heldRequest setData:data];
+                [heldRequest setUri:LSPTextDocumentURIOfParams(params)];
+                [_heldRequests addObject:heldRequest];
+                held = YES;
+            } else {
+                [_backgroundRequestIDs addObject:messageID];
+            }
+        }
+    }
+    if (held == NO) {
+        [self _sendMessage:data request:YES priority:priority];
+    }
+    if (timeout > 0.0) {
+        __weak __typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeout * NSEC_PER_SEC)), _decodeQueue, ^{
+            [weakSelf _requestDidTimeOut:messageID];
+        });
+    }
+    return messageID;
+}
+
+/**
+ * Must be called with _replyBlocks locked. Frees the slot of a background
+ * request that was sent, and returns the held request that takes it. Stale
+ * held requests are skipped, their reply blocks are added to
+ * staleReplyBlocks.
+ */
+- (LSPHeldRequest *)_finishBackgroundRequest:(NSNumber *)messageID staleReplyBlocks:(NSMutableArray<ReplyBlock> *)staleReplyBlocks {
+    if ([_backgroundRequestIDs containsObject:messageID] == NO) {
+        return nil;
+    }
+    [_backgroundRequestIDs removeObject:messageID];
+    while ([_heldRequests count] > 0) {
+        LSPHeldRequest *heldRequest = [_heldRequests objectAtIndex:0];
+        [_heldRequests removeObjectAtIndex:0];
+        if ([heldRequest isStale]) {
+            ReplyBlock block = [_replyBlocks objectForKey:[heldRequest messageID]];
+            [_replyBlocks removeObjectForKey:[heldRequest messageID]];
+            if (block) {
+                [staleReplyBlocks addObject:block];
+            }
+            continue;
+        }
+        [_backgroundRequestIDs addObject:[heldRequest messageID]];
+        return heldRequest;
+    }
+    return nil;
+}
+
+/**
+ * Sends the held request that took a free slot. The stale ones skipped are
+ * answered with LSPResponseContentModified, as the server would have.
+ */
+- (void)_sendHeldRequest:(LSPHeldRequest *)heldRequest staleReplyBlocks:(NSArray<ReplyBlock> *)staleReplyBlocks {
+    if (heldRequest) {
+        [self _sendMessage:[heldRequest data] request:YES priority:LSPRequestPriorityBackground];
+    }
+    if ([staleReplyBlocks count] > 0) {
+        NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+                              @"The document changed before the request was sent.", NSLocalizedDescriptionKey, nil];
+        NSError *error = [NSError errorWithDomain:LSPResponseError code:LSPResponseContentModified userInfo:info];
+        for (ReplyBlock block in staleReplyBlocks) {
+            block(nil, error);
+        }
+    }
+}
+
+/**
+ * Must be called with _replyBlocks locked. Marks the held requests for the
+ * document of a didChange or didClose notification as stale.
+ */
+- (void)_heldRequestsDidChangeForNotification:(NSString *)method params:(NSDictionary *)params {
+    if ([_heldRequests count] == 0) {
+        return;
+    }
+    if ([method isEqualToString:@"textDocument/didChange"] == NO && [method isEqualToString:@"textDocument/didClose"] == NO) {
+        return;
+    }
+    NSString *uri = LSPTextDocumentURIOfParams(params);
+    if (uri == nil) {
+        return;
+    }
+    for (LSPHeldRequest *heldRequest in _heldRequests) {
+        if ([[heldRequest uri] isEqualToString:uri]) {
+            [heldRequest setStale:YES];
+        }
+    }
+}
+
+/**
+ * Must be called with _replyBlocks locked. Forgets a request that is held,
+ * returns NO if it was sent.
+ */
+- (BOOL)_removeHeldRequest:(NSNumber *)messageID {
+    for (NSUInteger index = 0; index < [_heldRequests count]; index++) {
+        if ([[[_heldRequests objectAtIndex:index] messageID] isEqual:messageID]) {
+            [_heldRequests removeObjectAtIndex:index];
+            return YES;
+        }
+    }
+    return NO;
+}
+
+/**
+ * Forgets a pending request. Unless it was still held, the server is told to
+ * cancel it and the next held background request is sent. Returns the reply
+ * block, nil if the request was not pending.
+ */
+- (ReplyBlock)_removePendingRequest:(NSNumber *)messageID {
+    ReplyBlock block = nil;
+    BOOL held = NO;
+    LSPHeldRequest *nextRequest = nil;
+    NSMutableArray<ReplyBlock> *staleReplyBlocks = [NSMutableArray array];
+    @synchronized (_replyBlocks) {
+        block = [_replyBlocks objectForKey:messageID];
+        [_replyBlocks removeObjectForKey:messageID];
+        if (block) {
+            held = [self _removeHeldRequest:messageID];
+            nextRequest = [self _finishBackgroundRequest:messageID staleReplyBlocks:staleReplyBlocks];
+        }
+    }
+    if (block == nil) {
+        return nil;
+    }
+    [[self metrics] incrementCounter:LSPMetricsCounterCancelledRequests by:1];
+    if (held == NO) {
+        // The error reply of the server has no reply block left, it is dropped.
+        [self sendNotification:@"$/cancelRequest" params:[NSDictionary dictionaryWithObjectsAndKeys:messageID, @"id", nil]];
+    }
+    [self _sendHeldRequest:nextRequest staleReplyBlocks:staleReplyBlocks];
+    return block;
+}
+
+- (void)cancelRequest:(NSNumber *)messageID {
+    [self _removePendingRequest:messageID];
+}
+
+/** Called on the decode queue when the timeout of a request has passed. */
+- (void)_requestDidTimeOut:(NSNumber *)messageID {
+    ReplyBlock block = [self _removePendingRequest:messageID];
+    if (block) {
+        NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+                              @"The language server did not reply in time.", NSLocalizedDescriptionKey, nil];
+        block(nil, [NSError errorWithDomain:LSPResponseError code:LSPResponseRequestTimedOut userInfo:info]);
+    }
+}
+
+- (NSUInteger)pendingRequestCount {
+    @synchronized (_replyBlocks) {
+        return [_replyBlocks count];
+    }
+}
+
+- (NSUInteger)heldRequestCount {
+    @synchronized (_replyBlocks) {
+        return [_heldRequests count];
+    }
+}
+
+- (void)sendReplyToRequest:(id)messageID result:(id)result error:(NSError *)error {
+    NSDictionary *reply = nil;
+    if (error) {
+        NSDictionary *jsonError = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [NSNumber numberWithInteger:[error code]], @"code",
+                                   [error localizedDescription], @"message",
+                                   nil];
+        reply = [NSDictionary dictionaryWithObjectsAndKeys:
+                 @"2.0", @"jsonrpc",
+                 messageID, @"id",
+                 jsonError, @"error",
+                 nil];
+    } else {
+        reply = [NSDictionary dictionaryWithObjectsAndKeys:
+                 @"2.0", @"jsonrpc",
+                 messageID, @"id",
+                 result ?: [NSNull null], @"result",
+                 nil];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:reply options:0 error:NULL];
+    if (data) {
+        [self sendMessage:data];
+    }
+}
+
+- (void)sendNotification:(NSString *)method params:(NSDictionary *)params {
+    @synchronized (_replyBlocks) {
+        [self _heldRequestsDidChangeForNotification:method params:params];
+    }
+    NSDictionary *request = [NSDictionary dictionaryWithObjectsAndKeys:
+                             @"2.0", @"jsonrpc",
+                             method, @"method",
+                             params ?: [NSNull  null], @"params",
+                             nil];
+    LSPMetricsRecorder *metrics = [self metrics];
+    [metrics incrementCounter:LSPMetricsCounterSentNotifications by:1];
+    // The text of a large document is escaped on the write queue, straight
+    // into the pipe, instead of being serialized here.
+    LSPMetricsInterval interval = LSPMetricsIntervalBegin(metrics, LSPMetricsStageIndexEncode);
+    LSPMessageEncoder *encoder = [[LSPMessageEncoder alloc] initWithJSONObject:request minimumStreamedStringLength:LSPMessageEncoderMinimumStreamedStringLength];
+    NSData *data = nil;
+    if (encoder == nil) {
+        NSError *error = nil;
+        data = [NSJSONSerialization dataWithJSONObject:request options:0 error:&error];
+    }
+    LSPMetricsIntervalEnd(metrics, LSPMetricsStageIndexEncode, interval);
+    if (encoder) {
+        LSPTraceRecorder *traceRecorder = [self traceRecorder];
+        if (traceRecorder) {
+            // A streamed message is too long to be recorded whole, a second
+            // encoder gives the beginning of it.
+            LSPMessageEncoder *prefixEncoder = [[LSPMessageEncoder alloc] initWithJSONObject:request minimumStreamedStringLength:LSPMessageEncoderMinimumStreamedStringLength];
+            NSMutableData *prefix = [NSMutableData dataWithLength:MAX([traceRecorder maximumMessageLength], (NSUInteger)16)];
+            NSUInteger length = 0;
+            NSUInteger encoded = 0;
+            while (length + 16 <= [prefix length] && (encoded = [prefixEncoder getBytes:(uint8_t *)[prefix mutableBytes] + length maxLength:[prefix length] - length]) > 0) {
+                length += encoded;
+            }
+            [prefix setLength:length];
+            [traceRecorder recordMessage:prefix length:[encoder estimatedContentLength] direction:LSPTraceDirectionSend];
+        }
+        [self sendMessageWithEncoder:encoder];
+    } else if (data) {
+        [self sendMessage:data];
+    }
+}
+
+@end
+
+@implementation LSPPipeline (Replay)
+
+- (NSUInteger)replayReceivedMessagesOfTrace:(LSPTraceRecorder *)trace preservingTiming:(BOOL)preservingTiming {
+    __block NSUInteger count = 0;
+    __block uint64_t previousTimestamp = 0;
+    [trace enumerateMessagesUsingBlock:^(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop) {
+        if (direction != LSPTraceDirectionReceive || [content length] != length) {
+            return;
+        }
+        if (preservingTiming && previousTimestamp != 0 && timestamp > previousTimestamp) {
+            [NSThread sleepForTimeInterval:(NSTimeInterval)(timestamp - previousTimestamp) / NSEC_PER_SEC];
+        }
+        previousTimestamp = timestamp;
+        char header[64];
+        int headerLength = snprintf(header, sizeof(header), "Content-Length: %lu\r\n\r\n", (unsigned long)length);
+        NSMutableData *frame = [NSMutableData dataWithCapacity:(NSUInteger)headerLength + length];
+        [frame appendBytes:header length:(NSUInteger)headerLength];
+        [frame appendData:content];
+        [self didReceiveData:frame];
+        count++;
+    }];
+    return count;
+}
+
+@end
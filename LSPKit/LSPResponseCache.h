@@ -0,0 +1,51 @@
+//
+//  LSPResponseCache.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Results of language feature requests by a key of method, document, version
+ * and position, with a memory budget. When the estimated cost of the results
+ * exceeds costLimit, the least recently used results are evicted.
+ *
+ * Must be used on the main thread. Not part of the public API of the
+ * framework, the header is only visible to LSPKit and the unit tests.
+ */
+@interface LSPResponseCache : NSObject
+
+/**
+ * Estimated bytes of the results the cache holds at most. 0 disables the
+ * cache. Defaults to 4 MB.
+ */
+@property (nonatomic) NSUInteger costLimit;
+@property (readonly) NSUInteger totalCost;
+@property (readonly) NSUInteger count;
+/**
+ * The number of lookups that found a result, and that did not.
+ */
+@property (readonly) NSUInteger hitCount;
+@property (readonly) NSUInteger missCount;
+
+/**
+ * Estimated bytes of a JSON object: its strings, numbers and containers.
+ */
++ (NSUInteger)costOfJSONObject:(id)object;
+
+/**
+ * Returns the result for key and makes it the most recently used one, or nil.
+ * A result of null is returned as NSNull.
+ */
+- (id)objectForKey:(NSString *)key;
+/**
+ * Stores a result of a request for the document uri, nil as NSNull.
+ */
+- (void)setObject:(id)object forKey:(NSString *)key uri:(NSURL *)uri;
+- (void)removeObjectsForURI:(NSURL *)uri;
+- (void)removeAllObjects;
+
+@end
@@ -0,0 +1,173 @@
+//
+//  LSPResponseCache.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPResponseCache.h"
+
+/** Estimated bytes of an object and its entry in a container. */
+static const NSUInteger LSPObjectOverhead = 16;
+
+@interface LSPResponseCacheEntry : NSObject {
+@public
+    NSString *_key;
+    NSURL *_uri;
+    id _object;
+    NSUInteger _cost;
+    // Doubly linked in order of use, the least recently used first.
+    __unsafe_unretained LSPResponseCacheEntry *_previous;
+    LSPResponseCacheEntry *_next;
+}
+@end
+
+@implementation LSPResponseCacheEntry
+@end
+
+@interface LSPResponseCache () {
+    NSMutableDictionary<NSString *, LSPResponseCacheEntry *> *_entries;
+    LSPResponseCacheEntry *_first;
+    __unsafe_unretained LSPResponseCacheEntry *_last;
+}
+@end
+
+
+@implementation LSPResponseCache
+
++ (NSUInteger)costOfJSONObject:(id)object {
+    if ([object isKindOfClass:[NSString class]]) {
+        return LSPObjectOverhead + [object length] * sizeof(unichar);
+    }
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        NSUInteger cost = LSPObjectOverhead;
+        for (id key in object) {
+            cost += [self costOfJSONObject:key] + [self costOfJSONObject:[object objectForKey:key]];
+        }
+        return cost;
+    }
+    if ([object isKindOfClass:[NSArray class]]) {
+        NSUInteger cost = LSPObjectOverhead;
+        for (id element in object) {
+            cost += [self costOfJSONObject:element];
+        }
+        return cost;
+    }
+    return LSPObjectOverhead;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _entries = [NSMutableDictionary dictionary];
+        _costLimit = 4 * 1024 * 1024;
+    }
+    return self;
+}
+
+- (void)setCostLimit:(NSUInteger)costLimit {
+    _costLimit = costLimit;
+    [self _evictAboveCostLimit];
+}
+
+- (NSUInteger)count {
+    return [_entries count];
+}
+
+- (void)_unlinkEntry:(LSPResponseCacheEntry *)entry {
+    if (entry->_previous) {
+        entry->_previous->_next = entry->_next;
+    } else {
+        _first = entry->_next;
+    }
+    if (entry->_next) {
+        entry->_next->_previous = entry->_previous;
+    } else {
+        _last = entry->_previous;
+    }
+    entry->_previous = nil;
+    entry->_next = nil;
+}
+
+- (void)_appendEntry:(LSPResponseCacheEntry *)entry {
+    entry->_previous = _last;
+    if (_last) {
+        _last->_next = entry;
+    } else {
+        _first = entry;
+    }
+    _last = entry;
+}
+
+- (void)_removeEntry:(LSPResponseCacheEntry *)entry {
+    NSString *key = entry->_key;
+    _totalCost -= entry->_cost;
+    [self _unlinkEntry:entry];
+    [_entries removeObjectForKey:key];
+}
+
+- (void)_evictAboveCostLimit {
+    while (_first && _totalCost > _costLimit) {
+        LSPResponseCacheEntry *entry = _first;
+        [self _removeEntry:entry];
+    }
+}
+
+- (id)objectForKey:(NSString *)key {
+    LSPResponseCacheEntry *entry = [_entries objectForKey:key];
+    if (entry == nil) {
+        _missCount++;
+        return nil;
+    }
+    _hitCount++;
+    if (entry != _last) {
+        [self _unlinkEntry:entry];
+        [self _appendEntry:entry];
+    }
+    return entry->_object;
+}
+
+- (void)setObject:(id)object forKey:(NSString *)key uri:(NSURL *)uri {
+    LSPResponseCacheEntry *oldEntry = [_entries objectForKey:key];
+    if (oldEntry) {
+        [self _removeEntry:oldEntry];
+    }
+    LSPResponseCacheEntry *entry = [[LSPResponseCacheEntry alloc] init];
+    entry->_key = [key copy];
+    entry->_uri = [uri copy];
+    entry->_object = object ?: [NSNull null];
+    entry->_cost = [key length] * sizeof(unichar) + [[self class] costOfJSONObject:object];
+    if (entry->_cost > _costLimit) {
+        return;
+    }
+    [_entries setObject:entry forKey:entry->_key];
+    [self _appendEntry:entry];
+    _totalCost += entry->_cost;
+    [self _evictAboveCostLimit];
+}
+
+- (void)removeObjectsForURI:(NSURL *)uri {
+    LSPResponseCacheEntry *entry = _first;
+    while (entry) {
+        LSPResponseCacheEntry *next = entry->_next;
+        if ([entry->_uri isEqual:uri]) {
+            [self _removeEntry:entry];
+        }
+        entry = next;
+    }
+}
+
+- (void)removeAllObjects {
+    // Unlinked one by one, a long chain of strong references is not released recursively.
+    while (_first) {
+        LSPResponseCacheEntry *entry = _first;
+        [self _removeEntry:entry];
+    }
+}
+
+- (void)dealloc {
+    [self removeAllObjects];
+}
+
+@end
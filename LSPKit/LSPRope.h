@@ -0,0 +1,31 @@
+//
+//  LSPRope.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A mutable string for large documents. The characters are kept in chunks of
+ * a few thousand UTF-16 code units, and a Fenwick tree over the chunk lengths
+ * finds the chunk of a character index in O(log n). An edit only moves the
+ * characters of the chunks it touches, not the rest of the text.
+ *
+ * -copy returns an immutable snapshot sharing the chunks with the rope. A
+ * chunk is copied when the rope changes it while a snapshot still uses it,
+ * so taking a snapshot is O(number of chunks) and the snapshot can be read
+ * on another thread while the rope is edited.
+ *
+ * Like NSMutableString, a rope must not be edited on several threads at once.
+ */
+@interface LSPRope : NSMutableString
+
+/**
+ * The number of chunks, for tests and statistics.
+ */
+@property (readonly) NSUInteger numberOfChunks;
+
+@end
@@ -0,0 +1,447 @@
+//
+//  LSPRope.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPRope.h"
+
+/** Chunks grow up to this many characters, new chunks are filled half. */
+static const NSUInteger LSPRopeMaximumChunkLength = 4096;
+/** A chunk shorter than this is merged with the next chunk when it is rebuilt. */
+static const NSUInteger LSPRopeMinimumChunkLength = LSPRopeMaximumChunkLength / 8;
+
+/**
+ * A chunk of characters. Chunks are shared between a rope and its snapshots,
+ * the retain count is changed atomically because a snapshot may be released
+ * on another thread.
+ */
+typedef struct {
+    NSUInteger retainCount;
+    NSUInteger length;
+    NSUInteger capacity;
+    unichar characters[];
+} LSPRopeChunk;
+
+static LSPRopeChunk *LSPRopeChunkCreate(NSUInteger length, NSUInteger capacity) {
+    capacity = MAX(capacity, length);
+    LSPRopeChunk *chunk = malloc(sizeof(LSPRopeChunk) + capacity * sizeof(unichar));
+    chunk->retainCount = 1;
+    chunk->length = length;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+static inline LSPRopeChunk *LSPRopeChunkRetain(LSPRopeChunk *chunk) {
+    __atomic_fetch_add(&chunk->retainCount, 1, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+static inline void LSPRopeChunkRelease(LSPRopeChunk *chunk) {
+    if (__atomic_sub_fetch(&chunk->retainCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(chunk);
+    }
+}
+
+/** Copies the characters in range, the chunk at index starts at chunkStart and contains range.location. */
+static void LSPRopeChunksGetCharacters(LSPRopeChunk *const *chunks, NSUInteger index, NSUInteger chunkStart, unichar *buffer, NSRange range) {
+    NSUInteger offset = range.location - chunkStart;
+    NSUInteger remaining = range.length;
+    while (remaining > 0) {
+        LSPRopeChunk *chunk = chunks[index++];
+        NSUInteger count = MIN(chunk->length - offset, remaining);
+        memcpy(buffer, chunk->characters + offset, count * sizeof(unichar));
+        buffer += count;
+        remaining -= count;
+        offset = 0;
+    }
+}
+
+static void LSPRopeRaiseRangeException(id string, SEL selector, NSRange range) {
+    [NSException raise:NSRangeException format:@"-[%@ %@]: Range %@ out of bounds; string length %lu",
+     [string className], NSStringFromSelector(selector), NSStringFromRange(range), (unsigned long)[string length]];
+}
+
+#pragma mark -
+
+/**
+ * An immutable snapshot of a rope. The chunk starts are stored directly,
+ * a snapshot never changes.
+ */
+@interface LSPRopeSnapshot : NSString
+- (instancetype)initWithChunks:(LSPRopeChunk *const *)chunks count:(NSUInteger)count length:(NSUInteger)length;
+@end
+
+@interface LSPRope ()
+- (instancetype)initWithChunks:(LSPRopeChunk *const *)chunks count:(NSUInteger)count length:(NSUInteger)length;
+@end
+
+@implementation LSPRopeSnapshot {
+    LSPRopeChunk **_chunks;
+    NSUInteger *_starts;
+    NSUInteger _count;
+    NSUInteger _length;
+}
+
+- (instancetype)initWithChunks:(LSPRopeChunk *const *)chunks count:(NSUInteger)count length:(NSUInteger)length {
+    self = [super init];
+    if (self) {
+        _chunks = malloc(MAX(count, 1) * sizeof(LSPRopeChunk *));
+        _starts = malloc(MAX(count, 1) * sizeof(NSUInteger));
+        _count = count;
+        _length = length;
+        NSUInteger start = 0;
+        for (NSUInteger index = 0; index < count; index++) {
+            _chunks[index] = LSPRopeChunkRetain(chunks[index]);
+            _starts[index] = start;
+            start += chunks[index]->length;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger index = 0; index < _count; index++) {
+        LSPRopeChunkRelease(_chunks[index]);
+    }
+    free(_chunks);
+    free(_starts);
+}
+
+/** The last chunk starting at or before location. */
+- (NSUInteger)_chunkIndexForLocation:(NSUInteger)location {
+    NSUInteger low = 0, high = _count;
+    while (high - low > 1) {
+        NSUInteger mid = low + (high - low) / 2;
+        if (_starts[mid] <= location) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+- (NSUInteger)length {
+    return _length;
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index {
+    if (index >= _length) {
+        LSPRopeRaiseRangeException(self, _cmd, NSMakeRange(index, 1));
+    }
+    NSUInteger chunkIndex = [self _chunkIndexForLocation:index];
+    return _chunks[chunkIndex]->characters[index - _starts[chunkIndex]];
+}
+
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range {
+    if (NSMaxRange(range) > _length) {
+        LSPRopeRaiseRangeException(self, _cmd, range);
+    }
+    if (range.length == 0) return;
+    NSUInteger chunkIndex = [self _chunkIndexForLocation:range.location];
+    LSPRopeChunksGetCharacters(_chunks, chunkIndex, _starts[chunkIndex], buffer, range);
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+- (id)mutableCopyWithZone:(NSZone *)zone {
+    return [[LSPRope alloc] initWithChunks:_chunks count:_count length:_length];
+}
+
+@end
+
+#pragma mark -
+
+@implementation LSPRope {
+    LSPRopeChunk **_chunks;
+    NSUInteger _count;
+    NSUInteger _capacity;
+    /** Fenwick tree over the chunk lengths, one-based. */
+    NSUInteger *_tree;
+    NSUInteger _length;
+}
+
+- (instancetype)init {
+    return [self initWithCapacity:0];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    return self;
+}
+
+- (instancetype)initWithString:(NSString *)string {
+    self = [self initWithCapacity:0];
+    if (self) {
+        [self replaceCharactersInRange:NSMakeRange(0, 0) withString:string];
+    }
+    return self;
+}
+
+- (instancetype)initWithCharacters:(const unichar *)characters length:(NSUInteger)length {
+    NSString *string = [[NSString alloc] initWithCharactersNoCopy:(unichar *)characters length:length freeWhenDone:NO];
+    return [self initWithString:string];
+}
+
+- (instancetype)initWithChunks:(LSPRopeChunk *const *)chunks count:(NSUInteger)count length:(NSUInteger)length {
+    self = [self initWithCapacity:0];
+    if (self) {
+        [self _reserveChunks:count];
+        for (NSUInteger index = 0; index < count; index++) {
+            _chunks[index] = LSPRopeChunkRetain(chunks[index]);
+        }
+        _count = count;
+        _length = length;
+        [self _rebuildTreeFromChunkAtIndex:0];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger index = 0; index < _count; index++) {
+        LSPRopeChunkRelease(_chunks[index]);
+    }
+    free(_chunks);
+    free(_tree);
+}
+
+- (NSUInteger)numberOfChunks {
+    return _count;
+}
+
+#pragma mark Chunks
+
+- (void)_reserveChunks:(NSUInteger)count {
+    if (count <= _capacity) return;
+    NSUInteger capacity = MAX(_capacity * 2, MAX(count, 16));
+    _chunks = reallocf(_chunks, capacity * sizeof(LSPRopeChunk *));
+    _tree = reallocf(_tree, (capacity + 1) * sizeof(NSUInteger));
+    _capacity = capacity;
+}
+
+/**
+ * Rebuilds the nodes of the chunks from index on, the nodes before only sum
+ * chunks before index and are kept.
+ */
+- (void)_rebuildTreeFromChunkAtIndex:(NSUInteger)index {
+    for (NSUInteger i = index + 1; i <= _count; i++) {
+        _tree[i] = _chunks[i - 1]->length;
+    }
+    // The kept nodes summing up to index are the ones whose parents are rebuilt.
+    for (NSUInteger i = index; i > 0; i -= i & -i) {
+        NSUInteger parent = i + (i & -i);
+        if (parent <= _count) {
+            _tree[parent] += _tree[i];
+        }
+    }
+    for (NSUInteger i = index + 1; i <= _count; i++) {
+        NSUInteger parent = i + (i & -i);
+        if (parent <= _count) {
+            _tree[parent] += _tree[i];
+        }
+    }
+}
+
+- (void)_addLength:(NSInteger)delta toChunkAtIndex:(NSUInteger)index {
+    for (NSUInteger i = index + 1; i <= _count; i += i & -i) {
+        _tree[i] += delta;
+    }
+}
+
+/**
+ * The index of the chunk containing location and the start of that chunk.
+ * The end of the text belongs to the last chunk. The rope must not be empty.
+ */
+- (NSUInteger)_chunkIndexForLocation:(NSUInteger)location start:(NSUInteger *)start {
+    NSUInteger index = 0;
+    NSUInteger sum = 0;
+    NSUInteger step = 1;
+    while (step * 2 <= _count) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (index + step <= _count && sum + _tree[index + step] <= location) {
+            index += step;
+            sum += _tree[index];
+        }
+    }
+    // index chunks end at or before location.
+    if (index == _count) {
+        index--;
+        sum -= _chunks[index]->length;
+    }
+    *start = sum;
+    return index;
+}
+
+/** The chunk at index, copied if it is shared with a snapshot or too small for length characters. */
+- (LSPRopeChunk *)_mutableChunkAtIndex:(NSUInteger)index length:(NSUInteger)length {
+    LSPRopeChunk *chunk = _chunks[index];
+    if (__atomic_load_n(&chunk->retainCount, __ATOMIC_ACQUIRE) == 1 && length <= chunk->capacity) {
+        return chunk;
+    }
+    NSUInteger capacity = MIN(MAX(length, MAX(chunk->capacity * 2, 64)), LSPRopeMaximumChunkLength);
+    LSPRopeChunk *copy = LSPRopeChunkCreate(chunk->length, capacity);
+    memcpy(copy->characters, chunk->characters, chunk->length * sizeof(unichar));
+    LSPRopeChunkRelease(chunk);
+    _chunks[index] = copy;
+    return copy;
+}
+
+#pragma mark NSString
+
+- (NSUInteger)length {
+    return _length;
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index {
+    if (index >= _length) {
+        LSPRopeRaiseRangeException(self, _cmd, NSMakeRange(index, 1));
+    }
+    NSUInteger start = 0;
+    NSUInteger chunkIndex = [self _chunkIndexForLocation:index start:&start];
+    return _chunks[chunkIndex]->characters[index - start];
+}
+
+- (void)getCharacters:(unichar *)buffer range:(NSRange)range {
+    if (NSMaxRange(range) > _length) {
+        LSPRopeRaiseRangeException(self, _cmd, range);
+    }
+    if (range.length == 0) return;
+    NSUInteger start = 0;
+    NSUInteger chunkIndex = [self _chunkIndexForLocation:range.location start:&start];
+    LSPRopeChunksGetCharacters(_chunks, chunkIndex, start, buffer, range);
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    return [[LSPRopeSnapshot alloc] initWithChunks:_chunks count:_count length:_length];
+}
+
+- (id)mutableCopyWithZone:(NSZone *)zone {
+    return [[LSPRope alloc] initWithChunks:_chunks count:_count length:_length];
+}
+
+#pragma mark NSMutableString
+
+- (void)replaceCharactersInRange:(NSRange)range withString:(NSString *)string {
+    if (NSMaxRange(range) > _length) {
+        LSPRopeRaiseRangeException(self, _cmd, range);
+    }
+    if (string == self) {
+        string = [string copy];
+    }
+    NSUInteger stringLength = [string length];
+    if (range.length == 0 && stringLength == 0) return;
+    if (_count > 0) {
+        // Typing and deleting usually stay inside one chunk, which only
+        // moves the characters of that chunk.
+        NSUInteger start = 0;
+        NSUInteger index = [self _chunkIndexForLocation:range.location start:&start];
+        NSUInteger offset = range.location - start;
+        NSUInteger chunkLength = _chunks[index]->length;
+        NSUInteger length = chunkLength - range.length + stringLength;
+        if (offset + range.length <= chunkLength && length <= LSPRopeMaximumChunkLength &&
+            (length >= LSPRopeMinimumChunkLength || index + 1 == _count) && length > 0) {
+            LSPRopeChunk *chunk = [self _mutableChunkAtIndex:index length:length];
+            memmove(chunk->characters + offset + stringLength,
+                    chunk->characters + offset + range.length,
+                    (chunkLength - offset - range.length) * sizeof(unichar));
+            [string getCharacters:chunk->characters + offset range:NSMakeRange(0, stringLength)];
+            chunk->length = length;
+            [self _addLength:(NSInteger)stringLength - (NSInteger)range.length toChunkAtIndex:index];
+            _length = _length - range.length + stringLength;
+            return;
+        }
+    }
+    [self _rebuildChunksInRange:range withString:string];
+}
+
+/**
+ * Replaces the chunks touched by range with new chunks, made of their
+ * characters before range, string and their characters after range.
+ *
+ * The chunks after them are moved and their tree nodes rebuilt, which is
+ * linear in the number of chunks after range. That is a few thousand
+ * pointers for a 10 MB document, and only edits that split or merge chunks
+ * get here.
+ */
+- (void)_rebuildChunksInRange:(NSRange)range withString:(NSString *)string {
+    NSUInteger stringLength = [string length];
+    NSUInteger first = 0;
+    NSUInteger replacedCount = 0;
+    NSUInteger prefixLength = 0;
+    NSUInteger suffixLength = 0;
+    unichar *prefix = NULL;
+    unichar *suffix = NULL;
+    if (_count > 0) {
+        NSUInteger firstStart = 0;
+        NSUInteger lastStart = 0;
+        first = [self _chunkIndexForLocation:range.location start:&firstStart];
+        NSUInteger last = [self _chunkIndexForLocation:NSMaxRange(range) start:&lastStart];
+        if (last > first && lastStart == NSMaxRange(range)) {
+            // The range ends where the last chunk starts, it stays as it is.
+            last--;
+            lastStart -= _chunks[last]->length;
+        }
+        NSUInteger end = lastStart + _chunks[last]->length;
+        prefixLength = range.location - firstStart;
+        suffixLength = end - NSMaxRange(range);
+        if (prefixLength + stringLength + suffixLength < LSPRopeMinimumChunkLength && last + 1 < _count) {
+            // Too small, take the next chunk along.
+            last++;
+            suffixLength += _chunks[last]->length;
+        }
+        prefix = malloc(MAX(prefixLength, 1) * sizeof(unichar));
+        suffix = malloc(MAX(suffixLength, 1) * sizeof(unichar));
+        LSPRopeChunksGetCharacters(_chunks, first, firstStart, prefix, NSMakeRange(firstStart, prefixLength));
+        NSUInteger suffixStart = 0;
+        NSUInteger suffixIndex = [self _chunkIndexForLocation:NSMaxRange(range) start:&suffixStart];
+        LSPRopeChunksGetCharacters(_chunks, suffixIndex, suffixStart, suffix, NSMakeRange(NSMaxRange(range), suffixLength));
+        replacedCount = last - first + 1;
+    }
+
+    NSUInteger total = prefixLength + stringLength + suffixLength;
+    NSUInteger newCount = (total + LSPRopeMaximumChunkLength / 2 - 1) / (LSPRopeMaximumChunkLength / 2);
+    for (NSUInteger index = first; index < first + replacedCount; index++) {
+        LSPRopeChunkRelease(_chunks[index]);
+    }
+    [self _reserveChunks:_count - replacedCount + newCount];
+    memmove(_chunks + first + newCount, _chunks + first + replacedCount, (_count - first - replacedCount) * sizeof(LSPRopeChunk *));
+
+    // Fill the new chunks evenly from prefix, string and suffix.
+    NSUInteger position = 0;
+    for (NSUInteger index = 0; index < newCount; index++) {
+        NSUInteger length = total * (index + 1) / newCount - position;
+        LSPRopeChunk *chunk = LSPRopeChunkCreate(length, length);
+        NSUInteger filled = 0;
+        while (filled < length) {
+            NSUInteger location = position + filled;
+            NSUInteger count = 0;
+            if (location < prefixLength) {
+                count = MIN(prefixLength - location, length - filled);
+                memcpy(chunk->characters + filled, prefix + location, count * sizeof(unichar));
+            } else if (location < prefixLength + stringLength) {
+                count = MIN(prefixLength + stringLength - location, length - filled);
+                [string getCharacters:chunk->characters + filled range:NSMakeRange(location - prefixLength, count)];
+            } else {
+                count = MIN(total - location, length - filled);
+                memcpy(chunk->characters + filled, suffix + location - prefixLength - stringLength, count * sizeof(unichar));
+            }
+            filled += count;
+        }
+        _chunks[first + index] = chunk;
+        position += length;
+    }
+    free(prefix);
+    free(suffix);
+    _count = _count - replacedCount + newCount;
+    _length = _length - range.length + stringLength;
+    [self _rebuildTreeFromChunkAtIndex:first];
+}
+
+@end
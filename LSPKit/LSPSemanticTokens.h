@@ -0,0 +1,52 @@
+//
+//  LSPSemanticTokens.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A semantic token as a character range of the document text.
+ */
+typedef struct {
+    NSUInteger location;
+    uint32_t length;
+    /** Index into semanticTokenTypes of the client. */
+    uint32_t type;
+    /** Bit set of indexes into semanticTokenModifiers of the client. */
+    uint32_t modifiers;
+} LSPSemanticTokenRun;
+
+/**
+ * The semantic tokens of a document, as sent by the server.
+ *
+ * The relative integers of the reply are kept in one buffer, and the runs
+ * are computed from them into a second one, ordered by location. A delta
+ * from the server is applied to the integers in place, and the runs are
+ * computed again. No object is created per token.
+ *
+ * The tokens of a document are updated in place by the next delta reply, on
+ * the main thread. Use them on the main thread.
+ */
+@interface LSPSemanticTokens : NSObject
+
+/** Identifies the tokens for a delta request, nil if the server has none. */
+@property (readonly) NSString *resultID;
+
+/**
+ * The number of runs. Tokens beyond the last line of the document, as it
+ * was when the reply came, have no run.
+ */
+@property (readonly) NSUInteger count;
+@property (readonly) const LSPSemanticTokenRun *runs NS_RETURNS_INNER_POINTER;
+
+/**
+ * The indexes of the runs that intersect range, with a binary search.
+ */
+- (NSRange)rangeOfRunsInCharacterRange:(NSRange)range;
+- (void)enumerateRunsInCharacterRange:(NSRange)range usingBlock:(void (^)(const LSPSemanticTokenRun *run, BOOL *stop))block;
+
+@end
@@ -0,0 +1,209 @@
+//
+//  LSPSemanticTokens.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPSemanticTokens.h"
+
+#import "LSPCommon.h"
+
+/** deltaLine, deltaStartChar, length, tokenType and tokenModifiers. */
+static const NSUInteger LSPSemanticTokenIntegerCount = 5;
+
+/**
+ * Copies the integers of array into buffer, returns NO if one of the objects
+ * is not a number.
+ */
+static BOOL LSPCopyIntegers(NSArray *array, uint32_t *buffer) {
+    NSUInteger index = 0;
+    for (NSNumber *number in array) {
+        if ([number isKindOfClass:[NSNumber class]] == NO) {
+            return NO;
+        }
+        buffer[index++] = (uint32_t)[number unsignedIntValue];
+    }
+    return YES;
+}
+
+@interface LSPSemanticTokens () {
+    // The integers as sent by the server, capacity integers allocated.
+    uint32_t *_data;
+    NSUInteger _length;
+    NSUInteger _capacity;
+    LSPSemanticTokenRun *_runs;
+}
+@property (readwrite) NSString *resultID;
+/** Used by LSPClient. */
+- (instancetype)initWithData:(NSArray<NSNumber *> *)data resultID:(NSString *)resultID;
+- (BOOL)applyEdits:(NSArray<NSDictionary *> *)edits resultID:(NSString *)resultID;
+- (void)updateRunsWithLineIndex:(LSPLineIndex *)lineIndex;
+@end
+
+@implementation LSPSemanticTokens
+
+- (instancetype)initWithData:(NSArray<NSNumber *> *)data resultID:(NSString *)resultID {
+    self = [super init];
+    if (self) {
+        NSUInteger length = [data count];
+        if (length % LSPSemanticTokenIntegerCount != 0) {
+            return nil;
+        }
+        _capacity = MAX(length, LSPSemanticTokenIntegerCount);
+        _data = malloc(_capacity * sizeof(uint32_t));
+        if (LSPCopyIntegers(data, _data) == NO) {
+            return nil;
+        }
+        _length = length;
+        _resultID = [resultID isKindOfClass:[NSString class]] ? [resultID copy] : nil;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_data);
+    free(_runs);
+}
+
+/**
+ * Applies the edits of a delta reply. Their start and deleteCount refer to
+ * the integers before the edits, so they are applied from the end. Returns
+ * NO, without changing the tokens, if the edits do not fit.
+ */
+- (BOOL)applyEdits:(NSArray<NSDictionary *> *)edits resultID:(NSString *)resultID {
+    NSMutableArray<NSDictionary *> *sortedEdits = [NSMutableArray arrayWithCapacity:[edits count]];
+    NSUInteger length = _length;
+    for (NSDictionary *edit in edits) {
+        if ([edit isKindOfClass:[NSDictionary class]] == NO) {
+            return NO;
+        }
+        NSUInteger start = [[edit objectForKey:@"start"] unsignedIntegerValue];
+        NSUInteger deleteCount = [[edit objectForKey:@"deleteCount"] unsignedIntegerValue];
+        NSArray *data = [edit objectForKey:@"data"];
+        if (start > _length || deleteCount > _length - start || (data != nil && [data isKindOfClass:[NSArray class]] == NO)) {
+            return NO;
+        }
+        for (NSNumber *number in data) {
+            if ([number isKindOfClass:[NSNumber class]] == NO) {
+                return NO;
+            }
+        }
+        length = length - deleteCount + [data count];
+        [sortedEdits addObject:edit];
+    }
+    if (length % LSPSemanticTokenIntegerCount != 0) {
+        return NO;
+    }
+    [sortedEdits sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSDictionary *edit1, NSDictionary *edit2) {
+        return [[edit2 objectForKey:@"start"] compare:[edit1 objectForKey:@"start"]];
+    }];
+    for (NSUInteger index = 1; index < [sortedEdits count]; index++) {
+        NSDictionary *edit = [sortedEdits objectAtIndex:index];
+        NSUInteger end = [[edit objectForKey:@"start"] unsignedIntegerValue] + [[edit objectForKey:@"deleteCount"] unsignedIntegerValue];
+        if (end > [[[sortedEdits objectAtIndex:index - 1] objectForKey:@"start"] unsignedIntegerValue]) {
+            return NO;
+        }
+    }
+
+    // An edit applied before one at a lower start may make the integers
+    // longer than they end up. The buffer only grows, to the largest length
+    // it had.
+    NSUInteger currentLength = _length;
+    NSUInteger maximumLength = _length;
+    for (NSDictionary *edit in sortedEdits) {
+        currentLength = currentLength - [[edit objectForKey:@"deleteCount"] unsignedIntegerValue] + [[edit objectForKey:@"data"] count];
+        maximumLength = MAX(maximumLength, currentLength);
+    }
+    if (maximumLength > _capacity) {
+        _capacity = MAX(maximumLength, _capacity + _capacity / 2);
+        _data = realloc(_data, _capacity * sizeof(uint32_t));
+    }
+    currentLength = _length;
+    for (NSDictionary *edit in sortedEdits) {
+        NSUInteger start = [[edit objectForKey:@"start"] unsignedIntegerValue];
+        NSUInteger deleteCount = [[edit objectForKey:@"deleteCount"] unsignedIntegerValue];
+        NSArray *data = [edit objectForKey:@"data"];
+        NSUInteger insertCount = [data count];
+        memmove(_data + start + insertCount, _data + start + deleteCount, (currentLength - start - deleteCount) * sizeof(uint32_t));
+        LSPCopyIntegers(data, _data + start);
+        currentLength = currentLength - deleteCount + insertCount;
+    }
+    _length = currentLength;
+    _resultID = [resultID isKindOfClass:[NSString class]] ? [resultID copy] : nil;
+    return YES;
+}
+
+/** Computes the runs from the relative integers, with one pass over them. */
+- (void)updateRunsWithLineIndex:(LSPLineIndex *)lineIndex {
+    NSUInteger tokenCount = _length / LSPSemanticTokenIntegerCount;
+    free(_runs);
+    _runs = malloc(MAX(tokenCount, 1) * sizeof(LSPSemanticTokenRun));
+    NSUInteger line = 0;
+    NSUInteger lineStart = 0;
+    NSUInteger character = 0;
+    NSUInteger count = 0;
+    for (NSUInteger index = 0; index < tokenCount; index++) {
+        const uint32_t *token = _data + index * LSPSemanticTokenIntegerCount;
+        if (token[0] > 0) {
+            line += token[0];
+            lineStart = [lineIndex characterIndexForLine:line];
+            character = token[1];
+        } else {
+            character += token[1];
+        }
+        if (lineStart == NSNotFound) {
+            break;
+        }
+        LSPSemanticTokenRun *run = _runs + count++;
+        run->location = lineStart + character;
+        run->length = token[2];
+        run->type = token[3];
+        run->modifiers = token[4];
+    }
+    _count = count;
+}
+
+- (const LSPSemanticTokenRun *)runs {
+    return _runs;
+}
+
+- (NSRange)rangeOfRunsInCharacterRange:(NSRange)range {
+    // The runs do not overlap, their ends are ordered as well.
+    NSUInteger low = 0;
+    NSUInteger high = _count;
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        if (_runs[middle].location + _runs[middle].length <= range.location) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    NSUInteger first = low;
+    high = _count;
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        if (_runs[middle].location < NSMaxRange(range)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NSMakeRange(first, low - first);
+}
+
+- (void)enumerateRunsInCharacterRange:(NSRange)range usingBlock:(void (^)(const LSPSemanticTokenRun *run, BOOL *stop))block {
+    NSRange runRange = [self rangeOfRunsInCharacterRange:range];
+    BOOL stop = NO;
+    for (NSUInteger index = runRange.location; index < NSMaxRange(runRange) && stop == NO; index++) {
+        block(_runs + index, &stop);
+    }
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ resultID = %@ count = %lu>", [self className], _resultID, (unsigned long)_count];
+}
+
+@end
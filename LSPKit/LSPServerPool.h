@@ -0,0 +1,74 @@
+//
+//  LSPServerPool.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class LSPClient;
+
+/**
+ * Language server processes, one per language and workspace root.
+ *
+ * A client is launched the first time it is asked for. At most
+ * maximumServerCount servers run at once, and a server without an edit,
+ * open or request for idleTimeout is suspended. Suspending shuts the server
+ * down cleanly but keeps the client and its open documents, so the client
+ * handed out stays valid: using it again relaunches the server and opens
+ * the documents again.
+ *
+ * The limit is enforced when a client is handed out and on every idle check.
+ * A suspended client used directly runs until the next check. Must be used
+ * on the main thread.
+ */
+@interface LSPServerPool : NSObject
+
+/**
+ * A pool with the bundled bash-language-server for "shellscript" and
+ * vscode-html-languageserver for "html".
+ */
++ (instancetype)sharedServerPool;
+
+/**
+ * Registers the executable and arguments of the server for a language. The
+ * server is launched with the workspace root as current directory.
+ */
+- (void)registerServerWithPath:(NSString *)path arguments:(NSArray<NSString *> *)arguments forLanguageID:(NSString *)languageID;
+
+/**
+ * Returns the client for the language and workspace root, launching or
+ * relaunching its server if needed, or nil if no server is registered for
+ * the language. rootURL may be nil for documents outside of a workspace.
+ * The client still needs to be initialized with -initialWithCompletionHandler:.
+ */
+- (LSPClient *)clientForLanguageID:(NSString *)languageID rootURL:(NSURL *)rootURL;
+
+/**
+ * The maximum number of servers running at once. Defaults to 4.
+ */
+@property NSUInteger maximumServerCount;
+/**
+ * Seconds without activity after which a server is suspended, 0 to keep
+ * servers running. Defaults to 300.
+ */
+@property NSTimeInterval idleTimeout;
+/**
+ * The number of servers running, not suspended.
+ */
+@property (readonly) NSUInteger serverCount;
+@property (readonly) NSArray<LSPClient *> *clients;
+
+/**
+ * Suspends idle servers, then the least recently used ones above the limit.
+ * Called periodically, you don't need to call it.
+ */
+- (void)suspendIdleServers;
+/**
+ * Terminates all servers and forgets their clients.
+ */
+- (void)terminate;
+
+@end
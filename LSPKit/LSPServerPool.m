@@ -0,0 +1,187 @@
+//
+//  LSPServerPool.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPServerPool.h"
+
+#import "LSPClient.h"
+
+@interface LSPClient (LanguageServers)
++ (NSString *)languageServersPath;
+@end
+
+/** Seconds between checks for idle servers when idleTimeout is 0. */
+static const NSTimeInterval LSPServerPoolCheckInterval = 10.0;
+
+@interface LSPServerPool () {
+    // Launch path and arguments by language ID.
+    NSMutableDictionary<NSString *, NSArray *> *_servers;
+    NSMutableDictionary<NSString *, LSPClient *> *_clients;
+    dispatch_source_t _idleTimer;
+}
+@end
+
+
+@implementation LSPServerPool
+
++ (instancetype)sharedServerPool {
+    static id sharedServerPool = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        LSPServerPool *pool = [[[self class] alloc] init];
+        NSString *languageServersPath = [LSPClient languageServersPath];
+        NSBundle *bashBundle = [NSBundle bundleWithPath:[languageServersPath stringByAppendingPathComponent:@"bash-language-server.bundle"]];
+        if (bashBundle) {
+            [pool registerServerWithPath:[bashBundle executablePath] arguments:[NSArray arrayWithObjects:@"start", nil] forLanguageID:@"shellscript"];
+        }
+        NSBundle *htmlBundle = [NSBundle bundleWithPath:[languageServersPath stringByAppendingPathComponent:@"vscode-html-languageserver.bundle"]];
+        if (htmlBundle) {
+            [pool registerServerWithPath:[htmlBundle executablePath] arguments:[NSArray arrayWithObjects:@"--stdio", nil] forLanguageID:@"html"];
+        }
+        sharedServerPool = pool;
+    });
+    return sharedServerPool;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _servers = [NSMutableDictionary dictionary];
+        _clients = [NSMutableDictionary dictionary];
+        _maximumServerCount = 4;
+        _idleTimeout = 300.0;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_idleTimer) {
+        dispatch_source_cancel(_idleTimer);
+    }
+}
+
+- (void)registerServerWithPath:(NSString *)path arguments:(NSArray<NSString *> *)arguments forLanguageID:(NSString *)languageID {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    [_servers setObject:[NSArray arrayWithObjects:path, arguments ?: [NSArray array], nil] forKey:languageID];
+}
+
+- (LSPClient *)clientForLanguageID:(NSString *)languageID rootURL:(NSURL *)rootURL {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    NSArray *server = [_servers objectForKey:languageID];
+    if (server == nil) {
+        NSLog(@"No language server registered for %@", languageID);
+        return nil;
+    }
+    NSString *key = [NSString stringWithFormat:@"%@ %@", languageID, [rootURL absoluteString] ?: @""];
+    LSPClient *client = [_clients objectForKey:key];
+    if (client == nil) {
+        NSString *currentDirectoryPath = [rootURL isFileURL] ? [rootURL path] : nil;
+        client = [[LSPClient alloc] initWithPath:[server objectAtIndex:0] arguments:[server objectAtIndex:1] currentDirectoryPath:currentDirectoryPath languageID:languageID];
+        [client setRootURL:rootURL];
+        [_clients setObject:client forKey:key];
+    } else if ([client isSuspended]) {
+        [client initialWithCompletionHandler:nil];
+    }
+    [self _suspendServersAboveLimitExcept:client];
+    if (_idleTimer == nil) {
+        [self _scheduleIdleTimer];
+    }
+    return client;
+}
+
+- (NSUInteger)serverCount {
+    NSUInteger count = 0;
+    for (LSPClient *client in [_clients objectEnumerator]) {
+        if ([client isSuspended] == NO) {
+            count++;
+        }
+    }
+    return count;
+}
+
+- (NSArray<LSPClient *> *)clients {
+    return [_clients allValues];
+}
+
+#pragma mark Suspension
+
+- (void)suspendIdleServers {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    if (_idleTimeout > 0.0) {
+        NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+        for (LSPClient *client in [_clients objectEnumerator]) {
+            if ([client isSuspended] == NO && now - [client lastActivityTime] >= _idleTimeout) {
+                [client suspend];
+            }
+        }
+    }
+    [self _suspendServersAboveLimitExcept:nil];
+}
+
+/**
+ * Suspends the least recently used servers until no more than
+ * maximumServerCount are running. A server that is still being initialized
+ * can not be suspended, it keeps running.
+ */
+- (void)_suspendServersAboveLimitExcept:(LSPClient *)exception {
+    NSMutableArray *runningClients = [NSMutableArray arrayWithCapacity:[_clients count]];
+    for (LSPClient *client in [_clients objectEnumerator]) {
+        if ([client isSuspended] == NO) {
+            [runningClients addObject:client];
+        }
+    }
+    [runningClients sortUsingComparator:^NSComparisonResult(LSPClient *client1, LSPClient *client2) {
+        if ([client1 lastActivityTime] < [client2 lastActivityTime]) return NSOrderedAscending;
+        if ([client1 lastActivityTime] > [client2 lastActivityTime]) return NSOrderedDescending;
+        return NSOrderedSame;
+    }];
+    NSUInteger count = [runningClients count];
+    for (LSPClient *client in runningClients) {
+        if (count <= MAX(_maximumServerCount, 1)) {
+            break;
+        }
+        if (client == exception) {
+            continue;
+        }
+        [client suspend];
+        if ([client isSuspended]) {
+            count--;
+        }
+    }
+}
+
+- (void)_scheduleIdleTimer {
+    if (_idleTimer == nil) {
+        __weak __typeof(self) weakSelf = self;
+        _idleTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+        dispatch_source_set_event_handler(_idleTimer, ^{
+            __strong __typeof(self) strongSelf = weakSelf;
+            [strongSelf suspendIdleServers];
+            [strongSelf _scheduleIdleTimer];
+        });
+        dispatch_source_set_timer(_idleTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(_idleTimer);
+    }
+    // A server is suspended at most a quarter of the timeout late.
+    NSTimeInterval interval = (_idleTimeout > 0.0) ? MIN(_idleTimeout / 4.0, LSPServerPoolCheckInterval) : LSPServerPoolCheckInterval;
+    dispatch_time_t start = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC));
+    dispatch_source_set_timer(_idleTimer, start, DISPATCH_TIME_FOREVER, (uint64_t)(interval * NSEC_PER_SEC / 10));
+}
+
+- (void)terminate {
+    NSAssert([NSThread isMainThread], @"This method must be invoked on main thread");
+    for (LSPClient *client in [_clients objectEnumerator]) {
+        [client terminate];
+    }
+    [_clients removeAllObjects];
+    if (_idleTimer) {
+        dispatch_source_cancel(_idleTimer);
+        _idleTimer = nil;
+    }
+}
+
+@end
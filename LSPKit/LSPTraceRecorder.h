@@ -0,0 +1,77 @@
+//
+//  LSPTraceRecorder.h
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, LSPTraceDirection) {
+    /**
+     * A message of the client to the server.
+     */
+    LSPTraceDirectionSend = 1,
+    /**
+     * A message of the server to the client.
+     */
+    LSPTraceDirectionReceive = 2
+};
+
+/**
+ * Records the messages between a client and its server into a ring buffer
+ * of fixed size: the JSON content of every frame as it was sent or received,
+ * with a timestamp in nanoseconds. Nothing is serialized again. When the
+ * buffer is full, the oldest messages are dropped.
+ *
+ * Messages longer than maximumMessageLength, like the text of a large
+ * document, are recorded truncated, and can not be replayed.
+ *
+ * The buffer can be a memory-mapped file, so the trace outlives a crash of
+ * the app and can be opened again with -initWithContentsOfURL:error:. Can be
+ * used from any thread.
+ */
+@interface LSPTraceRecorder : NSObject
+
+/**
+ * A trace in memory, capacity is the size of the buffer in bytes.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+/**
+ * A trace in a memory-mapped file, which is created or replaced.
+ */
+- (instancetype)initWithFileURL:(NSURL *)url capacity:(NSUInteger)capacity error:(NSError **)error;
+/**
+ * Opens the trace recorded into a file. New messages are added to it.
+ */
+- (instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError **)error;
+
+@property (readonly) NSUInteger capacity;
+/**
+ * Bytes of a message that are recorded at most. Defaults to a sixteenth of
+ * the capacity.
+ */
+@property NSUInteger maximumMessageLength;
+/**
+ * The number of messages in the buffer, and the ones dropped to make room.
+ */
+@property (readonly) NSUInteger messageCount;
+@property (readonly) NSUInteger droppedMessageCount;
+
+/**
+ * Calls block with every message in the buffer, the oldest first. The
+ * timestamp is in nanoseconds since 1970, content is shorter than length if
+ * the message was truncated.
+ */
+- (void)enumerateMessagesUsingBlock:(void (^)(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop))block;
+/**
+ * The messages in the log format of the language-server-protocol-inspector,
+ * one JSON object per line with the type, the message and a timestamp in
+ * milliseconds. A truncated message is exported with its id and method only.
+ * See LspItem at https://github.com/Microsoft/language-server-protocol-inspector
+ */
+- (NSString *)inspectorLog;
+- (void)removeAllMessages;
+
+@end
@@ -0,0 +1,369 @@
+//
+//  LSPTraceRecorder.m
+//  LSPKit
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "LSPTraceRecorder.h"
+
+#import <fcntl.h>
+#import <os/lock.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <time.h>
+#import <unistd.h>
+
+static const char LSPTraceMagic[8] = { 'L', 'S', 'P', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t LSPTraceVersion = 1;
+static const NSUInteger LSPTraceMinimumCapacity = 4096;
+
+/**
+ * The start of the buffer. start and end are byte offsets that only grow,
+ * the position of an offset in the ring is offset modulo capacity.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerLength;
+    uint64_t capacity;
+    uint64_t start;
+    uint64_t end;
+    uint64_t messageCount;
+    uint64_t droppedMessageCount;
+} LSPTraceHeader;
+
+/** Precedes the content of every message, which is padded to 8 bytes. */
+typedef struct {
+    uint64_t timestamp;
+    uint32_t length;
+    uint32_t originalLength;
+    uint32_t direction;
+    uint32_t reserved;
+} LSPTraceRecordHeader;
+
+static uint64_t LSPTraceRecordSize(uint32_t length) {
+    return sizeof(LSPTraceRecordHeader) + (((uint64_t)length + 7) & ~(uint64_t)7);
+}
+
+@interface LSPTraceRecorder () {
+    os_unfair_lock _lock;
+    LSPTraceHeader *_header;
+    uint8_t *_ring;
+    size_t _mappedLength;
+    BOOL _mapped;
+}
+/**
+ * Called by the pipeline. Only the first maximumMessageLength bytes of
+ * content are recorded, length is that of the whole message.
+ */
+- (void)recordMessage:(NSData *)content length:(NSUInteger)length direction:(LSPTraceDirection)direction;
+@end
+
+
+@implementation LSPTraceRecorder
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (self) {
+        capacity = MAX((capacity + 7) & ~(NSUInteger)7, LSPTraceMinimumCapacity);
+        _mappedLength = sizeof(LSPTraceHeader) + capacity;
+        _header = calloc(1, _mappedLength);
+        if (_header == NULL) {
+            return nil;
+        }
+        [self _setUpWithCapacity:capacity];
+    }
+    return self;
+}
+
+- (instancetype)initWithFileURL:(NSURL *)url capacity:(NSUInteger)capacity error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        capacity = MAX((capacity + 7) & ~(NSUInteger)7, LSPTraceMinimumCapacity);
+        int fileDescriptor = open([[url path] fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fileDescriptor < 0 || ftruncate(fileDescriptor, (off_t)(sizeof(LSPTraceHeader) + capacity)) != 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            }
+            if (fileDescriptor >= 0) {
+                close(fileDescriptor);
+            }
+            return nil;
+        }
+        if ([self _mapFile:fileDescriptor length:sizeof(LSPTraceHeader) + capacity error:error] == NO) {
+            return nil;
+        }
+        [self _setUpWithCapacity:capacity];
+    }
+    return self;
+}
+
+- (instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError **)error {
+    self = [super init];
+    if (self) {
+        int fileDescriptor = open([[url path] fileSystemRepresentation], O_RDWR);
+        struct stat status;
+        if (fileDescriptor < 0 || fstat(fileDescriptor, &status) != 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            }
+            if (fileDescriptor >= 0) {
+                close(fileDescriptor);
+            }
+            return nil;
+        }
+        if ((size_t)status.st_size < sizeof(LSPTraceHeader)) {
+            close(fileDescriptor);
+            if (error) {
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:nil];
+            }
+            return nil;
+        }
+        if ([self _mapFile:fileDescriptor length:(size_t)status.st_size error:error] == NO) {
+            return nil;
+        }
+        if (memcmp(_header->magic, LSPTraceMagic, sizeof(LSPTraceMagic)) != 0 || _header->version != LSPTraceVersion ||
+            _header->headerLength != sizeof(LSPTraceHeader) || sizeof(LSPTraceHeader) + _header->capacity != _mappedLength ||
+            _header->start > _header->end || _header->end - _header->start > _header->capacity) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:nil];
+            }
+            return nil;
+        }
+        _ring = (uint8_t *)(_header + 1);
+        _maximumMessageLength = (NSUInteger)_header->capacity / 16;
+    }
+    return self;
+}
+
+/** Maps the file and closes the file descriptor, the mapping keeps it open. */
+- (BOOL)_mapFile:(int)fileDescriptor length:(size_t)length error:(NSError **)error {
+    void *address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    int mapError = errno;
+    close(fileDescriptor);
+    if (address == MAP_FAILED) {
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:mapError userInfo:nil];
+        }
+        return NO;
+    }
+    _header = address;
+    _mappedLength = length;
+    _mapped = YES;
+    _lock = OS_UNFAIR_LOCK_INIT;
+    return YES;
+}
+
+- (void)_setUpWithCapacity:(NSUInteger)capacity {
+    _lock = OS_UNFAIR_LOCK_INIT;
+    memset(_header, 0, sizeof(LSPTraceHeader));
+    memcpy(_header->magic, LSPTraceMagic, sizeof(LSPTraceMagic));
+    _header->version = LSPTraceVersion;
+    _header->headerLength = sizeof(LSPTraceHeader);
+    _header->capacity = capacity;
+    _ring = (uint8_t *)(_header + 1);
+    _maximumMessageLength = capacity / 16;
+}
+
+- (void)dealloc {
+    if (_mapped) {
+        munmap(_header, _mappedLength);
+    } else {
+        free(_header);
+    }
+}
+
+- (NSUInteger)capacity {
+    return (NSUInteger)_header->capacity;
+}
+
+- (NSUInteger)messageCount {
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = (NSUInteger)_header->messageCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger)droppedMessageCount {
+    os_unfair_lock_lock(&_lock);
+    NSUInteger count = (NSUInteger)_header->droppedMessageCount;
+    os_unfair_lock_unlock(&_lock);
+    return count;
+}
+
+#pragma mark Ring
+
+/** Copies bytes into the ring at a logical offset, wrapping around its end. */
+- (void)_writeBytes:(const void *)bytes length:(uint64_t)length atOffset:(uint64_t)offset {
+    uint64_t capacity = _header->capacity;
+    uint64_t position = offset % capacity;
+    uint64_t first = MIN(length, capacity - position);
+    memcpy(_ring + position, bytes, (size_t)first);
+    if (first < length) {
+        memcpy(_ring, (const uint8_t *)bytes + first, (size_t)(length - first));
+    }
+}
+
+- (void)_readBytes:(void *)bytes length:(uint64_t)length atOffset:(uint64_t)offset {
+    uint64_t capacity = _header->capacity;
+    uint64_t position = offset % capacity;
+    uint64_t first = MIN(length, capacity - position);
+    memcpy(bytes, _ring + position, (size_t)first);
+    if (first < length) {
+        memcpy((uint8_t *)bytes + first, _ring, (size_t)(length - first));
+    }
+}
+
+- (void)recordMessage:(NSData *)content length:(NSUInteger)length direction:(LSPTraceDirection)direction {
+    LSPTraceRecordHeader record = { 0 };
+    record.timestamp = clock_gettime_nsec_np(CLOCK_REALTIME);
+    record.direction = (uint32_t)direction;
+    record.originalLength = (uint32_t)MIN(length, (NSUInteger)UINT32_MAX);
+    os_unfair_lock_lock(&_lock);
+    NSUInteger maximumLength = MIN(_maximumMessageLength, (NSUInteger)_header->capacity - sizeof(LSPTraceRecordHeader) - 8);
+    record.length = (uint32_t)MIN(MIN([content length], length), maximumLength);
+    uint64_t size = LSPTraceRecordSize(record.length);
+    // The oldest messages make room. The header is updated before the ring,
+    // so a trace file is consistent even if the app dies while recording.
+    while (_header->end + size - _header->start > _header->capacity) {
+        LSPTraceRecordHeader oldest;
+        [self _readBytes:&oldest length:sizeof(oldest) atOffset:_header->start];
+        _header->start += LSPTraceRecordSize(oldest.length);
+        _header->messageCount--;
+        _header->droppedMessageCount++;
+    }
+    [self _writeBytes:&record length:sizeof(record) atOffset:_header->end];
+    [self _writeBytes:[content bytes] length:record.length atOffset:_header->end + sizeof(record)];
+    _header->end += size;
+    _header->messageCount++;
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)enumerateMessagesUsingBlock:(void (^)(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop))block {
+    // The messages are copied out first, block may take its time.
+    NSMutableArray<NSData *> *contents = [NSMutableArray array];
+    NSMutableData *records = [NSMutableData data];
+    os_unfair_lock_lock(&_lock);
+    uint64_t offset = _header->start;
+    while (offset < _header->end) {
+        LSPTraceRecordHeader record;
+        [self _readBytes:&record length:sizeof(record) atOffset:offset];
+        NSMutableData *content = [NSMutableData dataWithLength:record.length];
+        [self _readBytes:[content mutableBytes] length:record.length atOffset:offset + sizeof(record)];
+        [contents addObject:content];
+        [records appendBytes:&record length:sizeof(record)];
+        offset += LSPTraceRecordSize(record.length);
+    }
+    os_unfair_lock_unlock(&_lock);
+    const LSPTraceRecordHeader *record = [records bytes];
+    BOOL stop = NO;
+    for (NSUInteger index = 0; index < [contents count] && stop == NO; index++) {
+        block((LSPTraceDirection)record[index].direction, record[index].timestamp, [contents objectAtIndex:index], record[index].originalLength, &stop);
+    }
+}
+
+- (void)removeAllMessages {
+    os_unfair_lock_lock(&_lock);
+    _header->start = _header->end;
+    _header->messageCount = 0;
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark Export
+
+/**
+ * The id and the method of a truncated message, the members of its top level
+ * object found in the part that was recorded. Nested objects are skipped, the
+ * params of a request may have an id of their own.
+ */
+static NSDictionary *LSPTraceIdentityOfTruncatedMessage(NSData *content) {
+    const char *bytes = [content bytes];
+    NSUInteger length = [content length];
+    NSMutableDictionary *identity = [NSMutableDictionary dictionary];
+    NSUInteger depth = 0;
+    BOOL expectsKey = NO;
+    NSString *key = nil;
+    for (NSUInteger index = 0; index < length; index++) {
+        char c = bytes[index];
+        if (c == '"') {
+            NSUInteger end = index + 1;
+            while (end < length && bytes[end] != '"') {
+                end += (bytes[end] == '\\') ? 2 : 1;
+            }
+            if (end >= length) {
+                break;
+            }
+            if (depth == 1) {
+                NSString *string = [[NSString alloc] initWithBytes:bytes + index + 1 length:end - index - 1 encoding:NSUTF8StringEncoding];
+                if (expectsKey) {
+                    key = string;
+                    expectsKey = NO;
+                } else if (string && ([key isEqualToString:@"id"] || [key isEqualToString:@"method"])) {
+                    [identity setObject:string forKey:key];
+                }
+            }
+            index = end;
+        } else if (c == '{' || c == '[') {
+            depth++;
+            expectsKey = (depth == 1);
+            key = nil;
+        } else if (c == '}' || c == ']') {
+            depth = (depth > 0) ? depth - 1 : 0;
+        } else if (c == ',' && depth == 1) {
+            expectsKey = YES;
+            key = nil;
+        } else if (depth == 1 && (c == '-' || (c >= '0' && c <= '9')) && [key isEqualToString:@"id"]) {
+            NSUInteger end = index + 1;
+            while (end < length && bytes[end] >= '0' && bytes[end] <= '9') {
+                end++;
+            }
+            if (end >= length) {
+                break;
+            }
+            NSString *number = [[NSString alloc] initWithBytes:bytes + index length:end - index encoding:NSASCIIStringEncoding];
+            [identity setObject:[NSNumber numberWithLongLong:[number longLongValue]] forKey:key];
+            key = nil;
+            index = end - 1;
+        }
+    }
+    return identity;
+}
+
+- (NSString *)inspectorLog {
+    NSMutableString *log = [NSMutableString string];
+    [self enumerateMessagesUsingBlock:^(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop) {
+        NSDictionary *message = nil;
+        if ([content length] == length) {
+            message = [NSJSONSerialization JSONObjectWithData:content options:0 error:NULL];
+        } else {
+            // Enough to tell a request, a response and a notification apart.
+            NSMutableDictionary *truncatedMessage = [NSMutableDictionary dictionaryWithObject:@"2.0" forKey:@"jsonrpc"];
+            [truncatedMessage addEntriesFromDictionary:LSPTraceIdentityOfTruncatedMessage(content)];
+            message = truncatedMessage;
+        }
+        if ([message isKindOfClass:[NSDictionary class]] == NO) {
+            return;
+        }
+        NSString *kind = @"notification";
+        if ([message objectForKey:@"id"] != nil) {
+            kind = ([message objectForKey:@"method"] != nil) ? @"request" : @"response";
+        }
+        NSString *type = [NSString stringWithFormat:@"%@-%@", (direction == LSPTraceDirectionSend) ? @"send" : @"recv", kind];
+        NSDictionary *logItem = [NSDictionary dictionaryWithObjectsAndKeys:
+                                 type, @"type",
+                                 message, @"message",
+                                 [NSNumber numberWithDouble:(double)timestamp / NSEC_PER_MSEC], @"timestamp",
+                                 nil];
+        NSData *logData = [NSJSONSerialization dataWithJSONObject:logItem options:0 error:NULL];
+        NSString *logString = [[NSString alloc] initWithData:logData encoding:NSUTF8StringEncoding];
+        if (logString) {
+            [log appendString:logString];
+            [log appendString:@"\r\n"];
+        }
+    }];
+    return log;
+}
+
+@end
@@ -0,0 +1,841 @@
+//
+//  LSPBenchmarks.m
+//  LSPKitBenchmarks
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach.h>
+#import <malloc/malloc.h>
+
+#import <LSPKit/LSPKit.h>
+
+#import "LSPPipeline.h"
+
+// Every scenario launches the stub language server with its own arguments,
+// runs a number of operations one after the other, each until the client
+// has seen its effect, and logs one line:
+//
+//   scenario, operations per second, p50 and p99 latency of an operation,
+//   bytes and blocks still allocated by malloc afterwards, the peak physical
+//   footprint of the process during the run, and the bytes written to and
+//   read from the server.
+//
+// With the environment variable LSPBENCHMARK_REPORT set to a path, the
+// results are also written there as JSON, to be compared with a baseline.
+
+static NSUInteger LSPPhysicalFootprint(void) {
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return (NSUInteger)info.phys_footprint;
+}
+
+static NSString *LSPBenchmarkText(NSUInteger lineCount) {
+    NSMutableString *text = [NSMutableString string];
+    for (NSUInteger line = 0; line < lineCount; line++) {
+        [text appendFormat:@"echo \"line %lu of the benchmark document\" | grep line\n", (unsigned long)line];
+    }
+    return text;
+}
+
+
+/** Diagnostics in random order, the way a linter reports them grouped by rule. */
+static NSArray<LSPDiagnostic *> *LSPBenchmarkDiagnostics(NSUInteger count, NSUInteger lineCount) {
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        NSUInteger line = (NSUInteger)random() % lineCount;
+        NSUInteger character = (NSUInteger)random() % 30;
+        NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                               [[LSPPosition positionWithLine:line character:character] params], @"start",
+                               [[LSPPosition positionWithLine:line character:character + 4] params], @"end",
+                               nil];
+        [array addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                          range, @"range",
+                          [NSNumber numberWithInteger:LSPDiagnosticSeverityWarning], @"severity",
+                          @"Double quote to prevent globbing and word splitting.", @"message",
+                          nil]];
+    }
+    return [LSPDiagnostic diagnosticsFromArray:array];
+}
+
+// libmalloc calls malloc_logger, if set, for every allocation. This is what
+// the malloc stack logging of Instruments is built on.
+typedef void (LSPMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip);
+extern LSPMallocLogger *malloc_logger;
+
+static int64_t LSPAllocationCount = 0;
+
+static void LSPCountingMallocLogger(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numHotFramesToSkip) {
+    // MALLOC_LOG_TYPE_ALLOCATE
+    if (type & 2) {
+        __atomic_fetch_add(&LSPAllocationCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Framed server traffic: log messages, publishDiagnostics and completion
+ * lists of 200 or 5000 items, split in reads between 1 byte and 64 KB.
+ */
+static NSArray<NSData *> *LSPBenchmarkServerReads(NSUInteger *frameCount, NSUInteger *byteCount) {
+    NSMutableArray *messages = [NSMutableArray array];
+    for (NSUInteger round = 0; round < 20; round++) {
+        NSDictionary *logParams = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [NSNumber numberWithInteger:LSPMessageTypeInfo], @"type",
+                                   @"Analyzing file:///Users/chris/Projects/script.sh", @"message",
+                                   nil];
+        [messages addObject:[NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"window/logMessage", @"method", logParams, @"params", nil]];
+        NSMutableArray *diagnostics = [NSMutableArray array];
+        for (NSUInteger index = 0; index < 50; index++) {
+            NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [[LSPPosition positionWithLine:index character:0] params], @"start",
+                                   [[LSPPosition positionWithLine:index character:12] params], @"end",
+                                   nil];
+            [diagnostics addObject:[NSDictionary dictionaryWithObjectsAndKeys:range, @"range", @"Failed to parse expression", @"message", nil]];
+        }
+        NSDictionary *diagnosticsParams = [NSDictionary dictionaryWithObjectsAndKeys:@"file:///Users/chris/Projects/script.sh", @"uri", diagnostics, @"diagnostics", nil];
+        [messages addObject:[NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"textDocument/publishDiagnostics", @"method", diagnosticsParams, @"params", nil]];
+        NSUInteger itemCount = (round % 4 == 0) ? 5000 : 200;
+        NSMutableArray *items = [NSMutableArray arrayWithCapacity:itemCount];
+        for (NSUInteger index = 0; index < itemCount; index++) {
+            [items addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSString stringWithFormat:@"completion_item_%lu", (unsigned long)index], @"label",
+                              [NSNumber numberWithInteger:LSPCompletionItemKindFunction], @"kind",
+                              nil]];
+        }
+        NSDictionary *completionList = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithBool:NO], @"isIncomplete", items, @"items", nil];
+        [messages addObject:[NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", [NSNumber numberWithUnsignedInteger:round + 1], @"id", completionList, @"result", nil]];
+    }
+    NSMutableData *traffic = [NSMutableData data];
+    for (NSDictionary *message in messages) {
+        NSData *content = [NSJSONSerialization dataWithJSONObject:message options:0 error:NULL];
+        [traffic appendData:[[NSString stringWithFormat:@"Content-Length: %lu\r\n\r\n", (unsigned long)[content length]] dataUsingEncoding:NSUTF8StringEncoding]];
+        [traffic appendData:content];
+    }
+    NSMutableArray *reads = [NSMutableArray array];
+    srandom(7);
+    NSUInteger offset = 0;
+    while (offset < [traffic length]) {
+        // Biased towards small reads.
+        NSUInteger length = MIN(1 + (NSUInteger)random() % (1 << (random() % 17)), [traffic length] - offset);
+        [reads addObject:[traffic subdataWithRange:NSMakeRange(offset, length)]];
+        offset += length;
+    }
+    *frameCount = [messages count];
+    *byteCount = [traffic length];
+    return reads;
+}
+
+
+@interface LSPBenchmarkObserver : NSObject <LSPClientObserver>
+@property (copy) void (^diagnosticsHandler)(NSURL *url, NSArray<LSPDiagnostic *> *diagnostics);
+@property (copy) void (^logMessageHandler)(NSString *message);
+@end
+
+@implementation LSPBenchmarkObserver
+
+- (void)languageServer:(LSPClient *)client document:(NSURL *)url diagnostics:(NSArray<LSPDiagnostic *> *)diagnostics {
+    if (_diagnosticsHandler) {
+        _diagnosticsHandler(url, diagnostics);
+    }
+}
+
+- (void)languageServer:(LSPClient *)client logMessage:(NSString *)message type:(LSPMessageType)type {
+    if (_logMessageHandler) {
+        _logMessageHandler(message);
+    }
+}
+
+@end
+
+
+
+@interface LSPBenchmarks : XCTestCase
+@end
+
+@implementation LSPBenchmarks
+
++ (NSMutableArray<NSDictionary *> *)results {
+    static NSMutableArray *results = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        results = [NSMutableArray array];
+    });
+    return results;
+}
+
++ (void)tearDown {
+    NSString *path = [[[NSProcessInfo processInfo] environment] objectForKey:@"LSPBENCHMARK_REPORT"];
+    if (path) {
+        NSData *data = [NSJSONSerialization dataWithJSONObject:[self results] options:NSJSONWritingPrettyPrinted error:NULL];
+        [data writeToFile:path atomically:YES];
+    }
+    [super tearDown];
+}
+
+- (LSPClient *)initializedStubServerWithArguments:(NSArray<NSString *> *)arguments {
+    // The stub server is built next to the test bundle.
+    NSString *productsPath = [[[NSBundle bundleForClass:[self class]] bundlePath] stringByDeletingLastPathComponent];
+    NSString *path = [productsPath stringByAppendingPathComponent:@"stub-language-server"];
+    LSPClient *client = [[LSPClient alloc] initWithPath:path arguments:arguments currentDirectoryPath:nil languageID:@"plaintext"];
+    [client setMetricsEnabled:YES];
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    return client;
+}
+
+/** Calls block on the main queue once the server has handled everything sent before. */
+- (void)roundTripWithClient:(LSPClient *)client completionHandler:(void (^)(void))block {
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/echo" params:nil withReply:^(id obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), block);
+    }];
+}
+
+/**
+ * Runs operation count times on the main thread, the next one once the
+ * previous one called done, and reports the results.
+ */
+- (void)measureScenario:(NSString *)name client:(LSPClient *)client operationCount:(NSUInteger)count operation:(void (^)(NSUInteger index, void (^done)(void)))operation {
+    NSMutableArray<NSNumber *> *latencies = [NSMutableArray arrayWithCapacity:count];
+    __block NSUInteger peakFootprint = LSPPhysicalFootprint();
+    dispatch_queue_t samplingQueue = dispatch_queue_create("LSPBenchmarks.sampling", DISPATCH_QUEUE_SERIAL);
+    dispatch_source_t samplingTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+    dispatch_source_set_timer(samplingTimer, DISPATCH_TIME_NOW, 5 * NSEC_PER_MSEC, NSEC_PER_MSEC);
+    dispatch_source_set_event_handler(samplingTimer, ^{
+        peakFootprint = MAX(peakFootprint, LSPPhysicalFootprint());
+    });
+    [client resetMetrics];
+    malloc_statistics_t mallocBefore;
+    malloc_zone_statistics(NULL, &mallocBefore);
+    dispatch_resume(samplingTimer);
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < count; index++) {
+        @autoreleasepool {
+            __block BOOL finished = NO;
+            CFAbsoluteTime operationStart = CFAbsoluteTimeGetCurrent();
+            operation(index, ^{
+                finished = YES;
+            });
+            NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10.0];
+            while (finished == NO && [timeout timeIntervalSinceNow] > 0.0) {
+                [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:timeout];
+            }
+            XCTAssertTrue(finished, @"%@ operation %lu timed out", name, (unsigned long)index);
+            [latencies addObject:[NSNumber numberWithDouble:CFAbsoluteTimeGetCurrent() - operationStart]];
+        }
+    }
+    NSTimeInterval duration = CFAbsoluteTimeGetCurrent() - start;
+
+    malloc_statistics_t mallocAfter;
+    malloc_zone_statistics(NULL, &mallocAfter);
+    dispatch_source_cancel(samplingTimer);
+    dispatch_sync(samplingQueue, ^{});
+    LSPMetricsSnapshot *snapshot = [client metricsSnapshot];
+
+    [latencies sortUsingSelector:@selector(compare:)];
+    double p50 = [[latencies objectAtIndex:(count - 1) * 50 / 100] doubleValue];
+    double p99 = [[latencies objectAtIndex:(count - 1) * 99 / 100] doubleValue];
+    long long allocatedBytes = (long long)mallocAfter.size_in_use - (long long)mallocBefore.size_in_use;
+    long long allocatedBlocks = (long long)mallocAfter.blocks_in_use - (long long)mallocBefore.blocks_in_use;
+    NSLog(@"%-14@ %9.0f ops/s  p50 %8.3f ms  p99 %8.3f ms  malloc %+lld bytes in %+lld blocks  peak footprint %.1f MB  written %lu  read %lu bytes",
+          name, count / duration, p50 * 1000.0, p99 * 1000.0, allocatedBytes, allocatedBlocks,
+          peakFootprint / (1024.0 * 1024.0), (unsigned long)[snapshot bytesWritten], (unsigned long)[snapshot bytesRead]);
+    [[[self class] results] addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       name, @"scenario",
+                                       [NSNumber numberWithUnsignedInteger:count], @"operations",
+                                       [NSNumber numberWithDouble:count / duration], @"throughput",
+                                       [NSNumber numberWithDouble:p50], @"p50",
+                                       [NSNumber numberWithDouble:p99], @"p99",
+                                       [NSNumber numberWithLongLong:allocatedBytes], @"mallocBytes",
+                                       [NSNumber numberWithLongLong:allocatedBlocks], @"mallocBlocks",
+                                       [NSNumber numberWithUnsignedInteger:peakFootprint], @"peakFootprint",
+                                       [NSNumber numberWithUnsignedInteger:[snapshot bytesWritten]], @"bytesWritten",
+                                       [NSNumber numberWithUnsignedInteger:[snapshot bytesRead]], @"bytesRead",
+                                       nil]];
+}
+
+/** Logs and reports the latencies of operations that measureScenario can not run. */
+- (void)reportLatencies:(NSMutableArray<NSNumber *> *)latencies ofScenario:(NSString *)name {
+    NSUInteger count = [latencies count];
+    [latencies sortUsingSelector:@selector(compare:)];
+    double p50 = [[latencies objectAtIndex:(count - 1) * 50 / 100] doubleValue];
+    double p99 = [[latencies objectAtIndex:(count - 1) * 99 / 100] doubleValue];
+    NSLog(@"%-14@ p50 %8.3f ms  p99 %8.3f ms", name, p50 * 1000.0, p99 * 1000.0);
+    [[[self class] results] addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       name, @"scenario",
+                                       [NSNumber numberWithUnsignedInteger:count], @"operations",
+                                       [NSNumber numberWithDouble:p50], @"p50",
+                                       [NSNumber numberWithDouble:p99], @"p99",
+                                       nil]];
+}
+
+/** Logs and reports the throughput of a data structure, measured without a server. */
+- (void)reportThroughputOfComponent:(NSString *)name operationCount:(NSUInteger)count duration:(NSTimeInterval)duration {
+    NSLog(@"%-14@ %9.0f ops/s", name, count / duration);
+    [[[self class] results] addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       name, @"scenario",
+                                       [NSNumber numberWithUnsignedInteger:count], @"operations",
+                                       [NSNumber numberWithDouble:count / duration], @"throughput",
+                                       nil]];
+}
+
+#pragma mark Scenarios
+
+- (void)testOpenClose {
+    LSPClient *client = [self initializedStubServerWithArguments:nil];
+    NSString *text = LSPBenchmarkText(2000);
+    [self measureScenario:@"open-close" client:client operationCount:200 operation:^(NSUInteger index, void (^done)(void)) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"untitled:open-%lu.txt", (unsigned long)index]];
+        [client documentDidOpen:url content:text];
+        [client documentDidClose:url];
+        [self roundTripWithClient:client completionHandler:done];
+    }];
+    [client terminate];
+}
+
+- (void)testOpenLargeDocument {
+    LSPClient *client = [self initializedStubServerWithArguments:nil];
+    NSUInteger sizes[] = { 1, 10, 100 };
+    for (NSUInteger i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        // The peak footprint shows whether the text is copied while it is streamed.
+        NSString *text = [@"" stringByPaddingToLength:sizes[i] * 1024 * 1024 withString:@"<p class=\"generated\">\tbenchmark \u00fc</p>\n" startingAtIndex:0];
+        NSString *name = [NSString stringWithFormat:@"open-%luMB", (unsigned long)sizes[i]];
+        [self measureScenario:name client:client operationCount:5 operation:^(NSUInteger index, void (^done)(void)) {
+            NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"untitled:generated-%lu.html", (unsigned long)index]];
+            [client documentDidOpen:url content:text];
+            [client documentDidClose:url];
+            [self roundTripWithClient:client completionHandler:done];
+        }];
+    }
+    [client terminate];
+}
+
+- (void)testEdit {
+    LSPClient *client = [self initializedStubServerWithArguments:nil];
+    NSURL *url = [NSURL URLWithString:@"untitled:edit.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    [client documentDidOpen:url content:text];
+    __block NSUInteger length = [text length];
+    [self measureScenario:@"edit" client:client operationCount:2000 operation:^(NSUInteger index, void (^done)(void)) {
+        // Typing in the middle of the document, every keystroke sent on its own.
+        [client document:url changeTextInRange:NSMakeRange(length / 2, 0) replacementString:@"x"];
+        length++;
+        [client documentDidChange:url];
+        [self roundTripWithClient:client completionHandler:done];
+    }];
+    [client terminate];
+}
+
+- (void)testCompletion {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"65536", nil]];
+    NSURL *url = [NSURL URLWithString:@"untitled:completion.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    [client documentDidOpen:url content:text];
+    [self measureScenario:@"completion" client:client operationCount:500 operation:^(NSUInteger index, void (^done)(void)) {
+        [client documentCompletion:url inText:text forCharacterAtIndex:index * 97 completionHandler:^(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error) {
+            XCTAssertEqual([completionList count], 1024, @"");
+            done();
+        }];
+    }];
+    [client terminate];
+}
+
+- (void)testHover {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"2048", nil]];
+    NSURL *url = [NSURL URLWithString:@"untitled:hover.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    [client documentDidOpen:url content:text];
+    [self measureScenario:@"hover" client:client operationCount:1000 operation:^(NSUInteger index, void (^done)(void)) {
+        // A new position every time, so the response cache does not answer.
+        [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:index * 53 completionHandler:^(NSDictionary *dict, NSError *error) {
+            XCTAssertNotNil(dict, @"");
+            done();
+        }];
+    }];
+    [client terminate];
+}
+
+/**
+ * Hovers while every operation also asks for the semantic tokens of a number
+ * of other documents, at a server that takes 5 ms for every request and
+ * handles them in order. The tokens are background requests.
+ */
+- (void)measureHoverScenario:(NSString *)name backgroundDocumentCount:(NSUInteger)documentCount maximumBackgroundRequestCount:(NSUInteger)maximumBackgroundRequestCount {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"0.005", nil]];
+    [client setMaximumBackgroundRequestCount:maximumBackgroundRequestCount];
+    NSString *text = LSPBenchmarkText(200);
+    NSURL *url = [NSURL URLWithString:@"untitled:hover.txt"];
+    [client documentDidOpen:url content:text];
+    NSMutableArray<NSURL *> *backgroundURLs = [NSMutableArray arrayWithCapacity:documentCount];
+    for (NSUInteger index = 0; index < documentCount; index++) {
+        NSURL *backgroundURL = [NSURL URLWithString:[NSString stringWithFormat:@"untitled:background-%lu.txt", (unsigned long)index]];
+        [client documentDidOpen:backgroundURL content:text];
+        [backgroundURLs addObject:backgroundURL];
+    }
+    [self measureScenario:name client:client operationCount:100 operation:^(NSUInteger index, void (^done)(void)) {
+        // A pending tokens request of the same document is replaced.
+        for (NSURL *backgroundURL in backgroundURLs) {
+            [client documentSemanticTokens:backgroundURL completionHandler:nil];
+        }
+        [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:index * 53 completionHandler:^(NSDictionary *dict, NSError *error) {
+            XCTAssertNil(error, @"");
+            done();
+        }];
+    }];
+    [client terminate];
+}
+
+- (void)testHoverDuringBackgroundRequests {
+    // The hover latency should stay close to the idle one, unlike without a cap.
+    [self measureHoverScenario:@"hover-idle" backgroundDocumentCount:0 maximumBackgroundRequestCount:4];
+    [self measureHoverScenario:@"hover-bulk" backgroundDocumentCount:16 maximumBackgroundRequestCount:4];
+    [self measureHoverScenario:@"hover-bulk-nocap" backgroundDocumentCount:16 maximumBackgroundRequestCount:NSUIntegerMax];
+}
+
+/**
+ * Searches the workspace symbols, 1000 results the stub computes in chunks
+ * of 100, and waits for the first results: either streamed as partial
+ * results, the request is then cancelled, or with the reply.
+ */
+- (void)measureWorkspaceSymbolScenario:(NSString *)name streamed:(BOOL)streamed {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"0.005", nil]];
+    [client documentDidOpen:[NSURL URLWithString:@"untitled:symbols.txt"] content:LSPBenchmarkText(500)];
+    [self measureScenario:name client:client operationCount:50 operation:^(NSUInteger index, void (^done)(void)) {
+        __block LSPRequest *request = nil;
+        __block BOOL first = YES;
+        void (^partialResultHandler)(NSArray *) = nil;
+        if (streamed) {
+            partialResultHandler = ^(NSArray *symbols) {
+                if (first) {
+                    first = NO;
+                    [request cancel];
+                    done();
+                }
+            };
+        }
+        request = [client workspaceSymbol:@"line" partialResultHandler:partialResultHandler completionHandler:^(NSArray *symbols, NSError *error) {
+            XCTAssertEqual([symbols count], 1000, @"");
+            done();
+        }];
+    }];
+    [client terminate];
+}
+
+- (void)testWorkspaceSymbol {
+    [self measureWorkspaceSymbolScenario:@"symbols-first" streamed:YES];
+    [self measureWorkspaceSymbolScenario:@"symbols-whole" streamed:NO];
+}
+
+- (void)testDiagnostics {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObject:@"--diagnostics"]];
+    NSURL *url = [NSURL URLWithString:@"untitled:diagnostics.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    __block NSUInteger length = [text length];
+    __block void (^diagnosed)(void) = nil;
+    LSPBenchmarkObserver *observer = [[LSPBenchmarkObserver alloc] init];
+    [observer setDiagnosticsHandler:^(NSURL *diagnosedURL, NSArray<LSPDiagnostic *> *diagnostics) {
+        // The message of the stub's diagnostic is the length of the text it was computed for.
+        if ([diagnosedURL isEqual:url] && [[[diagnostics firstObject] message] integerValue] == (NSInteger)length && diagnosed) {
+            void (^done)(void) = diagnosed;
+            diagnosed = nil;
+            done();
+        }
+    }];
+    [client addObserver:observer];
+    [client documentDidOpen:url content:text];
+    [self measureScenario:@"diagnostics" client:client operationCount:1000 operation:^(NSUInteger index, void (^done)(void)) {
+        diagnosed = done;
+        [client document:url changeTextInRange:NSMakeRange(index * 31 % length, 0) replacementString:@"y"];
+        length++;
+        [client documentDidChange:url];
+    }];
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+/**
+ * Launches a server that takes 50 ms to initialize, opens a document and
+ * waits for its first diagnostic. Either right away, the client queues the
+ * document until the server is initialized, or only once it is.
+ */
+- (void)measureColdStartScenario:(NSString *)name opensBeforeInitialize:(BOOL)opensBeforeInitialize {
+    NSString *productsPath = [[[NSBundle bundleForClass:[self class]] bundlePath] stringByDeletingLastPathComponent];
+    NSString *path = [productsPath stringByAppendingPathComponent:@"stub-language-server"];
+    NSArray *arguments = [NSArray arrayWithObjects:@"--diagnostics", @"--initialize-delay", @"0.05", nil];
+    NSURL *url = [NSURL URLWithString:@"untitled:cold-start.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    NSMutableArray<LSPClient *> *clients = [NSMutableArray array];
+    // Every operation has a client of its own, the byte counts are not reported.
+    LSPClient *metricsClient = [self initializedStubServerWithArguments:nil];
+    [self measureScenario:name client:metricsClient operationCount:20 operation:^(NSUInteger index, void (^done)(void)) {
+        LSPClient *client = [[LSPClient alloc] initWithPath:path arguments:arguments currentDirectoryPath:nil languageID:@"plaintext"];
+        [clients addObject:client];
+        LSPBenchmarkObserver *observer = [[LSPBenchmarkObserver alloc] init];
+        [observer setDiagnosticsHandler:^(NSURL *diagnosedURL, NSArray<LSPDiagnostic *> *diagnostics) {
+            done();
+        }];
+        [client addObserver:observer forURI:url methods:nil];
+        if (opensBeforeInitialize) {
+            [client documentDidOpen:url content:text];
+        } else {
+            [client initialWithCompletionHandler:^(NSError *error) {
+                [client documentDidOpen:url content:text];
+            }];
+        }
+    }];
+    for (LSPClient *client in clients) {
+        [client terminate];
+    }
+    [metricsClient terminate];
+}
+
+- (void)testColdStart {
+    [self measureColdStartScenario:@"cold-awaited" opensBeforeInitialize:NO];
+    [self measureColdStartScenario:@"cold-queued" opensBeforeInitialize:YES];
+}
+
+/**
+ * Kills the server of a client with an open document and waits until it is
+ * diagnosed again: by the standby server, or by a relaunched one the
+ * document is opened in again. Operations are not run by measureScenario,
+ * the launch of the next standby server is awaited between them.
+ */
+- (void)measureCrashRecoveryScenario:(NSString *)name hotStandby:(BOOL)hotStandby {
+    NSString *productsPath = [[[NSBundle bundleForClass:[self class]] bundlePath] stringByDeletingLastPathComponent];
+    NSString *path = [productsPath stringByAppendingPathComponent:@"stub-language-server"];
+    LSPClient *client = [[LSPClient alloc] initWithPath:path arguments:[NSArray arrayWithObject:@"--diagnostics"] currentDirectoryPath:nil languageID:@"plaintext"];
+    [client setHotStandby:hotStandby];
+    NSURL *url = [NSURL URLWithString:@"untitled:crash.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    __block BOOL diagnosed = NO;
+    LSPBenchmarkObserver *observer = [[LSPBenchmarkObserver alloc] init];
+    [observer setDiagnosticsHandler:^(NSURL *diagnosedURL, NSArray<LSPDiagnostic *> *diagnostics) {
+        diagnosed = YES;
+    }];
+    [client addObserver:observer forURI:url methods:nil];
+    [client addTerminationObserver:self block:^(LSPClient *client) {
+        [client initialWithCompletionHandler:^(NSError *error) {
+            [client documentDidOpen:url content:text];
+        }];
+    }];
+    [client documentDidOpen:url content:text];
+
+    NSUInteger count = 20;
+    NSMutableArray<NSNumber *> *latencies = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10.0];
+        while ((diagnosed == NO || [client isStandbyReady] != hotStandby) && [timeout timeIntervalSinceNow] > 0.0) {
+            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        }
+        XCTAssertTrue(diagnosed, @"%@ operation %lu timed out", name, (unsigned long)index);
+        diagnosed = NO;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        kill([(NSTask *)[client valueForKey:@"task"] processIdentifier], SIGKILL);
+        timeout = [NSDate dateWithTimeIntervalSinceNow:10.0];
+        while (diagnosed == NO && [timeout timeIntervalSinceNow] > 0.0) {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:timeout];
+        }
+        [latencies addObject:[NSNumber numberWithDouble:CFAbsoluteTimeGetCurrent() - start]];
+    }
+    [client removeTerminationObserver:self];
+    [client removeObserver:observer];
+    [client terminate];
+
+    [self reportLatencies:latencies ofScenario:name];
+}
+
+- (void)testCrashRecovery {
+    [self measureCrashRecoveryScenario:@"crash-standby" hotStandby:YES];
+    [self measureCrashRecoveryScenario:@"crash-relaunch" hotStandby:NO];
+}
+
+/**
+ * Suspends a client with an open document, like LSPServerPool does with an
+ * idle server, and sends a request: the server is relaunched and gets the
+ * document again before it answers.
+ */
+- (void)testResumeSuspendedServer {
+    LSPClient *client = [self initializedStubServerWithArguments:nil];
+    NSURL *url = [NSURL URLWithString:@"untitled:suspended.txt"];
+    NSString *text = LSPBenchmarkText(2000);
+    [client documentDidOpen:url content:text];
+    NSUInteger count = 20;
+    NSMutableArray<NSNumber *> *latencies = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        NSTask *task = [client valueForKey:@"task"];
+        [client suspend];
+        NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10.0];
+        while ([task isRunning] && [timeout timeIntervalSinceNow] > 0.0) {
+            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        }
+        __block BOOL answered = NO;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        [client documentHighlight:url inText:text forCharacterAtIndex:index * 53 completionHandler:^(NSArray *highlights, NSError *error) {
+            answered = YES;
+        }];
+        timeout = [NSDate dateWithTimeIntervalSinceNow:10.0];
+        while (answered == NO && [timeout timeIntervalSinceNow] > 0.0) {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:timeout];
+        }
+        XCTAssertTrue(answered, @"resume operation %lu timed out", (unsigned long)index);
+        [latencies addObject:[NSNumber numberWithDouble:CFAbsoluteTimeGetCurrent() - start]];
+    }
+    [client terminate];
+    [self reportLatencies:latencies ofScenario:@"resume"];
+}
+
+- (void)testSemanticTokens {
+    LSPClient *client = [self initializedStubServerWithArguments:nil];
+    // The stub makes every word a token, 9 on each line of the text.
+    NSUInteger lineCount = 11112;
+    NSUInteger tokenCount = lineCount * 9;
+    NSString *text = LSPBenchmarkText(lineCount);
+    [self measureScenario:@"tokens-full" client:client operationCount:20 operation:^(NSUInteger index, void (^done)(void)) {
+        NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"untitled:tokens-%lu.txt", (unsigned long)index]];
+        [client documentDidOpen:url content:text];
+        [client documentSemanticTokens:url completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+            XCTAssertEqual([tokens count], tokenCount, @"");
+            [client documentDidClose:url];
+            done();
+        }];
+    }];
+
+    NSURL *url = [NSURL URLWithString:@"untitled:tokens.txt"];
+    NSMutableArray<NSNumber *> *lineStarts = [NSMutableArray arrayWithCapacity:lineCount];
+    [text enumerateSubstringsInRange:NSMakeRange(0, [text length]) options:NSStringEnumerationByLines | NSStringEnumerationSubstringNotRequired usingBlock:^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
+        [lineStarts addObject:[NSNumber numberWithUnsignedInteger:substringRange.location]];
+    }];
+    NSMutableArray<NSNumber *> *editedLines = [NSMutableArray array];
+    [client documentDidOpen:url content:text];
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"full"];
+    [client documentSemanticTokens:url completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+        [expectation fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    [self measureScenario:@"tokens-delta" client:client operationCount:200 operation:^(NSUInteger index, void (^done)(void)) {
+        // A new word at the start of a line, the delta inserts one token.
+        NSUInteger line = index * 53 % lineCount;
+        NSUInteger location = [[lineStarts objectAtIndex:line] unsignedIntegerValue];
+        for (NSNumber *editedLine in editedLines) {
+            location += ([editedLine unsignedIntegerValue] < line) ? 2 : 0;
+        }
+        [editedLines addObject:[NSNumber numberWithUnsignedInteger:line]];
+        [client document:url changeTextInRange:NSMakeRange(location, 0) replacementString:@"x "];
+        [client documentSemanticTokens:url completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+            XCTAssertEqual([tokens count], tokenCount + index + 1, @"");
+            done();
+        }];
+    }];
+    [client terminate];
+}
+
+- (void)testNotifications {
+    LSPClient *client = [self initializedStubServerWithArguments:[NSArray arrayWithObjects:@"--notification-rate", @"5000", nil]];
+    __block NSUInteger receivedCount = 0;
+    __block NSUInteger awaitedCount = 0;
+    __block void (^received)(void) = nil;
+    LSPBenchmarkObserver *observer = [[LSPBenchmarkObserver alloc] init];
+    [observer setLogMessageHandler:^(NSString *message) {
+        receivedCount++;
+        if (received && receivedCount >= awaitedCount) {
+            void (^done)(void) = received;
+            received = nil;
+            done();
+        }
+    }];
+    [client addObserver:observer];
+    // An operation is 100 notifications, the rate is set by the server.
+    [self measureScenario:@"notifications" client:client operationCount:50 operation:^(NSUInteger index, void (^done)(void)) {
+        awaitedCount = receivedCount + 100;
+        received = done;
+    }];
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+#pragma mark Components
+
+- (void)testLineIndex {
+    NSUInteger sizes[] = { 1000, 10000, 50000 };
+    for (NSUInteger i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        NSMutableString *text = [LSPBenchmarkText(sizes[i]) mutableCopy];
+        LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:text];
+        NSUInteger length = [text length];
+        NSUInteger conversions = 100000;
+        srandom(7);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger conversion = 0; conversion < conversions; conversion++) {
+            LSPPosition *position = [lineIndex positionForCharacterAtIndex:(NSUInteger)random() % length];
+            [lineIndex characterIndexForPosition:position];
+        }
+        [self reportThroughputOfComponent:[NSString stringWithFormat:@"lines-%lu-pos", (unsigned long)sizes[i]] operationCount:conversions duration:CFAbsoluteTimeGetCurrent() - start];
+
+        // Typing in the middle of the text, with a new line every 40 characters.
+        NSUInteger edits = 10000;
+        NSUInteger location = length / 2;
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger edit = 0; edit < edits; edit++) {
+            [text replaceCharactersInRange:NSMakeRange(location, 0) withString:(edit % 40 == 39) ? @"\n" : @"x"];
+            [lineIndex didReplaceCharactersInRange:NSMakeRange(location, 0) withLength:1];
+            location++;
+        }
+        [self reportThroughputOfComponent:[NSString stringWithFormat:@"lines-%lu-edit", (unsigned long)sizes[i]] operationCount:edits duration:CFAbsoluteTimeGetCurrent() - start];
+    }
+}
+
+- (void)testResolveDiagnostics {
+    NSUInteger lineCount = 10000;
+    NSString *text = LSPBenchmarkText(lineCount);
+    NSUInteger counts[] = { 10, 1000, 10000 };
+    srandom(11);
+    for (NSUInteger i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        NSArray<LSPDiagnostic *> *diagnostics = LSPBenchmarkDiagnostics(counts[i], lineCount);
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        [LSPDiagnostic resolveCharacterRangesOfDiagnostics:diagnostics inText:text];
+        [self reportThroughputOfComponent:[NSString stringWithFormat:@"diag-%lu-batch", (unsigned long)counts[i]] operationCount:counts[i] duration:CFAbsoluteTimeGetCurrent() - start];
+
+        LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:text];
+        start = CFAbsoluteTimeGetCurrent();
+        [LSPDiagnostic resolveCharacterRangesOfDiagnostics:diagnostics lineIndex:lineIndex];
+        [self reportThroughputOfComponent:[NSString stringWithFormat:@"diag-%lu-index", (unsigned long)counts[i]] operationCount:counts[i] duration:CFAbsoluteTimeGetCurrent() - start];
+
+        // One conversion per diagnostic, as observers did before. Skipped for
+        // the largest count, it takes too long.
+        if (counts[i] <= 1000) {
+            start = CFAbsoluteTimeGetCurrent();
+            for (LSPDiagnostic *diagnostic in diagnostics) {
+                [[diagnostic range] convertToRangeInText:text];
+            }
+            [self reportThroughputOfComponent:[NSString stringWithFormat:@"diag-%lu-single", (unsigned long)counts[i]] operationCount:counts[i] duration:CFAbsoluteTimeGetCurrent() - start];
+        }
+    }
+}
+
+- (void)testRope {
+    // Typing in the middle of a large document, with a snapshot for every
+    // 100 characters like a didChange in full sync mode.
+    NSUInteger sizes[] = { 1024 * 1024, 10 * 1024 * 1024 };
+    for (NSUInteger i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        NSString *text = [@"" stringByPaddingToLength:sizes[i] withString:@"echo \"benchmark\"\n" startingAtIndex:0];
+        NSArray *strings = [NSArray arrayWithObjects:[text mutableCopy], [[LSPRope alloc] initWithString:text], nil];
+        for (NSMutableString *string in strings) {
+            NSUInteger edits = 20000;
+            NSUInteger location = sizes[i] / 2;
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            for (NSUInteger edit = 0; edit < edits; edit++) {
+                if (edit % 3 == 2) {
+                    [string replaceCharactersInRange:NSMakeRange(--location, 1) withString:@""];
+                } else {
+                    [string replaceCharactersInRange:NSMakeRange(location++, 0) withString:@"x"];
+                }
+                if (edit % 100 == 0) {
+                    NSString *snapshot = [string copy];
+                    XCTAssertEqual([snapshot length], [string length], @"");
+                }
+            }
+            NSString *name = [NSString stringWithFormat:@"%@-%luMB", [string isKindOfClass:[LSPRope class]] ? @"rope" : @"string", (unsigned long)sizes[i] / (1024 * 1024)];
+            [self reportThroughputOfComponent:name operationCount:edits duration:CFAbsoluteTimeGetCurrent() - start];
+        }
+    }
+}
+
+- (void)testRopeChunkSplits {
+    // Pasting at the start of a document of thousands of chunks splits a
+    // chunk every time, which moves all chunks after it.
+    NSString *text = [@"" stringByPaddingToLength:10 * 1024 * 1024 withString:@"echo \"benchmark\"\n" startingAtIndex:0];
+    NSString *paste = [@"" stringByPaddingToLength:3000 withString:@"x" startingAtIndex:0];
+    LSPRope *rope = [[LSPRope alloc] initWithString:text];
+    NSUInteger chunkCount = [rope numberOfChunks];
+    NSUInteger edits = 2000;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger edit = 0; edit < edits; edit++) {
+        [rope replaceCharactersInRange:NSMakeRange(edit % 64, 0) withString:paste];
+    }
+    CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+    XCTAssertGreaterThan([rope numberOfChunks], chunkCount, @"");
+    XCTAssertEqual([rope length], [text length] + edits * [paste length], @"");
+    [self reportThroughputOfComponent:[NSString stringWithFormat:@"rope-splits-%luchunks", (unsigned long)chunkCount] operationCount:edits duration:duration];
+}
+
+- (void)testFrameDecoding {
+    NSUInteger frameCount = 0;
+    NSUInteger byteCount = 0;
+    NSArray<NSData *> *reads = LSPBenchmarkServerReads(&frameCount, &byteCount);
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    __block NSUInteger frames = 0;
+    [pipeline setDataHandler:^(NSData *content, NSString *charset) {
+        frames++;
+    }];
+    int64_t allocations = __atomic_load_n(&LSPAllocationCount, __ATOMIC_RELAXED);
+    malloc_logger = LSPCountingMallocLogger;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSData *read in reads) {
+        [pipeline didReceiveData:read];
+    }
+    CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+    malloc_logger = NULL;
+    allocations = __atomic_load_n(&LSPAllocationCount, __ATOMIC_RELAXED) - allocations;
+    [pipeline close];
+    XCTAssertEqual(frames, frameCount, @"");
+    NSLog(@"%-14@ %9.1f MB/s  %.2f allocations per frame, %lu frames in %lu reads", @"frames",
+          (byteCount / (1024.0 * 1024.0)) / duration, (double)allocations / frames,
+          (unsigned long)frames, (unsigned long)[reads count]);
+    [[[self class] results] addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       @"frames", @"scenario",
+                                       [NSNumber numberWithUnsignedInteger:frames], @"operations",
+                                       [NSNumber numberWithDouble:frames / duration], @"throughput",
+                                       [NSNumber numberWithDouble:(double)allocations / frames], @"allocationsPerFrame",
+                                       nil]];
+}
+
+- (void)testWriter {
+    // Notifications to a server that stops reading for a while, far more
+    // than the pipe buffer holds.
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    NSString *productsPath = [[[NSBundle bundleForClass:[self class]] bundlePath] stringByDeletingLastPathComponent];
+    NSTask *task = [[NSTask alloc] init];
+    [task setLaunchPath:[productsPath stringByAppendingPathComponent:@"stub-language-server"]];
+    [task setStandardInput:[pipeline stdinPipe]];
+    [task setStandardOutput:[pipeline stdoutPipe]];
+    [task setStandardError:[pipeline stderrPipe]];
+    [task launch];
+    NSDictionary *pause = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithDouble:1.0], @"seconds", nil];
+    [pipeline sendNotification:@"stub/pause" params:pause];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:[@"" stringByPaddingToLength:64 * 1024 withString:@"x" startingAtIndex:0], @"text", nil];
+    NSUInteger notificationCount = 256;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < notificationCount; index++) {
+        [pipeline sendNotification:@"stub/ignored" params:params];
+    }
+    CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+    XCTestExpectation *reply = [[XCTestExpectation alloc] initWithDescription:@"reply"];
+    [pipeline sendRequest:@"stub/echo" params:nil withReply:^(id obj, NSError *error) {
+        [reply fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:reply] timeout:30.0];
+    NSLog(@"%-14@ %9.2f ms to queue  %lu frames in %lu writes, %lu bytes high-water mark", @"writer",
+          duration * 1000.0, (unsigned long)[pipeline writtenMessageCount], (unsigned long)[pipeline writeCount],
+          (unsigned long)[pipeline queuedByteHighWaterMark]);
+    [[[self class] results] addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                                       @"writer", @"scenario",
+                                       [NSNumber numberWithUnsignedInteger:notificationCount], @"operations",
+                                       [NSNumber numberWithDouble:notificationCount / duration], @"throughput",
+                                       [NSNumber numberWithUnsignedInteger:[pipeline writeCount]], @"writes",
+                                       [NSNumber numberWithUnsignedInteger:[pipeline queuedByteHighWaterMark]], @"queuedByteHighWaterMark",
+                                       nil]];
+    [pipeline sendNotification:@"exit" params:nil];
+    [task waitUntilExit];
+    [pipeline close];
+}
+
+@end
@@ -10,6 +10,9 @@
 
 #import <LSPKit/LSPKit.h>
 
+#import "LSPPipeline.h"
+#import "XCTestCase+LSPStubServer.h"
+
 
 
 @interface DiagnosticsObserver : XCTestCase <LSPClientObserver>
@@ -35,6 +38,79 @@
 
 
 
+@interface DiagnosticsHandlerObserver : NSObject <LSPClientObserver>
+@property (copy) void (^handler)(NSURL *url, NSArray<LSPDiagnostic *> *diagnostics);
+@end
+
+@implementation DiagnosticsHandlerObserver
+
+- (void)languageServer:(LSPClient *)client document:(NSURL *)url diagnostics:(NSArray<LSPDiagnostic *> *)diagnostics {
+    _handler(url, diagnostics);
+}
+
+@end
+
+
+
+@interface ProgressObserver : NSObject <LSPClientObserver>
+@property (copy) void (^handler)(LSPWorkDoneProgress *progress);
+@end
+
+@implementation ProgressObserver
+
+- (void)languageServer:(LSPClient *)client workDoneProgress:(LSPWorkDoneProgress *)progress {
+    _handler(progress);
+}
+
+@end
+
+
+
+@interface MessageRequestObserver : NSObject <LSPClientObserver>
+@property (copy) void (^handler)(NSString *message, LSPMessageType type, NSArray<NSString *> *actions, void (^reply)(NSString *action));
+@end
+
+@implementation MessageRequestObserver
+
+- (void)languageServer:(LSPClient *)client showMessageRequest:(NSString *)message type:(LSPMessageType)type actions:(NSArray<NSString *> *)actions reply:(void (^)(NSString *action))reply {
+    _handler(message, type, actions, reply);
+}
+
+@end
+
+
+
+@interface LSPClient (DocumentChanges)
+- (void)_documentChangesTimerDidFire;
+@end
+
+/** Pending document changes are due by a clock the test advances. */
+@interface ManualClockClient : LSPClient
+@property NSTimeInterval time;
+@end
+
+@implementation ManualClockClient
+
+- (NSTimeInterval)_documentChangeTime {
+    return _time;
+}
+
+@end
+
+
+
+static NSString *LSPRandomEditText(NSUInteger maxLength) {
+    static NSString *alphabet[] = { @"a", @"b", @" ", @"\n", @"\r", @"\r\n", @"\u2028", @"echo" };
+    NSMutableString *text = [NSMutableString string];
+    NSUInteger count = (NSUInteger)random() % (maxLength + 1);
+    for (NSUInteger i = 0; i < count; i++) {
+        [text appendString:alphabet[(NSUInteger)random() % (sizeof(alphabet) / sizeof(alphabet[0]))]];
+    }
+    return text;
+}
+
+
+
 @interface LSPClientTests : XCTestCase
 @end
 
@@ -94,8 +170,8 @@
         [newText insertString:replacementString atIndex:range.location];
         [client document:scriptURL changeTextInRange:range replacementString:replacementString];
         
-        // Normally not required, but in the unit test the run loop
-        // never enters the idle state (NSPostWhenIdle).
+        // Normally not required, the symbol request sends the pending
+        // changes anyway.
         [client documentDidChange:scriptURL];
         
         [client documentSymbol:scriptURL completionHandler:^(NSArray *symbols, NSError *error) {
@@ -174,6 +250,643 @@
     [self waitForExpectations:[NSArray arrayWithObjects:expectation1, expectation2, nil] timeout:30.0];
 }
 
+- (void)testReplacedRequestsAreCancelled {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"highlight"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"statistics"];
+    NSURL *url = [NSURL URLWithString:@"untitled:cancel.txt"];
+    NSString *text = @"one two three four five six seven eight nine ten eleven twelve";
+    NSUInteger requestCount = 20;
+    __block NSUInteger highlightCount = 0;
+    // Every request takes the server 200 ms, like a busy server under fast cursor movement.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"0.2", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [client documentDidOpen:url content:text];
+        for (NSUInteger index = 0; index < requestCount; index++) {
+            LSPRequest *request = [client documentHighlight:url inText:text forCharacterAtIndex:index completionHandler:^(NSArray<LSPDocumentHighlight *> *highlights, NSError *error) {
+                XCTAssertTrue([NSThread isMainThread], @"");
+                XCTAssertNil(error, @"");
+                highlightCount++;
+                [expectation1 fulfill];
+            }];
+            XCTAssertNotNil(request, @"");
+        }
+        LSPRequest *hover = [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:0 completionHandler:^(NSDictionary *dict, NSError *error) {
+            XCTFail(@"The completion handler of a cancelled request must not be called.");
+        }];
+        [hover cancel];
+        XCTAssertTrue([hover isCancelled], @"");
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/statistics" params:nil withReply:^(id obj, NSError *error) {
+        // Only the last highlight was computed, the server dropped the others.
+        XCTAssertEqualObjects([obj objectForKey:@"handled"], [NSNumber numberWithUnsignedInteger:1], @"");
+        XCTAssertEqualObjects([obj objectForKey:@"cancelled"], [NSNumber numberWithUnsignedInteger:requestCount], @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    XCTAssertEqual(highlightCount, 1, @"");
+    [client terminate];
+}
+
+- (void)testRequestTimeout {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"hover"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"statistics"];
+    NSURL *url = [NSURL URLWithString:@"untitled:timeout.txt"];
+    NSString *text = @"one two three";
+    // A server that takes far longer than the client waits.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"10", nil]];
+    [client setRequestTimeout:0.2];
+    [client documentDidOpen:url content:text];
+    [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:4 completionHandler:^(NSDictionary *dict, NSError *error) {
+        XCTAssertTrue([NSThread isMainThread], @"");
+        XCTAssertNil(dict, @"");
+        XCTAssertEqual([error code], LSPResponseRequestTimedOut, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    XCTAssertEqual([pipeline pendingRequestCount], 0, @"");
+    [pipeline sendRequest:@"stub/statistics" params:nil withReply:^(id obj, NSError *error) {
+        // The server was told to stop working on it.
+        XCTAssertEqualObjects([obj objectForKey:@"cancelled"], [NSNumber numberWithUnsignedInteger:1], @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client terminate];
+}
+
+- (void)testDocumentChangesAreDebounced {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:debounce.txt"];
+    ManualClockClient *client = [[ManualClockClient alloc] initWithPath:[self stubServerPath] arguments:nil currentDirectoryPath:nil languageID:@"plaintext"];
+    [client setTime:1.0];
+    [client setDocumentChangeDebounceInterval:0.5];
+    [client setDocumentChangeMaximumLatency:2.0];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:@""];
+    __block NSUInteger length = 0;
+    void (^type)(NSString *) = ^(NSString *string) {
+        [client document:url changeTextInRange:NSMakeRange(length++, 0) replacementString:string];
+    };
+    // The timer fires when the clock passes a deadline.
+    void (^advance)(NSTimeInterval) = ^(NSTimeInterval interval) {
+        [client setTime:[client time] + interval];
+        [client _documentChangesTimerDidFire];
+    };
+    
+    // A burst of typing is sent in one notification, once typing paused.
+    for (NSUInteger index = 0; index < 100; index++) {
+        type(@"x");
+    }
+    advance(0.25);
+    XCTAssertEqual([client documentChangeNotificationCount], 0, @"");
+    advance(0.25);
+    XCTAssertEqual([client documentEditCount], 100, @"");
+    XCTAssertEqual([client documentChangeNotificationCount], 1, @"");
+    
+    // A request sends pending changes first.
+    type(@"y");
+    [client documentHoverWithContentsOfURL:url inText:@"" forCharacterAtIndex:0 completionHandler:nil];
+    XCTAssertEqual([client documentChangeNotificationCount], 2, @"");
+    
+    // Continuous typing is sent every maximum latency, the rest once it stops.
+    for (NSUInteger index = 0; index < 32; index++) {
+        advance(0.125);
+        type(@"z");
+    }
+    XCTAssertEqual([client documentChangeNotificationCount], 3, @"");
+    advance(0.5);
+    XCTAssertEqual([client documentEditCount], 133, @"");
+    XCTAssertEqual([client documentChangeNotificationCount], 4, @"");
+    // The server got them all, the statistics request is answered after them.
+    XCTAssertEqualObjects([[self statisticsOfClient:client] objectForKey:@"changeNotifications"], [NSNumber numberWithUnsignedInteger:4], @"");
+    [client terminate];
+}
+
+- (void)testMergedChangesReplayRandomEdits {
+    [self replayRandomEditsWithTextStorage:NO];
+}
+
+- (void)testBorrowedTextStorageReplayRandomEdits {
+    [self replayRandomEditsWithTextStorage:YES];
+}
+
+- (void)replayRandomEditsWithTextStorage:(BOOL)borrowsTextStorage {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"text"];
+    NSURL *url = [NSURL URLWithString:@"untitled:edits.txt"];
+    LSPClient *client = [self stubServerWithArguments:nil];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    
+    srandom(2026);
+    NSMutableString *text = [NSMutableString string];
+    for (NSUInteger line = 0; line < 200; line++) {
+        [text appendString:LSPRandomEditText(12)];
+        [text appendString:@"\n"];
+    }
+    // The host's text storage, changed right after the client was told.
+    NSMutableAttributedString *textStorage = [[NSMutableAttributedString alloc] initWithString:text];
+    if (borrowsTextStorage) {
+        [client documentDidOpen:url textStorage:textStorage];
+    } else {
+        [client documentDidOpen:url content:text];
+    }
+    NSUInteger cursor = 0;
+    for (NSUInteger round = 0; round < 200; round++) {
+        NSUInteger editCount = 1 + (NSUInteger)random() % 40;
+        for (NSUInteger edit = 0; edit < editCount; edit++) {
+            NSRange range = NSMakeRange(MIN(cursor, [text length]), 0);
+            NSString *replacementString = @"";
+            switch (random() % 8) {
+                case 0: case 1: case 2:
+                    // Typing
+                    replacementString = LSPRandomEditText(1);
+                    break;
+                case 3: case 4:
+                    // Backspace
+                    if (range.location > 0) {
+                        range = NSMakeRange(range.location - 1, 1);
+                    }
+                    break;
+                case 5:
+                    // Forward delete
+                    range.length = MIN((NSUInteger)random() % 3, [text length] - range.location);
+                    break;
+                case 6:
+                    // Paste somewhere else
+                    range.location = (NSUInteger)random() % ([text length] + 1);
+                    range.length = (NSUInteger)random() % (MIN([text length] - range.location, 20) + 1);
+                    replacementString = LSPRandomEditText(20);
+                    break;
+                default:
+                    // Replace most of the document
+                    if (random() % 20 == 0) {
+                        range = NSMakeRange(0, [text length] - [text length] / 10);
+                        replacementString = LSPRandomEditText(400);
+                    }
+                    break;
+            }
+            [client document:url changeTextInRange:range replacementString:replacementString];
+            [text replaceCharactersInRange:range withString:replacementString];
+            [textStorage replaceCharactersInRange:range withString:replacementString];
+            cursor = range.location + [replacementString length];
+        }
+        [client documentDidChange:url];
+    }
+    
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/text" params:[NSDictionary dictionaryWithObjectsAndKeys:[url absoluteString], @"uri", nil] withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects(obj, text, @"");
+        [pipeline sendRequest:@"stub/statistics" params:nil withReply:^(id obj, NSError *error) {
+            NSUInteger contentChangeCount = [[obj objectForKey:@"contentChanges"] unsignedIntegerValue];
+            XCTAssertEqual([[obj objectForKey:@"changeNotifications"] unsignedIntegerValue], 200, @"");
+            XCTAssertLessThan(contentChangeCount, [client documentEditCount] / 2, @"");
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [expectation2 fulfill];
+            });
+        }];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client terminate];
+}
+
+- (void)testDocumentDidOpenLargeDocument {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"text"];
+    LSPClient *client = [self stubServerWithArguments:nil];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    
+    // The text is streamed into the pipe, the server gets it unchanged.
+    NSURL *url = [NSURL URLWithString:@"untitled:generated.html"];
+    NSString *text = [@"" stringByPaddingToLength:1024 * 1024 withString:@"<p class=\"generated\">\tbenchmark \u00fc</p>\n" startingAtIndex:0];
+    [client documentDidOpen:url content:text];
+    [pipeline sendRequest:@"stub/text" params:[NSDictionary dictionaryWithObjectsAndKeys:[url absoluteString], @"uri", nil] withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects(obj, text, @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client documentDidClose:url];
+    XCTAssertEqual([pipeline queuedByteCount], 0, @"");
+    [client terminate];
+}
+
+/** Kills the server of a client with an open document and waits until it is diagnosed again. */
+- (void)recoverFromCrashWithHotStandby:(BOOL)hotStandby {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:standby.txt"];
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObject:@"--diagnostics"]];
+    [client setHotStandby:hotStandby];
+    __block NSString *message = nil;
+    DiagnosticsHandlerObserver *observer = [[DiagnosticsHandlerObserver alloc] init];
+    [observer setHandler:^(NSURL *diagnosedURL, NSArray<LSPDiagnostic *> *diagnostics) {
+        if ([diagnosedURL isEqual:url]) {
+            message = [[diagnostics firstObject] message];
+        }
+    }];
+    [client addObserver:observer];
+    __block NSUInteger terminationCount = 0;
+    [client addTerminationObserver:self block:^(LSPClient *client) {
+        // Without a standby server the documents are gone, the host opens them again.
+        terminationCount++;
+        [client initialWithCompletionHandler:^(NSError *error) {
+            XCTAssertNil(error, @"");
+            [client documentDidOpen:url content:@"hello world"];
+        }];
+    }];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:@"hello"];
+    [client document:url changeTextInRange:NSMakeRange(5, 0) replacementString:@" world"];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [message isEqual:@"11"] && [client isStandbyReady] == hotStandby;
+    } timeout:10.0], @"");
+
+    __block BOOL answered = NO;
+    [client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+        answered = YES;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return answered;
+    } timeout:10.0], @"");
+
+    NSTask *task = [client valueForKey:@"task"];
+    message = nil;
+    kill([task processIdentifier], SIGKILL);
+    // The server gets the document at its current text.
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [message isEqual:@"11"];
+    } timeout:10.0], @"");
+    XCTAssertNotEqual([client valueForKey:@"task"], task, @"");
+    XCTAssertEqual(terminationCount, hotStandby ? 0 : 1, @"");
+    // The result of the old server is not served for the same version.
+    answered = NO;
+    [client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+        answered = YES;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return answered;
+    } timeout:10.0], @"");
+    XCTAssertEqual([client responseCacheHitCount], 0, @"");
+    if (hotStandby) {
+        // The next standby server is launched.
+        XCTAssertTrue([self runUntil:^BOOL{
+            return [client isStandbyReady];
+        } timeout:10.0], @"");
+    }
+    [client removeTerminationObserver:self];
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+- (void)testHotStandbyTakesOverAfterCrash {
+    [self recoverFromCrashWithHotStandby:YES];
+}
+
+- (void)testRelaunchAfterCrashReopensDocuments {
+    [self recoverFromCrashWithHotStandby:NO];
+}
+
+- (void)testObserversForDocument {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url1 = [NSURL URLWithString:@"untitled:observed1.txt"];
+    NSURL *url2 = [NSURL URLWithString:@"untitled:observed2.txt"];
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObject:@"--diagnostics"]];
+    NSMutableArray<NSURL *> *urls1 = [NSMutableArray array];
+    NSMutableArray<NSURL *> *urls2 = [NSMutableArray array];
+    NSMutableArray<NSURL *> *allURLs = [NSMutableArray array];
+    DiagnosticsHandlerObserver *observer1 = [[DiagnosticsHandlerObserver alloc] init];
+    [observer1 setHandler:^(NSURL *url, NSArray<LSPDiagnostic *> *diagnostics) {
+        [urls1 addObject:url];
+    }];
+    DiagnosticsHandlerObserver *observer2 = [[DiagnosticsHandlerObserver alloc] init];
+    [observer2 setHandler:^(NSURL *url, NSArray<LSPDiagnostic *> *diagnostics) {
+        [urls2 addObject:url];
+    }];
+    DiagnosticsHandlerObserver *allObserver = [[DiagnosticsHandlerObserver alloc] init];
+    [allObserver setHandler:^(NSURL *url, NSArray<LSPDiagnostic *> *diagnostics) {
+        [allURLs addObject:url];
+    }];
+    NSSet *methods = [NSSet setWithObject:@"textDocument/publishDiagnostics"];
+    [client addObserver:observer1 forURI:url1 methods:methods];
+    [client addObserver:observer1 forURI:url1 methods:methods];
+    [client addObserver:observer2 forURI:url2 methods:[NSSet setWithObject:@"window/logMessage"]];
+    [client addObserver:allObserver];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+
+    [client documentDidOpen:url1 content:@"one"];
+    [client documentDidOpen:url2 content:@"two"];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [allURLs count] == 2;
+    } timeout:10.0], @"");
+    XCTAssertEqualObjects(allURLs, ([NSArray arrayWithObjects:url1, url2, nil]), @"");
+    XCTAssertEqualObjects(urls1, [NSArray arrayWithObject:url1], @"");
+    XCTAssertEqual([urls2 count], 0, @"");
+
+    // Removed observers are not called anymore, the others still are.
+    [client removeObserver:observer1];
+    [client addObserver:observer2 forURI:url2 methods:methods];
+    [client document:url1 changeTextInRange:NSMakeRange(3, 0) replacementString:@"!"];
+    [client document:url2 changeTextInRange:NSMakeRange(3, 0) replacementString:@"!"];
+    [client documentDidChange:url1];
+    [client documentDidChange:url2];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [allURLs count] == 4;
+    } timeout:10.0], @"");
+    XCTAssertEqual([urls1 count], 1, @"");
+    XCTAssertEqualObjects(urls2, [NSArray arrayWithObject:url2], @"");
+    [client removeObserver:observer2];
+    [client removeObserver:allObserver];
+    [client terminate];
+}
+
+- (void)testDocumentsAndRequestsBeforeInitialize {
+    NSURL *url = [NSURL URLWithString:@"untitled:early.txt"];
+    NSURL *closedURL = [NSURL URLWithString:@"untitled:closed.txt"];
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--diagnostics", @"--initialize-delay", @"0.2", nil]];
+    __block NSString *message = nil;
+    DiagnosticsHandlerObserver *observer = [[DiagnosticsHandlerObserver alloc] init];
+    [observer setHandler:^(NSURL *diagnosedURL, NSArray<LSPDiagnostic *> *diagnostics) {
+        message = [[diagnostics firstObject] message];
+    }];
+    [client addObserver:observer forURI:url methods:nil];
+
+    // Nothing waits for the initialize reply, the first open starts it.
+    [client documentDidOpen:url content:@"hello"];
+    [client document:url changeTextInRange:NSMakeRange(5, 0) replacementString:@" world"];
+    [client documentDidOpen:closedURL content:@"closed"];
+    __block BOOL highlighted = NO;
+    LSPRequest *highlightRequest = [client documentHighlight:url inText:@"hello world" forCharacterAtIndex:0 completionHandler:^(NSArray<LSPDocumentHighlight *> *highlights, NSError *error) {
+        XCTAssertNil(error, @"");
+        highlighted = YES;
+    }];
+    XCTAssertNotNil(highlightRequest, @"");
+    LSPRequest *closedRequest = [client documentSymbol:closedURL completionHandler:^(NSArray *symbols, NSError *error) {
+        XCTFail(@"The document was closed");
+    }];
+    [client documentDidClose:closedURL];
+    // The stub has no folding range provider.
+    LSPRequest *foldingRangeRequest = [client documentFoldingRange:url completionHandler:^(NSArray *foldingRanges, NSError *error) {
+        XCTFail(@"The server does not provide folding ranges");
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return highlighted && [message isEqual:@"11"];
+    } timeout:10.0], @"");
+    XCTAssertTrue([closedRequest isCancelled], @"");
+    XCTAssertTrue([foldingRangeRequest isCancelled], @"");
+    XCTAssertEqualObjects([[client valueForKey:@"documents"] allKeys], [NSArray arrayWithObject:url], @"");
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+- (void)testResponsesAreCachedAndShared {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:cache.txt"];
+    NSString *text = @"one two three";
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"0.1", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:text];
+
+    // Identical requests in flight share one server request.
+    __block NSUInteger symbolCount = 0;
+    for (NSUInteger index = 0; index < 3; index++) {
+        XCTAssertNotNil([client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+            XCTAssertNil(error, @"");
+            symbolCount++;
+        }], @"");
+    }
+    // The replaced hover does not cancel the server request the second one shares.
+    [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:4 completionHandler:^(NSDictionary *dict, NSError *error) {
+        XCTFail(@"The completion handler of a replaced request must not be called.");
+    }];
+    __block NSUInteger hoverCount = 0;
+    [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:4 completionHandler:^(NSDictionary *dict, NSError *error) {
+        XCTAssertNil(error, @"");
+        hoverCount++;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return symbolCount == 3 && hoverCount == 1;
+    } timeout:10.0], @"");
+
+    // The same version is answered from the cache, right away.
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+        symbolCount++;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return symbolCount == 4;
+    } timeout:10.0], @"");
+    XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - start, 0.1, @"");
+    XCTAssertEqual([client responseCacheHitCount], 1, @"");
+
+    // A change invalidates the results of the document.
+    [client document:url changeTextInRange:NSMakeRange(0, 3) replacementString:@"1"];
+    [client documentSymbol:url completionHandler:^(NSArray *symbols, NSError *error) {
+        symbolCount++;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return symbolCount == 5;
+    } timeout:10.0], @"");
+    XCTAssertEqual([client responseCacheHitCount], 1, @"");
+    XCTAssertEqual([client responseCacheMissCount], 6, @"");
+
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"statistics"];
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/statistics" params:nil withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects([obj objectForKey:@"handled"], [NSNumber numberWithUnsignedInteger:3], @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client terminate];
+}
+
+- (void)testStreamedResultsAndProgress {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:progress.txt"];
+    NSMutableString *text = [NSMutableString string];
+    for (NSUInteger index = 0; index < 250; index++) {
+        [text appendString:@"foo bar\n"];
+    }
+    NSMutableArray<LSPWorkDoneProgress *> *progresses = [NSMutableArray array];
+    ProgressObserver *observer = [[ProgressObserver alloc] init];
+    [observer setHandler:^(LSPWorkDoneProgress *progress) {
+        XCTAssertTrue([NSThread isMainThread], @"");
+        [progresses addObject:progress];
+    }];
+    // The stub creates a progress of its own after initialized.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObject:@"--progress"]];
+    [client addObserver:observer];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    XCTAssertTrue([client hasReferencesProvider], @"");
+    XCTAssertTrue([client workspaceSymbolProvider], @"");
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [[progresses lastObject] kind] == LSPWorkDoneProgressKindEnd;
+    } timeout:10.0], @"");
+    XCTAssertEqualObjects([[progresses firstObject] token], @"stub-indexing", @"");
+    XCTAssertEqualObjects([[progresses firstObject] title], @"Indexing", @"");
+    XCTAssertNil([[progresses firstObject] url], @"");
+    [progresses removeAllObjects];
+
+    // The chunks arrive before the reply, which has all of them.
+    [client documentDidOpen:url content:text];
+    NSMutableArray *chunks = [NSMutableArray array];
+    __block NSArray *symbols = nil;
+    [client workspaceSymbol:@"fo" partialResultHandler:^(NSArray *chunk) {
+        XCTAssertNil(symbols, @"");
+        [chunks addObject:chunk];
+    } completionHandler:^(NSArray *result, NSError *error) {
+        XCTAssertNil(error, @"");
+        symbols = result;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return symbols != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqual([chunks count], 3, @"");
+    XCTAssertEqual([[chunks lastObject] count], 50, @"");
+    XCTAssertEqual([symbols count], 250, @"");
+    XCTAssertEqualObjects([[symbols firstObject] objectForKey:@"name"], @"foo", @"");
+    XCTAssertEqual([[progresses firstObject] kind], LSPWorkDoneProgressKindBegin, @"");
+    XCTAssertEqual([[progresses objectAtIndex:1] percentage], 33, @"");
+    XCTAssertEqual([[progresses lastObject] kind], LSPWorkDoneProgressKindEnd, @"");
+    [progresses removeAllObjects];
+
+    // Without a partial result handler the reply has the results, the progress has the document.
+    __block NSArray *references = nil;
+    [client documentReferences:url inText:text forCharacterAtIndex:5 includeDeclaration:YES partialResultHandler:nil completionHandler:^(NSArray *locations, NSError *error) {
+        XCTAssertNil(error, @"");
+        references = locations;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return references != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqual([references count], 250, @"");
+    XCTAssertEqualObjects([[progresses firstObject] url], url, @"");
+
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"statistics"];
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/statistics" params:nil withReply:^(id obj, NSError *error) {
+        // The client answered window/workDoneProgress/create.
+        XCTAssertEqualObjects([obj objectForKey:@"responses"], [NSNumber numberWithUnsignedInteger:1], @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+- (void)testDroppedStreamingRequestRemovesProgressTokens {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:dropped.txt"];
+    // The stub takes long enough for the injected reply to come first.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"1.0", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:@"foo bar foo"];
+    LSPRequest *request = [client documentReferences:url inText:@"foo bar foo" forCharacterAtIndex:1 includeDeclaration:YES partialResultHandler:^(NSArray *chunk) {
+        XCTFail(@"The request was dropped");
+    } completionHandler:^(NSArray *locations, NSError *error) {
+        XCTFail(@"The request was dropped");
+    }];
+    XCTAssertEqual([[client valueForKey:@"partialResultHandlers"] count], 1, @"");
+    XCTAssertEqual([[client valueForKey:@"workDoneTokenURIs"] count], 1, @"");
+
+    [self receiveErrorCode:LSPResponseContentModified forRequest:request ofClient:client];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [[client valueForKey:@"partialResultHandlers"] count] == 0;
+    } timeout:10.0], @"");
+    XCTAssertEqual([[client valueForKey:@"workDoneTokenURIs"] count], 0, @"");
+    XCTAssertFalse([request isCancelled], @"");
+    [client terminate];
+}
+
+- (void)testShowMessageRequestIsAnsweredWithChosenAction {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    LSPClient *client = [self stubServerWithArguments:nil];
+    __block void (^pendingReply)(NSString *action) = nil;
+    MessageRequestObserver *observer = [[MessageRequestObserver alloc] init];
+    [observer setHandler:^(NSString *message, LSPMessageType type, NSArray<NSString *> *actions, void (^reply)(NSString *action)) {
+        XCTAssertTrue([NSThread isMainThread], @"");
+        XCTAssertEqualObjects(message, @"Reload the project?", @"");
+        XCTAssertEqual(type, LSPMessageTypeWarning, @"");
+        XCTAssertEqualObjects(actions, ([NSArray arrayWithObjects:@"Reload", @"Ignore", nil]), @"");
+        pendingReply = reply;
+    }];
+    [client addObserver:observer];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+
+    NSArray *actionItems = [NSArray arrayWithObjects:
+                            [NSDictionary dictionaryWithObjectsAndKeys:@"Reload", @"title", nil],
+                            [NSDictionary dictionaryWithObjectsAndKeys:@"Ignore", @"title", nil],
+                            nil];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:
+                            [NSNumber numberWithInteger:LSPMessageTypeWarning], @"type",
+                            @"Reload the project?", @"message",
+                            actionItems, @"actions",
+                            nil];
+    [self sendStubRequest:@"stub/showMessageRequest" params:params toClient:client];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return pendingReply != nil;
+    } timeout:10.0], @"");
+    // The server waits for the host to choose.
+    XCTAssertEqualObjects([[self statisticsOfClient:client] objectForKey:@"responses"], [NSNumber numberWithUnsignedInteger:0], @"");
+
+    pendingReply(@"Reload");
+    pendingReply(@"Ignore");
+    NSDictionary *statistics = [self statisticsOfClient:client];
+    XCTAssertEqualObjects([statistics objectForKey:@"responses"], [NSNumber numberWithUnsignedInteger:1], @"");
+    XCTAssertEqualObjects([statistics objectForKey:@"lastResponseResult"], [actionItems firstObject], @"");
+    [client removeObserver:observer];
+    [client terminate];
+}
+
 - (void)testLSPPositon {
     LSPPosition *position1 = [LSPPosition positionForCharacterAtIndex:0 inText:@""];
     XCTAssertEqual(position1.line, 0, @"");
@@ -187,6 +900,14 @@
     LSPPosition *position4 = [LSPPosition positionForCharacterAtIndex:5 inText:@"\n\n123"];
     XCTAssertEqual(position4.line, 2, @"");
     XCTAssertEqual(position4.character, 3, @"");
+    // The end of a string ending with a line terminator is on the last line.
+    LSPPosition *position5 = [LSPPosition positionForCharacterAtIndex:2 inText:@"a\n"];
+    XCTAssertEqual(position5.line, 0, @"");
+    XCTAssertEqual(position5.character, 2, @"");
+    LSPRange *range = [LSPRange range:NSMakeRange(0, 2) inText:@"a\n"];
+    XCTAssertEqual(range.end.line, 0, @"");
+    XCTAssertEqual(range.end.character, 2, @"");
+    XCTAssertTrue(NSEqualRanges([range convertToRangeInText:@"a\n"], NSMakeRange(0, 2)), @"");
 }
 
 @end
@@ -0,0 +1,295 @@
+//
+//  LSPCompletionListTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "XCTestCase+LSPStubServer.h"
+
+@interface LSPCompletionList (Merging)
+- (LSPCompletionList *)completionListByInsertingItemsOfList:(LSPCompletionList *)completionList atIndex:(NSUInteger)index incomplete:(BOOL)incomplete;
+@end
+
+@interface LSPCompletionListTests : XCTestCase
+@end
+
+@implementation LSPCompletionListTests
+
+- (NSDictionary *)itemWithLabel:(NSString *)label sortText:(NSString *)sortText {
+    return [NSDictionary dictionaryWithObjectsAndKeys:
+            label, @"label",
+            [NSNumber numberWithInteger:LSPCompletionItemKindFunction], @"kind",
+            [NSString stringWithFormat:@"func %@()", label], @"detail",
+            sortText, @"sortText",
+            nil];
+}
+
+- (void)testItemsAreDecodedWhenAccessed {
+    NSArray *items = [NSArray arrayWithObjects:
+                      [self itemWithLabel:@"forEach" sortText:nil],
+                      @"not an item",
+                      [NSDictionary dictionaryWithObjectsAndKeys:@"format", @"label", nil],
+                      nil];
+    LSPCompletionList *list = [[LSPCompletionList alloc] initWithItems:items incomplete:YES];
+    XCTAssertEqual([list count], 2, @"");
+    XCTAssertTrue([list isIncomplete], @"");
+    XCTAssertEqualObjects([list labels], ([NSArray arrayWithObjects:@"forEach", @"format", nil]), @"");
+    XCTAssertEqual([list kindAtIndex:0], LSPCompletionItemKindFunction, @"");
+    XCTAssertEqual([list kindAtIndex:1], 0, @"");
+
+    LSPCompletionItem *item = [list objectAtIndex:0];
+    XCTAssertEqualObjects([item detail], @"func forEach()", @"");
+    XCTAssertEqual([list objectAtIndex:0], item, @"");
+    XCTAssertEqual([list copy], list, @"");
+    XCTAssertThrows([list labelAtIndex:2], @"");
+}
+
+- (void)testFilterByWord {
+    NSArray *items = [NSArray arrayWithObjects:
+                      [self itemWithLabel:@"afford" sortText:@"1"],
+                      [self itemWithLabel:@"format" sortText:@"3"],
+                      [self itemWithLabel:@"bar" sortText:@"0"],
+                      [self itemWithLabel:@"Foo_bar" sortText:@"2"],
+                      [self itemWithLabel:@"fixOne" sortText:@"4"],
+                      nil];
+    LSPCompletionList *list = [[LSPCompletionList alloc] initWithItems:items incomplete:NO];
+
+    // Prefix matches ignoring ASCII case, then fuzzy matches starting with
+    // the first character, then the other fuzzy matches.
+    LSPCompletionList *filtered = [list completionListFilteredByWord:@"fo"];
+    XCTAssertEqualObjects([filtered labels], ([NSArray arrayWithObjects:@"Foo_bar", @"format", @"fixOne", @"afford", nil]), @"");
+    XCTAssertEqualObjects([[filtered objectAtIndex:1] label], @"format", @"");
+    XCTAssertFalse([filtered isIncomplete], @"");
+
+    XCTAssertEqualObjects([[filtered completionListFilteredByWord:@"FOR"] labels], ([NSArray arrayWithObjects:@"format", @"Foo_bar", @"afford", nil]), @"");
+    XCTAssertEqual([[list completionListFilteredByWord:@"xyz"] count], 0, @"");
+    XCTAssertEqualObjects([[list completionListFilteredByWord:@""] labels], ([NSArray arrayWithObjects:@"bar", @"afford", @"Foo_bar", @"format", @"fixOne", nil]), @"");
+}
+
+- (void)testFilterLargeList {
+    NSMutableArray *items = [NSMutableArray array];
+    for (NSUInteger index = 0; index < 10000; index++) {
+        [items addObject:[self itemWithLabel:[NSString stringWithFormat:@"symbol%05lu", (unsigned long)index] sortText:nil]];
+    }
+    LSPCompletionList *list = [[LSPCompletionList alloc] initWithItems:items incomplete:NO];
+    [self measureBlock:^{
+        XCTAssertEqualObjects([[list completionListFilteredByWord:@"symbol0001"] labelAtIndex:0], @"symbol00010", @"");
+        XCTAssertEqualObjects([[list completionListFilteredByWord:@"s99"] labelAtIndex:0], @"symbol00099", @"");
+    }];
+}
+
+- (NSUInteger)handledRequestCountOfClient:(LSPClient *)client {
+    return [[[self statisticsOfClient:client] objectForKey:@"handled"] unsignedIntegerValue];
+}
+
+- (void)testMergedListIsFilteredLikeBuiltList {
+    NSArray *items1 = [NSArray arrayWithObjects:
+                       [self itemWithLabel:@"afford" sortText:@"1"],
+                       [self itemWithLabel:@"format" sortText:@"3"],
+                       nil];
+    NSArray *items2 = [NSArray arrayWithObjects:
+                       [self itemWithLabel:@"bar" sortText:@"0"],
+                       [self itemWithLabel:@"Foo_bar" sortText:@"2"],
+                       [self itemWithLabel:@"fixOne" sortText:@"1"],
+                       [self itemWithLabel:@"forEach" sortText:@"3"],
+                       nil];
+    NSArray *items3 = [NSArray arrayWithObject:[self itemWithLabel:@"for" sortText:@"1"]];
+    LSPCompletionList *list1 = [[LSPCompletionList alloc] initWithItems:items1 incomplete:NO];
+    LSPCompletionList *list3 = [[LSPCompletionList alloc] initWithItems:items3 incomplete:YES];
+    // A filtered list is merged with its items in the filtered order.
+    LSPCompletionList *list2 = [[[LSPCompletionList alloc] initWithItems:items2 incomplete:NO] completionListFilteredByWord:@"f"];
+    XCTAssertEqualObjects([list2 labels], ([NSArray arrayWithObjects:@"fixOne", @"Foo_bar", @"forEach", nil]), @"");
+
+    // The lists answered in the order 3, 1, 2.
+    LSPCompletionList *merged = [list3 completionListByInsertingItemsOfList:list1 atIndex:0 incomplete:NO];
+    merged = [merged completionListByInsertingItemsOfList:list2 atIndex:[list1 count] incomplete:YES];
+    NSMutableArray *items = [NSMutableArray arrayWithArray:items1];
+    [items addObject:[items2 objectAtIndex:2]];
+    [items addObject:[items2 objectAtIndex:1]];
+    [items addObject:[items2 objectAtIndex:3]];
+    [items addObjectsFromArray:items3];
+    LSPCompletionList *built = [[LSPCompletionList alloc] initWithItems:items incomplete:YES];
+    XCTAssertTrue([merged isIncomplete], @"");
+    XCTAssertEqualObjects([merged labels], [built labels], @"");
+    XCTAssertEqualObjects([[merged objectAtIndex:3] detail], @"func Foo_bar()", @"");
+    for (NSString *word in [NSArray arrayWithObjects:@"", @"f", @"fo", @"FOR", @"ar", @"x", nil]) {
+        XCTAssertEqualObjects([[merged completionListFilteredByWord:word] labels], [[built completionListFilteredByWord:word] labels], @"%@", word);
+    }
+}
+
+- (void)testCompleteListIsFilteredWhileTyping {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:completion.txt"];
+    NSMutableString *text = [NSMutableString stringWithString:@"call comp"];
+    // 100 items of about 64 bytes, labeled completion000000 to completion000099.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"6400", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:text];
+
+    __block LSPCompletionList *result = nil;
+    void (^complete)(void) = ^{
+        XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"completion"];
+        [client documentCompletionList:url inText:text forCharacterAtIndex:[text length] completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+            XCTAssertNil(error, @"");
+            result = completionList;
+            [expectation fulfill];
+        }];
+        [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    };
+    void (^type)(NSString *) = ^(NSString *string) {
+        [client document:url changeTextInRange:NSMakeRange([text length], 0) replacementString:string];
+        [text appendString:string];
+    };
+
+    complete();
+    XCTAssertEqual([result count], 100, @"");
+    XCTAssertEqual([self handledRequestCountOfClient:client], 1, @"");
+
+    // The labels starting with the word come first, then the ones that only
+    // contain its characters in order.
+    type(@"letion00005");
+    complete();
+    XCTAssertEqual([result count], 19, @"");
+    XCTAssertEqualObjects([result labelAtIndex:0], @"completion000050", @"");
+    XCTAssertEqualObjects([result labelAtIndex:9], @"completion000059", @"");
+    XCTAssertEqualObjects([result labelAtIndex:10], @"completion000005", @"");
+    XCTAssertEqual([self handledRequestCountOfClient:client], 1, @"");
+
+    // A new word needs a new list.
+    type(@" x");
+    complete();
+    XCTAssertEqual([result count], 100, @"");
+    XCTAssertEqual([self handledRequestCountOfClient:client], 2, @"");
+
+    // So does a word shorter than the one the list was requested for.
+    [client document:url changeTextInRange:NSMakeRange([text length] - 1, 1) replacementString:@""];
+    [text deleteCharactersInRange:NSMakeRange([text length] - 1, 1)];
+    complete();
+    XCTAssertEqual([self handledRequestCountOfClient:client], 3, @"");
+    [client terminate];
+}
+
+- (void)testOtherEditsEndCompletionSession {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:session.txt"];
+    NSMutableString *text = [NSMutableString stringWithString:@"call comp\nfoo"];
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"6400", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:text];
+
+    void (^complete)(NSUInteger) = ^(NSUInteger characterIndex) {
+        XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"completion"];
+        [client documentCompletionList:url inText:text forCharacterAtIndex:characterIndex completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+            XCTAssertNil(error, @"");
+            [expectation fulfill];
+        }];
+        [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    };
+    void (^replace)(NSRange, NSString *) = ^(NSRange range, NSString *string) {
+        [client document:url changeTextInRange:range replacementString:string];
+        [text replaceCharactersInRange:range withString:string];
+    };
+
+    complete(9);
+    XCTAssertEqual([self handledRequestCountOfClient:client], 1, @"");
+
+    // A word replaced by one of the same length needs a new list.
+    replace(NSMakeRange(5, 4), @"xomp");
+    complete(9);
+    XCTAssertEqual([self handledRequestCountOfClient:client], 2, @"");
+
+    // Typing on in the word keeps the list.
+    replace(NSMakeRange(9, 0), @"l");
+    complete(10);
+    XCTAssertEqual([self handledRequestCountOfClient:client], 2, @"");
+
+    // An edit elsewhere in the document ends it.
+    replace(NSMakeRange([text length], 0), @"d");
+    complete(10);
+    XCTAssertEqual([self handledRequestCountOfClient:client], 3, @"");
+    [client terminate];
+}
+
+- (void)testResolveVisibleItems {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"completion"];
+    NSURL *url = [NSURL URLWithString:@"untitled:resolve.txt"];
+    NSString *text = @"call comp";
+    // Every request takes 50 ms, prefetches queue up in the server.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"6400", @"--delay", @"0.05", nil]];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    XCTAssertTrue([client hasCompletionResolveProvider], @"");
+    [client documentDidOpen:url content:text];
+
+    __block LSPCompletionList *list = nil;
+    [client documentCompletionList:url inText:text forCharacterAtIndex:[text length] completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+        list = completionList;
+        [expectation2 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    XCTAssertEqual([list count], 100, @"");
+
+    // Scrolling on cancels the prefetches of the first page.
+    [client prefetchResolvedCompletionItemsInRange:NSMakeRange(0, 10) ofCompletionList:list];
+    [client prefetchResolvedCompletionItemsInRange:NSMakeRange(50, 10) ofCompletionList:list];
+    XCTestExpectation *expectation3 = [[XCTestExpectation alloc] initWithDescription:@"resolve"];
+    __block LSPCompletionItem *resolvedItem = nil;
+    [client resolveCompletionItemAtIndex:59 ofCompletionList:list completionHandler:^(LSPCompletionItem *item, NSError *error) {
+        XCTAssertNil(error, @"");
+        resolvedItem = item;
+        [expectation3 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation3] timeout:10.0];
+    XCTAssertEqualObjects([resolvedItem label], @"completion000059", @"");
+    XCTAssertEqualObjects([resolvedItem documentation], @"documentation of completion000059", @"");
+    XCTAssertNil([[list objectAtIndex:59] documentation], @"");
+    NSDictionary *statistics = [self statisticsOfClient:client];
+    NSUInteger resolved = [[statistics objectForKey:@"resolved"] unsignedIntegerValue];
+    XCTAssertGreaterThan([[statistics objectForKey:@"cancelled"] unsignedIntegerValue], 0, @"");
+    XCTAssertEqual(resolved + [[statistics objectForKey:@"cancelled"] unsignedIntegerValue], 20, @"");
+
+    // The prefetched items are resolved for the filtered lists as well.
+    LSPCompletionList *filtered = [list completionListFilteredByWord:@"completion00005"];
+    XCTestExpectation *expectation4 = [[XCTestExpectation alloc] initWithDescription:@"cached"];
+    [client resolveCompletionItemAtIndex:0 ofCompletionList:filtered completionHandler:^(LSPCompletionItem *item, NSError *error) {
+        XCTAssertEqualObjects([item documentation], @"documentation of completion000050", @"");
+        [expectation4 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation4] timeout:10.0];
+
+    // Resolving an item in flight shares the request.
+    XCTestExpectation *expectation5 = [[XCTestExpectation alloc] initWithDescription:@"shared"];
+    expectation5.expectedFulfillmentCount = 2;
+    LSPRequest *request = [client resolveCompletionItemAtIndex:70 ofCompletionList:list completionHandler:^(LSPCompletionItem *item, NSError *error) {
+        XCTFail(@"The request was cancelled");
+    }];
+    for (NSUInteger index = 0; index < 2; index++) {
+        [client resolveCompletionItemAtIndex:70 ofCompletionList:list completionHandler:^(LSPCompletionItem *item, NSError *error) {
+            XCTAssertEqualObjects([item documentation], @"documentation of completion000070", @"");
+            [expectation5 fulfill];
+        }];
+    }
+    [request cancel];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation5] timeout:10.0];
+    XCTAssertEqual([[[self statisticsOfClient:client] objectForKey:@"resolved"] unsignedIntegerValue], resolved + 1, @"");
+    [client terminate];
+}
+
+@end
@@ -0,0 +1,186 @@
+//
+//  LSPCompositeClientTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "XCTestCase+LSPStubServer.h"
+
+
+
+@interface CompositeDiagnosticsObserver : NSObject <LSPClientObserver>
+@property NSMutableArray<LSPDiagnosticsDelta *> *deltas;
+@end
+
+@implementation CompositeDiagnosticsObserver
+
+- (void)languageServer:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta {
+    [_deltas addObject:delta];
+}
+
+@end
+
+
+
+@interface LSPCompositeClientTests : XCTestCase
+@end
+
+@implementation LSPCompositeClientTests
+
+- (void)testFanOutAndMerge {
+    NSURL *url = [NSURL URLWithString:@"untitled:composite.txt"];
+    // A slow server with two completion items, a fast one with three, and a
+    // linter without completion and hover.
+    LSPClient *language = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"0.2", @"--response-size", @"128", nil]];
+    LSPClient *second = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"192", @"--diagnostics", nil]];
+    LSPClient *linter = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--diagnostics", @"--without", @"completionProvider", @"--without", @"hoverProvider", nil]];
+    LSPCompositeClient *client = [[LSPCompositeClient alloc] initWithClients:[NSArray arrayWithObjects:language, second, linter, nil]];
+    CompositeDiagnosticsObserver *observer = [[CompositeDiagnosticsObserver alloc] init];
+    [observer setDeltas:[NSMutableArray array]];
+    [client addObserver:observer forURI:url];
+
+    // The document and the request wait for the clients to be initialized.
+    [client documentDidOpen:url content:@"one two"];
+    NSMutableArray<LSPCompletionList *> *partialLists = [NSMutableArray array];
+    __block LSPCompletionList *mergedList = nil;
+    [client documentCompletion:url inText:@"one two" forCharacterAtIndex:3 partialResultHandler:^(LSPCompletionList *completionList) {
+        XCTAssertTrue([NSThread isMainThread], @"");
+        [partialLists addObject:completionList];
+    } completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+        XCTAssertNil(error, @"");
+        XCTAssertFalse(isIncomplete, @"");
+        mergedList = completionList;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return mergedList != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqualObjects([client clientsProvidingMethod:@"textDocument/completion"], ([NSArray arrayWithObjects:language, second, nil]), @"");
+    // The fast server came first, the merged list is in the order of the clients.
+    XCTAssertEqual([partialLists count], 1, @"");
+    XCTAssertEqual([[partialLists firstObject] count], 3, @"");
+    XCTAssertEqual([mergedList count], 5, @"");
+    XCTAssertEqualObjects([mergedList labelAtIndex:2], @"completion000000", @"");
+
+    // Resolving goes to the server of the item.
+    __block LSPCompletionItem *resolvedItem = nil;
+    [client resolveCompletionItemAtIndex:3 ofCompletionList:mergedList completionHandler:^(LSPCompletionItem *item, NSError *error) {
+        resolvedItem = item;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return resolvedItem != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqualObjects([resolvedItem documentation], @"documentation of completion000001", @"");
+    XCTAssertEqualObjects([[self sendStubRequest:@"stub/statistics" params:nil toClient:second] objectForKey:@"resolved"], [NSNumber numberWithUnsignedInteger:1], @"");
+    XCTAssertEqualObjects([[self sendStubRequest:@"stub/statistics" params:nil toClient:language] objectForKey:@"resolved"], [NSNumber numberWithUnsignedInteger:0], @"");
+
+    // The diagnostics of both servers that publish are merged.
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [[[[observer deltas] lastObject] diagnostics] count] == 2;
+    } timeout:10.0], @"");
+    XCTAssertEqual([[client diagnosticsForURI:url] count], 2, @"");
+
+    // Every server sees the same edits.
+    [client document:url changeTextInRange:NSMakeRange(3, 0) replacementString:@" three"];
+    [client documentDidChange:url];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:[url absoluteString], @"uri", nil];
+    for (LSPClient *backingClient in [client clients]) {
+        XCTAssertEqualObjects([self sendStubRequest:@"stub/text" params:params toClient:backingClient], @"one three two", @"");
+    }
+
+    // The hover of the first server wins, even though the second one answers first.
+    __block NSDictionary *hover = nil;
+    [client documentHoverWithContentsOfURL:url inText:@"one three two" forCharacterAtIndex:5 completionHandler:^(NSDictionary *dict, NSError *error) {
+        XCTAssertNil(error, @"");
+        hover = dict;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return hover != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqual([[[hover objectForKey:@"contents"] objectForKey:@"value"] length], 128, @"");
+
+    [client documentDidClose:url];
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+- (void)testCompletionListOfSingleServerIsReleased {
+    NSURL *url = [NSURL URLWithString:@"untitled:single.txt"];
+    LSPClient *language = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"128", nil]];
+    LSPCompositeClient *client = [[LSPCompositeClient alloc] initWithClients:[NSArray arrayWithObject:language]];
+    [client documentDidOpen:url content:@"one two"];
+    __weak LSPCompletionList *weakList = nil;
+    @autoreleasepool {
+        __block LSPCompletionList *mergedList = nil;
+        [client documentCompletion:url inText:@"one two" forCharacterAtIndex:3 partialResultHandler:nil completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+            XCTAssertNil(error, @"");
+            mergedList = completionList;
+        }];
+        XCTAssertTrue([self runUntil:^BOOL{
+            return mergedList != nil;
+        } timeout:10.0], @"");
+        XCTAssertEqual([mergedList count], 2, @"");
+        weakList = mergedList;
+        mergedList = nil;
+    }
+    // The completion session of the document keeps the list, the sources do not.
+    XCTAssertNotNil(weakList, @"");
+    [client documentDidClose:url];
+    XCTAssertNil(weakList, @"");
+    [client terminate];
+}
+
+- (void)testDroppedReplyCompletesRequest {
+    NSURL *url = [NSURL URLWithString:@"untitled:dropped.txt"];
+    // The slow server would answer long after the fast one.
+    LSPClient *slow = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"2.0", @"--response-size", @"128", nil]];
+    LSPClient *fast = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"192", nil]];
+    LSPCompositeClient *client = [[LSPCompositeClient alloc] initWithClients:[NSArray arrayWithObjects:slow, fast, nil]];
+    [client documentDidOpen:url content:@"one two"];
+    __block LSPCompletionList *mergedList = nil;
+    [client documentCompletion:url inText:@"one two" forCharacterAtIndex:3 partialResultHandler:nil completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
+        XCTAssertNil(error, @"");
+        mergedList = completionList;
+    }];
+    NSMutableDictionary *replaceableRequests = [slow valueForKey:@"replaceableRequests"];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [replaceableRequests count] > 0;
+    } timeout:10.0], @"");
+
+    // The slow server modified the content meanwhile, the fast one has the only result.
+    [self receiveErrorCode:LSPResponseContentModified forRequest:[[replaceableRequests allValues] firstObject] ofClient:slow];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return mergedList != nil;
+    } timeout:1.0], @"");
+    XCTAssertEqual([mergedList count], 3, @"");
+    [client documentDidClose:url];
+    [client terminate];
+}
+
+- (void)testFirstHoverCancelsTheOthers {
+    NSURL *url = [NSURL URLWithString:@"untitled:hover.txt"];
+    LSPClient *fast = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--response-size", @"128", nil]];
+    LSPClient *slow = [self stubServerWithArguments:[NSArray arrayWithObjects:@"--delay", @"2.0", @"--response-size", @"192", nil]];
+    LSPCompositeClient *client = [[LSPCompositeClient alloc] initWithClients:[NSArray arrayWithObjects:fast, slow, nil]];
+    [client documentDidOpen:url content:@"one two"];
+    __block NSDictionary *hover = nil;
+    [client documentHoverWithContentsOfURL:url inText:@"one two" forCharacterAtIndex:1 completionHandler:^(NSDictionary *dict, NSError *error) {
+        XCTAssertNil(error, @"");
+        hover = dict;
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return hover != nil;
+    } timeout:10.0], @"");
+    XCTAssertEqual([[[hover objectForKey:@"contents"] objectForKey:@"value"] length], 128, @"");
+    // The server handles the statistics after the cancelled hover.
+    XCTAssertEqualObjects([[self sendStubRequest:@"stub/statistics" params:nil toClient:slow] objectForKey:@"cancelled"], [NSNumber numberWithUnsignedInteger:1], @"");
+    XCTAssertEqual([[client valueForKey:@"pendingClientRequests"] count], 0, @"");
+    [client documentDidClose:url];
+    [client terminate];
+}
+
+@end
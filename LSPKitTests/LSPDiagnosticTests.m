@@ -0,0 +1,66 @@
+//
+//  LSPDiagnosticTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+
+static NSString *LSPScriptWithNumberOfLines(NSUInteger numberOfLines) {
+    NSMutableString *script = [NSMutableString stringWithCapacity:numberOfLines * 40];
+    for (NSUInteger line = 0; line < numberOfLines; line++) {
+        [script appendFormat:@"echo \"line %lu of the benchmark script\"\n", (unsigned long)line];
+    }
+    return script;
+}
+
+/** Diagnostics in random order, the way a linter reports them grouped by rule. */
+static NSArray<LSPDiagnostic *> *LSPRandomDiagnostics(NSUInteger count, NSUInteger numberOfLines) {
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        NSUInteger line = (NSUInteger)random() % numberOfLines;
+        NSUInteger character = (NSUInteger)random() % 30;
+        NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                               [[LSPPosition positionWithLine:line character:character] params], @"start",
+                               [[LSPPosition positionWithLine:line character:character + 4] params], @"end",
+                               nil];
+        NSDictionary *diagnostic = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    range, @"range",
+                                    [NSNumber numberWithInteger:LSPDiagnosticSeverityWarning], @"severity",
+                                    @"shellcheck", @"source",
+                                    @"Double quote to prevent globbing and word splitting.", @"message",
+                                    nil];
+        [array addObject:diagnostic];
+    }
+    return [LSPDiagnostic diagnosticsFromArray:array];
+}
+
+@interface LSPDiagnosticTests : XCTestCase
+@end
+
+@implementation LSPDiagnosticTests
+
+- (void)testResolveCharacterRanges {
+    NSString *text = LSPScriptWithNumberOfLines(100);
+    srandom(3);
+    NSArray<LSPDiagnostic *> *diagnostics = LSPRandomDiagnostics(200, 110);
+    XCTAssertEqual([[diagnostics firstObject] characterRange].location, NSNotFound, @"");
+    [LSPDiagnostic resolveCharacterRangesOfDiagnostics:diagnostics inText:text];
+    for (LSPDiagnostic *diagnostic in diagnostics) {
+        NSRange range = [[diagnostic range] convertToRangeInText:text];
+        XCTAssertTrue(NSEqualRanges([diagnostic characterRange], range), @"%@", diagnostic);
+    }
+    
+    NSRange *characterRanges = malloc([diagnostics count] * sizeof(NSRange));
+    [LSPRange getCharacterRanges:characterRanges forRanges:[diagnostics valueForKey:@"range"] inText:text];
+    for (NSUInteger index = 0; index < [diagnostics count]; index++) {
+        XCTAssertTrue(NSEqualRanges(characterRanges[index], [[diagnostics objectAtIndex:index] characterRange]), @"");
+    }
+    free(characterRanges);
+}
+
+@end
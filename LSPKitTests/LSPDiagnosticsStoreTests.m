@@ -0,0 +1,179 @@
+//
+//  LSPDiagnosticsStoreTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "XCTestCase+LSPStubServer.h"
+
+@interface LSPDiagnosticsStore (Updating)
+- (LSPDiagnosticsDelta *)setDiagnostics:(NSArray<LSPDiagnostic *> *)diagnostics forURI:(NSURL *)uri;
+- (void)document:(NSURL *)uri didReplaceCharactersInRange:(NSRange)range withLength:(NSUInteger)length;
+@end
+
+
+
+@interface DiagnosticsDeltaObserver : NSObject <LSPClientObserver>
+@property (copy) void (^handler)(LSPDiagnosticsDelta *delta);
+@end
+
+@implementation DiagnosticsDeltaObserver
+
+- (void)languageServer:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta {
+    _handler(delta);
+}
+
+@end
+
+
+
+@interface LSPDiagnosticsStoreTests : XCTestCase
+@end
+
+@implementation LSPDiagnosticsStoreTests
+
+- (LSPDiagnostic *)diagnosticOnLine:(NSUInteger)line from:(NSUInteger)start to:(NSUInteger)end severity:(LSPDiagnosticSeverity)severity message:(NSString *)message {
+    NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [[LSPPosition positionWithLine:line character:start] params], @"start",
+                           [[LSPPosition positionWithLine:line character:end] params], @"end",
+                           nil];
+    return [LSPDiagnostic diagnosticFromDictionary:[NSDictionary dictionaryWithObjectsAndKeys:
+                                                    range, @"range",
+                                                    [NSNumber numberWithInteger:severity], @"severity",
+                                                    message, @"message",
+                                                    nil]];
+}
+
+- (void)testDeltasAndEdits {
+    NSURL *uri = [NSURL URLWithString:@"untitled:store.sh"];
+    NSMutableString *text = [NSMutableString stringWithString:@"echo $a\necho $b\n"];
+    LSPDiagnosticsStore *store = [[LSPDiagnosticsStore alloc] init];
+    NSArray *diagnostics = [NSArray arrayWithObjects:
+                            [self diagnosticOnLine:0 from:5 to:7 severity:LSPDiagnosticSeverityWarning message:@"Double quote $a"],
+                            [self diagnosticOnLine:1 from:5 to:7 severity:LSPDiagnosticSeverityError message:@"$b is not set"],
+                            nil];
+    [LSPDiagnostic resolveCharacterRangesOfDiagnostics:diagnostics inText:text];
+    LSPDiagnosticsDelta *delta = [store setDiagnostics:diagnostics forURI:uri];
+    XCTAssertEqual([[delta addedDiagnostics] count], 2, @"");
+    XCTAssertEqual([[delta removedDiagnostics] count], 0, @"");
+    XCTAssertEqual([store countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityWarning], 1, @"");
+    XCTAssertEqual([store countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityError], 1, @"");
+    LSPDiagnostic *warning = [diagnostics objectAtIndex:0];
+
+    // The ranges follow the edits until the server publishes again.
+    [text insertString:@"xx" atIndex:0];
+    [store document:uri didReplaceCharactersInRange:NSMakeRange(0, 0) withLength:2];
+    XCTAssertEqual([warning characterRange].location, 7, @"");
+    XCTAssertEqual([[diagnostics objectAtIndex:1] characterRange].location, 15, @"");
+    XCTAssertEqualObjects([store diagnosticsForURI:uri inCharacterRange:NSMakeRange(0, 8)], [NSArray arrayWithObject:warning], @"");
+    XCTAssertEqualObjects([store diagnosticsForURI:uri inCharacterRange:NSMakeRange(9, 0)], [NSArray arrayWithObject:warning], @"");
+    XCTAssertEqual([[store diagnosticsForURI:uri inCharacterRange:NSMakeRange(10, 4)] count], 0, @"");
+
+    NSArray *published = [NSArray arrayWithObjects:
+                          [self diagnosticOnLine:0 from:7 to:9 severity:LSPDiagnosticSeverityWarning message:@"Double quote $a"],
+                          [self diagnosticOnLine:1 from:5 to:7 severity:LSPDiagnosticSeverityWarning message:@"Double quote $b"],
+                          nil];
+    [LSPDiagnostic resolveCharacterRangesOfDiagnostics:published inText:text];
+    delta = [store setDiagnostics:published forURI:uri];
+    XCTAssertEqualObjects([delta unchangedDiagnostics], [NSArray arrayWithObject:warning], @"");
+    XCTAssertEqual([[delta diagnostics] objectAtIndex:0], warning, @"");
+    XCTAssertEqualObjects([delta addedDiagnostics], [NSArray arrayWithObject:[published objectAtIndex:1]], @"");
+    XCTAssertEqualObjects([delta removedDiagnostics], [NSArray arrayWithObject:[diagnostics objectAtIndex:1]], @"");
+    XCTAssertEqual([store countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityWarning], 2, @"");
+    XCTAssertEqual([store countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityError], 0, @"");
+
+    // Deleting the text of a diagnostic leaves it empty where the text was.
+    [store document:uri didReplaceCharactersInRange:NSMakeRange(6, 4) withLength:0];
+    XCTAssertTrue(NSEqualRanges([warning characterRange], NSMakeRange(6, 0)), @"");
+
+    __block NSUInteger count = 0;
+    [store enumerateDiagnosticsWithSeverity:LSPDiagnosticSeverityWarning usingBlock:^(NSURL *diagnosticURI, LSPDiagnostic *diagnostic, BOOL *stop) {
+        XCTAssertEqualObjects(diagnosticURI, uri, @"");
+        count++;
+    }];
+    XCTAssertEqual(count, 2, @"");
+
+    delta = [store setDiagnostics:[NSArray array] forURI:uri];
+    XCTAssertEqual([[delta removedDiagnostics] count], 2, @"");
+    XCTAssertEqual([[store URIs] count], 0, @"");
+    XCTAssertEqual([store countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityWarning], 0, @"");
+}
+
+- (void)testUnchangedDiagnosticTakesPublishedRange {
+    NSURL *uri = [NSURL URLWithString:@"untitled:moved.sh"];
+    NSMutableString *text = [NSMutableString stringWithString:@"echo $a\n"];
+    LSPDiagnosticsStore *store = [[LSPDiagnosticsStore alloc] init];
+    LSPDiagnostic *warning = [self diagnosticOnLine:0 from:5 to:7 severity:LSPDiagnosticSeverityWarning message:@"Double quote $a"];
+    [LSPDiagnostic resolveCharacterRangesOfDiagnostics:[NSArray arrayWithObject:warning] inText:text];
+    [store setDiagnostics:[NSArray arrayWithObject:warning] forURI:uri];
+
+    // A line inserted above moves the diagnostic to the next line.
+    [text insertString:@"set -u\n" atIndex:0];
+    [store document:uri didReplaceCharactersInRange:NSMakeRange(0, 0) withLength:7];
+    XCTAssertEqual([[[warning range] start] line], 0, @"");
+    LSPDiagnostic *published = [self diagnosticOnLine:1 from:5 to:7 severity:LSPDiagnosticSeverityWarning message:@"Double quote $a"];
+    [LSPDiagnostic resolveCharacterRangesOfDiagnostics:[NSArray arrayWithObject:published] inText:text];
+    LSPDiagnosticsDelta *delta = [store setDiagnostics:[NSArray arrayWithObject:published] forURI:uri];
+    XCTAssertEqualObjects([delta unchangedDiagnostics], [NSArray arrayWithObject:warning], @"");
+    XCTAssertEqual([[delta addedDiagnostics] count], 0, @"");
+    XCTAssertEqual([[[warning range] start] line], 1, @"");
+    XCTAssertEqual([[[warning range] start] character], 5, @"");
+    XCTAssertEqual([[[warning range] end] line], 1, @"");
+    XCTAssertTrue(NSEqualRanges([warning characterRange], NSMakeRange(12, 2)), @"");
+}
+
+- (void)testClientPublishesDeltas {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:deltas.txt"];
+    NSMutableArray<LSPDiagnosticsDelta *> *deltas = [NSMutableArray array];
+    __block XCTestExpectation *published = nil;
+    DiagnosticsDeltaObserver *observer = [[DiagnosticsDeltaObserver alloc] init];
+    [observer setHandler:^(LSPDiagnosticsDelta *delta) {
+        XCTAssertTrue([NSThread isMainThread], @"");
+        [deltas addObject:delta];
+        [published fulfill];
+    }];
+    // The stub publishes one diagnostic with the length of the document as message.
+    LSPClient *client = [self stubServerWithArguments:[NSArray arrayWithObject:@"--diagnostics"]];
+    [client addObserver:observer];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+
+    void (^waitForDiagnostics)(void) = ^{
+        published = [[XCTestExpectation alloc] initWithDescription:@"published"];
+        [self waitForExpectations:[NSArray arrayWithObject:published] timeout:10.0];
+        published = nil;
+    };
+    [client documentDidOpen:url content:@"abc"];
+    waitForDiagnostics();
+    XCTAssertEqual([[[deltas lastObject] addedDiagnostics] count], 1, @"");
+    LSPDiagnostic *diagnostic = [[[deltas lastObject] addedDiagnostics] firstObject];
+    XCTAssertEqualObjects([diagnostic message], @"3", @"");
+    XCTAssertEqualObjects([[client diagnosticsStore] diagnosticsForURI:url], [NSArray arrayWithObject:diagnostic], @"");
+
+    // The same diagnostic again is unchanged.
+    [client document:url changeTextInRange:NSMakeRange(2, 1) replacementString:@"d"];
+    [client documentDidChange:url];
+    waitForDiagnostics();
+    XCTAssertEqualObjects([[deltas lastObject] unchangedDiagnostics], [NSArray arrayWithObject:diagnostic], @"");
+    XCTAssertEqual([[[deltas lastObject] addedDiagnostics] count], 0, @"");
+
+    [client document:url changeTextInRange:NSMakeRange(3, 0) replacementString:@"e"];
+    [client documentDidChange:url];
+    waitForDiagnostics();
+    XCTAssertEqualObjects([[deltas lastObject] removedDiagnostics], [NSArray arrayWithObject:diagnostic], @"");
+    XCTAssertEqualObjects([[[[deltas lastObject] addedDiagnostics] firstObject] message], @"4", @"");
+    XCTAssertEqual([[client diagnosticsStore] countOfDiagnosticsWithSeverity:LSPDiagnosticSeverityInformation], 1, @"");
+    [client removeObserver:observer];
+    [client terminate];
+}
+
+@end
@@ -0,0 +1,135 @@
+//
+//  LSPLineIndexTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+
+/** Line starts the way the line index was computed before, with -lineRangeForRange:. */
+static NSArray<NSNumber *> *LSPLineStartsOfString(NSString *string) {
+    NSMutableArray *lineStarts = [NSMutableArray arrayWithObject:[NSNumber numberWithUnsignedInteger:0]];
+    NSUInteger index = 0, length = [string length];
+    while (index < length) {
+        index = NSMaxRange([string lineRangeForRange:NSMakeRange(index, 0)]);
+        // -lineRangeForRange: has no empty last line.
+        [lineStarts addObject:[NSNumber numberWithUnsignedInteger:index]];
+    }
+    if ([lineStarts count] > 1 && [[lineStarts lastObject] unsignedIntegerValue] == length) {
+        unichar c = [string characterAtIndex:length - 1];
+        BOOL endsWithLineTerminator = (c == '\n' || c == '\r' || c == 0x85 || c == 0x2028 || c == 0x2029);
+        if (endsWithLineTerminator == NO) {
+            [lineStarts removeLastObject];
+        }
+    }
+    return lineStarts;
+}
+
+static NSString *LSPRandomFragment(NSUInteger maxLength) {
+    static NSString *alphabet[] = { @"a", @"b", @" ", @"\n", @"\r", @"\r\n", @" ", @"echo" };
+    NSMutableString *fragment = [NSMutableString string];
+    NSUInteger count = (NSUInteger)random() % (maxLength + 1);
+    for (NSUInteger i = 0; i < count; i++) {
+        [fragment appendString:alphabet[(NSUInteger)random() % (sizeof(alphabet) / sizeof(alphabet[0]))]];
+    }
+    return fragment;
+}
+
+static NSString *LSPScriptWithNumberOfLines(NSUInteger numberOfLines) {
+    NSMutableString *script = [NSMutableString stringWithCapacity:numberOfLines * 40];
+    for (NSUInteger line = 0; line < numberOfLines; line++) {
+        [script appendFormat:@"echo \"line %lu of the benchmark script\"\n", (unsigned long)line];
+    }
+    return script;
+}
+
+@interface LSPLineIndexTests : XCTestCase
+@end
+
+@implementation LSPLineIndexTests
+
+- (void)testLineIndex {
+    LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:@"a\r\nbc\n\nd"];
+    XCTAssertEqual([lineIndex numberOfLines], 4, @"");
+    XCTAssertEqual([lineIndex characterIndexForLine:1], 3, @"");
+    XCTAssertEqual([lineIndex characterIndexForLine:3], 7, @"");
+    XCTAssertEqual([lineIndex characterIndexForLine:4], NSNotFound, @"");
+    XCTAssertEqual([lineIndex lineForCharacterAtIndex:2], 0, @"");
+    XCTAssertEqual([lineIndex lineForCharacterAtIndex:8], 3, @"");
+    
+    LSPPosition *position = [lineIndex positionForCharacterAtIndex:4];
+    XCTAssertEqual(position.line, 1, @"");
+    XCTAssertEqual(position.character, 1, @"");
+    XCTAssertNil([lineIndex positionForCharacterAtIndex:9], @"");
+    
+    // A character beyond the end of the line defaults back to the line length.
+    XCTAssertEqual([lineIndex characterIndexForPosition:[LSPPosition positionWithLine:0 character:10]], 1, @"");
+    XCTAssertEqual([lineIndex characterIndexForPosition:[LSPPosition positionWithLine:1 character:10]], 5, @"");
+    XCTAssertEqual([lineIndex characterIndexForPosition:[LSPPosition positionWithLine:3 character:10]], 8, @"");
+    XCTAssertEqual([lineIndex characterIndexForPosition:[LSPPosition positionWithLine:10 character:0]], 8, @"");
+    
+    LSPPosition *end = [[[LSPLineIndex alloc] initWithString:@"a\n"] positionForCharacterAtIndex:2];
+    XCTAssertEqual(end.line, 1, @"");
+    XCTAssertEqual(end.character, 0, @"");
+}
+
+- (void)testRandomEdits {
+    srandom(2026);
+    for (NSUInteger run = 0; run < 200; run++) {
+        NSMutableString *text = [LSPRandomFragment(40) mutableCopy];
+        LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:text];
+        for (NSUInteger edit = 0; edit < 50; edit++) {
+            NSUInteger location = (NSUInteger)random() % ([text length] + 1);
+            NSUInteger length = (NSUInteger)random() % (MIN([text length] - location, 6) + 1);
+            NSString *replacementString = LSPRandomFragment(4);
+            NSRange range = NSMakeRange(location, length);
+            [text replaceCharactersInRange:range withString:replacementString];
+            [lineIndex didReplaceCharactersInRange:range withLength:[replacementString length]];
+            
+            NSArray *lineStarts = LSPLineStartsOfString(text);
+            XCTAssertEqual([lineIndex numberOfLines], [lineStarts count], @"%@", [text debugDescription]);
+            for (NSUInteger line = 0; line < MIN([lineIndex numberOfLines], [lineStarts count]); line++) {
+                XCTAssertEqual([lineIndex characterIndexForLine:line], [[lineStarts objectAtIndex:line] unsignedIntegerValue], @"");
+            }
+        }
+    }
+}
+
+- (void)testPositionRoundTrips {
+    NSMutableString *text = [LSPScriptWithNumberOfLines(1000) mutableCopy];
+    LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:text];
+    NSUInteger length = [text length];
+    srandom(7);
+    for (NSUInteger conversion = 0; conversion < 10000; conversion++) {
+        NSUInteger location = (NSUInteger)random() % length;
+        LSPPosition *position = [lineIndex positionForCharacterAtIndex:location];
+        XCTAssert([lineIndex characterIndexForPosition:position] == location, @"");
+    }
+    
+    // Typing in the middle of the text, with a new line every 40 characters.
+    NSUInteger location = length / 2;
+    for (NSUInteger edit = 0; edit < 1000; edit++) {
+        NSString *character = (edit % 40 == 39) ? @"\n" : @"x";
+        [text replaceCharactersInRange:NSMakeRange(location, 0) withString:character];
+        [lineIndex didReplaceCharactersInRange:NSMakeRange(location, 0) withLength:1];
+        location++;
+    }
+    XCTAssertEqual([lineIndex numberOfLines], [LSPLineStartsOfString(text) count], @"");
+}
+
+- (void)testConvertedStringIsNotKeptAlive {
+    __weak NSString *weakText = nil;
+    @autoreleasepool {
+        NSString *text = [[LSPScriptWithNumberOfLines(100) mutableCopy] copy];
+        weakText = text;
+        LSPPosition *position = [LSPPosition positionForCharacterAtIndex:[text length] / 2 inText:text];
+        XCTAssertEqual([position convertToPositionInText:text], [text length] / 2, @"");
+    }
+    XCTAssertNil(weakText, @"");
+}
+
+@end
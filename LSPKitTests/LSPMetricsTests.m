@@ -0,0 +1,105 @@
+//
+//  LSPMetricsTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "LSPMetricsRecorder.h"
+#import "LSPPipeline.h"
+#import "XCTestCase+LSPStubServer.h"
+
+@interface LSPMetricsTests : XCTestCase
+@end
+
+@implementation LSPMetricsTests
+
+- (void)testLatencyHistogram {
+    LSPMetricsRecorder *recorder = [[LSPMetricsRecorder alloc] init];
+    for (NSUInteger index = 0; index < 90; index++) {
+        [recorder recordLatency:800 * NSEC_PER_USEC ofRequest:@"textDocument/hover"];
+    }
+    for (NSUInteger index = 0; index < 10; index++) {
+        [recorder recordLatency:30 * NSEC_PER_MSEC ofRequest:@"textDocument/hover"];
+    }
+    [recorder recordLatency:7 * NSEC_PER_SEC ofRequest:@"textDocument/documentSymbol"];
+    LSPMetricsSnapshot *snapshot = [recorder snapshotWithPipeline:nil];
+
+    LSPLatencyHistogram *hover = [[snapshot requestLatencies] objectForKey:@"textDocument/hover"];
+    XCTAssertEqual([hover count], 100, @"");
+    XCTAssertEqualWithAccuracy([hover durationAtPercentile:50.0], 0.001, 1e-9, @"");
+    XCTAssertEqualWithAccuracy([hover durationAtPercentile:99.0], 0.03, 1e-9, @"");
+    XCTAssertEqualWithAccuracy([hover maximumDuration], 0.03, 1e-9, @"");
+    XCTAssertEqualWithAccuracy([hover totalDuration], 0.372, 1e-9, @"");
+    XCTAssertEqual([[hover bucketCounts] count], [[LSPLatencyHistogram bucketUpperBounds] count], @"");
+
+    // Longer than the last bound, counted in the open bucket.
+    LSPLatencyHistogram *symbol = [[snapshot requestLatencies] objectForKey:@"textDocument/documentSymbol"];
+    XCTAssertEqualObjects([[symbol bucketCounts] lastObject], [NSNumber numberWithUnsignedInteger:1], @"");
+    XCTAssertEqualWithAccuracy([symbol durationAtPercentile:50.0], 7.0, 1e-9, @"");
+
+    [recorder reset];
+    XCTAssertEqual([[[recorder snapshotWithPipeline:nil] requestLatencies] count], 0, @"");
+}
+
+- (void)testClientMetrics {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"hover"];
+    XCTestExpectation *expectation3 = [[XCTestExpectation alloc] initWithDescription:@"flood"];
+    NSURL *url = [NSURL URLWithString:@"untitled:metrics.txt"];
+    NSString *text = @"one two three";
+    LSPClient *client = [self stubServerWithArguments:nil];
+    XCTAssertNil([client metricsSnapshot], @"");
+    [client setMetricsEnabled:YES];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    [client documentDidOpen:url content:text];
+    [client documentHoverWithContentsOfURL:url inText:text forCharacterAtIndex:4 completionHandler:^(NSDictionary *dict, NSError *error) {
+        [expectation2 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/flood" params:[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:100], @"count", nil] withReply:^(id obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation3 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation3] timeout:10.0];
+
+    LSPMetricsSnapshot *snapshot = [client metricsSnapshot];
+    XCTAssertGreaterThan([snapshot duration], 0.0, @"");
+    XCTAssertEqual([[[snapshot requestLatencies] objectForKey:@"initialize"] count], 1, @"");
+    XCTAssertEqual([[[snapshot requestLatencies] objectForKey:@"textDocument/hover"] count], 1, @"");
+    XCTAssertEqual([[[snapshot requestLatencies] objectForKey:@"stub/flood"] count], 1, @"");
+    XCTAssertEqual([snapshot sentRequestCount], 3, @"");
+    XCTAssertEqual([snapshot receivedResponseCount], 3, @"");
+    XCTAssertEqual([snapshot errorResponseCount], 0, @"");
+    XCTAssertEqual([snapshot cancelledRequestCount], 0, @"");
+    XCTAssertEqual([snapshot receivedRequestCount], 0, @"");
+    XCTAssertGreaterThanOrEqual([snapshot sentNotificationCount], 1, @"");
+    // The notifications were sent before the reply, the reply is handled last.
+    XCTAssertEqual([snapshot receivedNotificationCount], 100, @"");
+    XCTAssertGreaterThan([snapshot bytesWritten], [text length], @"");
+    XCTAssertGreaterThan([snapshot bytesRead], 0, @"");
+    XCTAssertGreaterThan([snapshot readCount], 0, @"");
+    XCTAssertGreaterThan([snapshot writeCount], 0, @"");
+    for (NSString *stage in [NSArray arrayWithObjects:LSPMetricsStageEncode, LSPMetricsStageWrite, LSPMetricsStageRead, LSPMetricsStageDecode, nil]) {
+        XCTAssertGreaterThan([[[snapshot stageDurations] objectForKey:stage] count], 0, @"%@", stage);
+    }
+    XCTAssertEqual([[[snapshot stageDurations] objectForKey:LSPMetricsStageDispatch] count], 100, @"");
+
+    [client resetMetrics];
+    XCTAssertEqual([[client metricsSnapshot] sentRequestCount], 0, @"");
+    [client setMetricsEnabled:NO];
+    XCTAssertNil([client metricsSnapshot], @"");
+    [client terminate];
+}
+
+@end
@@ -0,0 +1,474 @@
+//
+//  LSPPipelineTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "LSPPipeline.h"
+#import "LSPMessageEncoder.h"
+#import "XCTestCase+LSPStubServer.h"
+
+static NSData *LSPFrameWithJSONObject(id object) {
+    NSData *content = [NSJSONSerialization dataWithJSONObject:object options:0 error:NULL];
+    NSString *header = [NSString stringWithFormat:@"Content-Length: %lu\r\n\r\n", (unsigned long)[content length]];
+    NSMutableData *frame = [[header dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    [frame appendData:content];
+    return frame;
+}
+
+/**
+ * Server traffic modeled after replies of the bundled servers: log messages,
+ * publishDiagnostics and completion lists ranging from a few to thousands of items.
+ */
+static NSData *LSPServerTraffic(NSUInteger *frameCount) {
+    NSMutableData *traffic = [NSMutableData data];
+    NSString *uri = @"file:///Users/chris/Projects/script.sh";
+    NSUInteger frames = 0;
+    for (NSUInteger round = 0; round < 20; round++) {
+        NSDictionary *logParams = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [NSNumber numberWithInteger:LSPMessageTypeInfo], @"type",
+                                   [NSString stringWithFormat:@"Analyzing %@", uri], @"message",
+                                   nil];
+        NSDictionary *logMessage = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    @"2.0", @"jsonrpc",
+                                    @"window/logMessage", @"method",
+                                    logParams, @"params",
+                                    nil];
+        [traffic appendData:LSPFrameWithJSONObject(logMessage)];
+        frames++;
+        
+        NSMutableArray *diagnostics = [NSMutableArray array];
+        for (NSUInteger index = 0; index < 50; index++) {
+            NSDictionary *range = [NSDictionary dictionaryWithObjectsAndKeys:
+                                   [[LSPPosition positionWithLine:index character:0] params], @"start",
+                                   [[LSPPosition positionWithLine:index character:12] params], @"end",
+                                   nil];
+            NSDictionary *diagnostic = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        range, @"range",
+                                        [NSNumber numberWithInteger:LSPDiagnosticSeverityError], @"severity",
+                                        @"bash-language-server", @"source",
+                                        @"Failed to parse expression", @"message",
+                                        nil];
+            [diagnostics addObject:diagnostic];
+        }
+        NSDictionary *diagnosticsParams = [NSDictionary dictionaryWithObjectsAndKeys:
+                                           uri, @"uri",
+                                           diagnostics, @"diagnostics",
+                                           nil];
+        NSDictionary *publishDiagnostics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            @"2.0", @"jsonrpc",
+                                            @"textDocument/publishDiagnostics", @"method",
+                                            diagnosticsParams, @"params",
+                                            nil];
+        [traffic appendData:LSPFrameWithJSONObject(publishDiagnostics)];
+        frames++;
+        
+        NSUInteger itemCount = (round % 4 == 0) ? 5000 : 200;
+        NSMutableArray *items = [NSMutableArray arrayWithCapacity:itemCount];
+        for (NSUInteger index = 0; index < itemCount; index++) {
+            NSDictionary *item = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  [NSString stringWithFormat:@"completion_item_%lu", (unsigned long)index], @"label",
+                                  [NSNumber numberWithInteger:LSPCompletionItemKindFunction], @"kind",
+                                  [NSDictionary dictionaryWithObjectsAndKeys:@"builtin", @"type", @"echo", @"name", nil], @"data",
+                                  nil];
+            [items addObject:item];
+        }
+        NSDictionary *completionList = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        [NSNumber numberWithBool:NO], @"isIncomplete",
+                                        items, @"items",
+                                        nil];
+        NSDictionary *completion = [NSDictionary dictionaryWithObjectsAndKeys:
+                                    @"2.0", @"jsonrpc",
+                                    [NSNumber numberWithUnsignedInteger:round + 1], @"id",
+                                    completionList, @"result",
+                                    nil];
+        [traffic appendData:LSPFrameWithJSONObject(completion)];
+        frames++;
+    }
+    if (frameCount) {
+        *frameCount = frames;
+    }
+    return traffic;
+}
+
+/** Splits data in chunks between 1 byte and 64 KB, biased towards small reads. */
+static NSArray<NSData *> *LSPRandomChunks(NSData *data, unsigned int seed) {
+    NSMutableArray *chunks = [NSMutableArray array];
+    srandom(seed);
+    NSUInteger offset = 0;
+    NSUInteger length = [data length];
+    while (offset < length) {
+        NSUInteger chunkLength = 1 + (NSUInteger)random() % (1 << (random() % 17));
+        chunkLength = MIN(chunkLength, length - offset);
+        [chunks addObject:[data subdataWithRange:NSMakeRange(offset, chunkLength)]];
+        offset += chunkLength;
+    }
+    return chunks;
+}
+
+@interface LSPPipelineTests : XCTestCase
+@end
+
+@implementation LSPPipelineTests
+
+- (NSTask *)launchStubServerWithPipeline:(LSPPipeline *)pipeline {
+    NSTask *task = [[NSTask alloc] init];
+    [task setLaunchPath:[self stubServerPath]];
+    [task setStandardInput:[pipeline stdinPipe]];
+    [task setStandardOutput:[pipeline stdoutPipe]];
+    [task setStandardError:[pipeline stderrPipe]];
+    [task launch];
+    return task;
+}
+
+- (void)terminateStubServer:(NSTask *)task pipeline:(LSPPipeline *)pipeline {
+    [pipeline sendNotification:@"exit" params:nil];
+    [task waitUntilExit];
+    [pipeline close];
+}
+
+- (void)testFrameDecodingSplitAtEveryOffset {
+    NSMutableData *traffic = [NSMutableData data];
+    [traffic appendData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"first", @"method", nil])];
+    [traffic appendData:[@"Content-Length: 2\r\nContent-Type: application/vscode-jsonrpc; charset=utf-16\r\n\r\n{}" dataUsingEncoding:NSUTF8StringEncoding]];
+    [traffic appendData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"third", @"method", nil])];
+    for (NSUInteger split = 0; split <= [traffic length]; split++) {
+        LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+        NSMutableArray *contents = [NSMutableArray array];
+        NSMutableArray *charsets = [NSMutableArray array];
+        [pipeline setDataHandler:^(NSData *content, NSString *charset) {
+            [contents addObject:[NSData dataWithData:content]];
+            [charsets addObject:charset];
+        }];
+        [pipeline didReceiveData:[traffic subdataWithRange:NSMakeRange(0, split)]];
+        [pipeline didReceiveData:[traffic subdataWithRange:NSMakeRange(split, [traffic length] - split)]];
+        [pipeline close];
+        XCTAssertEqual([contents count], 3, @"split at %lu", (unsigned long)split);
+        XCTAssertEqualObjects([contents objectAtIndex:1], [@"{}" dataUsingEncoding:NSUTF8StringEncoding], @"");
+        XCTAssertEqualObjects([charsets objectAtIndex:0], @"utf-8", @"");
+        XCTAssertEqualObjects([charsets objectAtIndex:1], @"utf-16", @"");
+        NSDictionary *last = [NSJSONSerialization JSONObjectWithData:[contents lastObject] options:0 error:NULL];
+        XCTAssertEqualObjects([last objectForKey:@"method"], @"third", @"");
+    }
+}
+
+- (void)testFrameDecodingRandomChunks {
+    NSUInteger frameCount = 0;
+    NSData *traffic = LSPServerTraffic(&frameCount);
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    __block NSUInteger frames = 0;
+    [pipeline setDataHandler:^(NSData *content, NSString *charset) {
+        XCTAssertNotNil([NSJSONSerialization JSONObjectWithData:content options:0 error:NULL], @"");
+        frames++;
+    }];
+    for (NSData *chunk in LSPRandomChunks(traffic, 42)) {
+        [pipeline didReceiveData:chunk];
+    }
+    [pipeline close];
+    XCTAssertEqual(frames, frameCount, @"");
+}
+
+- (void)testFrameDecodingSkipsContentThatCannotBeAllocated {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    __block NSUInteger frames = 0;
+    [pipeline setDataHandler:^(NSData *content, NSString *charset) {
+        frames++;
+    }];
+    // The content would not fit in memory, the frame that follows belongs
+    // to it and must not be decoded as a frame of its own.
+    [pipeline didReceiveData:[@"Content-Length: 18446744073709551600\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [pipeline didReceiveData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"skipped", @"method", nil])];
+    [pipeline close];
+    XCTAssertEqual(frames, 0, @"");
+}
+
+- (void)testFrameDecodingDropsOverlongHeader {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    NSMutableArray *contents = [NSMutableArray array];
+    [pipeline setDataHandler:^(NSData *content, NSString *charset) {
+        [contents addObject:[NSData dataWithData:content]];
+    }];
+    // Garbage without a terminator is not buffered, the decoder resyncs at
+    // the next terminator.
+    NSData *garbage = [[@"" stringByPaddingToLength:10000 withString:@"Content-Length: 2\r\n" startingAtIndex:0] dataUsingEncoding:NSUTF8StringEncoding];
+    for (NSData *chunk in LSPRandomChunks(garbage, 7)) {
+        [pipeline didReceiveData:chunk];
+        XCTAssertLessThanOrEqual([(NSData *)[pipeline valueForKey:@"header"] length], 4 * 1024, @"");
+    }
+    [pipeline didReceiveData:[@"\r\n\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [pipeline didReceiveData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"next", @"method", nil])];
+    [pipeline close];
+    XCTAssertEqual([contents count], 1, @"");
+    NSDictionary *message = [NSJSONSerialization JSONObjectWithData:[contents lastObject] options:0 error:NULL];
+    XCTAssertEqualObjects([message objectForKey:@"method"], @"next", @"");
+}
+
+- (void)testConcurrentRequests {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    NSTask *task = [self launchStubServerWithPipeline:pipeline];
+    NSUInteger requestCount = 4000;
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"replies"];
+    [expectation setExpectedFulfillmentCount:requestCount];
+    dispatch_apply(requestCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t index) {
+        NSNumber *number = [NSNumber numberWithUnsignedInteger:index];
+        NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:number, @"index", nil];
+        [pipeline sendRequest:@"stub/echo" params:params withReply:^(id obj, NSError *error) {
+            XCTAssertNil(error, @"");
+            XCTAssertEqualObjects([obj objectForKey:@"index"], number, @"");
+            [expectation fulfill];
+        }];
+    });
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:30.0];
+    [self terminateStubServer:task pipeline:pipeline];
+}
+
+- (void)testNotificationBackpressure {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    NSUInteger maximumInFlightMessageCount = 16;
+    NSUInteger notificationCount = 5000;
+    [pipeline setMaximumInFlightMessageCount:maximumInFlightMessageCount];
+    [pipeline setNotificationQueue:dispatch_queue_create("LSPPipelineTests.notifications", DISPATCH_QUEUE_SERIAL)];
+    XCTestExpectation *notifications = [[XCTestExpectation alloc] initWithDescription:@"notifications"];
+    [notifications setExpectedFulfillmentCount:notificationCount];
+    __block NSUInteger maximumObserved = 0;
+    __weak LSPPipeline *weakPipeline = pipeline;
+    [pipeline setNotificationMessageHandler:^(NSDictionary *message) {
+        // A slow consumer.
+        usleep(50);
+        maximumObserved = MAX(maximumObserved, [weakPipeline inFlightMessageCount]);
+        [notifications fulfill];
+    }];
+    NSTask *task = [self launchStubServerWithPipeline:pipeline];
+    XCTestExpectation *reply = [[XCTestExpectation alloc] initWithDescription:@"reply"];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:notificationCount], @"count", nil];
+    [pipeline sendRequest:@"stub/flood" params:params withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects([obj objectForKey:@"count"], [NSNumber numberWithUnsignedInteger:notificationCount], @"");
+        [reply fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObjects:notifications, reply, nil] timeout:60.0];
+    XCTAssertLessThanOrEqual(maximumObserved, maximumInFlightMessageCount, @"");
+    [self terminateStubServer:task pipeline:pipeline];
+}
+
+- (void)testMessageEncoder {
+    unichar characters[] = { '"', '\\', '/', '\n', '\r', '\t', 0x01, 0x1f, 0x7f, 0xfc, 0x20ac, 0x2028, 0xd83d, 0xde00 };
+    NSMutableString *text = [NSMutableString string];
+    srandom(2026);
+    while ([text length] < 10000) {
+        NSUInteger count = (NSUInteger)random() % 40;
+        [text appendString:[@"" stringByPaddingToLength:count withString:@"echo benchmark " startingAtIndex:0]];
+        // The last two are the surrogate pair of an emoji.
+        NSUInteger index = (NSUInteger)random() % 13;
+        [text appendString:[NSString stringWithCharacters:characters + index length:(index == 12) ? 2 : 1]];
+    }
+    NSDictionary *textDocument = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  @"file:///tmp/encoder.txt", @"uri",
+                                  text, @"text",
+                                  nil];
+    NSArray *contentChanges = [NSArray arrayWithObjects:
+                               [NSDictionary dictionaryWithObjectsAndKeys:text, @"text", nil],
+                               [NSDictionary dictionaryWithObjectsAndKeys:@"short", @"text", nil],
+                               nil];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:
+                            textDocument, @"textDocument",
+                            contentChanges, @"contentChanges",
+                            nil];
+    NSDictionary *message = [NSDictionary dictionaryWithObjectsAndKeys:
+                             @"2.0", @"jsonrpc",
+                             @"textDocument/didOpen", @"method",
+                             params, @"params",
+                             nil];
+    XCTAssertNil([[LSPMessageEncoder alloc] initWithJSONObject:message minimumStreamedStringLength:[text length] + 1], @"");
+    
+    // Encoded into buffers of odd sizes, so characters end up at every buffer boundary.
+    LSPMessageEncoder *encoder = [[LSPMessageEncoder alloc] initWithJSONObject:message minimumStreamedStringLength:1000];
+    XCTAssertNotNil(encoder, @"");
+    NSMutableData *data = [NSMutableData data];
+    uint8_t buffer[64];
+    NSUInteger maxLength = 16;
+    NSUInteger length = 0;
+    while ((length = [encoder getBytes:buffer maxLength:maxLength]) > 0) {
+        [data appendBytes:buffer length:length];
+        maxLength = 16 + (maxLength + 7) % 48;
+    }
+    XCTAssertEqual([encoder contentLength], [data length], @"");
+    XCTAssertLessThanOrEqual([encoder estimatedContentLength], [encoder contentLength], @"");
+    XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData:data options:0 error:NULL], message, @"");
+}
+
+- (void)testWriterDoesNotBlockWhenServerStopsReading {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    NSTask *task = [self launchStubServerWithPipeline:pipeline];
+    NSDictionary *pause = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithDouble:2.0], @"seconds", nil];
+    [pipeline sendNotification:@"stub/pause" params:pause];
+    // Far more than the pipe buffer holds, the writes would block without the write queue.
+    NSString *text = [@"" stringByPaddingToLength:64 * 1024 withString:@"x" startingAtIndex:0];
+    NSDictionary *params = [NSDictionary dictionaryWithObjectsAndKeys:text, @"text", nil];
+    NSUInteger notificationCount = 256;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSUInteger index = 0; index < notificationCount; index++) {
+        [pipeline sendNotification:@"stub/ignored" params:params];
+    }
+    CFAbsoluteTime duration = CFAbsoluteTimeGetCurrent() - start;
+    XCTAssertLessThan(duration, 1.0, @"");
+    XCTAssertGreaterThan([pipeline queuedByteCount], 0, @"");
+    XCTAssertGreaterThan([pipeline queuedByteHighWaterMark], notificationCount * [text length] / 2, @"");
+
+    XCTestExpectation *reply = [[XCTestExpectation alloc] initWithDescription:@"reply"];
+    [pipeline sendRequest:@"stub/echo" params:pause withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects(obj, pause, @"");
+        [reply fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:reply] timeout:30.0];
+    XCTAssertEqual([pipeline queuedByteCount], 0, @"");
+    XCTAssertEqual([pipeline writtenMessageCount], notificationCount + 2, @"");
+    XCTAssertLessThan([pipeline writeCount], [pipeline writtenMessageCount], @"");
+    [self terminateStubServer:task pipeline:pipeline];
+}
+
+- (NSArray<NSDictionary *> *)messagesWrittenByPipeline:(LSPPipeline *)pipeline count:(NSUInteger)count {
+    NSMutableArray<NSDictionary *> *messages = [NSMutableArray array];
+    LSPPipeline *reader = [[LSPPipeline alloc] init];
+    [reader setDataHandler:^(NSData *content, NSString *charset) {
+        [messages addObject:[NSJSONSerialization JSONObjectWithData:content options:0 error:NULL]];
+    }];
+    NSFileHandle *fileHandle = [[pipeline stdinPipe] fileHandleForReading];
+    while ([messages count] < count) {
+        [reader didReceiveData:[fileHandle availableData]];
+    }
+    [reader close];
+    return messages;
+}
+
+- (void)testCloseWithWriteSource {
+    NSString *text = [@"" stringByPaddingToLength:256 * 1024 withString:@"x" startingAtIndex:0];
+    NSData *frame = LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"stub/ignored", @"method", text, @"params", nil]);
+
+    // Closed while the source waits for the pipe to become writable.
+    LSPPipeline *waiting = [[LSPPipeline alloc] init];
+    [waiting writeData:frame];
+    NSDate *end = [NSDate dateWithTimeIntervalSinceNow:10.0];
+    while ([[waiting valueForKey:@"waitingForWritable"] boolValue] == NO && [end timeIntervalSinceNow] > 0.0) {
+        [NSThread sleepForTimeInterval:0.001];
+    }
+    XCTAssertTrue([[waiting valueForKey:@"waitingForWritable"] boolValue], @"");
+    [waiting close];
+
+    // Closed after the source fired and was suspended again.
+    LSPPipeline *fired = [[LSPPipeline alloc] init];
+    [fired writeData:frame];
+    [fired sendNotification:@"stub/ignored" params:nil];
+    XCTAssertEqual([[self messagesWrittenByPipeline:fired count:2] count], 2, @"");
+    XCTAssertNotNil([fired valueForKey:@"writeSource"], @"");
+    XCTAssertFalse([[fired valueForKey:@"waitingForWritable"] boolValue], @"");
+    [fired close];
+}
+
+- (void)testInteractiveRequestsGoFirst {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    // More than the pipe holds, nobody reads it yet, so the requests stay queued behind it.
+    NSString *text = [@"" stringByPaddingToLength:256 * 1024 withString:@"x" startingAtIndex:0];
+    [pipeline writeData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", @"stub/ignored", @"method", text, @"params", nil])];
+    [pipeline sendRequest:@"textDocument/documentSymbol" params:nil priority:LSPRequestPriorityBackground timeout:0.0 withReply:nil];
+    [pipeline sendRequest:@"textDocument/foldingRange" params:nil priority:LSPRequestPriorityNormal timeout:0.0 withReply:nil];
+    [pipeline sendNotification:@"textDocument/didChange" params:nil];
+    [pipeline sendRequest:@"textDocument/documentSymbol" params:nil priority:LSPRequestPriorityBackground timeout:0.0 withReply:nil];
+    [pipeline sendRequest:@"textDocument/hover" params:nil priority:LSPRequestPriorityInteractive timeout:0.0 withReply:nil];
+    NSArray<NSDictionary *> *messages = [self messagesWrittenByPipeline:pipeline count:6];
+    // Requests pass the waiting requests of a lower priority, but not the notification.
+    NSArray *methods = [messages valueForKey:@"method"];
+    XCTAssertEqualObjects(methods, ([NSArray arrayWithObjects:@"stub/ignored", @"textDocument/foldingRange", @"textDocument/documentSymbol", @"textDocument/didChange", @"textDocument/hover", @"textDocument/documentSymbol", nil]), @"");
+    XCTAssertEqual([pipeline pendingRequestCount], 4, @"");
+    [pipeline close];
+    XCTAssertEqual([pipeline pendingRequestCount], 0, @"");
+}
+
+- (void)testBackgroundRequestsAndTimeouts {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    [pipeline setMaximumBackgroundRequestCount:2];
+    NSMutableArray<NSNumber *> *replies = [NSMutableArray array];
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"background"];
+    [expectation1 setExpectedFulfillmentCount:3];
+    NSMutableArray<NSNumber *> *messageIDs = [NSMutableArray array];
+    for (NSUInteger index = 0; index < 4; index++) {
+        NSNumber *messageID = [pipeline sendRequest:@"textDocument/documentSymbol" params:nil priority:LSPRequestPriorityBackground timeout:0.0 withReply:^(id obj, NSError *error) {
+            @synchronized (replies) {
+                [replies addObject:obj];
+            }
+            [expectation1 fulfill];
+        }];
+        [messageIDs addObject:messageID];
+    }
+    XCTAssertEqual([pipeline heldRequestCount], 2, @"");
+
+    // The server never answers, the reply block is called with an error anyway.
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"timeout"];
+    NSNumber *hoverID = [pipeline sendRequest:@"textDocument/hover" params:nil priority:LSPRequestPriorityInteractive timeout:0.1 withReply:^(id obj, NSError *error) {
+        XCTAssertNil(obj, @"");
+        XCTAssertEqualObjects([error domain], LSPResponseError, @"");
+        XCTAssertEqual([error code], LSPResponseRequestTimedOut, @"");
+        [expectation2 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    XCTAssertEqual([pipeline pendingRequestCount], 4, @"");
+
+    // A held request that is cancelled is never sent, an answered one makes room for the next.
+    [pipeline cancelRequest:[messageIDs objectAtIndex:3]];
+    XCTAssertEqual([pipeline heldRequestCount], 1, @"");
+    [pipeline didReceiveData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", [messageIDs objectAtIndex:0], @"id", [messageIDs objectAtIndex:0], @"result", nil])];
+    NSArray<NSDictionary *> *messages = [self messagesWrittenByPipeline:pipeline count:5];
+    XCTAssertEqual([pipeline heldRequestCount], 0, @"");
+    // The hover may have passed the first two, if they were still queued.
+    NSSet *firstIDs = [NSSet setWithObjects:[messageIDs objectAtIndex:0], [messageIDs objectAtIndex:1], hoverID, nil];
+    XCTAssertEqualObjects([NSSet setWithArray:[[messages valueForKey:@"id"] subarrayWithRange:NSMakeRange(0, 3)]], firstIDs, @"");
+    XCTAssertEqualObjects([[messages objectAtIndex:4] objectForKey:@"id"], [messageIDs objectAtIndex:2], @"");
+    XCTAssertEqualObjects([[messages objectAtIndex:3] objectForKey:@"method"], @"$/cancelRequest", @"");
+    XCTAssertEqualObjects([[[messages objectAtIndex:3] objectForKey:@"params"] objectForKey:@"id"], hoverID, @"");
+
+    for (NSUInteger index = 1; index < 3; index++) {
+        [pipeline didReceiveData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", [messageIDs objectAtIndex:index], @"id", [messageIDs objectAtIndex:index], @"result", nil])];
+    }
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    XCTAssertEqualObjects(replies, [messageIDs subarrayWithRange:NSMakeRange(0, 3)], @"");
+    XCTAssertEqual([pipeline pendingRequestCount], 0, @"");
+    [pipeline close];
+}
+
+- (void)testHeldRequestsOfChangedDocumentAreNotSent {
+    LSPPipeline *pipeline = [[LSPPipeline alloc] init];
+    [pipeline setMaximumBackgroundRequestCount:1];
+    NSDictionary *changedParams = [NSDictionary dictionaryWithObjectsAndKeys:[NSDictionary dictionaryWithObjectsAndKeys:@"untitled:changed.txt", @"uri", nil], @"textDocument", nil];
+    NSDictionary *otherParams = [NSDictionary dictionaryWithObjectsAndKeys:[NSDictionary dictionaryWithObjectsAndKeys:@"untitled:other.txt", @"uri", nil], @"textDocument", nil];
+    NSNumber *sentID = [pipeline sendRequest:@"textDocument/documentSymbol" params:changedParams priority:LSPRequestPriorityBackground timeout:0.0 withReply:nil];
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"stale"];
+    __block NSError *staleError = nil;
+    [pipeline sendRequest:@"textDocument/foldingRange" params:changedParams priority:LSPRequestPriorityBackground timeout:0.0 withReply:^(id obj, NSError *error) {
+        XCTAssertNil(obj, @"");
+        staleError = error;
+        [expectation fulfill];
+    }];
+    NSNumber *otherID = [pipeline sendRequest:@"textDocument/documentSymbol" params:otherParams priority:LSPRequestPriorityBackground timeout:0.0 withReply:nil];
+    XCTAssertEqual([pipeline heldRequestCount], 2, @"");
+
+    // The held request of the changed document is answered without being
+    // sent, the one of the other document takes the free slot.
+    [pipeline sendNotification:@"textDocument/didChange" params:changedParams];
+    [pipeline didReceiveData:LSPFrameWithJSONObject([NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", sentID, @"id", [NSNull null], @"result", nil])];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    XCTAssertEqualObjects([staleError domain], LSPResponseError, @"");
+    XCTAssertEqual([staleError code], LSPResponseContentModified, @"");
+    NSArray<NSDictionary *> *messages = [self messagesWrittenByPipeline:pipeline count:3];
+    XCTAssertEqualObjects([[messages objectAtIndex:0] objectForKey:@"id"], sentID, @"");
+    XCTAssertEqualObjects([[messages objectAtIndex:1] objectForKey:@"method"], @"textDocument/didChange", @"");
+    XCTAssertEqualObjects([[messages objectAtIndex:2] objectForKey:@"id"], otherID, @"");
+    XCTAssertEqual([pipeline heldRequestCount], 0, @"");
+    XCTAssertEqual([pipeline pendingRequestCount], 1, @"");
+    [pipeline close];
+}
+
+@end
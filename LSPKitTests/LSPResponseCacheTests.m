@@ -0,0 +1,63 @@
+//
+//  LSPResponseCacheTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LSPResponseCache.h"
+
+@interface LSPResponseCacheTests : XCTestCase
+@end
+
+@implementation LSPResponseCacheTests
+
+- (void)testLeastRecentlyUsedResultsAreEvicted {
+    NSURL *uri = [NSURL URLWithString:@"untitled:cache.txt"];
+    NSString *result = [@"" stringByPaddingToLength:100 withString:@"x" startingAtIndex:0];
+    NSUInteger cost = [@"key 0" length] * sizeof(unichar) + [LSPResponseCache costOfJSONObject:result];
+    LSPResponseCache *cache = [[LSPResponseCache alloc] init];
+    [cache setCostLimit:cost * 3];
+    [cache setObject:result forKey:@"key 0" uri:uri];
+    [cache setObject:result forKey:@"key 1" uri:uri];
+    [cache setObject:result forKey:@"key 2" uri:uri];
+    XCTAssertEqual([cache totalCost], cost * 3, @"");
+    XCTAssertEqualObjects([cache objectForKey:@"key 0"], result, @"");
+    [cache setObject:result forKey:@"key 3" uri:uri];
+    // key 1 was used least recently.
+    XCTAssertEqual([cache count], 3, @"");
+    XCTAssertNil([cache objectForKey:@"key 1"], @"");
+    XCTAssertNotNil([cache objectForKey:@"key 0"], @"");
+    XCTAssertNotNil([cache objectForKey:@"key 2"], @"");
+    XCTAssertNotNil([cache objectForKey:@"key 3"], @"");
+    XCTAssertEqual([cache hitCount], 4, @"");
+    XCTAssertEqual([cache missCount], 1, @"");
+
+    [cache setCostLimit:cost];
+    XCTAssertEqual([cache count], 1, @"");
+    XCTAssertNotNil([cache objectForKey:@"key 3"], @"");
+    [cache setCostLimit:0];
+    XCTAssertEqual([cache count], 0, @"");
+    XCTAssertEqual([cache totalCost], 0, @"");
+}
+
+- (void)testResultsAreRemovedByDocument {
+    NSURL *uri1 = [NSURL URLWithString:@"untitled:one.txt"];
+    NSURL *uri2 = [NSURL URLWithString:@"untitled:two.txt"];
+    LSPResponseCache *cache = [[LSPResponseCache alloc] init];
+    [cache setObject:nil forKey:@"hover one" uri:uri1];
+    [cache setObject:[NSArray array] forKey:@"symbol one" uri:uri1];
+    [cache setObject:[NSArray array] forKey:@"symbol two" uri:uri2];
+    XCTAssertEqualObjects([cache objectForKey:@"hover one"], [NSNull null], @"");
+    [cache removeObjectsForURI:uri1];
+    XCTAssertEqual([cache count], 1, @"");
+    XCTAssertNotNil([cache objectForKey:@"symbol two"], @"");
+    [cache removeAllObjects];
+    XCTAssertEqual([cache count], 0, @"");
+    XCTAssertEqual([cache totalCost], 0, @"");
+}
+
+@end
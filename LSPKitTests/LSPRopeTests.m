@@ -0,0 +1,90 @@
+//
+//  LSPRopeTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+
+static NSString *LSPRandomString(NSUInteger maxLength) {
+    static NSString *alphabet[] = { @"a", @"b", @" ", @"\n", @"\r\n", @"ü", @"😀", @"echo" };
+    NSMutableString *string = [NSMutableString string];
+    NSUInteger count = (NSUInteger)random() % (maxLength + 1);
+    for (NSUInteger i = 0; i < count; i++) {
+        [string appendString:alphabet[(NSUInteger)random() % (sizeof(alphabet) / sizeof(alphabet[0]))]];
+    }
+    return string;
+}
+
+@interface LSPRopeTests : XCTestCase
+@end
+
+@implementation LSPRopeTests
+
+- (void)testRandomEdits {
+    srandom(2026);
+    for (NSUInteger run = 0; run < 20; run++) {
+        NSMutableString *string = [LSPRandomString(2000) mutableCopy];
+        LSPRope *rope = [[LSPRope alloc] initWithString:string];
+        for (NSUInteger edit = 0; edit < 2000; edit++) {
+            NSUInteger location = (NSUInteger)random() % ([string length] + 1);
+            NSUInteger maxLength = (random() % 10 == 0) ? 20000 : 4;
+            NSUInteger length = (NSUInteger)random() % (MIN([string length] - location, maxLength) + 1);
+            NSString *replacementString = LSPRandomString((random() % 20 == 0) ? 3000 : 3);
+            NSRange range = NSMakeRange(location, length);
+            [string replaceCharactersInRange:range withString:replacementString];
+            [rope replaceCharactersInRange:range withString:replacementString];
+            XCTAssertEqual([rope length], [string length], @"");
+        }
+        XCTAssertEqualObjects(rope, string, @"");
+        NSUInteger location = [string length] / 3;
+        NSRange range = NSMakeRange(location, MIN([string length] - location, 9000));
+        XCTAssertEqualObjects([rope substringWithRange:range], [string substringWithRange:range], @"");
+    }
+}
+
+- (void)testSnapshots {
+    LSPRope *rope = [[LSPRope alloc] initWithString:[@"" stringByPaddingToLength:100000 withString:@"0123456789" startingAtIndex:0]];
+    NSString *snapshot = [rope copy];
+    XCTAssertFalse([snapshot isKindOfClass:[NSMutableString class]], @"");
+    [rope replaceCharactersInRange:NSMakeRange(50000, 10) withString:@"changed"];
+    [rope appendString:rope];
+    XCTAssertEqual([snapshot length], 100000, @"");
+    XCTAssertEqualObjects([snapshot substringWithRange:NSMakeRange(50000, 10)], @"0123456789", @"");
+    XCTAssertEqual([rope length], 2 * (100000 - 3), @"");
+    XCTAssertEqualObjects([rope substringWithRange:NSMakeRange(50000, 7)], @"changed", @"");
+
+    NSMutableString *copy = [snapshot mutableCopy];
+    [copy deleteCharactersInRange:NSMakeRange(0, 99990)];
+    XCTAssertEqualObjects(copy, @"0123456789", @"");
+    XCTAssertEqual([snapshot length], 100000, @"");
+
+    NSData *data = [NSJSONSerialization dataWithJSONObject:[NSArray arrayWithObject:[rope copy]] options:0 error:NULL];
+    XCTAssertEqual([data length], [rope length] + 4, @"");
+}
+
+- (void)testTypingWithSnapshots {
+    // Typing in the middle of a document, with a snapshot for every 100
+    // characters like a didChange in full sync mode.
+    NSString *text = [@"" stringByPaddingToLength:64 * 1024 withString:@"echo \"benchmark\"\n" startingAtIndex:0];
+    NSMutableString *string = [text mutableCopy];
+    LSPRope *rope = [[LSPRope alloc] initWithString:text];
+    NSUInteger location = [text length] / 2;
+    for (NSUInteger edit = 0; edit < 2000; edit++) {
+        NSRange range = (edit % 3 == 2) ? NSMakeRange(--location, 1) : NSMakeRange(location++, 0);
+        NSString *replacementString = (edit % 3 == 2) ? @"" : @"x";
+        [string replaceCharactersInRange:range withString:replacementString];
+        [rope replaceCharactersInRange:range withString:replacementString];
+        if (edit % 100 == 0) {
+            NSString *snapshot = [rope copy];
+            XCTAssertEqualObjects(snapshot, string, @"");
+        }
+    }
+    XCTAssertEqualObjects(rope, string, @"");
+}
+
+@end
@@ -0,0 +1,179 @@
+//
+//  LSPSemanticTokensTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "XCTestCase+LSPStubServer.h"
+
+@interface LSPSemanticTokens (Decoding)
+- (instancetype)initWithData:(NSArray<NSNumber *> *)data resultID:(NSString *)resultID;
+- (BOOL)applyEdits:(NSArray<NSDictionary *> *)edits resultID:(NSString *)resultID;
+- (void)updateRunsWithLineIndex:(LSPLineIndex *)lineIndex;
+@end
+
+@interface LSPSemanticTokensTests : XCTestCase
+@end
+
+@implementation LSPSemanticTokensTests
+
+- (NSArray<NSNumber *> *)numbers:(const uint32_t *)values count:(NSUInteger)count {
+    NSMutableArray *numbers = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        [numbers addObject:[NSNumber numberWithUnsignedInt:values[index]]];
+    }
+    return numbers;
+}
+
+- (void)testDecodeEditAndQuery {
+    LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:@"let a = 1\n  foo bar\nbaz"];
+    const uint32_t data[] = {
+        0, 0, 3, 2, 0,  // let
+        0, 4, 1, 0, 0,  // a
+        0, 4, 1, 3, 0,  // 1
+        1, 2, 3, 1, 1,  // foo
+        0, 4, 3, 0, 0,  // bar
+        1, 0, 3, 0, 0,  // baz
+        3, 0, 1, 0, 0,  // beyond the last line
+    };
+    XCTAssertNil([[LSPSemanticTokens alloc] initWithData:[self numbers:data count:4] resultID:nil], @"");
+    LSPSemanticTokens *tokens = [[LSPSemanticTokens alloc] initWithData:[self numbers:data count:35] resultID:@"1"];
+    [tokens updateRunsWithLineIndex:lineIndex];
+    XCTAssertEqual([tokens count], 6, @"");
+    XCTAssertEqualObjects([tokens resultID], @"1", @"");
+    const LSPSemanticTokenRun *runs = [tokens runs];
+    XCTAssertEqual(runs[3].location, 12, @"");
+    XCTAssertEqual(runs[3].length, 3, @"");
+    XCTAssertEqual(runs[3].type, 1, @"");
+    XCTAssertEqual(runs[3].modifiers, 1, @"");
+    XCTAssertEqual(runs[5].location, 20, @"");
+    XCTAssertTrue(NSEqualRanges([tokens rangeOfRunsInCharacterRange:NSMakeRange(4, 5)], NSMakeRange(1, 2)), @"");
+    XCTAssertTrue(NSEqualRanges([tokens rangeOfRunsInCharacterRange:NSMakeRange(13, 1)], NSMakeRange(3, 1)), @"");
+    XCTAssertEqual([tokens rangeOfRunsInCharacterRange:NSMakeRange(15, 1)].length, 0, @"");
+
+    // Edits that do not fit leave the tokens as they are.
+    NSDictionary *outOfRange = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSNumber numberWithUnsignedInteger:40], @"start",
+                                [NSNumber numberWithUnsignedInteger:0], @"deleteCount",
+                                nil];
+    XCTAssertFalse([tokens applyEdits:[NSArray arrayWithObject:outOfRange] resultID:@"2"], @"");
+    XCTAssertEqualObjects([tokens resultID], @"1", @"");
+
+    // Removes "a" and moves "1" to where it was, the edits refer to the integers before.
+    const uint32_t deltaStart[] = { 8 };
+    NSArray *edits = [NSArray arrayWithObjects:
+                      [NSDictionary dictionaryWithObjectsAndKeys:
+                       [NSNumber numberWithUnsignedInteger:5], @"start",
+                       [NSNumber numberWithUnsignedInteger:5], @"deleteCount",
+                       nil],
+                      [NSDictionary dictionaryWithObjectsAndKeys:
+                       [NSNumber numberWithUnsignedInteger:11], @"start",
+                       [NSNumber numberWithUnsignedInteger:1], @"deleteCount",
+                       [self numbers:deltaStart count:1], @"data",
+                       nil],
+                      nil];
+    XCTAssertTrue([tokens applyEdits:edits resultID:@"3"], @"");
+    [tokens updateRunsWithLineIndex:lineIndex];
+    XCTAssertEqualObjects([tokens resultID], @"3", @"");
+    XCTAssertEqual([tokens count], 5, @"");
+    runs = [tokens runs];
+    XCTAssertEqual(runs[1].location, 8, @"");
+    XCTAssertEqual(runs[1].type, 3, @"");
+    XCTAssertEqual(runs[2].location, 12, @"");
+
+    __block NSUInteger count = 0;
+    [tokens enumerateRunsInCharacterRange:NSMakeRange(0, 23) usingBlock:^(const LSPSemanticTokenRun *run, BOOL *stop) {
+        count++;
+        *stop = (count == 2);
+    }];
+    XCTAssertEqual(count, 2, @"");
+}
+
+- (void)testInsertionBeforeDeletionAtLowerStart {
+    LSPLineIndex *lineIndex = [[LSPLineIndex alloc] initWithString:@"foo bar\nbaz"];
+    const uint32_t data[] = {
+        0, 0, 3, 1, 0,  // foo
+        1, 0, 3, 2, 0,  // baz
+    };
+    LSPSemanticTokens *tokens = [[LSPSemanticTokens alloc] initWithData:[self numbers:data count:10] resultID:@"1"];
+    // Replaces "foo" with "bar". The insertion is applied first and makes the
+    // integers longer than the buffer, although they end up as long as before.
+    const uint32_t bar[] = { 0, 4, 3, 3, 0 };
+    NSArray *edits = [NSArray arrayWithObjects:
+                      [NSDictionary dictionaryWithObjectsAndKeys:
+                       [NSNumber numberWithUnsignedInteger:5], @"start",
+                       [NSNumber numberWithUnsignedInteger:0], @"deleteCount",
+                       [self numbers:bar count:5], @"data",
+                       nil],
+                      [NSDictionary dictionaryWithObjectsAndKeys:
+                       [NSNumber numberWithUnsignedInteger:0], @"start",
+                       [NSNumber numberWithUnsignedInteger:5], @"deleteCount",
+                       nil],
+                      nil];
+    XCTAssertTrue([tokens applyEdits:edits resultID:@"2"], @"");
+    [tokens updateRunsWithLineIndex:lineIndex];
+    XCTAssertEqual([tokens count], 2, @"");
+    const LSPSemanticTokenRun *runs = [tokens runs];
+    XCTAssertEqual(runs[0].location, 4, @"");
+    XCTAssertEqual(runs[0].type, 3, @"");
+    XCTAssertEqual(runs[1].location, 8, @"");
+    XCTAssertEqual(runs[1].type, 2, @"");
+}
+
+- (void)testClientAppliesDeltas {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    NSURL *url = [NSURL URLWithString:@"untitled:tokens.txt"];
+    // The stub makes every word a token, its type is the length modulo 4.
+    LSPClient *client = [self stubServerWithArguments:nil];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    XCTAssertTrue([client hasSemanticTokensDeltaProvider], @"");
+    XCTAssertEqualObjects([client semanticTokenTypes], ([NSArray arrayWithObjects:@"variable", @"function", @"keyword", @"number", nil]), @"");
+
+    [client documentDidOpen:url content:@"one two\nthree"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"full"];
+    __block LSPSemanticTokens *fullTokens = nil;
+    [client documentSemanticTokens:url completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+        XCTAssertNil(error, @"");
+        fullTokens = tokens;
+        [expectation2 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    XCTAssertEqual([fullTokens count], 3, @"");
+    XCTAssertNotNil([fullTokens resultID], @"");
+    XCTAssertEqual([fullTokens runs][2].location, 8, @"");
+    XCTAssertEqual([fullTokens runs][2].type, 1, @"");
+
+    // The next request is a delta, applied to the same tokens.
+    [client document:url changeTextInRange:NSMakeRange(8, 0) replacementString:@"four "];
+    XCTestExpectation *expectation3 = [[XCTestExpectation alloc] initWithDescription:@"delta"];
+    [client documentSemanticTokens:url completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+        XCTAssertEqual(tokens, fullTokens, @"");
+        [expectation3 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation3] timeout:10.0];
+    XCTAssertEqual([[[self statisticsOfClient:client] objectForKey:@"semanticTokensDeltas"] unsignedIntegerValue], 1, @"");
+    XCTAssertEqual([fullTokens count], 4, @"");
+    XCTAssertEqual([fullTokens runs][2].location, 8, @"");
+    XCTAssertEqual([fullTokens runs][3].location, 13, @"");
+
+    XCTestExpectation *expectation4 = [[XCTestExpectation alloc] initWithDescription:@"range"];
+    [client documentSemanticTokens:url inCharacterRange:NSMakeRange(8, 10) completionHandler:^(LSPSemanticTokens *tokens, NSError *error) {
+        XCTAssertEqual([tokens count], 2, @"");
+        XCTAssertEqual([tokens runs][0].location, 8, @"");
+        XCTAssertNil([tokens resultID], @"");
+        [expectation4 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation4] timeout:10.0];
+    [client terminate];
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  LSPServerPoolTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "LSPPipeline.h"
+#import "XCTestCase+LSPStubServer.h"
+
+/** The number of clients whose server process is still running. */
+static NSUInteger LSPRunningProcessCount(NSArray<LSPClient *> *clients) {
+    NSUInteger count = 0;
+    for (LSPClient *client in clients) {
+        if ([[client valueForKey:@"task"] isRunning]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+@interface LSPServerPoolTests : XCTestCase
+@end
+
+@implementation LSPServerPoolTests
+
+- (LSPServerPool *)stubServerPool {
+    LSPServerPool *pool = [[LSPServerPool alloc] init];
+    [pool registerServerWithPath:[self stubServerPath] arguments:nil forLanguageID:@"plaintext"];
+    return pool;
+}
+
+- (NSURL *)workspaceURL:(NSUInteger)index {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"LSPServerPoolTests/workspace-%lu", (unsigned long)index]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:path withIntermediateDirectories:YES attributes:nil error:NULL];
+    return [NSURL fileURLWithPath:path isDirectory:YES];
+}
+
+- (void)initializeClient:(LSPClient *)client {
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+}
+
+- (void)testServerCountIsLimited {
+    LSPServerPool *pool = [self stubServerPool];
+    [pool setMaximumServerCount:2];
+    NSMutableArray *clients = [NSMutableArray array];
+    for (NSUInteger index = 0; index < 4; index++) {
+        NSURL *rootURL = [self workspaceURL:index];
+        LSPClient *client = [pool clientForLanguageID:@"plaintext" rootURL:rootURL];
+        XCTAssertEqual([pool clientForLanguageID:@"plaintext" rootURL:rootURL], client, @"");
+        [self initializeClient:client];
+        [client documentDidOpen:[rootURL URLByAppendingPathComponent:@"file.txt"] content:@"hello"];
+        [clients addObject:client];
+        XCTAssertLessThanOrEqual([pool serverCount], 2, @"");
+    }
+    XCTAssertNil([pool clientForLanguageID:@"unknown" rootURL:nil], @"");
+    XCTAssertEqual([[pool clients] count], 4, @"");
+    // The least recently used servers were shut down.
+    XCTAssertTrue([[clients objectAtIndex:0] isSuspended], @"");
+    XCTAssertTrue([[clients objectAtIndex:1] isSuspended], @"");
+    XCTAssertFalse([[clients objectAtIndex:2] isSuspended], @"");
+    XCTAssertFalse([[clients objectAtIndex:3] isSuspended], @"");
+    XCTAssertTrue([self runUntil:^BOOL{
+        return LSPRunningProcessCount(clients) == 2;
+    } timeout:10.0], @"");
+
+    // Every server works on its own workspace.
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"initialize params"];
+    LSPPipeline *pipeline = [[clients lastObject] valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/initialize" params:nil withReply:^(id obj, NSError *error) {
+        XCTAssertEqualObjects([obj objectForKey:@"rootUri"], [[self workspaceURL:3] absoluteString], @"");
+        XCTAssertEqual([[obj objectForKey:@"workspaceFolders"] count], 1, @"");
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    [pool terminate];
+}
+
+- (void)testDocumentsReopenAfterSuspension {
+    LSPServerPool *pool = [self stubServerPool];
+    [pool setIdleTimeout:0.5];
+    NSURL *rootURL = [self workspaceURL:0];
+    NSURL *url = [rootURL URLByAppendingPathComponent:@"file.txt"];
+    LSPClient *client = [pool clientForLanguageID:@"plaintext" rootURL:rootURL];
+    [self initializeClient:client];
+    [client documentDidOpen:url content:@"one two three"];
+    [client document:url changeTextInRange:NSMakeRange(4, 3) replacementString:@"2"];
+
+    // The idle server is shut down, the document is kept.
+    XCTAssertTrue([self runUntil:^BOOL{
+        return [client isSuspended] && LSPRunningProcessCount([NSArray arrayWithObject:client]) == 0;
+    } timeout:10.0], @"");
+    XCTAssertEqual([pool serverCount], 0, @"");
+    [client document:url changeTextInRange:NSMakeRange(6, 5) replacementString:@"3"];
+
+    // A request relaunches the server, which gets the document as it is now.
+    XCTestExpectation *expectation = [[XCTestExpectation alloc] initWithDescription:@"text"];
+    XCTAssertNotNil([client documentHighlight:url inText:@"one 2 3" forCharacterAtIndex:0 completionHandler:nil], @"");
+    XCTAssertFalse([client isSuspended], @"");
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+        [pipeline sendRequest:@"stub/text" params:[NSDictionary dictionaryWithObjectsAndKeys:[url absoluteString], @"uri", nil] withReply:^(id obj, NSError *error) {
+            XCTAssertEqualObjects(obj, @"one 2 3", @"");
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [expectation fulfill];
+            });
+        }];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation] timeout:10.0];
+    XCTAssertEqual([pool serverCount], 1, @"");
+    [pool terminate];
+}
+
+@end
@@ -0,0 +1,179 @@
+//
+//  LSPTraceRecorderTests.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <LSPKit/LSPKit.h>
+#import "LSPPipeline.h"
+#import "XCTestCase+LSPStubServer.h"
+
+@interface LSPTraceRecorder (Recording)
+- (void)recordMessage:(NSData *)content length:(NSUInteger)length direction:(LSPTraceDirection)direction;
+@end
+
+@interface LSPTraceRecorderTests : XCTestCase
+@end
+
+@implementation LSPTraceRecorderTests
+
+- (NSData *)notificationWithIndex:(NSUInteger)index {
+    NSString *string = [NSString stringWithFormat:@"{\"jsonrpc\":\"2.0\",\"method\":\"stub/notification\",\"params\":{\"index\":%lu}}", (unsigned long)index];
+    return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (void)testRingDropsOldestMessages {
+    LSPTraceRecorder *trace = [[LSPTraceRecorder alloc] initWithCapacity:4096];
+    XCTAssertEqual([trace capacity], 4096, @"");
+    for (NSUInteger index = 0; index < 200; index++) {
+        [trace recordMessage:[self notificationWithIndex:index] length:[[self notificationWithIndex:index] length] direction:LSPTraceDirectionReceive];
+    }
+    XCTAssertGreaterThan([trace messageCount], 0, @"");
+    XCTAssertEqual([trace messageCount] + [trace droppedMessageCount], 200, @"");
+
+    // The newest messages are kept, in order.
+    __block NSUInteger expectedIndex = 200 - [trace messageCount];
+    __block uint64_t previousTimestamp = 0;
+    [trace enumerateMessagesUsingBlock:^(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop) {
+        XCTAssertEqual(direction, LSPTraceDirectionReceive, @"");
+        XCTAssertGreaterThanOrEqual(timestamp, previousTimestamp, @"");
+        XCTAssertEqualObjects(content, [self notificationWithIndex:expectedIndex], @"");
+        previousTimestamp = timestamp;
+        expectedIndex++;
+    }];
+    XCTAssertEqual(expectedIndex, 200, @"");
+
+    [trace removeAllMessages];
+    XCTAssertEqual([trace messageCount], 0, @"");
+}
+
+- (void)testTraceFileCanBeReopened {
+    NSURL *url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]]];
+    NSError *error = nil;
+    LSPTraceRecorder *trace = [[LSPTraceRecorder alloc] initWithFileURL:url capacity:8192 error:&error];
+    XCTAssertNotNil(trace, @"%@", error);
+    [trace recordMessage:[self notificationWithIndex:1] length:[[self notificationWithIndex:1] length] direction:LSPTraceDirectionSend];
+    [trace recordMessage:[self notificationWithIndex:2] length:[[self notificationWithIndex:2] length] direction:LSPTraceDirectionReceive];
+    trace = nil;
+
+    LSPTraceRecorder *reopened = [[LSPTraceRecorder alloc] initWithContentsOfURL:url error:&error];
+    XCTAssertNotNil(reopened, @"%@", error);
+    XCTAssertEqual([reopened capacity], 8192, @"");
+    XCTAssertEqual([reopened messageCount], 2, @"");
+    NSMutableArray *contents = [NSMutableArray array];
+    [reopened enumerateMessagesUsingBlock:^(LSPTraceDirection direction, uint64_t timestamp, NSData *content, NSUInteger length, BOOL *stop) {
+        [contents addObject:content];
+    }];
+    XCTAssertEqualObjects(contents, ([NSArray arrayWithObjects:[self notificationWithIndex:1], [self notificationWithIndex:2], nil]), @"");
+    [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+
+    XCTAssertNil([[LSPTraceRecorder alloc] initWithContentsOfURL:[[NSBundle bundleForClass:[self class]] executableURL] error:&error], @"");
+}
+
+- (void)testInspectorLog {
+    LSPTraceRecorder *trace = [[LSPTraceRecorder alloc] initWithCapacity:4096];
+    [trace setMaximumMessageLength:64];
+    NSData *request = [@"{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *response = [@"{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{}}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *text = [@"" stringByPaddingToLength:1000 withString:@"x" startingAtIndex:0];
+    NSData *didOpen = [[NSString stringWithFormat:@"{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"text\":\"%@\"}}", text] dataUsingEncoding:NSUTF8StringEncoding];
+    [trace recordMessage:request length:[request length] direction:LSPTraceDirectionSend];
+    [trace recordMessage:response length:[response length] direction:LSPTraceDirectionReceive];
+    [trace recordMessage:didOpen length:[didOpen length] direction:LSPTraceDirectionSend];
+
+    NSArray *lines = [[trace inspectorLog] componentsSeparatedByString:@"\r\n"];
+    XCTAssertEqual([lines count], 4, @"");
+    NSMutableArray *types = [NSMutableArray array];
+    for (NSString *line in [lines subarrayWithRange:NSMakeRange(0, 3)]) {
+        NSDictionary *item = [NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding] options:0 error:NULL];
+        XCTAssertGreaterThan([[item objectForKey:@"timestamp"] doubleValue], 1e12, @"");
+        [types addObject:[item objectForKey:@"type"]];
+        if ([[item objectForKey:@"type"] isEqualToString:@"send-notification"]) {
+            XCTAssertEqualObjects([[item objectForKey:@"message"] objectForKey:@"method"], @"textDocument/didOpen", @"");
+        }
+    }
+    XCTAssertEqualObjects(types, ([NSArray arrayWithObjects:@"send-request", @"recv-response", @"send-notification", nil]), @"");
+}
+
+- (void)testTruncatedMessagesKeepIdAndKind {
+    LSPTraceRecorder *trace = [[LSPTraceRecorder alloc] initWithCapacity:8192];
+    [trace setMaximumMessageLength:80];
+    NSString *text = [@"" stringByPaddingToLength:1000 withString:@"x" startingAtIndex:0];
+    NSData *request = [[NSString stringWithFormat:@"{\"jsonrpc\":\"2.0\",\"params\":{\"id\":7,\"text\":\"%@\"},\"id\":3,\"method\":\"stub/echo\"}", text] dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *shortRequest = [[NSString stringWithFormat:@"{\"jsonrpc\":\"2.0\",\"id\":\"a-1\",\"method\":\"stub/echo\",\"params\":{\"id\":7,\"text\":\"%@\"}}", text] dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *response = [[NSString stringWithFormat:@"{\"jsonrpc\":\"2.0\",\"id\":12,\"result\":{\"text\":\"%@\"}}", text] dataUsingEncoding:NSUTF8StringEncoding];
+    [trace recordMessage:request length:[request length] direction:LSPTraceDirectionSend];
+    [trace recordMessage:shortRequest length:[shortRequest length] direction:LSPTraceDirectionSend];
+    [trace recordMessage:response length:[response length] direction:LSPTraceDirectionReceive];
+
+    NSMutableArray *items = [NSMutableArray array];
+    for (NSString *line in [[trace inspectorLog] componentsSeparatedByString:@"\r\n"]) {
+        if ([line length]) {
+            [items addObject:[NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding] options:0 error:NULL]];
+        }
+    }
+    XCTAssertEqual([items count], 3, @"");
+    // The id and the method of the first one were cut off, the id of its params is not taken.
+    NSDictionary *message = [[items objectAtIndex:0] objectForKey:@"message"];
+    XCTAssertEqualObjects([[items objectAtIndex:0] objectForKey:@"type"], @"send-notification", @"");
+    XCTAssertNil([message objectForKey:@"id"], @"");
+    message = [[items objectAtIndex:1] objectForKey:@"message"];
+    XCTAssertEqualObjects([[items objectAtIndex:1] objectForKey:@"type"], @"send-request", @"");
+    XCTAssertEqualObjects([message objectForKey:@"id"], @"a-1", @"");
+    XCTAssertEqualObjects([message objectForKey:@"method"], @"stub/echo", @"");
+    message = [[items objectAtIndex:2] objectForKey:@"message"];
+    XCTAssertEqualObjects([[items objectAtIndex:2] objectForKey:@"type"], @"recv-response", @"");
+    XCTAssertEqualObjects([message objectForKey:@"id"], [NSNumber numberWithInteger:12], @"");
+    XCTAssertNil([message objectForKey:@"method"], @"");
+}
+
+- (void)testReplayRecordedSession {
+    XCTestExpectation *expectation1 = [[XCTestExpectation alloc] initWithDescription:@"initialized"];
+    XCTestExpectation *expectation2 = [[XCTestExpectation alloc] initWithDescription:@"flood"];
+    LSPTraceRecorder *trace = [[LSPTraceRecorder alloc] initWithCapacity:1024 * 1024];
+    LSPClient *client = [self stubServerWithArguments:nil];
+    [client setTraceRecorder:trace];
+    [client initialWithCompletionHandler:^(NSError *error) {
+        XCTAssertNil(error, @"");
+        [expectation1 fulfill];
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation1] timeout:10.0];
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:@"stub/flood" params:[NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:500], @"count", nil] withReply:^(id obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [expectation2 fulfill];
+        });
+    }];
+    [self waitForExpectations:[NSArray arrayWithObject:expectation2] timeout:10.0];
+    [client terminate];
+    XCTAssertEqual([trace droppedMessageCount], 0, @"");
+    // The requests and notifications of the client are recorded as well.
+    XCTAssertGreaterThan([trace messageCount], 502, @"");
+
+    // The notifications of the server are handled again by a pipeline
+    // without a server, as fast as they are decoded.
+    LSPPipeline *replayPipeline = [[LSPPipeline alloc] init];
+    [replayPipeline setNotificationQueue:dispatch_queue_create("LSPTraceRecorderTests", DISPATCH_QUEUE_SERIAL)];
+    __block NSUInteger notificationCount = 0;
+    [replayPipeline setNotificationMessageHandler:^(NSDictionary *message) {
+        if ([[message objectForKey:@"method"] isEqualToString:@"stub/notification"]) {
+            notificationCount++;
+        }
+    }];
+    NSUInteger replayedCount = [replayPipeline replayReceivedMessagesOfTrace:trace preservingTiming:NO];
+    while ([replayPipeline inFlightMessageCount] > 0) {
+        [NSThread sleepForTimeInterval:0.001];
+    }
+    // The responses to initialize and stub/flood, and the notifications.
+    XCTAssertGreaterThanOrEqual(replayedCount, 502, @"");
+    dispatch_sync([replayPipeline notificationQueue], ^{
+        XCTAssertEqual(notificationCount, 500, @"");
+    });
+    [replayPipeline close];
+}
+
+@end
@@ -0,0 +1,42 @@
+//
+//  XCTestCase+LSPStubServer.h
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+@class LSPClient;
+@class LSPRequest;
+
+/**
+ * Runs the stub language server, which is built next to the test bundle.
+ */
+@interface XCTestCase (LSPStubServer)
+
+- (NSString *)stubServerPath;
+- (LSPClient *)stubServerWithArguments:(NSArray<NSString *> *)arguments;
+
+/**
+ * Runs the main run loop until condition is YES or timeout passed, returns
+ * the last value of condition.
+ */
+- (BOOL)runUntil:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout;
+
+/**
+ * Sends a request, like "stub/text", right to the server of client and
+ * returns its result.
+ */
+- (id)sendStubRequest:(NSString *)method params:(NSDictionary *)params toClient:(LSPClient *)client;
+/** The result of "stub/statistics". */
+- (NSDictionary *)statisticsOfClient:(LSPClient *)client;
+
+/**
+ * Feeds a reply with the error code to the pipeline of client, as if the
+ * server had answered request with it. The real reply is ignored later.
+ */
+- (void)receiveErrorCode:(NSInteger)code forRequest:(LSPRequest *)request ofClient:(LSPClient *)client;
+
+@end
@@ -0,0 +1,62 @@
+//
+//  XCTestCase+LSPStubServer.m
+//  LSPKitTests
+//
+//  Created by Christopher Atlan on 17.10.26.
+//  Copyright © 2026 Letter Opener GmbH. All rights reserved.
+//
+
+#import "XCTestCase+LSPStubServer.h"
+
+#import <LSPKit/LSPKit.h>
+#import "LSPPipeline.h"
+
+@implementation XCTestCase (LSPStubServer)
+
+- (NSString *)stubServerPath {
+    NSString *productsPath = [[[NSBundle bundleForClass:[self class]] bundlePath] stringByDeletingLastPathComponent];
+    return [productsPath stringByAppendingPathComponent:@"stub-language-server"];
+}
+
+- (LSPClient *)stubServerWithArguments:(NSArray<NSString *> *)arguments {
+    return [[LSPClient alloc] initWithPath:[self stubServerPath] arguments:arguments currentDirectoryPath:nil languageID:@"plaintext"];
+}
+
+- (BOOL)runUntil:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout {
+    NSDate *end = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (condition() == NO && [end timeIntervalSinceNow] > 0.0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+    }
+    return condition();
+}
+
+- (id)sendStubRequest:(NSString *)method params:(NSDictionary *)params toClient:(LSPClient *)client {
+    __block id result = nil;
+    __block BOOL answered = NO;
+    LSPPipeline *pipeline = [client valueForKey:@"pipeline"];
+    [pipeline sendRequest:method params:params withReply:^(id obj, NSError *error) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            result = obj;
+            answered = YES;
+        });
+    }];
+    XCTAssertTrue([self runUntil:^BOOL{
+        return answered;
+    } timeout:10.0], @"%@", method);
+    return result;
+}
+
+- (NSDictionary *)statisticsOfClient:(LSPClient *)client {
+    return [self sendStubRequest:@"stub/statistics" params:nil toClient:client];
+}
+
+- (void)receiveErrorCode:(NSInteger)code forRequest:(LSPRequest *)request ofClient:(LSPClient *)client {
+    NSDictionary *error = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:code], @"code", @"stub error", @"message", nil];
+    NSDictionary *reply = [NSDictionary dictionaryWithObjectsAndKeys:@"2.0", @"jsonrpc", [request valueForKey:@"messageID"], @"id", error, @"error", nil];
+    NSData *content = [NSJSONSerialization dataWithJSONObject:reply options:0 error:NULL];
+    NSMutableData *frame = [[[NSString stringWithFormat:@"Content-Length: %lu\r\n\r\n", (unsigned long)[content length]] dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    [frame appendData:content];
+    [(LSPPipeline *)[client valueForKey:@"pipeline"] didReceiveData:frame];
+}
+
+@end
@@ -9,6 +9,7 @@
 #import "Document.h"
 
 #import "NoodleLineNumberView.h"
+#import "WorkspaceController.h"
 #import <Carbon/Carbon.h>
 #import <LSPKit/LSPKit.h>
 
@@ -52,7 +53,7 @@
 
 @interface DiagnosticViewController : NSViewController <NSPopoverDelegate>
 @property IBOutlet NSTextView *textView;
-@property NSRange characterRange;
+@property LSPDiagnostic *diagnostic;
 @end
 
 @implementation DiagnosticViewController
@@ -473,12 +474,12 @@
     NSRange _wordSelectionRange;
 }
 @property (nonatomic, copy) NSString *content;
-@property LSPClient *langClient;
+@property (nonatomic) LSPClient *langClient;
 @property NSWindowController *mainWindowController;
 @property DocumentViewController *documentViewController;
 @property TooltipViewController *tooltipViewController;
 @property NSMutableArray<DiagnosticViewController *> *diagnosticViewControllers;
-@property NSArray<LSPCompletionItem *> *completionList;
+@property LSPCompletionList *completionList;
 @end
 
 @implementation Document
@@ -495,17 +496,26 @@
     self = [super init];
     if (self) {
         _diagnosticViewControllers = [NSMutableArray array];
-        _langClient = [LSPClient sharedBashServer];
-        [_langClient addObserver:self];
-        __weak __typeof(self) weakSelf = self;
-        [_langClient addTerminationObserver:self block:^(LSPClient *client) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            [strongSelf languageServerTerminated:client];
-        }];
+        // Untitled documents share the server without a workspace.
+        self.langClient = [[LSPServerPool sharedServerPool] clientForLanguageID:@"shellscript" rootURL:nil];
     }
     return self;
 }
 
+- (void)setLangClient:(LSPClient *)langClient {
+    if (_langClient == langClient) {
+        return;
+    }
+    [_langClient removeObserver:self];
+    [_langClient removeTerminationObserver:self];
+    _langClient = langClient;
+    __weak __typeof(self) weakSelf = self;
+    [_langClient addTerminationObserver:self block:^(LSPClient *client) {
+        __strong __typeof(self) strongSelf = weakSelf;
+        [strongSelf languageServerTerminated:client];
+    }];
+}
+
 // Handle Untiled documents.
 //
 // -[NSDocumentController newDocument:]:
@@ -514,11 +524,8 @@
 - (instancetype)initWithType:(NSString *)typeName error:(NSError * _Nullable __autoreleasing *)outError {
     self = [super initWithType:typeName error:outError];
     if (self) {
-        __weak __typeof(self) weakSelf = self;
-        [_langClient initialWithCompletionHandler:^(NSError *error) {
-            __strong __typeof(self) strongSelf = weakSelf;
-            [[strongSelf langClient] documentDidOpen:[strongSelf URI] content:[self content]];
-        }];
+        // The client starts the server, the document is sent once it is initialized.
+        [self languageServerOpenDocument:[self URI]];
     }
     return self;
 }
@@ -542,14 +549,16 @@
     [_langClient removeTerminationObserver:self];
 }
 
+/** Opens the document in the server, and observes its diagnostics. */
+- (void)languageServerOpenDocument:(NSURL *)uri {
+    [_langClient addObserver:self forURI:uri methods:[NSSet setWithObject:@"textDocument/publishDiagnostics"]];
+    [_langClient documentDidOpen:uri content:[self content]];
+}
+
 #pragma mark Language Server termination
 
 - (void)languageServerTerminated:(LSPClient *)client {
-    __weak __typeof(self) weakSelf = self;
-    [client initialWithCompletionHandler:^(NSError *error) {
-        __strong __typeof(self) strongSelf = weakSelf;
-        [[strongSelf langClient] documentDidOpen:[strongSelf URI] content:[strongSelf content]];
-    }];
+    [self languageServerOpenDocument:[self URI]];
 }
 
 #pragma mark Read / Write
@@ -564,11 +573,12 @@
         return NO;
     }
     self.content = text;
-    __weak __typeof(self) weakSelf = self;
-    [_langClient initialWithCompletionHandler:^(NSError *error) {
-        __strong __typeof(self) strongSelf = weakSelf;
-        [[strongSelf langClient] documentDidOpen:[strongSelf URI] content:[strongSelf content]];
-    }];
+    // Every workspace has its own server, with the workspace as root.
+    Workspace *workspace = [[WorkspaceController sharedWorkspaceController] workspaceForURL:url];
+    NSURL *rootURL = [workspace URL] ?: [url URLByDeletingLastPathComponent];
+    self.langClient = [[LSPServerPool sharedServerPool] clientForLanguageID:@"shellscript" rootURL:rootURL];
+    // The fileURL is only set after reading.
+    [self languageServerOpenDocument:url];
     return YES;
 }
 
@@ -635,7 +645,7 @@
 }
 
 - (void)textView:(ScriptTextView *)textView complete:(id)sender {
-    [_langClient documentCompletion:[self URI] inText:[self content] forCharacterAtIndex:[textView selectedRange].location completionHandler:^(NSArray<LSPCompletionItem *> *completionList, BOOL isIncomplete, NSError *error) {
+    [_langClient documentCompletionList:[self URI] inText:[self content] forCharacterAtIndex:[textView selectedRange].location completionHandler:^(LSPCompletionList *completionList, BOOL isIncomplete, NSError *error) {
         self.completionList = completionList;
         [textView showCompleteList:sender];
     }];
@@ -643,8 +653,7 @@
 
 - (NSArray<NSString *> *)textView:(NSTextView *)textView completions:(NSArray<NSString *> *)words forPartialWordRange:(NSRange)charRange indexOfSelectedItem:(NSInteger *)index {
     if (_completionList == nil) return [NSArray array];
-    NSArray *completionList = [_completionList valueForKeyPath:@"label"];
-    return completionList;
+    return [_completionList labels];
 }
 
 - (void)textView:(ScriptTextView *)textView tooltip:(id)sender forCharacterAtIndex:(NSUInteger)characterIndex point:(NSPoint)point {
@@ -663,44 +672,47 @@
     [_documentViewController presentViewController:_tooltipViewController asPopoverRelativeToRect:[textView rectForCharacterRange:NSMakeRange(characterIndex, 1)] ofView:textView preferredEdge:NSRectEdgeMaxY behavior:NSPopoverBehaviorSemitransient];
 }
 
-- (void)clearDiagnostics {
-    for (DiagnosticViewController *diagnosticViewController in _diagnosticViewControllers) {
-        if ([diagnosticViewController isViewLoaded]) {
-            [[diagnosticViewController view] removeFromSuperview];
-        }
-    }
-    [_diagnosticViewControllers removeAllObjects];
-}
-
-- (void)languageServer:(LSPClient *)client document:(NSURL *)url diagnostics:(NSArray<LSPDiagnostic *> *)diagnostics {
-    if ([url isEqual:[self URI]] == NO) {
-        return;
-    }
+- (void)languageServer:(LSPClient *)client didChangeDiagnostics:(LSPDiagnosticsDelta *)delta {
     ScriptTextView *textView = [_documentViewController textView];
-    NSString *text = [[_documentViewController textView] string];
     NSColor *errorColor = [NSColor colorWithRed:254.0/255.0 green:239.0/255.0 blue:234.0/255.0 alpha:1.0];
     
-    [self clearDiagnostics];
-    
-    NSMutableArray *highlightLines = [NSMutableArray arrayWithCapacity:[diagnostics count]];
-    for (LSPDiagnostic *diagnostic in diagnostics) {
-        NSRange range = [[diagnostic range] convertToRangeInText:text];
-        
-        ScriptTextViewHighlight *item = [ScriptTextViewHighlight highlight:errorColor range:range];
-        [highlightLines addObject:item];
-        
+    // The views of unchanged diagnostics are kept, their ranges moved along
+    // with the edits.
+    NSArray *removedDiagnostics = [delta removedDiagnostics];
+    NSMutableArray *removedViewControllers = [NSMutableArray array];
+    for (DiagnosticViewController *diagnosticViewController in _diagnosticViewControllers) {
+        if ([removedDiagnostics indexOfObjectIdenticalTo:[diagnosticViewController diagnostic]] != NSNotFound) {
+            if ([diagnosticViewController isViewLoaded]) {
+                [[diagnosticViewController view] removeFromSuperview];
+            }
+            [removedViewControllers addObject:diagnosticViewController];
+        }
+    }
+    [_diagnosticViewControllers removeObjectsInArray:removedViewControllers];
+    for (LSPDiagnostic *diagnostic in [delta addedDiagnostics]) {
+        if ([diagnostic characterRange].location == NSNotFound) {
+            continue;
+        }
         DiagnosticViewController *diagnosticViewController = [[NSStoryboard storyboardWithName:@"Diagnostic" bundle:nil] instantiateInitialController];
         diagnosticViewController.representedObject = [diagnostic message];
-        diagnosticViewController.characterRange = range;
+        diagnosticViewController.diagnostic = diagnostic;
         [_diagnosticViewControllers addObject:diagnosticViewController];
     }
+    
+    NSMutableArray *highlightLines = [NSMutableArray arrayWithCapacity:[[delta diagnostics] count]];
+    for (LSPDiagnostic *diagnostic in [delta diagnostics]) {
+        NSRange range = [diagnostic characterRange];
+        if (range.location != NSNotFound) {
+            [highlightLines addObject:[ScriptTextViewHighlight highlight:errorColor range:range]];
+        }
+    }
     [textView setLineHighlights:highlightLines];
     [[textView textContainer] lsp_setNeedDisplay];
 }
 
 - (NSView *)textView:(ScriptTextView *)textView diagnosticViewForCharacterRange:(NSRange)charRange {
     for (DiagnosticViewController *diagnosticViewController in _diagnosticViewControllers) {
-        NSRange diagnosticRange = diagnosticViewController.characterRange;
+        NSRange diagnosticRange = [diagnosticViewController.diagnostic characterRange];
         NSRange range = NSIntersectionRange(diagnosticRange, charRange);
         if (NSEqualRanges(diagnosticRange, charRange) || NSLocationInRange(diagnosticRange.location, charRange)) {
             return [diagnosticViewController view];